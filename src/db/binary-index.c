@@ -0,0 +1,955 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "binary-index.h"
+#include "db.h"
+#include "../structs.h"
+#include "../query/result.h"
+#include "../functions/util.h"
+
+/**
+ * Binary index files (`<table>__<field>.(index|unique).idx`), written by
+ * CREATE INDEX ... USING BINARY and read through mmap as an alternative to
+ * sorted CSV index files.
+ *
+ * Like a CSV index, the file is a table of the key column(s) followed by the
+ * rowid, sorted by the first key column. Entries are grouped into pages of
+ * BINARY_INDEX_PAGE_ROWS. Within a page each key only stores the bytes it
+ * doesn't share with the key before it, and the first key of every page is
+ * stored whole so searches can binary search the pages directly and then
+ * decode a single page.
+ *
+ * Format, native endian, each section padded to 8 bytes:
+ *
+ *  struct IndexHeader
+ *  char names[]                            NUL separated column names
+ *  int32_t rowids[record_count]
+ *  uint64_t page_offsets[page_count + 1]   relative to data_offset
+ *  entries, each:
+ *    varint shared                         bytes shared with previous key
+ *    varint length
+ *    char suffix[length]
+ *    for each column between the key and rowid:
+ *      varint length
+ *      char value[length]
+ *
+ * Keys are ordered the same way ORDER BY orders them: numerically if both
+ * are numbers, otherwise byte by byte.
+ */
+
+#define INDEX_MAGIC     "CSVDBIDX"
+#define INDEX_VERSION   1
+
+struct IndexHeader {
+    char magic[8];
+    int32_t version;
+    int32_t field_count;
+    int64_t record_count;
+    int64_t page_rows;
+    int64_t names_offset;
+    int64_t rowids_offset;
+    int64_t pages_offset;
+    int64_t data_offset;
+    int64_t data_length;
+};
+
+/**
+ * @brief Growable buffer for the entries being written
+ */
+struct IndexBuffer {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+};
+
+struct BinaryIndexWriter {
+    int column_count;
+    char *names;
+    size_t names_length;
+    int32_t *rowids;
+    int record_count;
+    int rowid_capacity;
+    uint64_t *page_offsets;
+    struct IndexBuffer buffer;
+    /* Key of the previous entry */
+    char prev[MAX_VALUE_LENGTH];
+};
+
+static int isValidIndex (void *map, size_t map_size);
+
+static int getPageCount (struct IndexHeader *header);
+
+static const uint64_t *getPageOffsets (struct DB *db);
+
+static const unsigned char *getData (struct DB *db);
+
+static int seekEntry (struct DB *db, int rowid);
+
+static const unsigned char *decodeEntry (
+    struct DB *db,
+    const unsigned char *ptr,
+    const unsigned char *end,
+    char *key,
+    const unsigned char **extra
+);
+
+static const unsigned char *readVarint (
+    const unsigned char *ptr,
+    const unsigned char *end,
+    size_t *value
+);
+
+static int findBound (struct DB *db, const char *value, int strict);
+
+static int compareKey (const char *key, const char *value, int is_number, long number);
+
+static void appendVarint (struct IndexBuffer *buffer, size_t value);
+
+static void appendBytes (struct IndexBuffer *buffer, const void *data, size_t length);
+
+static int writeSection (FILE *f, const void *data, size_t size, int64_t *offset);
+
+static int writeIndexFile (
+    struct BinaryIndexWriter *writer,
+    const char *filename
+);
+
+/**
+ * @return int 1 if filename has the binary index extension
+ */
+int binaryIndex_isBinaryIndex (const char *filename) {
+    size_t length = strlen(filename);
+
+    return length > 4 && strcmp(filename + length - 4, ".idx") == 0;
+}
+
+/**
+ * @return int 0 on success; -1 on failure
+ */
+int binaryIndex_openDB (struct DB *db, const char *filename, char **resolved) {
+    if (!binaryIndex_isBinaryIndex(filename)) {
+        return -1;
+    }
+
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct IndexHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    if (!isValidIndex(map, st.st_size)) {
+        fprintf(stderr, "Invalid binary index: '%s'\n", filename);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    struct IndexHeader *header = map;
+
+    db->vfs = VFS_BINARY_INDEX;
+    db->file = NULL;
+    db->map = map;
+    db->map_size = st.st_size;
+    db->fields = (char *)map + header->names_offset;
+    db->field_count = header->field_count;
+    db->_record_count = header->record_count;
+    db->line_indices = NULL;
+    db->data = NULL;
+    db->offsets = NULL;
+    db->field_cache = NULL;
+    db->stream = NULL;
+    db->binary_index = calloc(1, sizeof(*db->binary_index));
+
+    if (db->binary_index == NULL) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    db->binary_index->entry = -1;
+
+    if (resolved != NULL) {
+        *resolved = realpath(filename, *resolved);
+    }
+
+    return 0;
+}
+
+void binaryIndex_closeDB (struct DB *db) {
+    if (db->map != NULL) {
+        munmap(db->map, db->map_size);
+    }
+
+    free(db->binary_index);
+
+    db->map = NULL;
+    db->fields = NULL;
+    db->binary_index = NULL;
+}
+
+int binaryIndex_getRecordCount (struct DB *db) {
+    return db->_record_count;
+}
+
+/**
+ * Returns the number of bytes read, or -1 on error
+ */
+int binaryIndex_getRecordValue (
+    struct DB *db,
+    int rowid,
+    int field_index,
+    char *value,
+    size_t value_max_length
+) {
+    if (
+        rowid < 0
+        || rowid >= db->_record_count
+        || field_index < 0
+        || field_index >= db->field_count
+    ) {
+        return -1;
+    }
+
+    struct IndexHeader *header = db->map;
+
+    // Last column is always the rowid
+    if (field_index == db->field_count - 1) {
+        const int32_t *rowids =
+            (const int32_t *)((char *)db->map + header->rowids_offset);
+
+        return snprintf(value, value_max_length, "%d", rowids[rowid]);
+    }
+
+    if (seekEntry(db, rowid) != 0) {
+        return -1;
+    }
+
+    struct BinaryIndex *index = db->binary_index;
+
+    const char *text = index->key;
+    size_t length = strlen(index->key);
+
+    if (field_index > 0) {
+        const unsigned char *ptr = index->extra;
+
+        for (int i = 1; i <= field_index; i++) {
+            ptr = readVarint(ptr, index->next, &length);
+
+            if (ptr == NULL) {
+                return -1;
+            }
+
+            text = (const char *)ptr;
+            ptr += length;
+        }
+    }
+
+    if (length >= value_max_length) {
+        length = value_max_length - 1;
+    }
+
+    memcpy(value, text, length);
+    value[length] = '\0';
+
+    return length;
+}
+
+/**
+ * @brief Same contract as the VFS-agnostic indexSearch(). Both bounds are
+ * found by binary search so there's no walking over duplicate keys.
+ */
+int binaryIndex_indexSearch (
+    struct DB *db,
+    const char *value,
+    int mode,
+    int *output_flag
+) {
+    int record_count = db->_record_count;
+
+    if (record_count == 0) {
+        *output_flag = RESULT_BELOW_MIN;
+        return RESULT_NO_ROWS;
+    }
+
+    int lower = findBound(db, value, 0);
+
+    int found = 0;
+
+    if (lower < record_count) {
+        char key[MAX_VALUE_LENGTH];
+
+        if (binaryIndex_getRecordValue(db, lower, 0, key, MAX_VALUE_LENGTH) < 0) {
+            *output_flag = RESULT_BELOW_MIN;
+            return RESULT_NO_ROWS;
+        }
+
+        int is_number = is_numeric(value);
+
+        found = compareKey(key, value, is_number, is_number ? atol(value) : 0) == 0;
+    }
+
+    if (!found) {
+        if (lower == 0) {
+            *output_flag = RESULT_BELOW_MIN;
+            return RESULT_NO_ROWS;
+        }
+
+        if (lower == record_count) {
+            *output_flag = RESULT_ABOVE_MAX;
+            return RESULT_NO_ROWS;
+        }
+
+        // Value would appear just before lower
+        *output_flag = RESULT_BETWEEN;
+        return lower;
+    }
+
+    *output_flag = RESULT_FOUND;
+
+    if (mode == MODE_UPPER_BOUND) {
+        return findBound(db, value, 1) - 1;
+    }
+
+    return lower;
+}
+
+/**
+ * @brief Write a binary index of the rows in row_list, which must already be
+ * sorted by the first column
+ *
+ * @param columns key columns followed by the rowid column
+ * @param column_count including the rowid column
+ * @return int 0 on success; -1 on failure
+ */
+int binaryIndex_create (
+    const char *filename,
+    struct Table *table,
+    struct Node *columns,
+    int column_count,
+    RowListIndex row_list,
+    int unique_flag
+) {
+    struct DB *db = table->db;
+    struct RowList *list = getRowList(row_list);
+    int record_count = list->row_count;
+
+    struct BinaryIndexWriter *writer =
+        binaryIndex_openWriter(columns, column_count);
+
+    char values[2][MAX_VALUE_LENGTH];
+    char extra[MAX_VALUE_LENGTH * 9];
+    const char *value_ptrs[10];
+
+    for (int i = 0; i < record_count; i++) {
+        int rowid = getRowID(list, 0, i);
+        char *key = values[i % 2];
+        char *prev = values[(i + 1) % 2];
+
+        if (getRecordValue(db, rowid, columns[0].field.index, key, MAX_VALUE_LENGTH) < 0) {
+            key[0] = '\0';
+        }
+
+        if (unique_flag && i > 0 && strcmp(key, prev) == 0) {
+            fprintf(
+                stderr,
+                "UNIQUE constraint failed. Multiple values for: '%s'\n",
+                key
+            );
+            exit(-1);
+        }
+
+        value_ptrs[0] = key;
+
+        for (int j = 1; j < column_count - 1; j++) {
+            char *value = extra + (j - 1) * MAX_VALUE_LENGTH;
+
+            if (getRecordValue(db, rowid, columns[j].field.index, value, MAX_VALUE_LENGTH) < 0) {
+                value[0] = '\0';
+            }
+
+            value_ptrs[j] = value;
+        }
+
+        binaryIndex_addEntry(writer, value_ptrs, rowid);
+    }
+
+    return binaryIndex_closeWriter(writer, filename);
+}
+
+/**
+ * @brief Start building a binary index in memory. Entries must be added in
+ * index order.
+ *
+ * @param columns key columns followed by the rowid column; only the aliases
+ * are used
+ * @param column_count including the rowid column (at most 10)
+ */
+struct BinaryIndexWriter *binaryIndex_openWriter (
+    struct Node *columns,
+    int column_count
+) {
+    struct BinaryIndexWriter *writer = calloc(1, sizeof(*writer));
+
+    if (writer == NULL) {
+        fprintf(stderr, "Unable to allocate memory for index\n");
+        exit(-1);
+    }
+
+    writer->column_count = column_count;
+
+    for (int i = 0; i < column_count; i++) {
+        writer->names_length += strlen(columns[i].alias) + 1;
+    }
+
+    writer->names = malloc(writer->names_length);
+
+    if (writer->names == NULL) {
+        fprintf(stderr, "Unable to allocate memory for index\n");
+        exit(-1);
+    }
+
+    char *ptr = writer->names;
+    for (int i = 0; i < column_count; i++) {
+        strcpy(ptr, columns[i].alias);
+        ptr += strlen(ptr) + 1;
+    }
+
+    return writer;
+}
+
+/**
+ * @param values the key then any other columns before rowid
+ */
+void binaryIndex_addEntry (
+    struct BinaryIndexWriter *writer,
+    const char **values,
+    int rowid
+) {
+    int i = writer->record_count;
+    int page_rows = BINARY_INDEX_PAGE_ROWS;
+
+    if (i == writer->rowid_capacity) {
+        writer->rowid_capacity = writer->rowid_capacity
+            ? writer->rowid_capacity * 2 : 1024;
+        writer->rowids = realloc(
+            writer->rowids,
+            sizeof(*writer->rowids) * writer->rowid_capacity
+        );
+
+        // One offset per page plus the end
+        writer->page_offsets = realloc(
+            writer->page_offsets,
+            sizeof(*writer->page_offsets)
+                * (writer->rowid_capacity / page_rows + 2)
+        );
+
+        if (writer->rowids == NULL || writer->page_offsets == NULL) {
+            fprintf(stderr, "Unable to allocate memory for index\n");
+            exit(-1);
+        }
+    }
+
+    writer->rowids[i] = rowid;
+
+    const char *key = values[0];
+    size_t shared = 0;
+
+    if (i % page_rows == 0) {
+        writer->page_offsets[i / page_rows] = writer->buffer.length;
+    }
+    else {
+        while (key[shared] != '\0' && key[shared] == writer->prev[shared]) {
+            shared++;
+        }
+    }
+
+    size_t length = strlen(key) - shared;
+
+    appendVarint(&writer->buffer, shared);
+    appendVarint(&writer->buffer, length);
+    appendBytes(&writer->buffer, key + shared, length);
+
+    for (int j = 1; j < writer->column_count - 1; j++) {
+        length = strlen(values[j]);
+
+        appendVarint(&writer->buffer, length);
+        appendBytes(&writer->buffer, values[j], length);
+    }
+
+    // prev already holds the shared prefix
+    strcpy(writer->prev + shared, key + shared);
+
+    writer->record_count++;
+}
+
+/**
+ * @brief Write the index to filename and free the writer. The file is
+ * written alongside and then renamed into place.
+ *
+ * @param filename NULL to discard the index
+ * @return int 0 on success; -1 on failure
+ */
+int binaryIndex_closeWriter (
+    struct BinaryIndexWriter *writer,
+    const char *filename
+) {
+    int ok = filename != NULL;
+
+    if (ok) {
+        ok = writeIndexFile(writer, filename) == 0;
+    }
+
+    free(writer->names);
+    free(writer->rowids);
+    free(writer->page_offsets);
+    free(writer->buffer.data);
+    free(writer);
+
+    return ok ? 0 : -1;
+}
+
+static int writeIndexFile (
+    struct BinaryIndexWriter *writer,
+    const char *filename
+) {
+    int record_count = writer->record_count;
+    int page_rows = BINARY_INDEX_PAGE_ROWS;
+    int page_count = (record_count + page_rows - 1) / page_rows;
+
+    char tmp_filename[FILENAME_MAX + 16];
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.%d", filename, getpid());
+
+    // Offsets are only allocated with the first entry
+    uint64_t end_offset = writer->buffer.length;
+    uint64_t *page_offsets = record_count > 0
+        ? writer->page_offsets : &end_offset;
+
+    page_offsets[page_count] = writer->buffer.length;
+
+    FILE *f = fopen(tmp_filename, "wb");
+
+    int ok = f != NULL;
+
+    struct IndexHeader header = {0};
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.field_count = writer->column_count;
+    header.record_count = record_count;
+    header.page_rows = page_rows;
+    header.data_length = writer->buffer.length;
+
+    int64_t offset = 0;
+
+    ok = ok && writeSection(f, &header, sizeof(header), &offset) == 0;
+
+    header.names_offset = offset;
+    ok = ok && writeSection(f, writer->names, writer->names_length, &offset) == 0;
+
+    header.rowids_offset = offset;
+    ok = ok && writeSection(
+        f,
+        writer->rowids,
+        sizeof(*writer->rowids) * record_count,
+        &offset
+    ) == 0;
+
+    header.pages_offset = offset;
+    ok = ok && writeSection(
+        f,
+        page_offsets,
+        sizeof(*page_offsets) * (page_count + 1),
+        &offset
+    ) == 0;
+
+    header.data_offset = offset;
+    ok = ok && writeSection(
+        f,
+        writer->buffer.data,
+        writer->buffer.length,
+        &offset
+    ) == 0;
+
+    ok = ok && fseek(f, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, f) == 1;
+
+    if (f != NULL && fclose(f) != 0) {
+        ok = 0;
+    }
+
+    // Rename is atomic so readers see either the old or new index
+    if (!ok || rename(tmp_filename, filename) != 0) {
+        remove(tmp_filename);
+        ok = 0;
+    }
+
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Check the header and that every section lies within the file
+ */
+static int isValidIndex (void *map, size_t map_size) {
+    struct IndexHeader *header = map;
+
+    if (
+        memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0
+        || header->version != INDEX_VERSION
+        || header->field_count < 2
+        || header->record_count < 0
+        || header->record_count > INT32_MAX
+        || header->page_rows <= 0
+        || header->names_offset < (int64_t)sizeof(*header)
+        || header->rowids_offset < header->names_offset
+        || header->pages_offset
+            < header->rowids_offset + (int64_t)sizeof(int32_t) * header->record_count
+        || header->data_offset
+            < header->pages_offset
+                + (int64_t)sizeof(uint64_t) * (getPageCount(header) + 1)
+        || header->data_length < 0
+        || (size_t)(header->data_offset + header->data_length) > map_size
+    ) {
+        return 0;
+    }
+
+    // Names must hold a NUL terminated name for every column
+    const char *names = (char *)map + header->names_offset;
+    const char *names_end = (char *)map + header->rowids_offset;
+    int name_count = 0;
+
+    for (const char *p = names; p < names_end && name_count < header->field_count; p++) {
+        if (*p == '\0') {
+            name_count++;
+        }
+    }
+
+    if (name_count < header->field_count) {
+        return 0;
+    }
+
+    const uint64_t *page_offsets =
+        (const uint64_t *)((char *)map + header->pages_offset);
+
+    for (int i = 0; i < getPageCount(header); i++) {
+        if (
+            page_offsets[i] > page_offsets[i + 1]
+            || page_offsets[i + 1] > (uint64_t)header->data_length
+        ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int getPageCount (struct IndexHeader *header) {
+    return (header->record_count + header->page_rows - 1) / header->page_rows;
+}
+
+static const uint64_t *getPageOffsets (struct DB *db) {
+    struct IndexHeader *header = db->map;
+
+    return (const uint64_t *)((char *)db->map + header->pages_offset);
+}
+
+static const unsigned char *getData (struct DB *db) {
+    struct IndexHeader *header = db->map;
+
+    return (const unsigned char *)db->map + header->data_offset;
+}
+
+/**
+ * @brief Decode entries up to rowid into db->binary_index. Reading forwards
+ * through a page continues from the last entry decoded.
+ *
+ * @return int 0 on success; -1 if the index is corrupt
+ */
+static int seekEntry (struct DB *db, int rowid) {
+    struct IndexHeader *header = db->map;
+    struct BinaryIndex *index = db->binary_index;
+
+    int page = rowid / header->page_rows;
+    const uint64_t *page_offsets = getPageOffsets(db);
+
+    if (
+        index->entry < 0
+        || index->entry > rowid
+        || index->entry / header->page_rows != page
+    ) {
+        // First key of each page is stored whole
+        index->entry = page * header->page_rows - 1;
+        index->next = getData(db) + page_offsets[page];
+        index->key[0] = '\0';
+    }
+
+    const unsigned char *end = getData(db) + page_offsets[page + 1];
+
+    while (index->entry < rowid) {
+        index->next = decodeEntry(db, index->next, end, index->key, &index->extra);
+
+        if (index->next == NULL) {
+            index->entry = -1;
+            return -1;
+        }
+
+        index->entry++;
+    }
+
+    return 0;
+}
+
+/**
+ * @param key IN previous key in the page; OUT this entry's key
+ * @param extra OUT start of the entry's extra columns
+ * @return const unsigned char* start of the next entry; NULL if corrupt
+ */
+static const unsigned char *decodeEntry (
+    struct DB *db,
+    const unsigned char *ptr,
+    const unsigned char *end,
+    char *key,
+    const unsigned char **extra
+) {
+    size_t shared;
+    size_t length;
+
+    ptr = readVarint(ptr, end, &shared);
+    ptr = ptr == NULL ? NULL : readVarint(ptr, end, &length);
+
+    if (
+        ptr == NULL
+        || shared > strlen(key)
+        || length > (size_t)(end - ptr)
+        || shared + length >= MAX_VALUE_LENGTH
+    ) {
+        return NULL;
+    }
+
+    memcpy(key + shared, ptr, length);
+    key[shared + length] = '\0';
+    ptr += length;
+
+    *extra = ptr;
+
+    // Skip over the other key columns
+    for (int i = 2; i < db->field_count; i++) {
+        ptr = readVarint(ptr, end, &length);
+
+        if (ptr == NULL || length > (size_t)(end - ptr)) {
+            return NULL;
+        }
+
+        ptr += length;
+    }
+
+    return ptr;
+}
+
+/**
+ * @brief LEB128
+ *
+ * @return const unsigned char* byte after the varint; NULL if it overruns
+ */
+static const unsigned char *readVarint (
+    const unsigned char *ptr,
+    const unsigned char *end,
+    size_t *value
+) {
+    size_t result = 0;
+    int shift = 0;
+
+    while (ptr < end && shift < 64) {
+        unsigned char byte = *ptr++;
+
+        result |= (size_t)(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return ptr;
+        }
+
+        shift += 7;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Find the first entry whose key is not below value (or if strict,
+ * the first entry whose key is above value)
+ *
+ * @return int entry index; record count if there is none
+ */
+static int findBound (struct DB *db, const char *value, int strict) {
+    struct IndexHeader *header = db->map;
+    const uint64_t *page_offsets = getPageOffsets(db);
+    const unsigned char *data = getData(db);
+
+    int page_count = getPageCount(header);
+    int is_number = is_numeric(value);
+    long number = is_number ? atol(value) : 0;
+
+    char key[MAX_VALUE_LENGTH];
+    const unsigned char *extra;
+
+    // Last page which starts before the bound
+    int lo = 0;
+    int hi = page_count - 1;
+    int page = -1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+
+        key[0] = '\0';
+
+        if (
+            decodeEntry(
+                db,
+                data + page_offsets[mid],
+                data + page_offsets[mid + 1],
+                key,
+                &extra
+            ) == NULL
+        ) {
+            return header->record_count;
+        }
+
+        int result = compareKey(key, value, is_number, number);
+
+        if (result < 0 || (strict && result == 0)) {
+            page = mid;
+            lo = mid + 1;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+
+    if (page < 0) {
+        return 0;
+    }
+
+    int start = page * header->page_rows;
+    int end = MIN(start + header->page_rows, header->record_count);
+
+    const unsigned char *ptr = data + page_offsets[page];
+    const unsigned char *page_end = data + page_offsets[page + 1];
+
+    key[0] = '\0';
+
+    for (int i = start; i < end; i++) {
+        ptr = decodeEntry(db, ptr, page_end, key, &extra);
+
+        if (ptr == NULL) {
+            return header->record_count;
+        }
+
+        int result = compareKey(key, value, is_number, number);
+
+        if (result > 0 || (!strict && result == 0)) {
+            return i;
+        }
+    }
+
+    // Bound is the first key of the next page
+    return end;
+}
+
+/**
+ * @brief Same ordering as sortQuick() used to build the index
+ *
+ * @return int <0, 0, >0 as key is below, equal to or above value
+ */
+static int compareKey (const char *key, const char *value, int is_number, long number) {
+    if (is_number && is_numeric(key)) {
+        long key_number = atol(key);
+
+        return (key_number > number) - (key_number < number);
+    }
+
+    return strcmp(key, value);
+}
+
+static void appendVarint (struct IndexBuffer *buffer, size_t value) {
+    unsigned char bytes[10];
+    int count = 0;
+
+    do {
+        bytes[count] = value & 0x7f;
+        value >>= 7;
+
+        if (value != 0) {
+            bytes[count] |= 0x80;
+        }
+
+        count++;
+    } while (value != 0);
+
+    appendBytes(buffer, bytes, count);
+}
+
+static void appendBytes (struct IndexBuffer *buffer, const void *data, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = MAX(buffer->capacity * 2, 64 * 1024);
+
+        while (capacity < buffer->length + length) {
+            capacity *= 2;
+        }
+
+        unsigned char *ptr = realloc(buffer->data, capacity);
+
+        if (ptr == NULL) {
+            fprintf(stderr, "Unable to allocate memory for index\n");
+            exit(-1);
+        }
+
+        buffer->data = ptr;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+/**
+ * @brief Write data followed by padding up to a multiple of 8 bytes
+ *
+ * @param offset IN/OUT position in the file
+ * @return int 0 on success; -1 on failure
+ */
+static int writeSection (FILE *f, const void *data, size_t size, int64_t *offset) {
+    static const char padding[8] = {0};
+
+    size_t padding_size = (8 - size % 8) % 8;
+
+    if (size > 0 && fwrite(data, 1, size, f) != size) {
+        return -1;
+    }
+
+    if (padding_size > 0 && fwrite(padding, 1, padding_size, f) != padding_size) {
+        return -1;
+    }
+
+    *offset += size + padding_size;
+
+    return 0;
+}
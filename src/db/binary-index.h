@@ -0,0 +1,63 @@
+#include <stdio.h>
+
+#include "../structs.h"
+
+struct BinaryIndexWriter;
+
+struct BinaryIndex {
+    /* Entry decoded into key (-1 if none) and where the entry after it
+     * starts */
+    int entry;
+    const unsigned char *next;
+    /* Extra key columns of the decoded entry */
+    const unsigned char *extra;
+    char key[MAX_VALUE_LENGTH];
+};
+
+int binaryIndex_isBinaryIndex (const char *filename);
+
+int binaryIndex_openDB (struct DB *db, const char *filename, char **resolved);
+
+void binaryIndex_closeDB (struct DB *db);
+
+int binaryIndex_getRecordCount (struct DB *db);
+
+int binaryIndex_getRecordValue (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    char *value,
+    size_t value_max_length
+);
+
+int binaryIndex_indexSearch (
+    struct DB *db,
+    const char *value,
+    int mode,
+    int *output_flag
+);
+
+int binaryIndex_create (
+    const char *filename,
+    struct Table *table,
+    struct Node *columns,
+    int column_count,
+    RowListIndex row_list,
+    int unique_flag
+);
+
+struct BinaryIndexWriter *binaryIndex_openWriter (
+    struct Node *columns,
+    int column_count
+);
+
+void binaryIndex_addEntry (
+    struct BinaryIndexWriter *writer,
+    const char **values,
+    int rowid
+);
+
+int binaryIndex_closeWriter (
+    struct BinaryIndexWriter *writer,
+    const char *filename
+);
@@ -6,6 +6,7 @@
 #include "../structs.h"
 #include "../functions/date.h"
 #include "../evaluate/predicates.h"
+#include "../evaluate/value.h"
 #include "../query/result.h"
 #include "../debug.h"
 
@@ -37,6 +38,56 @@
 #define COL_YEARDAY_STRING      25
 #define COL_WEEK_STRING         26
 #define COL_WEEKDAY_STRING      27
+#define COL_COUNT               28
+
+/* Blocks kept at once; a block is chosen by its start julian */
+#define CALENDAR_BLOCK_CACHE    256
+/* Longest formatted value (e.g. "+22000-W52-7") plus nul */
+#define CALENDAR_VALUE_WIDTH    16
+/* Lookups of other blocks before a cached block is replaced. Filling a block
+ * costs about as much as working out 16 days on their own, so lookups spread
+ * over more blocks than are cached mostly do the latter. */
+#define CALENDAR_FILL_MISSES    64
+/* Before this year datetimeFromJulian() gives some days which don't exist
+ * (e.g. 0300-02-29) so blocks are filled day by day using it directly */
+#define CALENDAR_INCREMENTAL_YEAR   301
+
+/**
+ * Calendar values only depend on the julian so they are computed a block of
+ * CALENDAR_BLOCK_ROWS days at a time. Only the first day of a block is
+ * converted from its julian; year, month, day, weekday, yearday and ISO week
+ * of each following day are derived from the day before. Text is formatted
+ * the first time each value is read and kept with the block, so scanning or
+ * joining on CALENDAR mostly copies short strings. Lookups spread over more
+ * blocks than are cached fall back to working out days one at a time.
+ */
+struct CalendarDay {
+    int year;
+    int month;
+    int day;
+    int weekday;
+    int yearday;
+    int week;
+    int weekyear;
+};
+
+struct CalendarBlock {
+    int start;
+    /* Number of days filled in */
+    int count;
+    /* Lookups of other blocks in this block's cache slot */
+    int misses;
+    struct CalendarDay days[CALENDAR_BLOCK_ROWS];
+    /* Text of each column, CALENDAR_VALUE_WIDTH bytes per day, or NULL until
+     * the column is first read. A length of 0 means not formatted yet. */
+    char *strings[COL_COUNT];
+    unsigned char *lengths[COL_COUNT];
+};
+
+static struct CalendarBlock *block_cache[CALENDAR_BLOCK_CACHE];
+
+/* Used for a day whose block isn't cached */
+static struct CalendarBlock single_day;
 
 static char *field_names[] = {
     "julian",
@@ -90,6 +141,47 @@ static int printDate (
     struct DateTime date
 );
 
+static struct CalendarBlock *getDay (int julian, int *offset);
+
+static struct CalendarBlock *getBlock (int julian);
+
+static void fillBlock (struct CalendarBlock *block, int start);
+
+static void resetText (struct CalendarBlock *block);
+
+static void setDay (struct CalendarDay *day, struct DateTime *dt);
+
+static const char *getBlockText (
+    struct CalendarBlock *block,
+    int offset,
+    int field_index,
+    int *length
+);
+
+static int formatValue (
+    struct CalendarBlock *block,
+    int offset,
+    int field_index,
+    char *output
+);
+
+static int getIntValue (struct CalendarDay *day, int field_index);
+
+static int getDateValue (
+    struct CalendarBlock *block,
+    int offset,
+    int field_index,
+    struct DateTime *dt
+);
+
+static int getMonthLength (int year, int month);
+
+static int formatInt (char *output, int value);
+
+static int formatYear (char *output, int year);
+
+static int formatPadded (char *output, int value, int width);
+
 int calendar_openDB (
     struct DB *db,
     const char *filename,
@@ -152,230 +244,572 @@ int calendar_getRecordValue (
     size_t value_max_length
 ) {
     // Special case for an "index"
-    if (db->field_count == 2 && field_index == 1) {
-        // indexRangeScan() thinks it's dealing with an index DB, just return
-        // the rowid
-        return snprintf(value, value_max_length, "%d", record_index);
+    // indexRangeScan() thinks it's dealing with an index DB, just return the
+    // rowid
+    if (
+        (db->field_count == 2 && field_index == 1)
+        || field_index == FIELD_ROW_INDEX
+    ) {
+        field_index = COL_JULIAN;
     }
 
-    // julian/rowid
-    if (field_index == COL_JULIAN || field_index == FIELD_ROW_INDEX) {
-        return snprintf(value, value_max_length, "%d", record_index);
+    if (field_index < 0 || field_index >= COL_COUNT) {
+        return 0;
     }
 
-    struct DateTime dt = {0};
-    datetimeFromJulian(&dt, record_index);
+    int offset;
+    struct CalendarBlock *block = getDay(record_index, &offset);
 
-    struct DateTime dt2 = {0};
+    int length;
+    const char *text = getBlockText(block, offset, field_index, &length);
 
-    // date
-    if (field_index == COL_DATE) {
-        return printDate(value, value_max_length, dt);
+    if ((size_t)length >= value_max_length) {
+        length = value_max_length - 1;
     }
 
-    // year
-    if (field_index == COL_YEAR) {
-        return snprintf(value, value_max_length, "%d", dt.year);
-    }
+    memcpy(value, text, length);
+    value[length] = '\0';
 
-    // month
-    if (field_index == COL_MONTH) {
-        return snprintf(value, value_max_length, "%d", dt.month);
-    }
+    return length;
+}
 
-    // day
-    if (field_index == COL_DAY) {
-        return snprintf(value, value_max_length, "%d", dt.day);
+/**
+ * @brief Typed value of a field straight from the block so predicates don't
+ * have to parse text. The result is always the same as parseValue() on the
+ * field's text, which is copied to buffer.
+ *
+ * @return int 0 on success; -1 if the field must be evaluated as text
+ */
+int calendar_getRecordTyped (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    struct Value *value,
+    char *buffer,
+    size_t buffer_length
+) {
+    if (
+        db->field_count == 2
+        || field_index < 0
+        || field_index >= COL_COUNT
+        || buffer_length < CALENDAR_VALUE_WIDTH
+    ) {
+        return -1;
     }
 
-    // weekyear
-    if (field_index == COL_WEEKYEAR) {
-        return snprintf(
-            value,
-            value_max_length,
-            "%d",
-            datetimeGetWeekYear(&dt)
-        );
-    }
+    int offset;
+    struct CalendarBlock *block = getDay(record_index, &offset);
+    struct CalendarDay *day = &block->days[offset];
+
+    int length;
+    const char *text = getBlockText(block, offset, field_index, &length);
+
+    memcpy(buffer, text, length + 1);
+
+    value->text = buffer;
+
+    // Outside these years parseValue() has special cases so leave it to that
+    int regular_year = day->year >= CALENDAR_INCREMENTAL_YEAR
+        && day->year < 9999;
+
+    switch (field_index) {
+        case COL_DATE:
+        case COL_FIRST_OF_YEAR:
+        case COL_LAST_OF_YEAR:
+        case COL_FIRST_OF_QUARTER:
+        case COL_LAST_OF_QUARTER:
+        case COL_FIRST_OF_MONTH:
+        case COL_LAST_OF_MONTH:
+        case COL_FIRST_OF_WEEK:
+        case COL_LAST_OF_WEEK: {
+            if (!regular_year) {
+                break;
+            }
 
-    // week
-    if (field_index == COL_WEEK) {
-        return snprintf(value, value_max_length, "%d", datetimeGetWeek(&dt));
-    }
+            struct DateTime dt = {0};
+
+            value->type = VALUE_DATE;
+            value->julian = getDateValue(block, offset, field_index, &dt);
+
+            return 0;
+        }
+
+        case COL_MONTH_STRING:
+        case COL_WEEK_STRING:
+            if (!regular_year) {
+                break;
+            }
+
+            value->type = VALUE_STRING;
 
-    // weekday
-    if (field_index == COL_WEEKDAY) {
-        return snprintf(value, value_max_length, "%d", datetimeGetWeekDay(&dt));
+            return 0;
+
+        // parseDate() doesn't always agree on which day an ordinal or week
+        // date is
+        case COL_YEARDAY_STRING:
+        case COL_WEEKDAY_STRING:
+            break;
+
+        default:
+            value->type = VALUE_INTEGER;
+            value->integer = field_index == COL_JULIAN
+                ? record_index
+                : getIntValue(day, field_index);
+
+            return 0;
     }
 
-    // yearday
-    if (field_index == COL_YEARDAY) {
-        return snprintf(value, value_max_length, "%d", datetimeGetYearDay(&dt));
+    parseValue(value, buffer);
+
+    return 0;
+}
+
+/**
+ * @brief Block holding a day, which is either cached or just the one day
+ *
+ * @param offset OUT index of the day within the block
+ */
+static struct CalendarBlock *getDay (int julian, int *offset) {
+    struct CalendarBlock *block = getBlock(julian);
+
+    if (block == NULL) {
+        block = &single_day;
+
+        if (block->count != 1 || block->start != julian) {
+            struct DateTime dt = {0};
+
+            datetimeFromJulian(&dt, julian);
+
+            block->start = julian;
+            block->count = 1;
+
+            setDay(&block->days[0], &dt);
+            resetText(block);
+        }
     }
 
-    // millennium
-    if (field_index == COL_MILLENNIUM) {
-        return snprintf(value, value_max_length, "%d", dt.year / 1000);
+    *offset = julian - block->start;
+
+    return block;
+}
+
+/**
+ * @brief Find the cached block containing julian, computing it if necessary
+ *
+ * @return NULL if another block is using the cache slot and hasn't missed
+ * often enough to be replaced yet
+ */
+static struct CalendarBlock *getBlock (int julian) {
+    // Round down, including for negative julians
+    int start = julian - (
+        (julian % CALENDAR_BLOCK_ROWS) + CALENDAR_BLOCK_ROWS
+    ) % CALENDAR_BLOCK_ROWS;
+
+    unsigned int slot =
+        (unsigned int)(start / CALENDAR_BLOCK_ROWS) % CALENDAR_BLOCK_CACHE;
+
+    struct CalendarBlock *block = block_cache[slot];
+
+    if (block != NULL && block->start == start) {
+        return block;
     }
 
-    // century
-    if (field_index == COL_CENTURY) {
-        return snprintf(value, value_max_length, "%d", dt.year / 100);
+    if (block != NULL && ++block->misses < CALENDAR_FILL_MISSES) {
+        return NULL;
     }
 
-    // decade
-    if (field_index == COL_DECADE) {
-        return snprintf(value, value_max_length, "%d", dt.year / 10);
+    if (block == NULL) {
+        block = calloc(1, sizeof(*block));
+
+        if (block == NULL) {
+            fprintf(stderr, "Unable to allocate calendar block\n");
+            exit(-1);
+        }
+
+        block_cache[slot] = block;
     }
 
-    // quarter
-    if (field_index == COL_QUARTER) {
-        return snprintf(value, value_max_length, "%d", (dt.month - 1) / 3 + 1);
+    fillBlock(block, start);
+    resetText(block);
+
+    return block;
+}
+
+static void fillBlock (struct CalendarBlock *block, int start) {
+    struct DateTime dt = {0};
+
+    datetimeFromJulian(&dt, start);
+
+    block->start = start;
+    block->count = CALENDAR_BLOCK_ROWS;
+    block->misses = 0;
+
+    setDay(&block->days[0], &dt);
+
+    int incremental = dt.year >= CALENDAR_INCREMENTAL_YEAR;
+
+    for (int i = 1; i < CALENDAR_BLOCK_ROWS; i++) {
+        struct CalendarDay *day = &block->days[i];
+
+        if (!incremental) {
+            datetimeFromJulian(&dt, start + i);
+            setDay(day, &dt);
+            continue;
+        }
+
+        *day = block->days[i - 1];
+
+        day->day++;
+        day->yearday++;
+
+        if (day->day > getMonthLength(day->year, day->month)) {
+            day->day = 1;
+            day->month++;
+
+            if (day->month > 12) {
+                day->month = 1;
+                day->year++;
+                day->yearday = 1;
+            }
+        }
+
+        day->weekday = day->weekday % 7 + 1;
+
+        // A week belongs to the year its Thursday is in
+        if (day->weekday == 1) {
+            int thursday_year = day->month == 12 && day->day >= 29
+                ? day->year + 1
+                : day->year;
+
+            if (thursday_year != day->weekyear) {
+                day->weekyear = thursday_year;
+                day->week = 1;
+            }
+            else {
+                day->week++;
+            }
+        }
     }
+}
 
-    // firstOfYear
-    if (field_index == COL_FIRST_OF_YEAR) {
-        dt2.year = dt.year;
-        dt2.month = 1;
-        dt2.day = 1;
-        return printDate(value, value_max_length, dt2);
+/**
+ * @brief Forget formatted text so it is formatted again on demand
+ */
+static void resetText (struct CalendarBlock *block) {
+    for (int i = 0; i < COL_COUNT; i++) {
+        if (block->lengths[i] != NULL) {
+            memset(block->lengths[i], 0, block->count);
+        }
     }
+}
 
-    // lastOfYear
-    if (field_index == COL_LAST_OF_YEAR) {
-        dt2.year = dt.year;
-        dt2.month = 12;
-        dt2.day = 31;
-        return printDate(value, value_max_length, dt2);
+static void setDay (struct CalendarDay *day, struct DateTime *dt) {
+    day->year = dt->year;
+    day->month = dt->month;
+    day->day = dt->day;
+    day->weekday = datetimeGetWeekDay(dt);
+    day->yearday = datetimeGetYearDay(dt);
+    day->week = datetimeGetWeek(dt);
+    day->weekyear = datetimeGetWeekYear(dt);
+}
+
+/**
+ * @brief Text of a field, formatting it if this is its first use
+ */
+static const char *getBlockText (
+    struct CalendarBlock *block,
+    int offset,
+    int field_index,
+    int *length
+) {
+    if (block->strings[field_index] == NULL) {
+        block->strings[field_index] = malloc(
+            CALENDAR_BLOCK_ROWS * CALENDAR_VALUE_WIDTH
+        );
+        block->lengths[field_index] = calloc(CALENDAR_BLOCK_ROWS, 1);
+
+        if (
+            block->strings[field_index] == NULL
+            || block->lengths[field_index] == NULL
+        ) {
+            fprintf(stderr, "Unable to allocate calendar block\n");
+            exit(-1);
+        }
     }
 
-    // firstOfQuarter
-    if (field_index == COL_FIRST_OF_QUARTER) {
-        dt2.year = dt.year;
-        dt2.month = ((dt.month - 1) / 3) * 3 + 1;
-        dt2.day = 1;
-        return printDate(value, value_max_length, dt2);
+    char *text = block->strings[field_index] + offset * CALENDAR_VALUE_WIDTH;
+    unsigned char *text_length = &block->lengths[field_index][offset];
+
+    // Every value has at least one character
+    if (*text_length == 0) {
+        *text_length = formatValue(block, offset, field_index, text);
     }
 
-    // lastOfQuarter
-    if (field_index == COL_LAST_OF_QUARTER) {
-        dt2.year = dt.year;
-        dt2.month = (((dt.month - 1) / 3) + 1) * 3;
+    *length = *text_length;
 
-        dt2.day = month_lengths[dt2.month - 1];
-        if (dt2.month == 2 && isLeapYear(dt2.year)) {
-            dt2.day++;
-        }
+    return text;
+}
+
+/**
+ * @brief Write the text of one field, nul terminated
+ *
+ * @return int length
+ */
+static int formatValue (
+    struct CalendarBlock *block,
+    int offset,
+    int field_index,
+    char *output
+) {
+    struct CalendarDay *day = &block->days[offset];
+    struct DateTime dt = {0};
+    int length;
+
+    switch (field_index) {
+        case COL_JULIAN:
+            return formatInt(output, block->start + offset);
+
+        case COL_DATE:
+        case COL_FIRST_OF_YEAR:
+        case COL_LAST_OF_YEAR:
+        case COL_FIRST_OF_QUARTER:
+        case COL_LAST_OF_QUARTER:
+        case COL_FIRST_OF_MONTH:
+        case COL_LAST_OF_MONTH:
+        case COL_FIRST_OF_WEEK:
+        case COL_LAST_OF_WEEK:
+            getDateValue(block, offset, field_index, &dt);
+
+            if (dt.year < 0 || dt.year >= 10000) {
+                return printDate(output, CALENDAR_VALUE_WIDTH, dt);
+            }
+
+            formatPadded(output, dt.year, 4);
+            output[4] = '-';
+            formatPadded(output + 5, dt.month, 2);
+            output[7] = '-';
+            formatPadded(output + 8, dt.day, 2);
 
-        return printDate(value, value_max_length, dt2);
+            return 10;
+
+        case COL_MONTH_STRING:
+            length = formatYear(output, day->year);
+            output[length++] = '-';
+
+            return length + formatPadded(output + length, day->month, 2);
+
+        case COL_YEARDAY_STRING:
+            length = formatYear(output, day->year);
+            output[length++] = '-';
+
+            return length + formatPadded(output + length, day->yearday, 3);
+
+        case COL_WEEK_STRING:
+        case COL_WEEKDAY_STRING:
+            length = formatYear(output, day->weekyear);
+            output[length++] = '-';
+            output[length++] = 'W';
+            length += formatPadded(output + length, day->week, 2);
+
+            if (field_index == COL_WEEKDAY_STRING) {
+                output[length++] = '-';
+                length += formatInt(output + length, day->weekday);
+            }
+
+            return length;
+
+        default:
+            return formatInt(output, getIntValue(day, field_index));
     }
+}
 
-    // firstOfMonth
-    if (field_index == COL_FIRST_OF_MONTH) {
-        dt2.year = dt.year;
-        dt2.month = dt.month;
-        dt2.day = 1;
-        return printDate(value, value_max_length, dt2);
+static int getIntValue (struct CalendarDay *day, int field_index) {
+    switch (field_index) {
+        case COL_YEAR:              return day->year;
+        case COL_MONTH:             return day->month;
+        case COL_DAY:               return day->day;
+        case COL_WEEKYEAR:          return day->weekyear;
+        case COL_WEEK:              return day->week;
+        case COL_WEEKDAY:           return day->weekday;
+        case COL_YEARDAY:           return day->yearday;
+        case COL_MILLENNIUM:        return day->year / 1000;
+        case COL_CENTURY:           return day->year / 100;
+        case COL_DECADE:            return day->year / 10;
+        case COL_QUARTER:           return (day->month - 1) / 3 + 1;
+        case COL_IS_LEAP_YEAR:      return isLeapYear(day->year) ? 1 : 0;
+        case COL_WEEKDAY_IN_MONTH:  return (day->day - 1) / 7 + 1;
+        case COL_IS_WEEKEND:        return day->weekday >= 6 ? 1 : 0;
     }
 
-    // lastOfMonth
-    if (field_index == COL_LAST_OF_MONTH) {
-        dt2.year = dt.year;
-        dt2.month = dt.month;
+    return 0;
+}
 
-        dt2.day = month_lengths[dt2.month - 1];
-        if (dt2.month == 2 && isLeapYear(dt2.year)) {
-            dt2.day++;
+/**
+ * @brief Date of a date column, or of the day itself for ordinalDate and
+ * weekDate
+ *
+ * @return int julian of the date (only valid for regular years)
+ */
+static int getDateValue (
+    struct CalendarBlock *block,
+    int offset,
+    int field_index,
+    struct DateTime *dt
+) {
+    struct CalendarDay *day = &block->days[offset];
+    int julian = block->start + offset;
+
+    dt->year = day->year;
+    dt->month = day->month;
+    dt->day = day->day;
+
+    switch (field_index) {
+        case COL_FIRST_OF_YEAR:
+            dt->month = 1;
+            dt->day = 1;
+            return julian - day->yearday + 1;
+
+        case COL_LAST_OF_YEAR:
+            dt->month = 12;
+            dt->day = 31;
+            return julian - day->yearday + (isLeapYear(day->year) ? 366 : 365);
+
+        case COL_FIRST_OF_QUARTER:
+        case COL_LAST_OF_QUARTER: {
+            int first_month = ((day->month - 1) / 3) * 3 + 1;
+
+            // Back to the first of the month then the quarter
+            julian -= day->day - 1;
+
+            for (int m = first_month; m < day->month; m++) {
+                julian -= getMonthLength(day->year, m);
+            }
+
+            dt->month = first_month;
+            dt->day = 1;
+
+            if (field_index == COL_FIRST_OF_QUARTER) {
+                return julian;
+            }
+
+            for (int m = first_month; m < first_month + 2; m++) {
+                julian += getMonthLength(day->year, m);
+            }
+
+            dt->month = first_month + 2;
+            dt->day = getMonthLength(day->year, dt->month);
+
+            return julian + dt->day - 1;
         }
 
-        return printDate(value, value_max_length, dt2);
-    }
+        case COL_FIRST_OF_MONTH:
+            dt->day = 1;
+            return julian - day->day + 1;
+
+        case COL_LAST_OF_MONTH:
+            dt->day = getMonthLength(day->year, day->month);
+            return julian - day->day + dt->day;
+
+        case COL_FIRST_OF_WEEK:
+        case COL_LAST_OF_WEEK: {
+            julian += field_index == COL_FIRST_OF_WEEK
+                ? 1 - day->weekday
+                : 7 - day->weekday;
 
-    // firstOfWeek
-    if (field_index == COL_FIRST_OF_WEEK) {
-        int weekDay = datetimeGetWeekDay(&dt);
-        datetimeFromJulian(&dt2, record_index - weekDay + 1);
-        return printDate(value, value_max_length, dt2);
+            int target = julian - block->start;
+
+            if (target >= 0 && target < block->count) {
+                dt->year = block->days[target].year;
+                dt->month = block->days[target].month;
+                dt->day = block->days[target].day;
+            }
+            else {
+                datetimeFromJulian(dt, julian);
+            }
+
+            return julian;
+        }
     }
 
-    // lastOfWeek
-    if (field_index == COL_LAST_OF_WEEK) {
-        int weekDay = datetimeGetWeekDay(&dt);
-        datetimeFromJulian(&dt2, record_index - weekDay + 7);
-        return printDate(value, value_max_length, dt2);
+    return julian;
+}
+
+static int getMonthLength (int year, int month) {
+    // datetimeFromJulian() doesn't give real months for negative julians
+    if (month < 1 || month > 12) {
+        return 0;
     }
 
-    // isLeapYear
-    if (field_index == COL_IS_LEAP_YEAR) {
-        return snprintf(
-            value,
-            value_max_length,
-            "%d",
-            isLeapYear(dt.year) ? 1 : 0
-        );
+    if (month == 2 && isLeapYear(year)) {
+        return 29;
     }
 
-    // weekdayInMonth
-    if (field_index == COL_WEEKDAY_IN_MONTH) {
-        return snprintf(value, value_max_length, "%d", (dt.day - 1) / 7 + 1);
+    return month_lengths[month - 1];
+}
+
+/**
+ * @brief Same as sprintf("%d")
+ */
+static int formatInt (char *output, int value) {
+    char digits[12];
+    int count = 0;
+    unsigned int magnitude = value < 0
+        ? -(unsigned int)value
+        : (unsigned int)value;
+
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    int length = 0;
+
+    if (value < 0) {
+        output[length++] = '-';
     }
 
-    // isWeekend
-    if (field_index == COL_IS_WEEKEND) {
-        return snprintf(
-            value,
-            value_max_length,
-            "%d",
-            datetimeGetWeekDay(&dt) >= 6 ? 1 : 0
-        );
+    while (count > 0) {
+        output[length++] = digits[--count];
     }
 
-    // month string
-    if (field_index == COL_MONTH_STRING) {
-        return snprintf(
-            value,
-            value_max_length,
-            "%04d-%02d",
-            dt.year,
-            dt.month
-        );
+    output[length] = '\0';
+
+    return length;
+}
+
+/**
+ * @brief Same as sprintf("%04d")
+ */
+static int formatYear (char *output, int year) {
+    if (year < 0 || year >= 10000) {
+        return sprintf(output, "%04d", year);
     }
 
-    // yearday string
-    if (field_index == COL_YEARDAY_STRING) {
-        return snprintf(
-            value,
-            value_max_length,
-            "%04d-%03d",
-            dt.year,
-            datetimeGetYearDay(&dt)
-        );
+    return formatPadded(output, year, 4);
+}
+
+/**
+ * @brief Same as sprintf("%0*d") for values which fit in width
+ */
+static int formatPadded (char *output, int value, int width) {
+    int limit = 1;
+
+    for (int i = 0; i < width; i++) {
+        limit *= 10;
     }
 
-    // week string
-    if (field_index == COL_WEEK_STRING) {
-        return snprintf(
-            value,
-            value_max_length,
-            "%04d-W%02d",
-            datetimeGetWeekYear(&dt),
-            datetimeGetWeek(&dt)
-        );
+    if (value < 0 || value >= limit) {
+        return sprintf(output, "%0*d", width, value);
     }
 
-    // month string
-    if (field_index == COL_WEEKDAY_STRING) {
-        return snprintf(
-            value,
-            value_max_length,
-            "%04d-W%02d-%d",
-            datetimeGetWeekYear(&dt),
-            datetimeGetWeek(&dt),
-            datetimeGetWeekDay(&dt)
-        );
+    for (int i = width - 1; i >= 0; i--) {
+        output[i] = '0' + value % 10;
+        value /= 10;
     }
 
-    return 0;
+    output[width] = '\0';
+
+    return width;
 }
 
 // All queries go through fullTableScan but it's useful to indicate to the
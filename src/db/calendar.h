@@ -21,6 +21,15 @@ int calendar_getRecordValue (
     size_t value_max_length
 );
 
+int calendar_getRecordTyped (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    struct Value *value,
+    char *buffer,
+    size_t buffer_length
+);
+
 enum IndexSearchType calendar_findIndex(
     struct DB *db,
     const char *table_name,
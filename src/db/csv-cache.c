@@ -0,0 +1,1387 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "csv-cache.h"
+#include "db.h"
+#include "../structs.h"
+#include "../query/result.h"
+#include "../evaluate/evaluate.h"
+#include "../evaluate/predicates.h"
+#include "../evaluate/value.h"
+
+/**
+ * Columnar binary copy of a CSV table (`<table>.cache`), written by
+ * CREATE CACHE ON <table> (or when the table is first opened, if
+ * CSVDB_AUTO_CACHE is set) and read instead of the CSV for as long as the
+ * CSV's size and mtime are unchanged.
+ *
+ * Format, native endian, each section padded to 8 bytes:
+ *
+ *  struct CacheHeader
+ *  struct CacheColumn columns[field_count]
+ *  char names[]                            NUL separated field names
+ *  for each column:
+ *    CACHE_INTEGER
+ *      int64_t values[record_count]        CACHE_NULL for empty values
+ *    CACHE_DICTIONARY
+ *      uint32_t codes[record_count]
+ *      uint64_t string_offsets[dictionary_count + 1]
+ *      char strings[]                      NUL terminated
+ *    struct CacheBlock blocks[block_count]
+ *
+ * Dictionaries are sorted with strcmp() so codes order the same way as their
+ * strings. Each block holds the min and max value (or code) of block_rows
+ * rows so scans can skip blocks which can't match.
+ *
+ * Integer columns are only used when every value is written exactly as
+ * printf("%ld") would write it and parses as VALUE_INTEGER, so values always
+ * read back as the original text.
+ */
+
+#define CACHE_MAGIC     "CSVDBCOL"
+#define CACHE_VERSION   1
+
+/* Stored for empty values in CACHE_INTEGER columns */
+#define CACHE_NULL      INT64_MIN
+
+enum CacheColumnType {
+    CACHE_INTEGER =     1,
+    CACHE_DICTIONARY =  2,
+};
+
+struct CacheHeader {
+    char magic[8];
+    int32_t version;
+    int32_t field_count;
+    int64_t file_size;
+    int64_t file_mtime;
+    int64_t record_count;
+    int64_t block_rows;
+    int64_t names_offset;
+};
+
+struct CacheColumn {
+    int32_t type;
+    uint32_t dictionary_count;
+    int64_t values_offset;
+    int64_t dictionary_offset;
+    int64_t strings_offset;
+    int64_t blocks_offset;
+};
+
+struct CacheBlock {
+    int64_t min;
+    int64_t max;
+};
+
+/**
+ * @brief A column while it's being built
+ */
+struct ColumnBuilder {
+    enum CacheColumnType type;
+    int64_t *values;
+    uint32_t *codes;
+    uint64_t *dictionary;
+    uint32_t dictionary_count;
+    char *strings;
+    size_t strings_length;
+    struct CacheBlock *blocks;
+};
+
+/**
+ * @brief Strings seen so far in a column, each given an id in order of first
+ * appearance
+ */
+struct StringSet {
+    char *strings;
+    size_t length;
+    size_t capacity;
+    /* Start of each string in strings, by id */
+    uint64_t *offsets;
+    unsigned long *hashes;
+    uint32_t count;
+    uint32_t id_capacity;
+    /* Open addressed; id + 1, or 0 if empty */
+    uint32_t *slots;
+    uint32_t slot_count;
+};
+
+/**
+ * @brief A predicate of the form `field op constant` (either way round)
+ * which can be tested against the cached column directly
+ */
+struct CachePredicate {
+    enum Function op;
+    struct CacheColumn *column;
+    /* Which side of op the row's value goes */
+    int field_on_left;
+    char constant_text[MAX_VALUE_LENGTH];
+    struct Value constant;
+    /* CACHE_INTEGER: blocks can be skipped by comparing with their range */
+    int skip_by_range;
+    /* CACHE_DICTIONARY: result for each code; -1 until checked */
+    signed char *matches;
+    /* CACHE_DICTIONARY: number of matching codes below each code, when every
+     * code has been checked */
+    uint32_t *match_counts;
+};
+
+static struct CacheColumn *getColumn (struct DB *db, int field_index);
+
+static void *getSection (struct DB *db, int64_t offset);
+
+static int isValidCache (void *map, size_t map_size);
+
+static int writeCache (struct DB *db, const char *filename);
+
+static int buildColumn (
+    struct DB *db,
+    int field_index,
+    int record_count,
+    int block_rows,
+    struct ColumnBuilder *column
+);
+
+static int parseCacheInteger (const char *text, int length, int64_t *result);
+
+static uint32_t addString (struct StringSet *set, const char *text, int length);
+
+static int compareStringIDs (const void *a, const void *b);
+
+static void freeColumnBuilder (struct ColumnBuilder *column);
+
+static int writeSection (FILE *f, const void *data, size_t size, int64_t *offset);
+
+static int preparePredicate (
+    struct DB *db,
+    struct Node *predicate,
+    struct CachePredicate *cache_predicate,
+    int full_scan
+);
+
+static int isCacheField (struct DB *db, struct Node *node);
+
+static int matchPredicate (struct DB *db, struct CachePredicate *p, int rowid);
+
+static int matchCode (struct DB *db, struct CachePredicate *p, uint32_t code);
+
+static int canSkipBlock (struct DB *db, struct CachePredicate *p, int block);
+
+static void freePredicate (struct CachePredicate *p);
+
+/* Used by compareStringIDs() while a dictionary is sorted */
+static struct StringSet *sort_set = NULL;
+
+/**
+ * @brief Open the cache for a CSV file, if there is one and it's up to date
+ *
+ * @param filename path of the CSV file (not the cache)
+ * @return int 0 on success; -1 if there is no valid cache
+ */
+int csvCache_openDB (struct DB *db, const char *filename) {
+    char cache_filename[FILENAME_MAX];
+    struct stat st;
+
+    if (strlen(filename) + sizeof(".cache") > FILENAME_MAX) {
+        return -1;
+    }
+
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+
+    sprintf(cache_filename, "%s.cache", filename);
+
+    int fd = open(cache_filename, O_RDONLY);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat cache_st;
+    if (
+        fstat(fd, &cache_st) != 0
+        || (size_t)cache_st.st_size < sizeof(struct CacheHeader)
+    ) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    struct CacheHeader *header = map;
+
+    if (
+        !isValidCache(map, cache_st.st_size)
+        || header->file_size != st.st_size
+        || header->file_mtime != st.st_mtime
+    ) {
+        munmap(map, cache_st.st_size);
+        return -1;
+    }
+
+    db->vfs = VFS_CSV_CACHE;
+    db->file = NULL;
+    db->map = map;
+    db->map_size = cache_st.st_size;
+    db->fields = getSection(db, header->names_offset);
+    db->field_count = header->field_count;
+    db->_record_count = header->record_count;
+    db->line_indices = NULL;
+    db->data = NULL;
+    db->offsets = NULL;
+    db->field_cache = NULL;
+    db->stream = NULL;
+
+    return 0;
+}
+
+/**
+ * @brief CREATE CACHE ON <table>
+ *
+ * @return int 0 on success; -1 on failure
+ */
+int csvCache_create (const char *table_name) {
+    struct DB db;
+    char *resolved = NULL;
+
+    if (openDBUncached(&db, table_name, &resolved) != 0) {
+        fprintf(stderr, "File not found: '%s'\n", table_name);
+        return -1;
+    }
+
+    int result = 0;
+
+    if (db.vfs == VFS_CSV_CACHE) {
+        // Already up to date
+    }
+    else if (
+        resolved == NULL
+        || db.field_count <= 0
+        || (
+            db.vfs != VFS_CSV_MMAP
+            && db.vfs != VFS_CSV_MEM
+            && db.vfs != VFS_CSV
+        )
+    ) {
+        fprintf(stderr, "Unable to cache table '%s'\n", table_name);
+        result = -1;
+    }
+    else if (writeCache(&db, resolved) != 0) {
+        fprintf(stderr, "Unable to write cache for table '%s'\n", table_name);
+        result = -1;
+    }
+
+    closeDB(&db);
+    free(resolved);
+
+    return result;
+}
+
+/**
+ * @brief When CSVDB_AUTO_CACHE is set, large tables are cached the first
+ * time they're opened and db is switched over to the cache.
+ *
+ * @param db freshly opened CSV table
+ * @param filename path of the CSV file
+ */
+void csvCache_autoCreate (struct DB *db, const char *filename) {
+    const char *env = getenv("CSVDB_AUTO_CACHE");
+
+    if (env == NULL || strcmp(env, "0") == 0) {
+        return;
+    }
+
+    struct stat st;
+
+    if (stat(filename, &st) != 0 || st.st_size < OFFSETS_FILE_LIMIT) {
+        return;
+    }
+
+    if (writeCache(db, filename) != 0) {
+        return;
+    }
+
+    struct DB cache_db;
+
+    if (csvCache_openDB(&cache_db, filename) == 0) {
+        closeDB(db);
+        *db = cache_db;
+    }
+}
+
+void csvCache_closeDB (struct DB *db) {
+    if (db->map != NULL) {
+        munmap(db->map, db->map_size);
+    }
+
+    db->map = NULL;
+    db->fields = NULL;
+}
+
+int csvCache_getRecordCount (struct DB *db) {
+    return db->_record_count;
+}
+
+/**
+ * Returns the length of the dictionary string for a row (which is also nul
+ * terminated)
+ */
+static int getDictionaryText (
+    struct DB *db,
+    struct CacheColumn *column,
+    int rowid,
+    const char **value
+) {
+    uint32_t *codes = getSection(db, column->values_offset);
+    uint64_t *dictionary = getSection(db, column->dictionary_offset);
+    char *strings = getSection(db, column->strings_offset);
+
+    uint32_t code = codes[rowid];
+
+    *value = strings + dictionary[code];
+
+    return dictionary[code + 1] - dictionary[code] - 1;
+}
+
+/**
+ * Returns the number of bytes read, or -1 on error
+ */
+int csvCache_getRecordValue (
+    struct DB *db,
+    int rowid,
+    int field_index,
+    char *value,
+    size_t value_max_length
+) {
+    if (
+        rowid < 0
+        || rowid >= db->_record_count
+        || field_index < 0
+        || field_index >= db->field_count
+    ) {
+        return -1;
+    }
+
+    struct CacheColumn *column = getColumn(db, field_index);
+
+    if (column->type == CACHE_INTEGER) {
+        int64_t *values = getSection(db, column->values_offset);
+
+        if (values[rowid] == CACHE_NULL) {
+            value[0] = '\0';
+            return 0;
+        }
+
+        return snprintf(value, value_max_length, "%ld", (long)values[rowid]);
+    }
+
+    const char *text;
+    int length = getDictionaryText(db, column, rowid, &text);
+
+    if ((size_t)length >= value_max_length) {
+        length = value_max_length - 1;
+    }
+
+    memcpy(value, text, length);
+    value[length] = '\0';
+
+    return length;
+}
+
+/**
+ * Returns the length of the field pointed to by value (which is also nul
+ * terminated), or -1 if the field must be copied with
+ * csvCache_getRecordValue(). Like the CSV views, strings which would need
+ * quoting are never handed out so output can write views unescaped.
+ */
+int csvCache_getRecordView (
+    struct DB *db,
+    int rowid,
+    int field_index,
+    const char **value
+) {
+    if (
+        rowid < 0
+        || rowid >= db->_record_count
+        || field_index < 0
+        || field_index >= db->field_count
+    ) {
+        return -1;
+    }
+
+    struct CacheColumn *column = getColumn(db, field_index);
+
+    if (column->type != CACHE_DICTIONARY) {
+        return -1;
+    }
+
+    int length = getDictionaryText(db, column, rowid, value);
+
+    if (strpbrk(*value, ",\"\n\r") != NULL) {
+        return -1;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Filter the table. Predicates comparing a column with a literal are
+ * tested on the cached values directly (each dictionary string is only
+ * parsed once) and skip whole blocks when they can; anything else is
+ * evaluated row by row as usual.
+ *
+ * @return int number of matched rows
+ */
+int csvCache_fullTableAccess (
+    struct DB *db,
+    RowListIndex list_id,
+    struct Node *predicates,
+    int predicate_count,
+    int limit_value
+) {
+    struct CacheHeader *header = db->map;
+
+    struct CachePredicate *fast = calloc(predicate_count + 1, sizeof(*fast));
+    struct Node *rest = malloc(sizeof(*rest) * (predicate_count + 1));
+
+    if (fast == NULL || rest == NULL) {
+        fprintf(stderr, "Unable to allocate memory for predicates\n");
+        exit(-1);
+    }
+
+    int fast_count = 0;
+    int rest_count = 0;
+
+    for (int i = 0; i < predicate_count; i++) {
+        if (preparePredicate(db, &predicates[i], &fast[fast_count], limit_value < 0)) {
+            fast_count++;
+        }
+        else {
+            rest[rest_count++] = predicates[i];
+        }
+    }
+
+    struct Table table;
+    table.db = db;
+
+    int block_rows = header->block_rows;
+    int record_count = db->_record_count;
+    int done = 0;
+
+    for (int start = 0; start < record_count && !done; start += block_rows) {
+        int block = start / block_rows;
+        int skip = 0;
+
+        for (int j = 0; j < fast_count && !skip; j++) {
+            skip = canSkipBlock(db, &fast[j], block);
+        }
+
+        if (skip) {
+            continue;
+        }
+
+        int end = MIN(start + block_rows, record_count);
+
+        for (int rowid = start; rowid < end; rowid++) {
+            int matching = 1;
+
+            for (int j = 0; j < fast_count && matching; j++) {
+                matching = matchPredicate(db, &fast[j], rowid);
+            }
+
+            if (matching && rest_count > 0) {
+                matching = evaluateOperatorNodeListAND(
+                    &table,
+                    ROWLIST_ROWID,
+                    rowid,
+                    rest,
+                    rest_count
+                );
+            }
+
+            if (matching) {
+                appendRowID(getRowList(list_id), rowid);
+            }
+
+            // Implement early exit FETCH FIRST/LIMIT for cases with no ORDER
+            // clause
+            if (
+                limit_value >= 0
+                && getRowList(list_id)->row_count >= (unsigned)limit_value
+            ) {
+                done = 1;
+                break;
+            }
+        }
+    }
+
+    for (int j = 0; j < fast_count; j++) {
+        freePredicate(&fast[j]);
+    }
+
+    free(fast);
+    free(rest);
+
+    return getRowList(list_id)->row_count;
+}
+
+static struct CacheColumn *getColumn (struct DB *db, int field_index) {
+    struct CacheHeader *header = db->map;
+
+    return (struct CacheColumn *)(header + 1) + field_index;
+}
+
+static void *getSection (struct DB *db, int64_t offset) {
+    return (char *)db->map + offset;
+}
+
+/**
+ * @brief Check the header and that every section lies within the file
+ */
+static int isValidCache (void *map, size_t map_size) {
+    struct CacheHeader *header = map;
+
+    if (
+        memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != CACHE_VERSION
+        || header->field_count <= 0
+        || header->field_count > MAX_FIELD_COUNT * 1024
+        || header->record_count < 0
+        || header->block_rows <= 0
+        || sizeof(*header)
+            + sizeof(struct CacheColumn) * header->field_count > map_size
+        || header->names_offset < 0
+        || (size_t)header->names_offset >= map_size
+    ) {
+        return 0;
+    }
+
+    int64_t record_count = header->record_count;
+    int64_t block_count = (record_count + header->block_rows - 1)
+        / header->block_rows;
+
+    struct CacheColumn *columns = (struct CacheColumn *)(header + 1);
+
+    for (int i = 0; i < header->field_count; i++) {
+        struct CacheColumn *column = &columns[i];
+
+        size_t value_size = column->type == CACHE_INTEGER
+            ? sizeof(int64_t) : sizeof(uint32_t);
+
+        if (
+            (column->type != CACHE_INTEGER && column->type != CACHE_DICTIONARY)
+            || column->values_offset < 0
+            || column->values_offset + value_size * record_count > map_size
+            || column->blocks_offset < 0
+            || column->blocks_offset + sizeof(struct CacheBlock) * block_count
+                > map_size
+        ) {
+            return 0;
+        }
+
+        if (column->type == CACHE_DICTIONARY) {
+            if (
+                column->dictionary_offset < 0
+                || column->dictionary_offset
+                    + sizeof(uint64_t) * (column->dictionary_count + 1)
+                    > map_size
+                || column->strings_offset < 0
+                || column->strings_offset
+                    + ((uint64_t *)((char *)map + column->dictionary_offset))
+                        [column->dictionary_count]
+                    > map_size
+            ) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Write `<filename>.cache` for a fully readable table. Written to a
+ * temporary file first and renamed so readers only ever see a complete
+ * cache.
+ *
+ * @param filename path of the CSV file
+ * @return int 0 on success; -1 on failure
+ */
+static int writeCache (struct DB *db, const char *filename) {
+    struct stat st;
+
+    if (stat(filename, &st) != 0) {
+        return -1;
+    }
+
+    char cache_filename[FILENAME_MAX];
+    char tmp_filename[FILENAME_MAX + 16];
+
+    if (strlen(filename) + sizeof(".cache") > FILENAME_MAX) {
+        return -1;
+    }
+
+    sprintf(cache_filename, "%s.cache", filename);
+    sprintf(tmp_filename, "%s.%d", cache_filename, getpid());
+
+    int record_count = getRecordCount(db);
+    int field_count = db->field_count;
+    int block_rows = CACHE_BLOCK_ROWS;
+    int block_count = (record_count + block_rows - 1) / block_rows;
+
+    struct ColumnBuilder *builders = calloc(field_count, sizeof(*builders));
+    struct CacheColumn *columns = calloc(field_count, sizeof(*columns));
+
+    if (builders == NULL || columns == NULL) {
+        free(builders);
+        free(columns);
+        return -1;
+    }
+
+    FILE *f = fopen(tmp_filename, "wb");
+
+    int ok = f != NULL;
+
+    struct CacheHeader header = {0};
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.field_count = field_count;
+    header.file_size = st.st_size;
+    header.file_mtime = st.st_mtime;
+    header.record_count = record_count;
+    header.block_rows = block_rows;
+
+    int64_t offset = 0;
+
+    // Header and columns are written again once offsets are known
+    ok = ok && writeSection(f, &header, sizeof(header), &offset) == 0;
+    ok = ok && writeSection(f, columns, sizeof(*columns) * field_count, &offset) == 0;
+
+    size_t names_length = 0;
+    for (int i = 0; i < field_count; i++) {
+        names_length += strlen(getFieldName(db, i)) + 1;
+    }
+
+    char *names = malloc(names_length);
+    ok = ok && names != NULL;
+
+    if (ok) {
+        char *ptr = names;
+
+        for (int i = 0; i < field_count; i++) {
+            strcpy(ptr, getFieldName(db, i));
+            ptr += strlen(ptr) + 1;
+        }
+
+        header.names_offset = offset;
+        ok = writeSection(f, names, names_length, &offset) == 0;
+    }
+
+    free(names);
+
+    // One column at a time so only one is ever held in memory
+    for (int i = 0; ok && i < field_count; i++) {
+        struct ColumnBuilder *builder = &builders[i];
+        struct CacheColumn *column = &columns[i];
+
+        ok = buildColumn(db, i, record_count, block_rows, builder) == 0;
+
+        if (!ok) {
+            break;
+        }
+
+        column->type = builder->type;
+
+        if (builder->type == CACHE_INTEGER) {
+            column->values_offset = offset;
+            ok = writeSection(
+                f,
+                builder->values,
+                sizeof(*builder->values) * record_count,
+                &offset
+            ) == 0;
+        }
+        else {
+            column->dictionary_count = builder->dictionary_count;
+
+            column->values_offset = offset;
+            ok = writeSection(
+                f,
+                builder->codes,
+                sizeof(*builder->codes) * record_count,
+                &offset
+            ) == 0;
+
+            column->dictionary_offset = offset;
+            ok = ok && writeSection(
+                f,
+                builder->dictionary,
+                sizeof(*builder->dictionary) * (builder->dictionary_count + 1),
+                &offset
+            ) == 0;
+
+            column->strings_offset = offset;
+            ok = ok && writeSection(
+                f,
+                builder->strings,
+                builder->strings_length,
+                &offset
+            ) == 0;
+        }
+
+        column->blocks_offset = offset;
+        ok = ok && writeSection(
+            f,
+            builder->blocks,
+            sizeof(*builder->blocks) * block_count,
+            &offset
+        ) == 0;
+
+        freeColumnBuilder(builder);
+    }
+
+    if (ok) {
+        ok = fseek(f, 0, SEEK_SET) == 0
+            && fwrite(&header, sizeof(header), 1, f) == 1
+            && fwrite(columns, sizeof(*columns), field_count, f)
+                == (size_t)field_count;
+    }
+
+    if (f != NULL && fclose(f) != 0) {
+        ok = 0;
+    }
+
+    // Rename is atomic so concurrent readers see either old or new cache
+    if (!ok || rename(tmp_filename, cache_filename) != 0) {
+        remove(tmp_filename);
+        ok = 0;
+    }
+
+    free(builders);
+    free(columns);
+
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Read one column of the table, as integers if possible, otherwise as
+ * a dictionary
+ *
+ * @return int 0 on success; -1 on failure
+ */
+static int buildColumn (
+    struct DB *db,
+    int field_index,
+    int record_count,
+    int block_rows,
+    struct ColumnBuilder *column
+) {
+    char buffer[MAX_VALUE_LENGTH];
+    const char *text;
+    int block_count = (record_count + block_rows - 1) / block_rows;
+
+    column->blocks = malloc(sizeof(*column->blocks) * (block_count + 1));
+    column->values = malloc(sizeof(*column->values) * (record_count + 1));
+
+    if (column->blocks == NULL || column->values == NULL) {
+        return -1;
+    }
+
+    column->type = CACHE_INTEGER;
+
+    for (int rowid = 0; rowid < record_count; rowid++) {
+        int length = getRecordView(
+            db,
+            rowid,
+            field_index,
+            &text,
+            buffer,
+            MAX_VALUE_LENGTH
+        );
+
+        if (
+            length < 0
+            || !parseCacheInteger(text, length, &column->values[rowid])
+        ) {
+            column->type = CACHE_DICTIONARY;
+            break;
+        }
+    }
+
+    if (column->type == CACHE_INTEGER) {
+        for (int block = 0; block < block_count; block++) {
+            // Empty range if every value is NULL
+            int64_t min = INT64_MAX;
+            int64_t max = INT64_MIN;
+
+            int end = MIN((block + 1) * block_rows, record_count);
+
+            for (int rowid = block * block_rows; rowid < end; rowid++) {
+                int64_t value = column->values[rowid];
+
+                if (value == CACHE_NULL) {
+                    continue;
+                }
+
+                if (value < min) min = value;
+                if (value > max) max = value;
+            }
+
+            column->blocks[block].min = min;
+            column->blocks[block].max = max;
+        }
+
+        return 0;
+    }
+
+    free(column->values);
+    column->values = NULL;
+
+    column->codes = malloc(sizeof(*column->codes) * (record_count + 1));
+
+    struct StringSet set = {0};
+
+    if (column->codes == NULL) {
+        return -1;
+    }
+
+    // Codes are ids in order of appearance to start with
+    for (int rowid = 0; rowid < record_count; rowid++) {
+        int length = getRecordView(
+            db,
+            rowid,
+            field_index,
+            &text,
+            buffer,
+            MAX_VALUE_LENGTH
+        );
+
+        if (length < 0) {
+            length = 0;
+        }
+
+        column->codes[rowid] = addString(&set, text, length);
+    }
+
+    // Then sorted into strcmp() order
+    uint32_t *order = malloc(sizeof(*order) * (set.count + 1));
+    uint32_t *rank = malloc(sizeof(*rank) * (set.count + 1));
+
+    column->dictionary = malloc(sizeof(*column->dictionary) * (set.count + 1));
+    column->strings = malloc(set.length + 1);
+
+    if (
+        order == NULL
+        || rank == NULL
+        || column->dictionary == NULL
+        || column->strings == NULL
+    ) {
+        fprintf(stderr, "Unable to allocate memory for cache dictionary\n");
+        exit(-1);
+    }
+
+    for (uint32_t i = 0; i < set.count; i++) {
+        order[i] = i;
+    }
+
+    sort_set = &set;
+    qsort(order, set.count, sizeof(*order), compareStringIDs);
+    sort_set = NULL;
+
+    size_t strings_length = 0;
+
+    for (uint32_t code = 0; code < set.count; code++) {
+        const char *string = set.strings + set.offsets[order[code]];
+        size_t length = strlen(string) + 1;
+
+        rank[order[code]] = code;
+
+        column->dictionary[code] = strings_length;
+        memcpy(column->strings + strings_length, string, length);
+        strings_length += length;
+    }
+
+    column->dictionary[set.count] = strings_length;
+    column->dictionary_count = set.count;
+    column->strings_length = strings_length;
+
+    for (int rowid = 0; rowid < record_count; rowid++) {
+        column->codes[rowid] = rank[column->codes[rowid]];
+    }
+
+    for (int block = 0; block < block_count; block++) {
+        int64_t min = INT64_MAX;
+        int64_t max = INT64_MIN;
+
+        int end = MIN((block + 1) * block_rows, record_count);
+
+        for (int rowid = block * block_rows; rowid < end; rowid++) {
+            int64_t code = column->codes[rowid];
+
+            if (code < min) min = code;
+            if (code > max) max = code;
+        }
+
+        column->blocks[block].min = min;
+        column->blocks[block].max = max;
+    }
+
+    free(order);
+    free(rank);
+    free(set.strings);
+    free(set.offsets);
+    free(set.hashes);
+    free(set.slots);
+
+    return 0;
+}
+
+/**
+ * @brief Accepts only integers which would be printed back exactly the same
+ * way, and which the evaluator treats as integers
+ *
+ * @param result OUT CACHE_NULL for an empty value
+ * @return int 1 if text can be stored as an integer
+ */
+static int parseCacheInteger (const char *text, int length, int64_t *result) {
+    if (length == 0) {
+        *result = CACHE_NULL;
+        return 1;
+    }
+
+    const char *ptr = text;
+    const char *end = text + length;
+
+    if (*ptr == '-') {
+        ptr++;
+    }
+
+    int digits = end - ptr;
+
+    // No "-0", no leading zeros, and nothing which could overflow
+    if (
+        digits < 1
+        || digits > 18
+        || (ptr[0] == '0' && (digits > 1 || ptr != text))
+    ) {
+        return 0;
+    }
+
+    for (const char *p = ptr; p < end; p++) {
+        if (*p < '0' || *p > '9') {
+            return 0;
+        }
+    }
+
+    char copy[24];
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    struct Value value;
+    parseValue(&value, copy);
+
+    if (value.type != VALUE_INTEGER) {
+        return 0;
+    }
+
+    *result = strtol(copy, NULL, 10);
+
+    return 1;
+}
+
+/**
+ * @brief FNV-1a
+ */
+static unsigned long hashString (const char *text, int length) {
+    unsigned long hash = 14695981039346656037UL;
+
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211UL;
+    }
+
+    return hash;
+}
+
+/**
+ * @return uint32_t id of the string (which need not be NUL terminated)
+ */
+static uint32_t addString (struct StringSet *set, const char *text, int length) {
+    unsigned long hash = hashString(text, length);
+
+    if (set->slots != NULL) {
+        uint32_t mask = set->slot_count - 1;
+
+        for (uint32_t i = hash & mask; set->slots[i] != 0; i = (i + 1) & mask) {
+            uint32_t id = set->slots[i] - 1;
+            const char *string = set->strings + set->offsets[id];
+
+            if (
+                set->hashes[id] == hash
+                && strncmp(string, text, length) == 0
+                && string[length] == '\0'
+            ) {
+                return id;
+            }
+        }
+    }
+
+    // Keep the table at most half full
+    if ((set->count + 1) * 2 > set->slot_count) {
+        uint32_t slot_count = set->slot_count == 0 ? 1024 : set->slot_count * 2;
+        uint32_t *slots = calloc(slot_count, sizeof(*slots));
+
+        if (slots == NULL) {
+            fprintf(stderr, "Unable to allocate memory for cache dictionary\n");
+            exit(-1);
+        }
+
+        for (uint32_t id = 0; id < set->count; id++) {
+            uint32_t i = set->hashes[id] & (slot_count - 1);
+
+            while (slots[i] != 0) {
+                i = (i + 1) & (slot_count - 1);
+            }
+
+            slots[i] = id + 1;
+        }
+
+        free(set->slots);
+        set->slots = slots;
+        set->slot_count = slot_count;
+    }
+
+    if (set->count == set->id_capacity) {
+        set->id_capacity = set->id_capacity == 0 ? 1024 : set->id_capacity * 2;
+
+        set->offsets = realloc(set->offsets, sizeof(*set->offsets) * set->id_capacity);
+        set->hashes = realloc(set->hashes, sizeof(*set->hashes) * set->id_capacity);
+
+        if (set->offsets == NULL || set->hashes == NULL) {
+            fprintf(stderr, "Unable to allocate memory for cache dictionary\n");
+            exit(-1);
+        }
+    }
+
+    while (set->length + length + 1 > set->capacity) {
+        set->capacity = set->capacity == 0 ? 64 * 1024 : set->capacity * 2;
+        set->strings = realloc(set->strings, set->capacity);
+
+        if (set->strings == NULL) {
+            fprintf(stderr, "Unable to allocate memory for cache dictionary\n");
+            exit(-1);
+        }
+    }
+
+    uint32_t id = set->count++;
+
+    set->offsets[id] = set->length;
+    set->hashes[id] = hash;
+
+    memcpy(set->strings + set->length, text, length);
+    set->strings[set->length + length] = '\0';
+    set->length += length + 1;
+
+    uint32_t mask = set->slot_count - 1;
+    uint32_t i = hash & mask;
+
+    while (set->slots[i] != 0) {
+        i = (i + 1) & mask;
+    }
+
+    set->slots[i] = id + 1;
+
+    return id;
+}
+
+static int compareStringIDs (const void *a, const void *b) {
+    uint32_t id_a = *(const uint32_t *)a;
+    uint32_t id_b = *(const uint32_t *)b;
+
+    return strcmp(
+        sort_set->strings + sort_set->offsets[id_a],
+        sort_set->strings + sort_set->offsets[id_b]
+    );
+}
+
+static void freeColumnBuilder (struct ColumnBuilder *column) {
+    free(column->values);
+    free(column->codes);
+    free(column->dictionary);
+    free(column->strings);
+    free(column->blocks);
+
+    column->values = NULL;
+    column->codes = NULL;
+    column->dictionary = NULL;
+    column->strings = NULL;
+    column->blocks = NULL;
+}
+
+/**
+ * @brief Write data followed by padding up to a multiple of 8 bytes
+ *
+ * @param offset IN/OUT position in the file
+ * @return int 0 on success; -1 on failure
+ */
+static int writeSection (FILE *f, const void *data, size_t size, int64_t *offset) {
+    static const char padding[8] = {0};
+
+    size_t padding_size = (8 - size % 8) % 8;
+
+    if (size > 0 && fwrite(data, 1, size, f) != size) {
+        return -1;
+    }
+
+    if (padding_size > 0 && fwrite(padding, 1, padding_size, f) != padding_size) {
+        return -1;
+    }
+
+    *offset += size + padding_size;
+
+    return 0;
+}
+
+/**
+ * @brief Check whether predicate compares a column with a literal
+ *
+ * @param full_scan whether every row is going to be read, in which case
+ * dictionary predicates are checked against every code up front so blocks
+ * can be skipped
+ * @return int 1 if cache_predicate has been prepared; 0 if the predicate must
+ * be evaluated row by row
+ */
+static int preparePredicate (
+    struct DB *db,
+    struct Node *predicate,
+    struct CachePredicate *p,
+    int full_scan
+) {
+    enum Function op = predicate->function;
+
+    if (
+        op != OPERATOR_EQ
+        && op != OPERATOR_NE
+        && op != OPERATOR_LT
+        && op != OPERATOR_LE
+        && op != OPERATOR_GT
+        && op != OPERATOR_GE
+        && op != OPERATOR_LIKE
+    ) {
+        return 0;
+    }
+
+    if (predicate->child_count != 2) {
+        return 0;
+    }
+
+    struct Node *field;
+    struct Node *constant;
+
+    if (
+        isCacheField(db, &predicate->children[0])
+        && predicate->children[1].function == FUNC_UNITY
+        && predicate->children[1].field.index == FIELD_CONSTANT
+    ) {
+        field = &predicate->children[0];
+        constant = &predicate->children[1];
+        p->field_on_left = 1;
+    }
+    else if (
+        isCacheField(db, &predicate->children[1])
+        && predicate->children[0].function == FUNC_UNITY
+        && predicate->children[0].field.index == FIELD_CONSTANT
+    ) {
+        field = &predicate->children[1];
+        constant = &predicate->children[0];
+        p->field_on_left = 0;
+    }
+    else {
+        return 0;
+    }
+
+    struct Table table;
+    table.db = db;
+
+    // Same evaluation as evaluateOperatorNode() would do for each row
+    if (
+        evaluateNode(
+            &table,
+            ROWLIST_ROWID,
+            0,
+            constant,
+            p->constant_text,
+            MAX_VALUE_LENGTH
+        ) < 0
+    ) {
+        return 0;
+    }
+
+    parseValue(&p->constant, p->constant_text);
+
+    p->op = op;
+    p->column = getColumn(db, field->field.index);
+
+    if (p->column->type == CACHE_INTEGER) {
+        // LIKE, and a string on the left of an integer, compare text
+        if (
+            op == OPERATOR_LIKE
+            || (!p->field_on_left && p->constant.type != VALUE_INTEGER)
+        ) {
+            return 0;
+        }
+
+        p->skip_by_range = p->constant.type == VALUE_INTEGER
+            && op != OPERATOR_NE;
+
+        return 1;
+    }
+
+    uint32_t count = p->column->dictionary_count;
+
+    p->matches = malloc(count + 1);
+
+    if (p->matches == NULL) {
+        return 0;
+    }
+
+    memset(p->matches, -1, count + 1);
+
+    if (full_scan) {
+        p->match_counts = malloc(sizeof(*p->match_counts) * (count + 1));
+
+        if (p->match_counts != NULL) {
+            p->match_counts[0] = 0;
+
+            for (uint32_t code = 0; code < count; code++) {
+                p->match_counts[code + 1] = p->match_counts[code]
+                    + matchCode(db, p, code);
+            }
+        }
+    }
+
+    return 1;
+}
+
+static int isCacheField (struct DB *db, struct Node *node) {
+    return node->function == FUNC_UNITY
+        && node->field.table_id == 0
+        && node->field.index >= 0
+        && node->field.index < db->field_count;
+}
+
+/**
+ * @return int 1 if the row matches
+ */
+static int matchPredicate (struct DB *db, struct CachePredicate *p, int rowid) {
+    if (p->column->type == CACHE_DICTIONARY) {
+        uint32_t *codes = getSection(db, p->column->values_offset);
+
+        return matchCode(db, p, codes[rowid]);
+    }
+
+    int64_t *values = getSection(db, p->column->values_offset);
+
+    struct Value value;
+
+    if (values[rowid] == CACHE_NULL) {
+        value.type = VALUE_NULL;
+        value.text = "";
+    }
+    else {
+        value.type = VALUE_INTEGER;
+        value.integer = values[rowid];
+        // compareValues() only looks at an integer's text to check for NULL
+        value.text = "0";
+    }
+
+    return p->field_on_left
+        ? compareValues(p->op, &value, &p->constant)
+        : compareValues(p->op, &p->constant, &value);
+}
+
+/**
+ * @brief Every row with the same code gives the same result, so each code is
+ * only checked once
+ */
+static int matchCode (struct DB *db, struct CachePredicate *p, uint32_t code) {
+    if (p->matches[code] >= 0) {
+        return p->matches[code];
+    }
+
+    uint64_t *dictionary = getSection(db, p->column->dictionary_offset);
+    char *strings = getSection(db, p->column->strings_offset);
+
+    struct Value value;
+    parseValue(&value, strings + dictionary[code]);
+
+    p->matches[code] = p->field_on_left
+        ? compareValues(p->op, &value, &p->constant)
+        : compareValues(p->op, &p->constant, &value);
+
+    return p->matches[code];
+}
+
+/**
+ * @return int 1 if no row in the block can match
+ */
+static int canSkipBlock (struct DB *db, struct CachePredicate *p, int block) {
+    struct CacheBlock *blocks = getSection(db, p->column->blocks_offset);
+    int64_t min = blocks[block].min;
+    int64_t max = blocks[block].max;
+
+    if (p->column->type == CACHE_DICTIONARY) {
+        if (p->match_counts == NULL) {
+            return 0;
+        }
+
+        return p->match_counts[max + 1] == p->match_counts[min];
+    }
+
+    if (!p->skip_by_range) {
+        return 0;
+    }
+
+    // Only NULLs, which don't match an integer with these operators
+    if (min > max) {
+        return 1;
+    }
+
+    long k = p->constant.integer;
+    enum Function op = p->op;
+
+    // Turn `k op field` round to `field op k`
+    if (!p->field_on_left) {
+        if (op == OPERATOR_LT) op = OPERATOR_GT;
+        else if (op == OPERATOR_LE) op = OPERATOR_GE;
+        else if (op == OPERATOR_GT) op = OPERATOR_LT;
+        else if (op == OPERATOR_GE) op = OPERATOR_LE;
+    }
+
+    if (op == OPERATOR_EQ) return k < min || k > max;
+    if (op == OPERATOR_LT) return min >= k;
+    if (op == OPERATOR_LE) return min > k;
+    if (op == OPERATOR_GT) return max <= k;
+    if (op == OPERATOR_GE) return max < k;
+
+    return 0;
+}
+
+static void freePredicate (struct CachePredicate *p) {
+    free(p->matches);
+    free(p->match_counts);
+}
@@ -0,0 +1,36 @@
+#include <stdio.h>
+
+#include "../structs.h"
+
+int csvCache_openDB (struct DB *db, const char *filename);
+
+int csvCache_create (const char *table_name);
+
+void csvCache_autoCreate (struct DB *db, const char *filename);
+
+void csvCache_closeDB (struct DB *db);
+
+int csvCache_getRecordCount (struct DB *db);
+
+int csvCache_getRecordValue (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    char *value,
+    size_t value_max_length
+);
+
+int csvCache_getRecordView (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    const char **value
+);
+
+int csvCache_fullTableAccess (
+    struct DB *db,
+    RowListIndex list_id,
+    struct Node *predicates,
+    int predicate_count,
+    int limit_value
+);
@@ -4,9 +4,10 @@
 #include <ctype.h>
 
 #include "helper.h"
+#include "csv-stream.h"
+#include "field-cache.h"
 #include "../structs.h"
 #include "../functions/util.h"
-#include "../functions/csv.h"
 #include "../query/select.h"
 
 static int countFields(const char *ptr);
@@ -15,9 +16,12 @@ static int prepareHeaders(struct DB *db);
 
 static char *get_end_of_data(struct DB *db);
 
+static int prepareRecord(struct DB *db, int record_index, int field_index);
+
 int csvMem_makeDB(struct DB *db, FILE *f)
 {
     db->vfs = VFS_CSV_MEM;
+    db->field_cache = NULL;
 
     // It would be nice to have a streaming solution but I don't think it's
     // realistically possible. We will just read the entire stream into memory.
@@ -49,6 +53,12 @@ int csvMem_openDB(struct DB *db, const char *filename, char **resolved)
 
     if (strcmp(filename, "stdin") == 0)
     {
+        // Pipes are read as records are needed rather than all up front
+        if (csvStream_isStream(stdin))
+        {
+            return csvStream_makeDB(db, stdin);
+        }
+
         f = stdin;
     }
     else
@@ -87,6 +97,8 @@ int csvMem_openDB(struct DB *db, const char *filename, char **resolved)
 
 void csvMem_closeDB(struct DB *db)
 {
+    fieldCache_free(db);
+
     if (db->line_indices != NULL)
     {
         // max_size of allocation is stored at start of real block
@@ -147,6 +159,25 @@ int csvMem_getRecordCount(struct DB *db)
     return db->_record_count;
 }
 
+/**
+ * @brief Only indexes far enough to find max_count records
+ */
+int csvMem_getRecordCountUpTo(struct DB *db, int max_count)
+{
+    if (db->_record_count < 0)
+    {
+        // One extra line so the last record is known to be complete
+        indexLines(db, max_count + 1, '"');
+    }
+
+    if (db->_record_count >= 0 && db->_record_count < max_count)
+    {
+        return db->_record_count;
+    }
+
+    return max_count;
+}
+
 /**
  * Returns the number of bytes read, or -1 on error
  */
@@ -156,6 +187,43 @@ int csvMem_getRecordValue(
     int field_index,
     char *value,
     size_t value_max_length)
+{
+    if (prepareRecord(db, record_index, field_index) < 0)
+    {
+        return -1;
+    }
+
+    return fieldCache_getRecordValue(
+        db,
+        record_index,
+        field_index,
+        value,
+        value_max_length);
+}
+
+/**
+ * Returns the length of the field pointed to by value (not nul terminated),
+ * or -1 if the field must be copied with csvMem_getRecordValue()
+ */
+int csvMem_getRecordView(
+    struct DB *db,
+    int record_index,
+    int field_index,
+    const char **value)
+{
+    if (prepareRecord(db, record_index, field_index) < 0)
+    {
+        return -1;
+    }
+
+    return fieldCache_getRecordView(db, record_index, field_index, value);
+}
+
+/**
+ * Makes sure record_index has been indexed.
+ * Returns 0 on success, or -1 if the record or field is out of range
+ */
+static int prepareRecord(struct DB *db, int record_index, int field_index)
 {
     if (db->_record_count < 0)
     {
@@ -178,9 +246,7 @@ int csvMem_getRecordValue(
         return -1;
     }
 
-    long file_offset = db->line_indices[record_index];
-
-    return csv_get_record_from_line(db->data + file_offset, field_index, value, value_max_length);
+    return 0;
 }
 
 static int prepareHeaders(struct DB *db)
@@ -262,6 +328,7 @@ const char *csvMem_fromValues(struct DB *db, const char *input, int length)
 
     db->vfs = VFS_CSV_MEM;
     db->file = NULL;
+    db->field_cache = NULL;
 
     size_t max_data_size = MAX_VALUE_LENGTH;
 
@@ -413,6 +480,7 @@ const char *csvMem_fromValues(struct DB *db, const char *input, int length)
 void csvMem_fromHeaders(struct DB *db, const char *headers)
 {
     db->vfs = VFS_CSV_MEM;
+    db->field_cache = NULL;
 
     db->data = malloc(strlen(headers) + 1);
 
@@ -432,6 +500,7 @@ void csvMem_fromHeaders(struct DB *db, const char *headers)
 int csvMem_fromQuery(struct DB *db, struct Query *query)
 {
     db->vfs = VFS_CSV_MEM;
+    db->field_cache = NULL;
 
     size_t size;
 
@@ -486,6 +555,9 @@ int csvMem_insertRow(struct DB *db, const char *row)
     int data_len = data_end - db->data;
     int header_len = db->data - db->fields;
 
+    // The last line might be extended if it had no trailing newline
+    fieldCache_free(db);
+
     // Extra bytes for '\n' and '\0'
     int new_size = header_len + data_len + len + 2;
 
@@ -17,6 +17,8 @@ char *csvMem_getFieldName (struct DB *db, int field_index);
 
 int csvMem_getRecordCount (struct DB *db);
 
+int csvMem_getRecordCountUpTo (struct DB *db, int max_count);
+
 int csvMem_getRecordValue (
     struct DB *db,
     int record_index,
@@ -25,6 +27,13 @@ int csvMem_getRecordValue (
     size_t value_max_length
 );
 
+int csvMem_getRecordView (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    const char **value
+);
+
 int csvMem_findIndex(
     struct DB *db,
     const char *table_name,
@@ -3,16 +3,21 @@
 #include <string.h>
 #include <ctype.h>
 
+#include <unistd.h>
 #include <sys/mman.h>
 
+#include "csv-mmap.h"
 #include "helper.h"
+#include "offsets.h"
+#include "field-cache.h"
 #include "../structs.h"
 #include "../functions/util.h"
-#include "../functions/csv.h"
 
 static void prepareHeaders (struct DB *db);
 
-static int makeDB (struct DB *db, FILE *f);
+static int indexFromOffsets (struct DB *db);
+
+static int prepareRecord (struct DB *db, int rowid, int field_index);
 
 /**
  * @brief Opens, consumes, and closes file specified by filename
@@ -43,9 +48,15 @@ int csvMmap_openDB (struct DB *db, const char *filename, char **resolved) {
         if (resolved != NULL) {
             *resolved = realpath(buffer, *resolved);
         }
+
+        int result = csvMmap_makeDB(db, f, buffer);
+
+        fclose(f);
+
+        return result;
     }
 
-    int result = makeDB(db, f);
+    int result = csvMmap_makeDB(db, f, filename);
 
     fclose(f);
 
@@ -53,15 +64,14 @@ int csvMmap_openDB (struct DB *db, const char *filename, char **resolved) {
 }
 
 void csvMmap_closeDB (struct DB *db) {
-    if (db->line_indices != NULL) {
-        // Rough size, and rough start location.
-        // Exact values aren't required.
-        // We'll do our best, especially if we've only done a partial index
-        int final_index = db->_record_count < 0
-            ? -db->_record_count - 1 : db->_record_count;
-        int file_size = db->line_indices[final_index];
-        munmap(db->data, file_size);
+    fieldCache_free(db);
 
+    if (db->map != NULL) {
+        munmap(db->map, db->map_size);
+        db->map = NULL;
+    }
+
+    if (db->line_indices != NULL) {
         // max_size of allocation is stored at start of real block
         void *ptr = db->line_indices;
         free(ptr - sizeof(int));
@@ -72,6 +82,8 @@ void csvMmap_closeDB (struct DB *db) {
         free(db->fields);
         db->fields = NULL;
     }
+
+    closeOffsetsFile(db);
 }
 
 int csvMmap_getFieldIndex (struct DB *db, const char *field) {
@@ -104,8 +116,11 @@ char *csvMmap_getFieldName (struct DB *db, int field_index) {
 
 
 int csvMmap_getRecordCount (struct DB *db) {
-    if (db->_record_count < 0) {
+    if (db->_record_count < 0 && indexFromOffsets(db) < 0) {
         indexLines(db, -1, '"');
+
+        // Header line is not included in line_indices
+        saveOffsets(db, db->line_indices, db->_record_count + 1);
     }
 
     return db->_record_count;
@@ -121,6 +136,71 @@ int csvMmap_getRecordValue (
     char *value,
     size_t value_max_length
 ) {
+    if (prepareRecord(db, rowid, field_index) < 0) {
+        return -1;
+    }
+
+    return fieldCache_getRecordValue(
+        db,
+        rowid,
+        field_index,
+        value,
+        value_max_length
+    );
+}
+
+/**
+ * Returns the length of the field pointed to by value (not nul terminated),
+ * or -1 if the field must be copied with csvMmap_getRecordValue()
+ */
+int csvMmap_getRecordView (
+    struct DB *db,
+    int rowid,
+    int field_index,
+    const char **value
+) {
+    if (prepareRecord(db, rowid, field_index) < 0) {
+        return -1;
+    }
+
+    return fieldCache_getRecordView(db, rowid, field_index, value);
+}
+
+/**
+ * @brief Read-ahead suits scans but wastes I/O on index lookups, which touch
+ * one or two pages per row.
+ *
+ * Only the part of the file which has already been indexed is switched to
+ * random access, since indexing further is itself a sequential pass.
+ */
+void csvMmap_adviseAccess (struct DB *db, enum AccessPattern pattern) {
+    if (db->map == NULL) {
+        return;
+    }
+
+    if (pattern == ACCESS_SEQUENTIAL) {
+        madvise(db->map, db->map_size, MADV_SEQUENTIAL);
+        return;
+    }
+
+    if (db->line_indices == NULL) {
+        return;
+    }
+
+    int final_index = db->_record_count < 0
+        ? -db->_record_count - 1 : db->_record_count;
+
+    size_t length = (db->data - (char *)db->map)
+        + db->line_indices[final_index];
+
+    madvise(db->map, MIN(length, db->map_size), MADV_RANDOM);
+}
+
+/**
+ * Makes sure rowid has been indexed.
+ * Returns 0 on success, or -1 if the record or field is out of range
+ */
+static int prepareRecord (struct DB *db, int rowid, int field_index) {
     if (rowid < 0) {
         return -1;
     }
@@ -129,7 +209,7 @@ int csvMmap_getRecordValue (
         return -1;
     }
 
-    if (db->_record_count < 0) {
+    if (db->_record_count < 0 && indexFromOffsets(db) < 0) {
         // Just index as many rows as we need
         if (indexLines(db, rowid + 1, '"') < 0) {
             return -1;
@@ -141,15 +221,21 @@ int csvMmap_getRecordValue (
         }
     }
 
-    long file_offset = db->line_indices[rowid];
-
-    return csv_get_record_from_line(db->data + file_offset, field_index, value, value_max_length);
+    return 0;
 }
 
-static int makeDB (struct DB *db, FILE *f) {
+/**
+ * @brief Maps f, which may be closed afterwards
+ *
+ * @param filename used to find the offsets sidecar
+ * @returns int 0 on success; -1 on failure
+ */
+int csvMmap_makeDB (struct DB *db, FILE *f, const char *filename) {
     db->vfs = VFS_CSV_MMAP;
     db->file = NULL;
     db->line_indices = NULL;
+    db->field_cache = NULL;
+    db->map = NULL;
 
     if (fseek(f, 0, SEEK_END)) {
         // Can only mmap a seekable file
@@ -157,19 +243,117 @@ static int makeDB (struct DB *db, FILE *f) {
     }
     size_t size = ftell(f);
 
-    db->data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (size == 0) {
+        // Zero length mappings aren't allowed
+        return -1;
+    }
 
-    if (db->data == MAP_FAILED) {
+    // Reserve at least one zeroed page after the file so the data is always
+    // NUL terminated, even when the file exactly fills its last page
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t map_size = (size / page_size + 1) * page_size;
+
+    void *map = mmap(
+        NULL,
+        map_size,
+        PROT_READ,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+
+    if (map == MAP_FAILED) {
         return -1;
     }
 
+    if (
+        mmap(
+            map,
+            size,
+            PROT_READ,
+            MAP_PRIVATE | MAP_FIXED,
+            fileno(f),
+            0
+        ) == MAP_FAILED
+    ) {
+        munmap(map, map_size);
+        return -1;
+    }
+
+    db->data = map;
+    db->map = map;
+    db->map_size = map_size;
+
+    // Tables are usually read from start to end: indexing lines and full
+    // scans. Index lookups switch to random access (csvMmap_adviseAccess()).
+    madvise(db->map, db->map_size, MADV_SEQUENTIAL);
+
+    char *start = db->data;
+
     prepareHeaders(db);
 
     db->_record_count = -1;
 
+    openOffsetsFile(db, filename);
+
+    if (db->offsets != NULL) {
+        // line_indices are relative to the first record, not start of file
+        db->offsets->base = db->data - start;
+    }
+
     return 0;
 }
 
+/**
+ * @brief Build line_indices from a valid sidecar file instead of scanning
+ *
+ * @param db
+ * @return int record count; -1 if there is no valid sidecar
+ */
+static int indexFromOffsets (struct DB *db) {
+    long count;
+    long *offsets = getOffsets(db, &count);
+
+    // Sidecar also includes the header line
+    if (offsets == NULL || offsets[1] != db->offsets->base) {
+        return -1;
+    }
+
+    int record_count = count - 2;
+
+    if (db->line_indices != NULL) {
+        void *ptr = db->line_indices;
+        free(ptr - sizeof(int));
+    }
+
+    // max_size of allocation is stored at start of real block
+    int *max_size = malloc(
+        sizeof(*max_size) + sizeof(*db->line_indices) * (record_count + 1)
+    );
+
+    if (max_size == NULL) {
+        fprintf(
+            stderr,
+            "Unable to allocate memory for %d line_indices\n",
+            record_count + 1
+        );
+        exit(-1);
+    }
+
+    *max_size = record_count + 1;
+    db->line_indices = (void *)max_size + sizeof(*max_size);
+
+    long base = db->offsets->base;
+
+    for (int i = 0; i <= record_count; i++) {
+        db->line_indices[i] = offsets[i + 1] - base;
+    }
+
+    db->_record_count = record_count;
+
+    return record_count;
+}
+
 static void prepareHeaders (struct DB *db) {
     db->field_count = 1;
 
@@ -4,6 +4,8 @@
 
 int csvMmap_openDB (struct DB *db, const char *filename, char **resolved);
 
+int csvMmap_makeDB (struct DB *db, FILE *f, const char *filename);
+
 void csvMmap_closeDB (struct DB *db);
 
 int csvMmap_getFieldIndex (struct DB *db, const char *field);
@@ -19,3 +21,12 @@ int csvMmap_getRecordValue (
     char *value,
     size_t value_max_length
 );
+
+int csvMmap_getRecordView (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    const char **value
+);
+
+void csvMmap_adviseAccess (struct DB *db, enum AccessPattern pattern);
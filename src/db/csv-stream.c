@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+
+#include "csv-stream.h"
+#include "../structs.h"
+#include "../functions/csv.h"
+#include "../functions/scan.h"
+
+/**
+ * CSV read incrementally from a pipe (usually stdin).
+ *
+ * Input is read a chunk at a time as records are asked for, and records are
+ * indexed as they arrive, so the first rows of a stream can be used before
+ * the rest of it has been written.
+ *
+ * The buffer grows geometrically so any record can be read again, which
+ * joins, sorts and later queries reading the same stream rely on. Readers
+ * making a single forward pass call csvStream_releaseRecords() as they go.
+ * Once the buffer reaches MEMORY_FILE_LIMIT, released records are dropped
+ * to make room instead of growing, so streams larger than memory can be
+ * filtered.
+ */
+
+static int prepareHeaders (struct DB *db);
+
+static int readChunk (struct DB *db);
+
+static void indexRecords (struct DB *db, int max_count, int partial);
+
+static void appendLine (struct DB *db, size_t offset);
+
+static void dropReleased (struct DB *db);
+
+/**
+ * @return int 1 if f can't be seeked, so must be read as a stream
+ */
+int csvStream_isStream (FILE *f) {
+    return fseek(f, 0, SEEK_CUR) != 0;
+}
+
+/**
+ * @brief Takes ownership of f. Only the header line is read now.
+ *
+ * @returns int 0 on success; -1 on failure
+ */
+int csvStream_makeDB (struct DB *db, FILE *f) {
+    struct CsvStream *stream = calloc(1, sizeof(*stream));
+
+    if (stream == NULL) {
+        return -1;
+    }
+
+    stream->capacity = CSV_STREAM_CHUNK_SIZE;
+    stream->line_capacity = 1024;
+
+    db->vfs = VFS_CSV_STREAM;
+    db->file = f;
+    db->stream = stream;
+    db->fields = NULL;
+    db->field_count = 0;
+    db->_record_count = -1;
+    db->offsets = NULL;
+    db->field_cache = NULL;
+    db->data = malloc(stream->capacity + 1);
+    db->line_indices = malloc(sizeof(*db->line_indices) * stream->line_capacity);
+
+    if (db->data == NULL || db->line_indices == NULL) {
+        fprintf(stderr, "Unable to allocate memory for stream\n");
+        exit(-1);
+    }
+
+    db->data[0] = '\0';
+
+    return prepareHeaders(db);
+}
+
+void csvStream_closeDB (struct DB *db) {
+    if (db->file != NULL && db->file != stdin) {
+        fclose(db->file);
+    }
+
+    free(db->data);
+    free(db->line_indices);
+    free(db->fields);
+    free(db->stream);
+
+    db->file = NULL;
+    db->data = NULL;
+    db->line_indices = NULL;
+    db->fields = NULL;
+    db->stream = NULL;
+}
+
+int csvStream_getRecordCount (struct DB *db) {
+    if (db->_record_count < 0) {
+        indexRecords(db, -1, 0);
+    }
+
+    return db->_record_count;
+}
+
+/**
+ * @brief Only reads far enough to find max_count records. If the producer is
+ * slow, returns early with whatever has arrived so long as there is at least
+ * one record past those released.
+ */
+int csvStream_getRecordCountUpTo (struct DB *db, int max_count) {
+    if (db->_record_count < 0) {
+        indexRecords(db, max_count, 1);
+    }
+
+    int count = db->stream->indexed_count;
+
+    return count < max_count ? count : max_count;
+}
+
+/**
+ * Returns the number of bytes read, or -1 on error
+ */
+int csvStream_getRecordValue (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    char *value,
+    size_t value_max_length
+) {
+    struct CsvStream *stream = db->stream;
+
+    if (record_index < stream->first_rowid) {
+        fprintf(
+            stderr,
+            "Record %d has already been discarded from the stream\n",
+            record_index
+        );
+        return -1;
+    }
+
+    if (record_index >= stream->indexed_count) {
+        indexRecords(db, record_index + 1, 0);
+    }
+
+    if (
+        record_index >= stream->indexed_count
+        || field_index < 0
+        || field_index >= db->field_count
+    ) {
+        return -1;
+    }
+
+    const char *line = db->data
+        + db->line_indices[record_index - stream->first_rowid];
+
+    return csv_get_record_from_line(line, field_index, value, value_max_length);
+}
+
+/**
+ * @brief Records before rowid will not be read again. They are only
+ * actually dropped if the buffer would otherwise have to grow past
+ * MEMORY_FILE_LIMIT.
+ */
+void csvStream_releaseRecords (struct DB *db, int rowid) {
+    struct CsvStream *stream = db->stream;
+
+    if (rowid > stream->indexed_count) {
+        rowid = stream->indexed_count;
+    }
+
+    if (rowid > stream->release_rowid) {
+        stream->release_rowid = rowid;
+    }
+}
+
+static int prepareHeaders (struct DB *db) {
+    struct CsvStream *stream = db->stream;
+
+    char *end = NULL;
+
+    while (
+        (end = memchr(db->data, '\n', stream->length)) == NULL
+        && !stream->eof
+    ) {
+        if (readChunk(db) < 0) {
+            return -1;
+        }
+    }
+
+    size_t header_length = end != NULL ? (size_t)(end - db->data) : stream->length;
+
+    db->fields = malloc(header_length + 1);
+
+    if (db->fields == NULL) {
+        return -1;
+    }
+
+    db->line_indices[0] = end != NULL ? header_length + 1 : header_length;
+    stream->scan_offset = db->line_indices[0];
+
+    if (header_length == 0 && end == NULL) {
+        // Empty stream
+        db->fields[0] = '\0';
+        db->field_count = 0;
+        return 0;
+    }
+
+    const char *read_ptr = db->data;
+    const char *read_end = db->data + header_length;
+    char *write_ptr = db->fields;
+
+    // Suppoprt Excel CSV UTF-8.
+    // Check for BOM
+    if (
+        header_length >= 3 &&
+        read_ptr[0] == '\xef' &&
+        read_ptr[1] == '\xbb' &&
+        read_ptr[2] == '\xbf'
+    ) {
+        read_ptr += 3;
+    }
+
+    db->field_count = 1;
+
+    while (read_ptr < read_end) {
+        if (*read_ptr == ',') {
+            *(write_ptr++) = '\0';
+            db->field_count++;
+        }
+        else if (*read_ptr != '"' && *read_ptr != '\r') {
+            *(write_ptr++) = *read_ptr;
+        }
+
+        read_ptr++;
+    }
+
+    *write_ptr = '\0';
+
+    return 0;
+}
+
+/**
+ * @brief Append whatever is available from the stream to db->data, making
+ * room for at least a chunk first
+ *
+ * @return int number of bytes read; 0 at end of stream; -1 on error
+ */
+static int readChunk (struct DB *db) {
+    struct CsvStream *stream = db->stream;
+
+    if (
+        stream->capacity - stream->length < CSV_STREAM_CHUNK_SIZE
+        && stream->capacity >= MEMORY_FILE_LIMIT
+    ) {
+        dropReleased(db);
+    }
+
+    if (stream->capacity - stream->length < CSV_STREAM_CHUNK_SIZE) {
+        size_t capacity = stream->capacity * 2;
+
+        char *data = realloc(db->data, capacity + 1);
+
+        if (data == NULL) {
+            fprintf(stderr, "Unable to allocate %zu bytes for stream\n", capacity);
+            exit(-1);
+        }
+
+        db->data = data;
+        stream->capacity = capacity;
+    }
+
+    ssize_t count;
+
+    // Take what's available now rather than waiting for a full buffer
+    do {
+        count = read(
+            fileno(db->file),
+            db->data + stream->length,
+            stream->capacity - stream->length
+        );
+    } while (count < 0 && errno == EINTR);
+
+    if (count <= 0) {
+        stream->eof = 1;
+        db->data[stream->length] = '\0';
+
+        return count < 0 ? -1 : 0;
+    }
+
+    stream->length += count;
+    db->data[stream->length] = '\0';
+
+    return count;
+}
+
+/**
+ * @brief Index records until there are max_count of them (-1 for all) or the
+ * stream ends. If partial is set, stops instead of waiting for more input
+ * once there are unreleased records.
+ */
+static void indexRecords (struct DB *db, int max_count, int partial) {
+    struct CsvStream *stream = db->stream;
+
+    while (max_count < 0 || stream->indexed_count < max_count) {
+        if (stream->scan_offset >= stream->length) {
+            if (partial && stream->indexed_count > stream->release_rowid) {
+                break;
+            }
+
+            if (stream->eof || readChunk(db) <= 0) {
+                break;
+            }
+
+            continue;
+        }
+
+        const char *ptr = scanFind(
+            db->data + stream->scan_offset,
+            stream->quoted ? "\"" : "\n\""
+        );
+
+        size_t i = ptr - db->data;
+
+        if (i >= stream->length) {
+            stream->scan_offset = stream->length;
+            continue;
+        }
+
+        if (*ptr == '\n') {
+            appendLine(db, i + 1);
+        }
+        else if (*ptr == '"') {
+            stream->quoted = !stream->quoted;
+        }
+
+        stream->scan_offset = i + 1;
+    }
+
+    if (stream->eof && stream->scan_offset >= stream->length) {
+        size_t start = db->line_indices[stream->indexed_count - stream->first_rowid];
+
+        // Last record might not have a newline
+        if (start < stream->length) {
+            appendLine(db, stream->length);
+        }
+
+        db->_record_count = stream->indexed_count;
+    }
+}
+
+/**
+ * @brief Record the end of a record, i.e. where the next one starts
+ */
+static void appendLine (struct DB *db, size_t offset) {
+    struct CsvStream *stream = db->stream;
+
+    int index = stream->indexed_count - stream->first_rowid + 1;
+
+    if (index >= stream->line_capacity) {
+        int capacity = stream->line_capacity * 2;
+
+        long *line_indices = realloc(
+            db->line_indices,
+            sizeof(*db->line_indices) * capacity
+        );
+
+        if (line_indices == NULL) {
+            fprintf(
+                stderr,
+                "Unable to allocate memory for %d line_indices\n",
+                capacity
+            );
+            exit(-1);
+        }
+
+        db->line_indices = line_indices;
+        stream->line_capacity = capacity;
+    }
+
+    db->line_indices[index] = offset;
+    stream->indexed_count++;
+}
+
+/**
+ * @brief Move everything after the released records to the start of the
+ * buffer
+ */
+static void dropReleased (struct DB *db) {
+    struct CsvStream *stream = db->stream;
+
+    int drop_count = stream->release_rowid - stream->first_rowid;
+
+    if (drop_count <= 0) {
+        return;
+    }
+
+    long shift = db->line_indices[drop_count];
+    int line_count = stream->indexed_count - stream->first_rowid + 1;
+
+    memmove(db->data, db->data + shift, stream->length - shift + 1);
+
+    for (int i = drop_count; i < line_count; i++) {
+        db->line_indices[i - drop_count] = db->line_indices[i] - shift;
+    }
+
+    stream->length -= shift;
+    stream->scan_offset -= shift;
+    stream->first_rowid = stream->release_rowid;
+}
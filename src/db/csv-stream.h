@@ -0,0 +1,41 @@
+#include <stdio.h>
+
+#include "../structs.h"
+
+struct CsvStream {
+    /* Rowid of the record at db->line_indices[0] */
+    int first_rowid;
+    /* Records before this rowid won't be read again and may be dropped */
+    int release_rowid;
+    /* Number of complete records found so far (including dropped ones) */
+    int indexed_count;
+    /* Number of entries allocated in db->line_indices */
+    int line_capacity;
+    /* Bytes held in db->data, which always has room for a NUL after them */
+    size_t length;
+    size_t capacity;
+    /* Where indexing resumes in db->data */
+    size_t scan_offset;
+    int quoted;
+    int eof;
+};
+
+int csvStream_isStream (FILE *f);
+
+int csvStream_makeDB (struct DB *db, FILE *f);
+
+void csvStream_closeDB (struct DB *db);
+
+int csvStream_getRecordCount (struct DB *db);
+
+int csvStream_getRecordCountUpTo (struct DB *db, int max_count);
+
+int csvStream_getRecordValue (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    char *value,
+    size_t value_max_length
+);
+
+void csvStream_releaseRecords (struct DB *db, int rowid);
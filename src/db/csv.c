@@ -5,12 +5,13 @@
 #include "../structs.h"
 #include "db.h"
 #include "csv-mem.h"
+#include "offsets.h"
 #include "../query/select.h"
 #include "../query/node.h"
 
-static int makeDB(struct DB *db, FILE *f);
+static int makeDB(struct DB *db, FILE *f, const char *filename);
 
-static int countLines(FILE *f);
+static int countLines(FILE *f, long byte_offset);
 
 static int measureLine(FILE *f, size_t byte_offset);
 
@@ -18,10 +19,16 @@ static void prepareHeaders(struct DB *db);
 
 static int indexLines(struct DB *db);
 
-static int makeDB(struct DB *db, FILE *f)
+static void prepareAppend(struct DB *db);
+
+static int makeDB(struct DB *db, FILE *f, const char *filename)
 {
     db->vfs = VFS_CSV;
     db->file = f;
+    db->line_indices = NULL;
+    db->appended_from = -1;
+
+    openOffsetsFile(db, filename);
 
     prepareHeaders(db);
 
@@ -57,19 +64,26 @@ int csv_openDB(struct DB *db, const char *filename, char **resolved)
         {
             *resolved = realpath(buffer, *resolved);
         }
+
+        return makeDB(db, f, buffer);
     }
 
-    return makeDB(db, f);
+    return makeDB(db, f, filename);
 }
 
 void csv_closeDB(struct DB *db)
 {
     if (db->line_indices != NULL)
     {
-        free(db->line_indices);
+        if (!isOffsetsMapped(db, db->line_indices))
+        {
+            free(db->line_indices);
+        }
         db->line_indices = NULL;
     }
 
+    closeOffsetsFile(db);
+
     if (db->fields != NULL)
     {
         free(db->fields);
@@ -94,16 +108,17 @@ int csv_getRecordCount(struct DB *db)
 }
 
 /**
+ * Counts lines from byte_offset to the end of the file
  * TODO: Very bad! Presumes no embedded '\n'
  */
-static int countLines(FILE *f)
+static int countLines(FILE *f, long byte_offset)
 {
     size_t buffer_size = 1024;
     int count = 0;
     char buffer[buffer_size];
     size_t read_size;
 
-    fseek(f, 0, SEEK_SET);
+    fseek(f, byte_offset, SEEK_SET);
 
     do
     {
@@ -166,25 +181,68 @@ static int measureLine(FILE *f, size_t byte_offset)
 
 static int indexLines(struct DB *db)
 {
-    int line_count = countLines(db->file);
+    long offset_count;
+
+    // First index can come straight from a valid sidecar file
+    if (db->line_indices == NULL)
+    {
+        long *offsets = getOffsets(db, &offset_count);
+
+        if (offsets != NULL)
+        {
+            db->line_indices = offsets;
+            db->_record_count = offset_count - 2;
+
+            return offset_count - 1;
+        }
+    }
+
+    // After an append only the new rows need scanning. Start from the last
+    // record already indexed as it might not have had a trailing '\n' then.
+    int count = 0;
+    long pos = 0;
+    long previous_count = 0;
+
+    if (db->line_indices != NULL && db->appended_from >= 0)
+    {
+        count = db->appended_from;
+        pos = db->line_indices[count];
+        previous_count = count + 2;
+    }
+    else if (db->line_indices != NULL)
+    {
+        if (!isOffsetsMapped(db, db->line_indices))
+        {
+            free(db->line_indices);
+        }
+
+        db->line_indices = NULL;
+    }
+
+    db->appended_from = -1;
+
+    int line_count = count + countLines(db->file, pos);
 
     db->_record_count = line_count - 1;
 
-    // Might be re-indexing due to insert
-    if (db->line_indices != NULL)
+    long *line_indices = realloc(
+        db->line_indices,
+        (sizeof db->line_indices[0]) * (line_count + 1)
+    );
+
+    if (line_indices == NULL)
     {
-        free(db->line_indices);
+        fprintf(stderr, "Unable to allocate line indices\n");
+        exit(-1);
     }
 
-    db->line_indices = malloc((sizeof db->line_indices[0]) * (line_count + 1));
+    db->line_indices = line_indices;
 
     size_t buffer_size = 1024;
-    int count = 0;
     char buffer[buffer_size];
     size_t read_size;
-    long pos = 0;
 
-    fseek(db->file, 0, SEEK_SET);
+    fseek(db->file, pos, SEEK_SET);
 
     db->line_indices[count] = pos;
 
@@ -223,6 +281,15 @@ static int indexLines(struct DB *db)
         db->line_indices[++count] = pos;
     }
 
+    if (previous_count > 0)
+    {
+        extendOffsets(db, db->line_indices, previous_count, count + 1);
+    }
+    else
+    {
+        saveOffsets(db, db->line_indices, count + 1);
+    }
+
     return count;
 }
 
@@ -550,7 +617,7 @@ enum IndexSearchType csv_findIndex(
 
     if (fn == FUNC_UNIQUE || fn == FUNC_INDEX)
     {
-        // Explicit index name, with or without '.csv'
+        // Explicit index name, with or without '.csv' or '.idx'
 
         strcpy(index_filename, field_name);
         f = fopen(index_filename, "r");
@@ -562,6 +629,13 @@ enum IndexSearchType csv_findIndex(
             f = fopen(index_filename, "r");
         }
 
+        if (!f)
+        {
+            // Then try a binary index
+            strcpy(index_filename + field_len, ".idx");
+            f = fopen(index_filename, "r");
+        }
+
         if (f && fn == FUNC_UNIQUE)
         {
             found_unique = 1;
@@ -583,25 +657,24 @@ enum IndexSearchType csv_findIndex(
         strncpy(table_filename, table_name, t_len);
         table_filename[t_len] = '\0';
 
-        sprintf(
-            index_filename,
-            "%s__%s.unique.csv",
-            table_filename,
-            field_name);
-        f = fopen(index_filename, "r");
+        // Binary indexes are preferred over CSV indexes of the same kind
+        const char *unique_names[] = {"%s__%s.unique.idx", "%s__%s.unique.csv"};
+        const char *index_names[] = {"%s__%s.index.idx", "%s__%s.index.csv"};
+
+        for (int i = 0; !f && i < 2; i++)
+        {
+            sprintf(index_filename, unique_names[i], table_filename, field_name);
+            f = fopen(index_filename, "r");
+        }
 
         if (f)
         {
             found_unique = 1;
         }
 
-        if (!f && index_type_flags == INDEX_ANY)
+        for (int i = 0; !f && index_type_flags == INDEX_ANY && i < 2; i++)
         {
-            sprintf(
-                index_filename,
-                "%s__%s.index.csv",
-                table_filename,
-                field_name);
+            sprintf(index_filename, index_names[i], table_filename, field_name);
             f = fopen(index_filename, "r");
         }
     }
@@ -745,16 +818,7 @@ int csv_fromQuery(
 
 int csv_insertRow(struct DB *db, const char *row)
 {
-    fseek(db->file, -1, SEEK_END);
-
-    // Make sure previous record ended with \n
-    if (fgetc(db->file) != '\n')
-    {
-        fseek(db->file, 0, SEEK_END);
-        fputc('\n', db->file);
-    }
-
-    fseek(db->file, 0, SEEK_END);
+    prepareAppend(db);
 
     if (fputs(row, db->file) < 0)
     {
@@ -763,7 +827,8 @@ int csv_insertRow(struct DB *db, const char *row)
 
     fputc('\n', db->file);
 
-    indexLines(db);
+    // Line indices are extended on the next read
+    db->_record_count = -1;
 
     return 0;
 }
@@ -775,16 +840,68 @@ int csv_insertFromQuery(
 {
     int flags = OUTPUT_FORMAT_COMMA;
 
-    fseek(db->file, 0, SEEK_END);
+    prepareAppend(db);
 
     int result = select_query(query, flags, db->file, end_ptr);
 
+    db->_record_count = -1;
+
     if (result < 0)
     {
         return -1;
     }
 
-    indexLines(db);
-
     return 0;
 }
+
+/**
+ * Positions the stream at the end of the file ready for writing. Consecutive
+ * inserts leave it there so they are buffered into one write rather than each
+ * being flushed by a seek. Any read goes through indexLines() first, which
+ * ends the run of appends.
+ */
+static void prepareAppend(struct DB *db)
+{
+    if (db->appended_from >= 0)
+    {
+        return;
+    }
+
+    if (db->line_indices != NULL && db->_record_count >= 0)
+    {
+        // Keep what's already indexed so only the new rows need scanning
+        if (isOffsetsMapped(db, db->line_indices))
+        {
+            size_t size = (sizeof db->line_indices[0]) * (db->_record_count + 2);
+            long *line_indices = malloc(size);
+
+            if (line_indices == NULL)
+            {
+                fprintf(stderr, "Unable to allocate line indices\n");
+                exit(-1);
+            }
+
+            memcpy(line_indices, db->line_indices, size);
+            db->line_indices = line_indices;
+        }
+
+        db->appended_from = db->_record_count;
+    }
+    else
+    {
+        db->appended_from = 0;
+    }
+
+    invalidateOffsets(db);
+
+    fseek(db->file, -1, SEEK_END);
+
+    // Make sure previous record ended with \n
+    if (fgetc(db->file) != '\n')
+    {
+        fseek(db->file, 0, SEEK_END);
+        fputc('\n', db->file);
+    }
+
+    fseek(db->file, 0, SEEK_END);
+}
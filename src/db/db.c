@@ -6,6 +6,9 @@
 #include "csv.h"
 #include "csv-mem.h"
 #include "csv-mmap.h"
+#include "csv-stream.h"
+#include "csv-cache.h"
+#include "binary-index.h"
 #include "calendar.h"
 #include "sequence.h"
 #include "sample.h"
@@ -16,7 +19,11 @@
 #include "tsv-mem.h"
 #include "wsv-mem.h"
 #include "col-mem.h"
+#include "parallel-scan.h"
+#include "zone-map.h"
+#include "table-cache.h"
 #include "../evaluate/predicates.h"
+#include "../evaluate/value.h"
 #include "../evaluate/evaluate.h"
 #include "../query/result.h"
 #include "db.h"
@@ -24,12 +31,13 @@
 #include "../evaluate/function.h"
 #include "../debug.h"
 
+static int openCSV (struct DB *db, const char *filename, char **resolved);
+
 struct VFS VFS_Table[VFS_COUNT] = {
     [VFS_NULL] = {
         0
     },
     [VFS_CSV] = {
-        .openDB = &csv_openDB,
         .closeDB = &csv_closeDB,
         .getFieldIndex = &csv_getFieldIndex,
         .getFieldName = &csv_getFieldName,
@@ -40,14 +48,41 @@ struct VFS VFS_Table[VFS_COUNT] = {
         .insertFromQuery = &csv_insertFromQuery,
     },
     [VFS_CSV_MEM] = {
-        .openDB = &csvMem_openDB,
         .closeDB = &csvMem_closeDB,
         .getFieldIndex = &csvMem_getFieldIndex,
         .getFieldName = &csvMem_getFieldName,
         .getRecordCount = &csvMem_getRecordCount,
+        .getRecordCountUpTo = &csvMem_getRecordCountUpTo,
         .getRecordValue = &csvMem_getRecordValue,
+        .getRecordView = &csvMem_getRecordView,
         .insertRow = &csvMem_insertRow,
     },
+    [VFS_CSV_STREAM] = {
+        .closeDB = &csvStream_closeDB,
+        .getFieldIndex = &csvMem_getFieldIndex,
+        .getFieldName = &csvMem_getFieldName,
+        .getRecordCount = &csvStream_getRecordCount,
+        .getRecordCountUpTo = &csvStream_getRecordCountUpTo,
+        .getRecordValue = &csvStream_getRecordValue,
+        .releaseRecords = &csvStream_releaseRecords,
+    },
+    [VFS_CSV_CACHE] = {
+        .closeDB = &csvCache_closeDB,
+        .getFieldIndex = &csvMem_getFieldIndex,
+        .getFieldName = &csvMem_getFieldName,
+        .getRecordCount = &csvCache_getRecordCount,
+        .getRecordValue = &csvCache_getRecordValue,
+        .getRecordView = &csvCache_getRecordView,
+        .fullTableAccess = &csvCache_fullTableAccess,
+    },
+    [VFS_BINARY_INDEX] = {
+        .closeDB = &binaryIndex_closeDB,
+        .getFieldIndex = &csvMem_getFieldIndex,
+        .getFieldName = &csvMem_getFieldName,
+        .getRecordCount = &binaryIndex_getRecordCount,
+        .getRecordValue = &binaryIndex_getRecordValue,
+        .indexSearch = &binaryIndex_indexSearch,
+    },
     [VFS_VIEW] = {
         .openDB = &view_openDB,
     },
@@ -59,6 +94,7 @@ struct VFS VFS_Table[VFS_COUNT] = {
         .getFieldName = &calendar_getFieldName,
         .getRecordCount = &calendar_getRecordCount,
         .getRecordValue = &calendar_getRecordValue,
+        .getRecordTyped = &calendar_getRecordTyped,
         .findIndex = &calendar_findIndex,
         .fullTableAccess = &calendar_fullTableAccess,
         .indexSearch = &calendar_indexSearch,
@@ -141,12 +177,13 @@ struct VFS VFS_Table[VFS_COUNT] = {
     #endif
     #ifdef COMPILE_CSV_MMAP
     [VFS_CSV_MMAP] = {
-        .openDB = &csvMmap_openDB,
         .closeDB = &csvMmap_closeDB,
         .getFieldIndex = &csvMmap_getFieldIndex,
         .getFieldName = &csvMmap_getFieldName,
         .getRecordCount = &csvMmap_getRecordCount,
         .getRecordValue = &csvMmap_getRecordValue,
+        .getRecordView = &csvMmap_getRecordView,
+        .adviseAccess = &csvMmap_adviseAccess,
     },
     #endif
     [VFS_TEMP] = {
@@ -165,12 +202,34 @@ struct VFS VFS_Table[VFS_COUNT] = {
  * @return 0 on success, -1 on failure
  */
 int openDB (struct DB *db, const char *filename, char **resolved) {
+    return tableCache_openDB(db, filename, resolved);
+}
+
+/**
+ * @brief openDB() without going through the table cache
+ */
+int openDBUncached (struct DB *db, const char *filename, char **resolved) {
     // Process explicit CSV_MEM first
     if (strncmp(filename, "memory:", 7) == 0) {
         return csvMem_openDB(db, filename + 7, resolved);
     }
 
+    // Binary index files are only ever opened by their full name
+    if (binaryIndex_isBinaryIndex(filename)) {
+        return binaryIndex_openDB(db, filename, resolved);
+    }
+
     for (enum VFSType i = 1; i < VFS_COUNT; i++) {
+        // Plain CSV files are claimed at this point, ahead of views and
+        // virtual tables, by whichever CSV VFS suits the file
+        if (i == VFS_CSV_MMAP) {
+            if (openCSV(db, filename, resolved) == 0) {
+                return 0;
+            }
+
+            continue;
+        }
+
         int (*vfs_openDB) (struct DB *, const char *filename, char **resolved)
             = VFS_Table[i].openDB;
 
@@ -183,44 +242,81 @@ int openDB (struct DB *db, const char *filename, char **resolved) {
         }
     }
 
-    // None of the other VFSs wanted to open this DB.
-    // Now we'll determine whether to use VFS_CSV or VFS_CSV_MEM.
+    return -1;
+}
 
+/**
+ * @brief Choose a CSV VFS for the file: pipes are read as a stream, files
+ * with an up to date columnar cache are read from the cache and anything
+ * else seekable is mapped, whatever its size. Without mmap support,
+ * smaller files are read into memory and larger ones are read from disk as
+ * needed.
+ *
+ * @return int 0 on success, -1 on failure
+ */
+static int openCSV (struct DB *db, const char *filename, char **resolved) {
     FILE *f;
+    char buffer[FILENAME_MAX];
+    const char *path = filename;
 
     if (strcmp(filename, "stdin") == 0) {
         f = stdin;
     }
     else {
         f = fopen(filename, "r");
-    }
-
-    // We haven't found the file yet. Try adding '.csv' and checking again.
-    if (!f) {
-        char buffer[FILENAME_MAX];
-        sprintf(buffer, "%s.csv", filename);
-        f = fopen(buffer, "r");
 
+        // We haven't found the file yet. Try adding '.csv' and checking again.
         if (!f) {
-            return -1;
+            sprintf(buffer, "%s.csv", filename);
+            f = fopen(buffer, "r");
+
+            if (!f) {
+                return -1;
+            }
+
+            path = buffer;
+        }
+
+        if (resolved != NULL) {
+            *resolved = realpath(path, *resolved);
         }
 
         if (debug_verbosity > 1) {
-            char * path = realpath(buffer, NULL);
-            fprintf(stderr, "Resolved path: %s\n", path);
+            char * real = realpath(path, NULL);
+            fprintf(stderr, "Resolved path: %s\n", real);
+            free(real);
         }
     }
 
     // Try to seek to see if we have a stream
     if (fseek(f, 0, SEEK_SET)) {
         // File is not seekable
-        // Must use VFS_CSV_MEM
-        int result = csvMem_makeDB(db, f);
+        // VFS_CSV_STREAM reads it as records are needed
+        return csvStream_makeDB(db, f);
+    }
+
+    // stdin redirected from a file is always read into memory
+    if (f == stdin) {
+        return csvMem_makeDB(db, f);
+    }
+
+    // Columnar cache written by CREATE CACHE, if it's still up to date
+    if (csvCache_openDB(db, path) == 0) {
         fclose(f);
-        return result;
+        return 0;
+    }
+
+    #ifdef COMPILE_CSV_MMAP
+    if (csvMmap_makeDB(db, f, path) == 0) {
+        fclose(f);
+        csvCache_autoCreate(db, path);
+        return 0;
     }
 
-    // OK so we don't have a stream but memory access could still be 20x faster
+    // e.g. empty file
+    rewind(f);
+    #endif
+
     // Seek to end get file size; if it's below limit then use faster memory
     // implementation.
     fseek(f, 0, SEEK_END);
@@ -233,8 +329,10 @@ int openDB (struct DB *db, const char *filename, char **resolved) {
         return result;
     }
 
+    fclose(f);
+
     // Fallback to CSV
-    return csv_openDB(db, filename, resolved);
+    return csv_openDB(db, path, NULL);
 }
 
 void closeDB (struct DB *db) {
@@ -242,6 +340,11 @@ void closeDB (struct DB *db) {
         return;
     }
 
+    // Shared copies are closed by the cache itself
+    if (tableCache_release(db)) {
+        return;
+    }
+
     void (*vfs_closeDB) (struct DB *) = VFS_Table[db->vfs].closeDB;
 
     if (vfs_closeDB != NULL) {
@@ -289,6 +392,53 @@ int getRecordCount (struct DB *db) {
     return 0;
 }
 
+/**
+ * @brief Record count for readers which only need to look ahead a little.
+ * VFSs which index lazily don't index past max_count records. Streams may
+ * return fewer than max_count before their end, but always more than the
+ * released records unless the stream has ended.
+ *
+ * @return int record count, or max_count if there are at least that many
+ */
+int getRecordCountUpTo (struct DB *db, int max_count) {
+    int (*vfs_getRecordCountUpTo) (struct DB *, int)
+        = VFS_Table[db->vfs].getRecordCountUpTo;
+
+    if (vfs_getRecordCountUpTo != NULL) {
+        return vfs_getRecordCountUpTo(db, max_count);
+    }
+
+    int record_count = getRecordCount(db);
+
+    return record_count < max_count ? record_count : max_count;
+}
+
+/**
+ * @brief Records before rowid won't be read again by the current query, so
+ * VFSs reading from a stream may discard them
+ */
+void releaseRecords (struct DB *db, int rowid) {
+    void (*vfs_releaseRecords) (struct DB *, int)
+        = VFS_Table[db->vfs].releaseRecords;
+
+    if (vfs_releaseRecords != NULL) {
+        vfs_releaseRecords(db, rowid);
+    }
+}
+
+/**
+ * @brief Hint at how the table is about to be read, so VFSs backed by the
+ * page cache can tune read-ahead
+ */
+void adviseAccess (struct DB *db, enum AccessPattern pattern) {
+    void (*vfs_adviseAccess) (struct DB *, enum AccessPattern)
+        = VFS_Table[db->vfs].adviseAccess;
+
+    if (vfs_adviseAccess != NULL) {
+        vfs_adviseAccess(db, pattern);
+    }
+}
+
 /**
  * Returns the number of bytes read, or -1 on error
  */
@@ -299,10 +449,11 @@ int getRecordValue (
     char *value,
     size_t value_max_length
 ) {
-    // A NULL rowid could come from a LEFT JOIN
-    if (record_index == ROWID_NULL) {
+    // A NULL rowid could come from a LEFT JOIN. No other negative index is
+    // a record either, and no VFS should be asked for one.
+    if (record_index < 0) {
         value[0] = '\0';
-        return 0;
+        return -1;
     }
 
     // This is the only field we can handle generically
@@ -326,6 +477,160 @@ int getRecordValue (
     return -1;
 }
 
+/**
+ * @brief Get a field value without copying it where the VFS allows. Otherwise
+ * the value is copied to buffer as with getRecordValue().
+ *
+ * @param value OUT points to the value. NOT nul terminated unless it points to
+ * buffer.
+ * @param buffer fallback storage
+ * @param buffer_length
+ * @return int length of value; -1 on error
+ */
+int getRecordView (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    const char **value,
+    char *buffer,
+    size_t buffer_length
+) {
+    int (*vfs_getRecordView) (struct DB *, int, int, const char **)
+        = VFS_Table[db->vfs].getRecordView;
+
+    if (
+        vfs_getRecordView != NULL
+        && record_index >= 0
+        && field_index >= 0
+    ) {
+        int length = vfs_getRecordView(db, record_index, field_index, value);
+
+        if (length >= 0) {
+            // Truncate the same way a copy would be
+            if ((size_t)length >= buffer_length) {
+                length = buffer_length - 1;
+            }
+
+            return length;
+        }
+    }
+
+    *value = buffer;
+
+    if (
+        getRecordValue(
+            db,
+            record_index,
+            field_index,
+            buffer,
+            buffer_length
+        ) < 0
+    ) {
+        return -1;
+    }
+
+    return strlen(buffer);
+}
+
+/**
+ * @brief Get a field as a typed value where the VFS can produce one without
+ * going through text. The value is the same as parseValue() would give.
+ *
+ * @param value OUT text points to buffer
+ * @param buffer receives the field's text
+ * @param buffer_length
+ * @return int 0 on success; -1 if the VFS can't, in which case the field
+ * should be evaluated as text
+ */
+int getRecordTyped (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    struct Value *value,
+    char *buffer,
+    size_t buffer_length
+) {
+    int (*vfs_getRecordTyped) (
+        struct DB *,
+        int,
+        int,
+        struct Value *,
+        char *,
+        size_t
+    ) = VFS_Table[db->vfs].getRecordTyped;
+
+    if (
+        vfs_getRecordTyped == NULL
+        || record_index < 0
+        || field_index < 0
+    ) {
+        return -1;
+    }
+
+    return vfs_getRecordTyped(
+        db,
+        record_index,
+        field_index,
+        value,
+        buffer,
+        buffer_length
+    );
+}
+
+/**
+ * @brief Guess a column's type from its first few rows. The result is only a
+ * hint for parseValueAs() so a wrong guess costs speed, never correctness.
+ *
+ * @return enum ValueType VALUE_UNKNOWN if the table can't be sampled cheaply,
+ * the column is empty or the sampled values disagree
+ */
+enum ValueType inferFieldType (struct DB *db, int field_index) {
+    if (
+        db == NULL
+        || (
+            db->vfs != VFS_CSV_MEM
+            && db->vfs != VFS_CSV_MMAP
+            && db->vfs != VFS_CSV_CACHE
+            && db->vfs != VFS_TSV_MEM
+            && db->vfs != VFS_WSV_MEM
+        )
+    ) {
+        return VALUE_UNKNOWN;
+    }
+
+    int record_count = getRecordCount(db);
+
+    if (record_count > FIELD_TYPE_SAMPLE_ROWS) {
+        record_count = FIELD_TYPE_SAMPLE_ROWS;
+    }
+
+    enum ValueType type = VALUE_UNKNOWN;
+
+    for (int i = 0; i < record_count; i++) {
+        char text[MAX_VALUE_LENGTH];
+        struct Value value;
+
+        if (getRecordValue(db, i, field_index, text, MAX_VALUE_LENGTH) < 0) {
+            return VALUE_UNKNOWN;
+        }
+
+        parseValue(&value, text);
+
+        if (value.type == VALUE_NULL) {
+            continue;
+        }
+
+        if (type == VALUE_UNKNOWN) {
+            type = value.type;
+        }
+        else if (type != value.type) {
+            return VALUE_UNKNOWN;
+        }
+    }
+
+    return type;
+}
+
 /**
  * @brief Searches for an index file with an explict name `x` i.e. UNIQUE(x) or
  * INDEX(x) or the autogenerated name `table__field`.
@@ -358,7 +663,15 @@ enum IndexSearchType findIndex(
     }
     #endif
 
-    return csv_findIndex(db, table_name, node, index_type_flags, resolved);
+    enum IndexSearchType result
+        = csv_findIndex(db, table_name, node, index_type_flags, resolved);
+
+    // Indexes are binary searched
+    if (db != NULL && result != INDEX_NONE) {
+        adviseAccess(db, ACCESS_RANDOM);
+    }
+
+    return result;
 }
 
 /**
@@ -378,6 +691,8 @@ int fullTableAccess (
         exit(-1);
     }
 
+    adviseAccess(db, ACCESS_SEQUENTIAL);
+
     int (*vfs_fullTableAccess) (
         struct DB *,
         int,
@@ -398,12 +713,54 @@ int fullTableAccess (
 
     // VFS-agnostic implementation
 
+    struct ZoneFilter zone_filter;
+    struct ZoneFilter *zones = NULL;
+
+    if (
+        zoneMap_getFilter(
+            db,
+            predicates,
+            predicate_count,
+            limit_value,
+            &zone_filter
+        ) == 0
+    ) {
+        zones = &zone_filter;
+    }
+
+    int parallel_count = parallelTableAccess(
+        db,
+        row_list,
+        predicates,
+        predicate_count,
+        limit_value,
+        zones
+    );
+
+    if (parallel_count >= 0) {
+        if (zones != NULL) {
+            zoneMap_freeFilter(zones);
+        }
+
+        return parallel_count;
+    }
+
     int record_count = getRecordCount(db);
 
     struct Table table;
     table.db = db;
 
     for (int i = 0; i < record_count; i++) {
+        // Skip the whole block if nothing in it can match
+        if (
+            zones != NULL
+            && i % zones->block_rows == 0
+            && zones->skip[i / zones->block_rows]
+        ) {
+            i += zones->block_rows - 1;
+            continue;
+        }
+
         int matching = 1;
 
         if (predicate_count > 0) {
@@ -427,6 +784,10 @@ int fullTableAccess (
         }
     }
 
+    if (zones != NULL) {
+        zoneMap_freeFilter(zones);
+    }
+
     return getRowList(row_list)->row_count;
 }
 
@@ -2,6 +2,8 @@
 
 int openDB (struct DB *db, const char *filename, char **resolved);
 
+int openDBUncached (struct DB *db, const char *filename, char **resolved);
+
 void closeDB (struct DB *db);
 
 int getFieldIndex (struct DB *db, const char *field);
@@ -10,6 +12,12 @@ char * getFieldName (struct DB *db, int field_index);
 
 int getRecordCount (struct DB *db);
 
+int getRecordCountUpTo (struct DB *db, int max_count);
+
+void releaseRecords (struct DB *db, int rowid);
+
+void adviseAccess (struct DB *db, enum AccessPattern pattern);
+
 int getRecordValue (
     struct DB *db,
     int record_index,
@@ -18,6 +26,26 @@ int getRecordValue (
     size_t value_max_length
 );
 
+int getRecordView (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    const char **value,
+    char *buffer,
+    size_t buffer_length
+);
+
+int getRecordTyped (
+    struct DB *db,
+    int record_index,
+    int field_index,
+    struct Value *value,
+    char *buffer,
+    size_t buffer_length
+);
+
+enum ValueType inferFieldType (struct DB *db, int field_index);
+
 enum IndexSearchType findIndex(
     struct DB *db,
     const char *table_name,
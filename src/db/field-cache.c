@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "field-cache.h"
+#include "../structs.h"
+#include "../limits.h"
+#include "../functions/csv.h"
+#include "../functions/scan.h"
+
+/**
+ * Field start offsets for CSV rows held in memory (VFS_CSV_MEM and
+ * VFS_CSV_MMAP).
+ *
+ * Entries store the offset of the field from the start of its line plus one,
+ * so that zero (from calloc) means "not yet known". A column is only allocated
+ * once a query asks for that field, and the total size is capped at
+ * FIELD_CACHE_LIMIT. Anything which doesn't fit is parsed from the line as
+ * before.
+ */
+
+#define FIELD_CACHE_MIN_ROWS 1024
+
+static const char *findField (struct DB *db, int rowid, int field_index);
+
+static struct FieldCache *getCache (struct DB *db);
+
+static int reserveRows (struct DB *db, struct FieldCache *cache, int rowid);
+
+static unsigned int *getColumn (struct FieldCache *cache, int field_index);
+
+static int copyField (const char *ptr, char *value, size_t value_max_length);
+
+/**
+ * @brief Drop-in replacement for csv_get_record_from_line() which remembers
+ * where fields start. db->line_indices must already cover rowid.
+ *
+ * @return int number of bytes written including NUL; -1 if field not found
+ */
+int fieldCache_getRecordValue (
+    struct DB *db,
+    int rowid,
+    int field_index,
+    char *value,
+    size_t value_max_length
+) {
+    const char *ptr = findField(db, rowid, field_index);
+
+    if (ptr == NULL) {
+        *value = '\0';
+        return -1;
+    }
+
+    return copyField(ptr, value, value_max_length);
+}
+
+/**
+ * @brief Point directly at a field in db->data. Only plain (unquoted) fields
+ * can be returned this way. db->line_indices must already cover rowid.
+ *
+ * @param value OUT pointer to start of field, NOT nul terminated
+ * @return int length of field; -1 if a view isn't possible
+ */
+int fieldCache_getRecordView (
+    struct DB *db,
+    int rowid,
+    int field_index,
+    const char **value
+) {
+    const char *ptr = findField(db, rowid, field_index);
+
+    if (ptr == NULL || *ptr == '"') {
+        return -1;
+    }
+
+    const char *end = scanFind(ptr, ",\n\r\"");
+
+    if (*end == '"' || (end == ptr && *end != ',')) {
+        return -1;
+    }
+
+    *value = ptr;
+
+    return end - ptr;
+}
+
+/**
+ * @brief Stop the cache from allocating or growing so that different rows can
+ * be read concurrently. Entries for already allocated fields are still filled
+ * in (each row only touches its own entry). db must be fully indexed.
+ *
+ * @return int 0 on success; -1 if the cache can't be used from threads
+ */
+int fieldCache_freeze (struct DB *db) {
+    struct FieldCache *cache = getCache(db);
+
+    if (cache == NULL) {
+        return -1;
+    }
+
+    if (db->_record_count > 0) {
+        reserveRows(db, cache, db->_record_count - 1);
+    }
+
+    cache->frozen = 1;
+
+    return 0;
+}
+
+void fieldCache_thaw (struct DB *db) {
+    if (db->field_cache != NULL) {
+        db->field_cache->frozen = 0;
+    }
+}
+
+void fieldCache_free (struct DB *db) {
+    struct FieldCache *cache = db->field_cache;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < cache->field_count; i++) {
+        free(cache->columns[i]);
+    }
+
+    free(cache->columns);
+    free(cache);
+
+    db->field_cache = NULL;
+}
+
+/**
+ * @brief Find the start of a field, using and filling in the cache
+ *
+ * @return const char* NULL if the row doesn't have that many fields
+ */
+static const char *findField (struct DB *db, int rowid, int field_index) {
+    const char *line = db->data + db->line_indices[rowid];
+
+    if (field_index == 0) {
+        return line;
+    }
+
+    struct FieldCache *cache = getCache(db);
+
+    if (cache != NULL && reserveRows(db, cache, rowid) < 0) {
+        cache = NULL;
+    }
+
+    unsigned int *column = cache != NULL ? getColumn(cache, field_index) : NULL;
+
+    if (column != NULL && column[rowid] != 0) {
+        return line + column[rowid] - 1;
+    }
+
+    // Start from the nearest field we already know about on this row
+    int current_index = 0;
+    const char *ptr = line;
+
+    for (int i = field_index - 1; cache != NULL && i > 0; i--) {
+        if (cache->columns[i] != NULL && cache->columns[i][rowid] != 0) {
+            current_index = i;
+            ptr = line + cache->columns[i][rowid] - 1;
+            break;
+        }
+    }
+
+    while (current_index < field_index) {
+        ptr = csv_skip_field(ptr);
+
+        if (*ptr != ',') {
+            return NULL;
+        }
+
+        ptr++;
+        current_index++;
+
+        if (cache == NULL) {
+            continue;
+        }
+
+        // Record any other requested fields we pass along the way
+        unsigned int *passed = cache->columns[current_index];
+        size_t offset = ptr - line;
+
+        if (passed != NULL && offset < UINT32_MAX) {
+            passed[rowid] = offset + 1;
+        }
+    }
+
+    return ptr;
+}
+
+static struct FieldCache *getCache (struct DB *db) {
+    if (db->field_cache != NULL) {
+        return db->field_cache;
+    }
+
+    struct FieldCache *cache = calloc(1, sizeof(*cache));
+
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    cache->columns = calloc(db->field_count, sizeof(*cache->columns));
+
+    if (cache->columns == NULL) {
+        free(cache);
+        return NULL;
+    }
+
+    cache->field_count = db->field_count;
+
+    db->field_cache = cache;
+
+    return cache;
+}
+
+/**
+ * @brief Make sure every allocated column has room for rowid
+ *
+ * @return int 0 on success; -1 if the cache can't grow
+ */
+static int reserveRows (struct DB *db, struct FieldCache *cache, int rowid) {
+    if (rowid < cache->row_capacity) {
+        return 0;
+    }
+
+    if (cache->frozen) {
+        return -1;
+    }
+
+    int new_capacity = cache->row_capacity * 2;
+
+    if (db->_record_count > new_capacity) {
+        new_capacity = db->_record_count;
+    }
+
+    if (rowid >= new_capacity) {
+        new_capacity = rowid + 1;
+    }
+
+    if (new_capacity < FIELD_CACHE_MIN_ROWS) {
+        new_capacity = FIELD_CACHE_MIN_ROWS;
+    }
+
+    size_t column_size = sizeof(**cache->columns) * new_capacity;
+    size_t new_memory = 0;
+
+    for (int i = 0; i < cache->field_count; i++) {
+        if (cache->columns[i] != NULL) {
+            new_memory += column_size;
+        }
+    }
+
+    if (new_memory > FIELD_CACHE_LIMIT) {
+        return -1;
+    }
+
+    size_t old_size = sizeof(**cache->columns) * cache->row_capacity;
+
+    for (int i = 0; i < cache->field_count; i++) {
+        if (cache->columns[i] == NULL) {
+            continue;
+        }
+
+        void *ptr = realloc(cache->columns[i], column_size);
+
+        if (ptr == NULL) {
+            return -1;
+        }
+
+        memset(ptr + old_size, 0, column_size - old_size);
+
+        cache->columns[i] = ptr;
+    }
+
+    cache->row_capacity = new_capacity;
+    cache->memory = new_memory;
+
+    return 0;
+}
+
+/**
+ * @brief Get entries for a field, allocating them on first use
+ *
+ * @return unsigned int* NULL if field is not cached
+ */
+static unsigned int *getColumn (struct FieldCache *cache, int field_index) {
+    if (cache->columns[field_index] != NULL || cache->frozen) {
+        return cache->columns[field_index];
+    }
+
+    size_t column_size = sizeof(**cache->columns) * cache->row_capacity;
+
+    if (cache->memory + column_size > FIELD_CACHE_LIMIT) {
+        return NULL;
+    }
+
+    cache->columns[field_index] = calloc(cache->row_capacity, sizeof(**cache->columns));
+
+    if (cache->columns[field_index] != NULL) {
+        cache->memory += column_size;
+    }
+
+    return cache->columns[field_index];
+}
+
+/**
+ * @brief Copy a single field starting at ptr. Plain fields are copied as a
+ * slice; anything containing quotes goes through the full parser.
+ */
+static int copyField (const char *ptr, char *value, size_t value_max_length) {
+    if (*ptr == '"') {
+        return csv_get_record_from_line(ptr, 0, value, value_max_length);
+    }
+
+    const char *end = scanFind(ptr, ",\n\r\"");
+
+    if (*end == '"') {
+        return csv_get_record_from_line(ptr, 0, value, value_max_length);
+    }
+
+    if (end == ptr && *end != ',') {
+        // Same as csv_get_record_from_line(): nothing left on this line
+        *value = '\0';
+        return -1;
+    }
+
+    size_t length = end - ptr;
+
+    if (length >= value_max_length) {
+        length = value_max_length - 1;
+    }
+
+    memcpy(value, ptr, length);
+    value[length] = '\0';
+
+    return length + 1;
+}
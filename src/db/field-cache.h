@@ -0,0 +1,36 @@
+#include <stddef.h>
+
+#include "../structs.h"
+
+struct FieldCache {
+    /* One entry per row for each field; NULL until that field is requested */
+    unsigned int **columns;
+    int field_count;
+    /* Number of rows allocated in each column */
+    int row_capacity;
+    /* Total bytes allocated to columns */
+    size_t memory;
+    /* While frozen nothing is allocated so rows can be read from threads */
+    int frozen;
+};
+
+int fieldCache_getRecordValue (
+    struct DB *db,
+    int rowid,
+    int field_index,
+    char *value,
+    size_t value_max_length
+);
+
+int fieldCache_getRecordView (
+    struct DB *db,
+    int rowid,
+    int field_index,
+    const char **value
+);
+
+int fieldCache_freeze (struct DB *db);
+
+void fieldCache_thaw (struct DB *db);
+
+void fieldCache_free (struct DB *db);
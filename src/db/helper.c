@@ -3,25 +3,32 @@
 #include <string.h>
 
 #include "../structs.h"
+#include "../functions/scan.h"
 
 void consumeStream (struct DB *db, FILE *stream) {
-    // 4 KB blocks
-    int block_size = 4 * 1024;
+    // Read at least 4 KB at a time
+    size_t block_size = 4 * 1024;
 
-    db->data = NULL;
+    // Double the allocation whenever it fills so each byte is only copied a
+    // constant number of times on average
+    size_t capacity = 64 * 1024;
 
-    int read_size = -1;
-    int block_count = 0;
+    db->data = malloc(capacity + 1);
 
-    int offset = 0;
+    if (db->data == NULL) {
+        fprintf(stderr, "Unable to assign memory");
+        exit(-1);
+    }
+
+    size_t read_size;
+
+    size_t offset = 0;
 
     do {
-        block_count++;
+        if (capacity - offset < block_size) {
+            capacity *= 2;
 
-        if (db->data == NULL) {
-            db->data = malloc(block_size);
-        } else {
-            void * ptr = realloc(db->data, block_size * block_count);
+            void * ptr = realloc(db->data, capacity + 1);
 
             if (ptr == NULL) {
                 fprintf(stderr, "Unable to assign memory");
@@ -31,7 +38,7 @@ void consumeStream (struct DB *db, FILE *stream) {
             db->data = ptr;
         }
 
-        read_size = fread(db->data + offset, 1, block_size, stream);
+        read_size = fread(db->data + offset, 1, capacity - offset, stream);
 
         offset += read_size;
     } while (read_size > 0);
@@ -78,7 +85,19 @@ int indexLines (struct DB *db, int max_lines, char quote_char) {
 
     int quoted = 0;
 
-    while (db->data[i] != '\0') {
+    // Only newlines and quotes are interesting. quote_char might be '\0' in
+    // which case it just terminates the set early.
+    char unquoted_set[] = { '\n', quote_char, '\0' };
+    char quoted_set[] = { quote_char, '\0' };
+
+    while (1) {
+        i = scanFind(db->data + i, quoted ? quoted_set : unquoted_set)
+            - db->data;
+
+        if (db->data[i] == '\0') {
+            break;
+        }
+
         if (db->data[i] == '\n' && !quoted){
             if (count == *max_size) {
                 *max_size *= 2;
@@ -121,7 +140,8 @@ int indexLines (struct DB *db, int max_lines, char quote_char) {
         i++;
     }
 
-    if (db->data[i-1] == '\n') {
+    // No records at all, or the last record ends in a newline
+    if (i == 0 || db->data[i-1] == '\n') {
         count--;
     }
 
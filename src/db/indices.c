@@ -14,6 +14,12 @@ static int indexWalk(
     struct RowList * row_list
 );
 
+static int getSearchPosition (
+    struct DB *index_db,
+    int index_rowid,
+    int search_status
+);
+
 /**
  * Just a unique seek but we know that [index rowid] == [table rowid]
  */
@@ -98,6 +104,8 @@ enum IndexSearchResult indexUniqueSeek (
             MODE_UNIQUE,
             &search_status);
 
+        index_rowid = getSearchPosition(index_db, index_rowid, search_status);
+
         if (predicate_op == OPERATOR_EQ && search_status)
         {
             // We want an exact match but value is not in index
@@ -139,7 +147,7 @@ enum IndexSearchResult indexUniqueSeek (
             int b = indexWalk(
                 index_db,
                 rowid_column,
-                index_rowid + 1,
+                search_status == RESULT_FOUND ? index_rowid + 1 : index_rowid,
                 record_count,
                 row_list);
 
@@ -260,6 +268,12 @@ enum IndexSearchResult indexSeek (
         &search_status1
     );
 
+    lower_index_rowid = getSearchPosition(
+        index_db,
+        lower_index_rowid,
+        search_status1
+    );
+
     if (predicate_op == OPERATOR_EQ && search_status1) {
         // We want an exact match but value is not in index
         // Just bail out now
@@ -279,6 +293,12 @@ enum IndexSearchResult indexSeek (
         &search_status2
     );
 
+    upper_index_rowid = getSearchPosition(
+        index_db,
+        upper_index_rowid,
+        search_status2
+    );
+
     if (predicate_op == OPERATOR_EQ) {
         lower_bound = lower_index_rowid;
         upper_bound = upper_index_rowid + 1;
@@ -335,7 +355,9 @@ enum IndexSearchResult indexSeek (
         int b = indexWalk(
             index_db,
             rowid_column,
-            upper_index_rowid,
+            search_status2 == RESULT_FOUND
+                ? upper_index_rowid + 1
+                : upper_index_rowid,
             record_count,
             row_list
         );
@@ -408,3 +430,26 @@ static int indexWalk(
 
     return upper_index - lower_index;
 }
+
+/**
+ * @brief indexSearch() reports values outside the index as RESULT_NO_ROWS.
+ * Turn that into the position the value would take so it can be used as a
+ * bound.
+ *
+ * @return int index rowid
+ */
+static int getSearchPosition (
+    struct DB *index_db,
+    int index_rowid,
+    int search_status
+) {
+    if (search_status == RESULT_BELOW_MIN) {
+        return 0;
+    }
+
+    if (search_status == RESULT_ABOVE_MAX) {
+        return getRecordCount(index_db);
+    }
+
+    return index_rowid;
+}
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "offsets.h"
+#include "zone-map.h"
+#include "../structs.h"
+
+/**
+ * Sidecar format (`<table>.offsets`), native endian:
+ *
+ *  struct OffsetsHeader
+ *  int64_t offsets[count]
+ *
+ * offsets[0..n-1] are byte offsets of the start of each line in the file
+ * (including the header line) and offsets[n] is the end of the last line.
+ */
+
+#define OFFSETS_MAGIC   "CSVDBOFS"
+#define OFFSETS_VERSION 1
+
+struct OffsetsHeader {
+    char magic[8];
+    int32_t version;
+    int32_t offset_size;
+    int64_t file_size;
+    int64_t file_mtime;
+    int64_t count;
+};
+
+static void mapOffsetsFile (struct OffsetsFile *offsets);
+
+static void getTableFilename (struct OffsetsFile *offsets, char *filename);
+
+/**
+ * @brief Attach sidecar information to a DB. If a sidecar exists and matches
+ * the current size and mtime of `filename` it is mapped into memory.
+ *
+ * @param db
+ * @param filename path of the table file (not the sidecar)
+ */
+void openOffsetsFile (struct DB *db, const char *filename) {
+    db->offsets = NULL;
+
+    struct stat st;
+
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+
+    if (strlen(filename) + sizeof(".offsets") > FILENAME_MAX) {
+        return;
+    }
+
+    struct OffsetsFile *offsets = calloc(1, sizeof(*offsets));
+
+    if (offsets == NULL) {
+        return;
+    }
+
+    sprintf(offsets->filename, "%s.offsets", filename);
+    offsets->file_size = st.st_size;
+    offsets->file_mtime = st.st_mtime;
+
+    mapOffsetsFile(offsets);
+
+    db->offsets = offsets;
+}
+
+void closeOffsetsFile (struct DB *db) {
+    if (db->offsets == NULL) {
+        return;
+    }
+
+    if (db->offsets->map != NULL) {
+        munmap(db->offsets->map, db->offsets->map_size);
+    }
+
+    zoneMap_free(db->offsets->zones);
+
+    free(db->offsets);
+    db->offsets = NULL;
+}
+
+/**
+ * @brief Get the line offsets from a valid sidecar
+ *
+ * @param db
+ * @param count OUT number of entries (line count + 1)
+ * @return long* pointer into the mapping or NULL if there's no valid sidecar
+ */
+long *getOffsets (struct DB *db, long *count) {
+    if (db->offsets == NULL || db->offsets->map == NULL) {
+        return NULL;
+    }
+
+    *count = db->offsets->count;
+
+    return (long *)((struct OffsetsHeader *)db->offsets->map + 1);
+}
+
+/**
+ * @brief Check whether line_indices is owned by the sidecar mapping and so
+ * must not be freed.
+ */
+int isOffsetsMapped (struct DB *db, long *line_indices) {
+    if (db->offsets == NULL || db->offsets->map == NULL) {
+        return 0;
+    }
+
+    return (void *)line_indices == (void *)((struct OffsetsHeader *)db->offsets->map + 1);
+}
+
+/**
+ * @brief Called before the table file is modified through this DB. Drops the
+ * mapping (and any line_indices pointing into it) so that the next index is
+ * rebuilt from the file and a fresh sidecar is written. Zone maps are
+ * dropped too.
+ */
+void invalidateOffsets (struct DB *db) {
+    if (db->offsets == NULL) {
+        return;
+    }
+
+    zoneMap_free(db->offsets->zones);
+    db->offsets->zones = NULL;
+
+    if (db->offsets->map == NULL) {
+        return;
+    }
+
+    if (isOffsetsMapped(db, db->line_indices)) {
+        db->line_indices = NULL;
+    }
+
+    munmap(db->offsets->map, db->offsets->map_size);
+
+    db->offsets->map = NULL;
+    db->offsets->map_size = 0;
+    db->offsets->count = 0;
+}
+
+/**
+ * @brief Write a sidecar for a completely indexed table. Only written for
+ * large files or when a (stale) sidecar already exists. Any failure is
+ * silently ignored; the sidecar is purely an optimisation.
+ *
+ * @param db
+ * @param line_indices
+ * @param count number of entries in line_indices
+ */
+void saveOffsets (struct DB *db, long *line_indices, long count) {
+    struct OffsetsFile *offsets = db->offsets;
+
+    if (offsets == NULL || count < 1) {
+        return;
+    }
+
+    // VFSs which index from the first record (base > 0) don't include the
+    // header line in line_indices
+    long base = offsets->base;
+
+    // Re-check the file now; it may have been appended to since it was opened
+    char table_filename[FILENAME_MAX];
+    getTableFilename(offsets, table_filename);
+
+    struct stat st;
+    if (stat(table_filename, &st) != 0) {
+        return;
+    }
+
+    // Index must describe the file exactly as it is now
+    if (line_indices[count - 1] + base != st.st_size) {
+        return;
+    }
+
+    if (
+        offsets->map != NULL
+        && st.st_size == offsets->file_size
+        && st.st_mtime == offsets->file_mtime
+    ) {
+        // Already up to date
+        return;
+    }
+
+    if (
+        st.st_size < OFFSETS_FILE_LIMIT
+        && access(offsets->filename, F_OK) != 0
+    ) {
+        // Small file and no existing sidecar. Not worth it.
+        return;
+    }
+
+    char tmp_filename[FILENAME_MAX + 8];
+    sprintf(tmp_filename, "%s.%d", offsets->filename, getpid());
+
+    FILE *f = fopen(tmp_filename, "wb");
+
+    if (f == NULL) {
+        return;
+    }
+
+    struct OffsetsHeader header = {0};
+    memcpy(header.magic, OFFSETS_MAGIC, sizeof(header.magic));
+    header.version = OFFSETS_VERSION;
+    header.offset_size = sizeof(*line_indices);
+    header.file_size = st.st_size;
+    header.file_mtime = st.st_mtime;
+    header.count = count;
+
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    if (base == 0) {
+        ok = ok && fwrite(line_indices, sizeof(*line_indices), count, f)
+            == (size_t)count;
+    }
+    else {
+        // Header line is not part of the index; prepend it
+        long start = 0;
+        ok = ok && fwrite(&start, sizeof(start), 1, f) == 1;
+
+        for (long i = 0; ok && i < count; i++) {
+            long offset = line_indices[i] + base;
+            ok = fwrite(&offset, sizeof(offset), 1, f) == 1;
+        }
+
+        header.count = count + 1;
+        ok = ok && fseek(f, 0, SEEK_SET) == 0
+            && fwrite(&header, sizeof(header), 1, f) == 1;
+    }
+
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+
+    // Rename is atomic so concurrent readers see either old or new sidecar
+    if (!ok || rename(tmp_filename, offsets->filename) != 0) {
+        remove(tmp_filename);
+    }
+}
+
+/**
+ * @brief Bring the sidecar up to date after lines were appended to the table.
+ * If the sidecar on disk still holds exactly the first `from` entries only
+ * the new entries and the header are written, otherwise this falls back to
+ * saveOffsets().
+ *
+ * Unlike saveOffsets() the sidecar is modified in place rather than
+ * renamed over, so copying the old entries isn't needed. Existing entries
+ * never change. Readers which already have it mapped only use the count they
+ * validated (see getOffsets()), so they never see the new header or read
+ * beyond their own entries. New entries are written before the header so a
+ * reader opening it in between sees a size mismatch, and rebuilds, until the
+ * sidecar is complete.
+ *
+ * @param db
+ * @param line_indices
+ * @param from number of entries which were indexed before the append
+ * @param count number of entries in line_indices
+ */
+void extendOffsets (struct DB *db, long *line_indices, long from, long count) {
+    struct OffsetsFile *offsets = db->offsets;
+
+    if (offsets == NULL || from < 1 || count <= from || offsets->base != 0) {
+        saveOffsets(db, line_indices, count);
+        return;
+    }
+
+    char table_filename[FILENAME_MAX];
+    getTableFilename(offsets, table_filename);
+
+    struct stat st;
+    if (stat(table_filename, &st) != 0) {
+        return;
+    }
+
+    if (line_indices[count - 1] != st.st_size) {
+        return;
+    }
+
+    FILE *f = fopen(offsets->filename, "r+b");
+
+    if (f == NULL) {
+        saveOffsets(db, line_indices, count);
+        return;
+    }
+
+    struct OffsetsHeader header;
+    long last_offset;
+    struct stat sidecar_st;
+
+    int valid = fread(&header, sizeof(header), 1, f) == 1
+        && memcmp(header.magic, OFFSETS_MAGIC, sizeof(header.magic)) == 0
+        && header.version == OFFSETS_VERSION
+        && header.offset_size == sizeof(*line_indices)
+        && header.count == from
+        && fstat(fileno(f), &sidecar_st) == 0
+        && (size_t)sidecar_st.st_size
+            == sizeof(header) + from * sizeof(*line_indices)
+        && fseek(f, -(long)sizeof(last_offset), SEEK_END) == 0
+        && fread(&last_offset, sizeof(last_offset), 1, f) == 1
+        && last_offset == line_indices[from - 1];
+
+    if (!valid) {
+        fclose(f);
+        saveOffsets(db, line_indices, count);
+        return;
+    }
+
+    header.file_size = st.st_size;
+    header.file_mtime = st.st_mtime;
+    header.count = count;
+
+    int ok = fseek(f, 0, SEEK_END) == 0
+        && fwrite(line_indices + from, sizeof(*line_indices), count - from, f)
+            == (size_t)(count - from)
+        && fflush(f) == 0
+        && fseek(f, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, f) == 1;
+
+    if (fclose(f) != 0 || !ok) {
+        remove(offsets->filename);
+    }
+}
+
+static void getTableFilename (struct OffsetsFile *offsets, char *filename) {
+    size_t len = strlen(offsets->filename) - (sizeof(".offsets") - 1);
+    memcpy(filename, offsets->filename, len);
+    filename[len] = '\0';
+}
+
+/**
+ * @brief mmap the sidecar file if it exists and is valid for the table file
+ */
+static void mapOffsetsFile (struct OffsetsFile *offsets) {
+    int fd = open(offsets->filename, O_RDONLY);
+
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct OffsetsHeader)) {
+        close(fd);
+        return;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return;
+    }
+
+    struct OffsetsHeader *header = map;
+
+    size_t expected_size = sizeof(*header)
+        + header->count * sizeof(long);
+
+    if (
+        memcmp(header->magic, OFFSETS_MAGIC, sizeof(header->magic)) != 0
+        || header->version != OFFSETS_VERSION
+        || header->offset_size != sizeof(long)
+        || header->file_size != offsets->file_size
+        || header->file_mtime != offsets->file_mtime
+        || header->count < 2
+        || (size_t)st.st_size != expected_size
+        || ((long *)(header + 1))[header->count - 1] != offsets->file_size
+    ) {
+        munmap(map, st.st_size);
+        return;
+    }
+
+    offsets->map = map;
+    offsets->map_size = st.st_size;
+    offsets->count = header->count;
+}
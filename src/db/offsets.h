@@ -0,0 +1,36 @@
+#include <stdio.h>
+
+#include "../structs.h"
+
+struct ZoneMap;
+
+struct OffsetsFile {
+    char filename[FILENAME_MAX];
+    /* Size and mtime of the table file when it was opened */
+    long file_size;
+    long file_mtime;
+    /* Offset within the file that line_indices are relative to */
+    long base;
+    /* Mapping of a valid sidecar file, or NULL */
+    void *map;
+    size_t map_size;
+    /* Entries in the mapping when it was validated. The header is not read
+     * again since another process may extend the sidecar in place. */
+    long count;
+    /* Zone maps for columns of this table (see zone-map.c); may be NULL */
+    struct ZoneMap *zones;
+};
+
+void openOffsetsFile (struct DB *db, const char *filename);
+
+void closeOffsetsFile (struct DB *db);
+
+long *getOffsets (struct DB *db, long *count);
+
+int isOffsetsMapped (struct DB *db, long *line_indices);
+
+void saveOffsets (struct DB *db, long *line_indices, long count);
+
+void extendOffsets (struct DB *db, long *line_indices, long from, long count);
+
+void invalidateOffsets (struct DB *db);
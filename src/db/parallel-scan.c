@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "parallel-scan.h"
+#include "field-cache.h"
+#include "zone-map.h"
+#include "db.h"
+#include "../structs.h"
+#include "../evaluate/evaluate.h"
+#include "../evaluate/predicates.h"
+#include "../query/result.h"
+
+/**
+ * Multi-threaded version of the VFS-agnostic fullTableAccess().
+ *
+ * The rowid range is split into one contiguous partition per thread. Workers
+ * collect matching rowids into their own buffers (they never touch the
+ * RowList pool) and the buffers are appended to the output RowList in
+ * partition order, so rows come out in the same order as a sequential scan.
+ *
+ * With a limit, a worker which finds enough rows publishes its partition
+ * number as the cutoff. Workers on later partitions can't contribute to the
+ * result any more so they give up.
+ */
+
+struct ScanShared {
+    struct DB *db;
+    struct Node *predicates;
+    int predicate_count;
+    int limit_value;
+    /* Blocks which can be skipped; may be NULL */
+    struct ZoneFilter *zones;
+    /* Lowest partition which has found limit_value rows */
+    int cutoff;
+};
+
+struct ScanWorker {
+    pthread_t thread;
+    struct ScanShared *shared;
+    int partition;
+    int start_rowid;
+    int end_rowid;
+    int *rowids;
+    int count;
+    int max_count;
+    /* 0 if the partition was scanned on the calling thread */
+    int is_thread;
+};
+
+static int getThreadCount (int record_count);
+
+static int isThreadSafeVFS (struct DB *db);
+
+static int isThreadSafeNode (struct Node *node);
+
+static void *scanPartition (void *arg);
+
+/**
+ * @brief Evaluate predicates against every row using multiple threads
+ *
+ * @param zones if not NULL, blocks of rows which can't match
+ * @return int number of rows in row_list; -1 if the scan wasn't attempted
+ * (caller should fall back to a sequential scan)
+ */
+int parallelTableAccess (
+    struct DB *db,
+    int row_list,
+    struct Node *predicates,
+    int predicate_count,
+    int limit_value,
+    struct ZoneFilter *zones
+) {
+    if (predicate_count == 0 || !isThreadSafeVFS(db)) {
+        return -1;
+    }
+
+    for (int i = 0; i < predicate_count; i++) {
+        if (!isThreadSafeNode(&predicates[i])) {
+            return -1;
+        }
+    }
+
+    // Also makes sure the table is fully indexed before any threads start
+    int record_count = getRecordCount(db);
+
+    int thread_count = getThreadCount(record_count);
+
+    if (thread_count < 2) {
+        return -1;
+    }
+
+    struct Table table;
+    table.db = db;
+
+    // Evaluate the first row on this thread so that any lazily built VFS
+    // state (such as field cache columns) exists before it is shared.
+    if (evaluateOperatorNodeListAND(&table, ROWLIST_ROWID, 0, predicates, predicate_count)) {
+        appendRowID(getRowList(row_list), 0);
+    }
+
+    if (limit_value >= 0 && getRowList(row_list)->row_count >= (unsigned)limit_value) {
+        return getRowList(row_list)->row_count;
+    }
+
+    int is_field_cache = db->vfs == VFS_CSV_MEM || db->vfs == VFS_CSV_MMAP;
+
+    if (is_field_cache && fieldCache_freeze(db) < 0) {
+        return -1;
+    }
+
+    struct ScanShared shared = {
+        .db = db,
+        .predicates = predicates,
+        .predicate_count = predicate_count,
+        .limit_value = limit_value,
+        .zones = zones,
+        .cutoff = thread_count,
+    };
+
+    struct ScanWorker *workers = calloc(thread_count, sizeof(*workers));
+
+    if (workers == NULL) {
+        fprintf(stderr, "Unable to allocate %d scan workers\n", thread_count);
+        exit(-1);
+    }
+
+    // Row 0 has already been done
+    int remaining = record_count - 1;
+    int rowid = 1;
+
+    for (int i = 0; i < thread_count; i++) {
+        int count = remaining / (thread_count - i);
+
+        workers[i].shared = &shared;
+        workers[i].partition = i;
+        workers[i].start_rowid = rowid;
+        workers[i].end_rowid = rowid + count;
+
+        rowid += count;
+        remaining -= count;
+
+        if (pthread_create(&workers[i].thread, NULL, scanPartition, &workers[i]) != 0) {
+            // Do this partition ourselves
+            scanPartition(&workers[i]);
+            continue;
+        }
+
+        workers[i].is_thread = 1;
+    }
+
+    struct RowList *list = getRowList(row_list);
+
+    for (int i = 0; i < thread_count; i++) {
+        if (workers[i].is_thread) {
+            pthread_join(workers[i].thread, NULL);
+        }
+
+        for (int j = 0; j < workers[i].count; j++) {
+            if (limit_value >= 0 && list->row_count >= (unsigned)limit_value) {
+                break;
+            }
+
+            appendRowID(list, workers[i].rowids[j]);
+        }
+
+        free(workers[i].rowids);
+    }
+
+    free(workers);
+
+    if (is_field_cache) {
+        fieldCache_thaw(db);
+    }
+
+    return list->row_count;
+}
+
+/**
+ * @brief Number of threads to use for a table of this size. Can be set with
+ * the CSVDB_THREADS environment variable, otherwise one per online CPU.
+ */
+static int getThreadCount (int record_count) {
+    int thread_count;
+
+    char *env = getenv("CSVDB_THREADS");
+
+    if (env != NULL) {
+        thread_count = atoi(env);
+    }
+    else {
+        thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    if (thread_count > PARALLEL_SCAN_MAX_THREADS) {
+        thread_count = PARALLEL_SCAN_MAX_THREADS;
+    }
+
+    // Not worth starting threads for small partitions
+    int max_threads = record_count / PARALLEL_SCAN_MIN_ROWS;
+
+    if (thread_count > max_threads) {
+        thread_count = max_threads;
+    }
+
+    return thread_count;
+}
+
+/**
+ * @brief Only VFSs whose getRecordValue() doesn't modify the DB once it has
+ * been fully indexed can be read from multiple threads.
+ */
+static int isThreadSafeVFS (struct DB *db) {
+    return db->vfs == VFS_CSV_MEM
+        || db->vfs == VFS_CSV_MMAP
+        || db->vfs == VFS_TSV_MEM
+        || db->vfs == VFS_WSV_MEM;
+}
+
+/**
+ * @brief RANDOM() draws from the shared rand() sequence so a seeded query
+ * would no longer repeat if rows were evaluated in a different order.
+ */
+static int isThreadSafeNode (struct Node *node) {
+    if (node->function == FUNC_RANDOM) {
+        return 0;
+    }
+
+    for (int i = 0; i < node->child_count; i++) {
+        if (!isThreadSafeNode(&node->children[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void *scanPartition (void *arg) {
+    struct ScanWorker *worker = arg;
+    struct ScanShared *shared = worker->shared;
+
+    struct Table table;
+    table.db = shared->db;
+
+    for (int i = worker->start_rowid; i < worker->end_rowid; i++) {
+        // An earlier partition already has enough rows
+        if (
+            shared->limit_value >= 0
+            && (i & 0x3ff) == 0
+            && __atomic_load_n(&shared->cutoff, __ATOMIC_RELAXED) < worker->partition
+        ) {
+            break;
+        }
+
+        struct ZoneFilter *zones = shared->zones;
+
+        // Move on to the next block if nothing in this one can match
+        if (zones != NULL && zones->skip[i / zones->block_rows]) {
+            i = (i / zones->block_rows + 1) * zones->block_rows - 1;
+            continue;
+        }
+
+        if (
+            !evaluateOperatorNodeListAND(
+                &table,
+                ROWLIST_ROWID,
+                i,
+                shared->predicates,
+                shared->predicate_count
+            )
+        ) {
+            continue;
+        }
+
+        if (worker->count == worker->max_count) {
+            worker->max_count = worker->max_count ? worker->max_count * 2 : 1024;
+
+            void *ptr = realloc(worker->rowids, sizeof(*worker->rowids) * worker->max_count);
+
+            if (ptr == NULL) {
+                fprintf(stderr, "Unable to allocate %d rowids\n", worker->max_count);
+                exit(-1);
+            }
+
+            worker->rowids = ptr;
+        }
+
+        worker->rowids[worker->count++] = i;
+
+        if (shared->limit_value >= 0 && worker->count >= shared->limit_value) {
+            int cutoff = __atomic_load_n(&shared->cutoff, __ATOMIC_RELAXED);
+
+            while (
+                worker->partition < cutoff
+                && !__atomic_compare_exchange_n(
+                    &shared->cutoff,
+                    &cutoff,
+                    worker->partition,
+                    0,
+                    __ATOMIC_RELAXED,
+                    __ATOMIC_RELAXED
+                )
+            );
+
+            break;
+        }
+    }
+
+    evaluateReleaseBuffers();
+
+    return NULL;
+}
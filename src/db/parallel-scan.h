@@ -0,0 +1,12 @@
+#include "../structs.h"
+
+struct ZoneFilter;
+
+int parallelTableAccess (
+    struct DB *db,
+    int row_list,
+    struct Node *predicates,
+    int predicate_count,
+    int limit_value,
+    struct ZoneFilter *zones
+);
@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <sys/stat.h>
+
+#include "table-cache.h"
+#include "db.h"
+#include "temp.h"
+#include "field-cache.h"
+#include "../structs.h"
+
+/**
+ * Opened tables shared by every query in the process, keyed by the name
+ * passed to openDB() (its extension picks the VFS) and the real path of the
+ * file it found.
+ *
+ * Callers get a shallow copy of the cached struct DB. Entries are fully
+ * indexed before they are shared so nothing in the struct itself changes
+ * afterwards; closeDB() recognises a copy by its `fields` pointer and just
+ * drops the reference.
+ *
+ * Each lookup re-stats the file and the entry is replaced if its device,
+ * inode, size or mtime have changed. An entry still in use when it goes
+ * stale is closed once its last reference is released.
+ *
+ * Unreferenced entries are evicted, least recently used first, to keep the
+ * cache under TABLE_CACHE_LIMIT bytes (or CSVDB_TABLE_CACHE megabytes; 0
+ * disables the cache).
+ *
+ * Only in-memory CSV/TSV/WSV tables are cached. stdin, temp tables, views
+ * and special tables always go straight to openDB().
+ */
+
+struct TableCacheEntry {
+    char name[MAX_TABLE_LENGTH];
+    /* Real path of the file which was opened, used for validation */
+    char path[PATH_MAX];
+    /* What the VFS wrote to `resolved`, or NULL if it didn't */
+    char *resolved;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct DB db;
+    /* Bytes held by the table apart from its field cache */
+    size_t memory;
+    unsigned long last_used;
+    int refs;
+    int stale;
+};
+
+static int table_cache_enabled = 1;
+
+/* -1 until read from the environment */
+static long table_cache_limit = -1;
+
+static unsigned long use_counter = 0;
+
+static struct TableCacheEntry **entries = NULL;
+
+static int entry_count = 0;
+
+static int isCacheable (const char *filename);
+
+static int resolvePath (const char *filename, char *path, struct stat *st);
+
+static int isCurrent (struct TableCacheEntry *entry, struct stat *st);
+
+static struct TableCacheEntry *findEntry (const char *filename, const char *path);
+
+static struct TableCacheEntry *addEntry (
+    const char *filename,
+    const char *path,
+    struct stat *st,
+    struct DB *db,
+    char *resolved
+);
+
+static void removeEntry (int index);
+
+static long getLimit ();
+
+static size_t getEntryMemory (struct TableCacheEntry *entry);
+
+static void evictEntries ();
+
+static void copyResolved (struct TableCacheEntry *entry, char **resolved);
+
+void tableCache_setEnabled (int enabled) {
+    table_cache_enabled = enabled;
+}
+
+/**
+ * @brief Same contract as openDB() but tables are shared with earlier and
+ * later opens of the same, unchanged, file.
+ *
+ * @return int 0 on success; -1 on failure
+ */
+int tableCache_openDB (struct DB *db, const char *filename, char **resolved) {
+    if (!table_cache_enabled || getLimit() == 0 || !isCacheable(filename)) {
+        return openDBUncached(db, filename, resolved);
+    }
+
+    char path[PATH_MAX];
+    struct stat st;
+
+    // Stat before opening so a change made while reading is noticed next time
+    if (resolvePath(filename, path, &st) != 0) {
+        return openDBUncached(db, filename, resolved);
+    }
+
+    struct TableCacheEntry *entry = findEntry(filename, path);
+
+    if (entry != NULL) {
+        if (isCurrent(entry, &st)) {
+            entry->refs++;
+            entry->last_used = ++use_counter;
+            *db = entry->db;
+            copyResolved(entry, resolved);
+            return 0;
+        }
+
+        entry->stale = 1;
+
+        if (entry->refs == 0) {
+            for (int i = 0; i < entry_count; i++) {
+                if (entries[i] == entry) {
+                    removeEntry(i);
+                    break;
+                }
+            }
+        }
+    }
+
+    char *vfs_resolved = NULL;
+
+    if (openDBUncached(db, filename, &vfs_resolved) != 0) {
+        return -1;
+    }
+
+    if (
+        db->fields == NULL
+        || (
+            db->vfs != VFS_CSV_MEM
+            && db->vfs != VFS_CSV_MMAP
+            && db->vfs != VFS_CSV_CACHE
+            && db->vfs != VFS_TSV_MEM
+            && db->vfs != VFS_WSV_MEM
+        )
+    ) {
+        if (resolved != NULL && vfs_resolved != NULL) {
+            if (*resolved == NULL) {
+                *resolved = vfs_resolved;
+                return 0;
+            }
+
+            strcpy(*resolved, vfs_resolved);
+        }
+
+        free(vfs_resolved);
+
+        return 0;
+    }
+
+    // Index every line now so copies never need to extend line_indices
+    getRecordCount(db);
+
+    // Likewise the field cache must exist before the struct is copied
+    if (db->vfs == VFS_CSV_MEM || db->vfs == VFS_CSV_MMAP) {
+        if (fieldCache_freeze(db) == 0) {
+            fieldCache_thaw(db);
+        }
+    }
+
+    entry = addEntry(filename, path, &st, db, vfs_resolved);
+
+    copyResolved(entry, resolved);
+
+    evictEntries();
+
+    return 0;
+}
+
+/**
+ * @brief Drop a reference to a cached table
+ *
+ * @return int 1 if db was a cached copy (and must not be closed); 0 if not
+ */
+int tableCache_release (struct DB *db) {
+    if (db->fields == NULL) {
+        return 0;
+    }
+
+    for (int i = 0; i < entry_count; i++) {
+        struct TableCacheEntry *entry = entries[i];
+
+        if (entry->db.fields != db->fields) {
+            continue;
+        }
+
+        entry->refs--;
+
+        if (entry->stale && entry->refs <= 0) {
+            removeEntry(i);
+        }
+        else {
+            // Entries in use when the cache filled up may go now
+            evictEntries();
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Close every cached table which isn't currently in use
+ */
+void tableCache_clear () {
+    for (int i = entry_count - 1; i >= 0; i--) {
+        if (entries[i]->refs <= 0) {
+            removeEntry(i);
+        }
+        else {
+            entries[i]->stale = 1;
+        }
+    }
+}
+
+static int isCacheable (const char *filename) {
+    if (strcmp(filename, "stdin") == 0 || strncmp(filename, "stdin.", 6) == 0) {
+        return 0;
+    }
+
+    if (strncmp(filename, "memory:", 7) == 0) {
+        return 0;
+    }
+
+    if (strlen(filename) >= MAX_TABLE_LENGTH) {
+        return 0;
+    }
+
+    // Temp table names are resolved per session
+    char temp_filename[MAX_TABLE_LENGTH];
+
+    if (temp_findTable(filename, temp_filename) == 0) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Find the regular file openDB() will read for filename, trying
+ * '.csv' as openDB() does
+ *
+ * @return int 0 on success; -1 if there's no such file
+ */
+static int resolvePath (const char *filename, char *path, struct stat *st) {
+    if (realpath(filename, path) == NULL || stat(path, st) != 0) {
+        char buffer[FILENAME_MAX];
+
+        if (strlen(filename) + sizeof(".csv") > sizeof(buffer)) {
+            return -1;
+        }
+
+        sprintf(buffer, "%s.csv", filename);
+
+        if (realpath(buffer, path) == NULL || stat(path, st) != 0) {
+            return -1;
+        }
+    }
+
+    return S_ISREG(st->st_mode) ? 0 : -1;
+}
+
+static int isCurrent (struct TableCacheEntry *entry, struct stat *st) {
+    return entry->dev == st->st_dev
+        && entry->ino == st->st_ino
+        && entry->size == st->st_size
+        && entry->mtime.tv_sec == st->st_mtim.tv_sec
+        && entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static struct TableCacheEntry *findEntry (const char *filename, const char *path) {
+    for (int i = 0; i < entry_count; i++) {
+        if (
+            !entries[i]->stale
+            && strcmp(entries[i]->name, filename) == 0
+            && strcmp(entries[i]->path, path) == 0
+        ) {
+            return entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static struct TableCacheEntry *addEntry (
+    const char *filename,
+    const char *path,
+    struct stat *st,
+    struct DB *db,
+    char *resolved
+) {
+    struct TableCacheEntry *entry = malloc(sizeof(*entry));
+    struct TableCacheEntry **new_entries = realloc(
+        entries,
+        sizeof(*entries) * (entry_count + 1)
+    );
+
+    if (entry == NULL || new_entries == NULL) {
+        fprintf(stderr, "Unable to allocate table cache entry\n");
+        exit(-1);
+    }
+
+    strcpy(entry->name, filename);
+    strcpy(entry->path, path);
+    entry->resolved = resolved;
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime = st->st_mtim;
+    entry->db = *db;
+    entry->memory = st->st_size
+        + (getRecordCount(db) + 2) * sizeof(db->line_indices[0]);
+    entry->last_used = ++use_counter;
+    entry->refs = 1;
+    entry->stale = 0;
+
+    entries = new_entries;
+    entries[entry_count++] = entry;
+
+    return entry;
+}
+
+static void removeEntry (int index) {
+    struct TableCacheEntry *entry = entries[index];
+
+    entries[index] = entries[--entry_count];
+
+    // No longer in the list so closeDB() will really close it
+    closeDB(&entry->db);
+
+    free(entry->resolved);
+    free(entry);
+}
+
+static void copyResolved (struct TableCacheEntry *entry, char **resolved) {
+    if (resolved == NULL || entry->resolved == NULL) {
+        return;
+    }
+
+    if (*resolved == NULL) {
+        *resolved = malloc(strlen(entry->resolved) + 1);
+
+        if (*resolved == NULL) {
+            return;
+        }
+    }
+
+    strcpy(*resolved, entry->resolved);
+}
+
+static long getLimit () {
+    if (table_cache_limit < 0) {
+        char *env = getenv("CSVDB_TABLE_CACHE");
+
+        if (env != NULL) {
+            table_cache_limit = atol(env) * 1024 * 1024;
+        }
+
+        if (env == NULL || table_cache_limit < 0) {
+            table_cache_limit = TABLE_CACHE_LIMIT;
+        }
+    }
+
+    return table_cache_limit;
+}
+
+static size_t getEntryMemory (struct TableCacheEntry *entry) {
+    size_t memory = entry->memory;
+
+    // The field cache carries on growing as columns are requested
+    if (
+        (entry->db.vfs == VFS_CSV_MEM || entry->db.vfs == VFS_CSV_MMAP)
+        && entry->db.field_cache != NULL
+    ) {
+        memory += entry->db.field_cache->memory;
+    }
+
+    return memory;
+}
+
+/**
+ * @brief Close least recently used tables which aren't in use until the
+ * cache is back under its limit
+ */
+static void evictEntries () {
+    size_t limit = getLimit();
+
+    while (1) {
+        size_t total = 0;
+        int lru_index = -1;
+
+        for (int i = 0; i < entry_count; i++) {
+            total += getEntryMemory(entries[i]);
+
+            if (
+                entries[i]->refs <= 0
+                && (
+                    lru_index < 0
+                    || entries[i]->last_used < entries[lru_index]->last_used
+                )
+            ) {
+                lru_index = i;
+            }
+        }
+
+        if (total <= limit || lru_index < 0) {
+            return;
+        }
+
+        removeEntry(lru_index);
+    }
+}
@@ -0,0 +1,9 @@
+#include "../structs.h"
+
+void tableCache_setEnabled (int enabled);
+
+int tableCache_openDB (struct DB *db, const char *filename, char **resolved);
+
+int tableCache_release (struct DB *db);
+
+void tableCache_clear ();
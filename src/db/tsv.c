@@ -6,9 +6,10 @@
 #include "db.h"
 #include "helper.h"
 #include "csv-mem.h"
+#include "offsets.h"
 #include "../query/select.h"
 
-static int makeDB(struct DB *db, FILE *f);
+static int makeDB(struct DB *db, FILE *f, const char *filename);
 
 static int countFields(FILE *f);
 
@@ -20,11 +21,21 @@ static void prepareHeaders(struct DB *db);
 
 static int tsv_indexLines(struct DB *db);
 
-static int makeDB(struct DB *db, FILE *f)
+static int makeDB(struct DB *db, FILE *f, const char *filename)
 {
     db->vfs = VFS_TSV;
     db->file = f;
 
+    // stdin.tsv is a stream so never has a sidecar
+    if (f == stdin)
+    {
+        db->offsets = NULL;
+    }
+    else
+    {
+        openOffsetsFile(db, filename);
+    }
+
     prepareHeaders(db);
 
     db->_record_count = -1;
@@ -58,17 +69,22 @@ int tsv_openDB(struct DB *db, const char *filename, char **resolved)
         return -1;
     }
 
-    return makeDB(db, f);
+    return makeDB(db, f, filename);
 }
 
 void tsv_closeDB(struct DB *db)
 {
     if (db->line_indices != NULL)
     {
-        free(db->line_indices);
+        if (!isOffsetsMapped(db, db->line_indices))
+        {
+            free(db->line_indices);
+        }
         db->line_indices = NULL;
     }
 
+    closeOffsetsFile(db);
+
     if (db->fields != NULL)
     {
         free(db->fields);
@@ -191,12 +207,28 @@ static int measureLine(FILE *f, size_t byte_offset)
 
 static int tsv_indexLines(struct DB *db)
 {
+    long offset_count;
+
+    // First index can come straight from a valid sidecar file
+    if (db->line_indices == NULL)
+    {
+        long *offsets = getOffsets(db, &offset_count);
+
+        if (offsets != NULL)
+        {
+            db->line_indices = offsets;
+            db->_record_count = offset_count - 2;
+
+            return offset_count - 1;
+        }
+    }
+
     int line_count = countLines(db->file);
 
     db->_record_count = line_count - 1;
 
     // Might be re-indexing due to insert
-    if (db->line_indices != NULL)
+    if (db->line_indices != NULL && !isOffsetsMapped(db, db->line_indices))
     {
         free(db->line_indices);
     }
@@ -242,6 +274,8 @@ static int tsv_indexLines(struct DB *db)
         db->line_indices[++count] = pos;
     }
 
+    saveOffsets(db, db->line_indices, count + 1);
+
     return count;
 }
 
@@ -694,6 +728,8 @@ int tsv_insertRow(struct DB *db, const char *row)
 
     fputc('\n', db->file);
 
+    invalidateOffsets(db);
+
     tsv_indexLines(db);
 
     return 0;
@@ -715,6 +751,8 @@ int tsv_insertFromQuery(
         return -1;
     }
 
+    invalidateOffsets(db);
+
     tsv_indexLines(db);
 
     return 0;
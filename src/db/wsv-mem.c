@@ -6,6 +6,7 @@
 #include "helper.h"
 #include "../structs.h"
 #include "../functions/util.h"
+#include "../functions/scan.h"
 #include "../query/select.h"
 
 static int prepareHeaders(struct DB *db);
@@ -525,20 +526,23 @@ static int wsv_get_record_from_line(
     {
         // Start of the field
 
+        // Fast path for fields we're not interested in
+        if (current_field_index < field_index)
+        {
+            in_ptr = scanFind(in_ptr, " \t\n\v\f\r");
+        }
+
         // Consume whole field
-        while (!wsv_is_end_of_field(*in_ptr))
+        while (current_field_index == field_index
+            && !wsv_is_end_of_field(*in_ptr))
         {
-            // If we're in the correct field, copy to output
-            if (current_field_index == field_index)
+            *(out_ptr++) = *in_ptr;
+
+            // Have we run out of space?
+            if (out_ptr == out_end_ptr)
             {
-                *(out_ptr++) = *in_ptr;
-
-                // Have we run out of space?
-                if (out_ptr == out_end_ptr)
-                {
-                    out_ptr--;
-                    break;
-                }
+                out_ptr--;
+                break;
             }
 
             in_ptr++;
@@ -0,0 +1,729 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "zone-map.h"
+#include "offsets.h"
+#include "db.h"
+#include "../structs.h"
+#include "../evaluate/evaluate.h"
+#include "../evaluate/value.h"
+
+/**
+ * Zone maps: the smallest and largest value in each block of
+ * ZONE_MAP_BLOCK_ROWS rows of a column, so that full table scans can skip
+ * blocks which can't satisfy a `field op constant` predicate. Most useful for
+ * tables which are (roughly) sorted, such as time ordered logs.
+ *
+ * A column's zone map is built the first time an unlimited scan of a large
+ * table filters on it, and saved in a `<table>.zones` sidecar next to the
+ * `.offsets` sidecar. Like that one, it's ignored and rebuilt whenever the
+ * table's size or modification time changes.
+ *
+ * Min and max are stored as text and compared with compareValues(), so they
+ * order values exactly the way predicates do. A block is only usable when all
+ * of its non-empty values have the same type, and then only for constants of
+ * that type.
+ *
+ * Sidecar format, native endian:
+ *
+ *  struct ZoneHeader
+ *  int64_t column_offsets[field_count]     0 if the column hasn't been built
+ *  for each built column:
+ *    struct ZoneBlock blocks[block_count]
+ *    int64_t strings_length
+ *    char strings[strings_length]          NUL terminated min/max values
+ */
+
+#define ZONES_MAGIC     "CSVDBZON"
+#define ZONES_VERSION   1
+
+struct ZoneHeader {
+    char magic[8];
+    int32_t version;
+    int32_t field_count;
+    int64_t file_size;
+    int64_t file_mtime;
+    int64_t record_count;
+    int64_t block_rows;
+};
+
+struct ZoneBlock {
+    /* Type of every non-empty value; VALUE_NULL if there are none;
+     * VALUE_UNKNOWN if the types are mixed */
+    int32_t type;
+    int32_t reserved;
+    /* Offsets of min and max text in the column's strings */
+    int64_t min;
+    int64_t max;
+};
+
+struct ZoneColumn {
+    /* NULL if not built */
+    struct ZoneBlock *blocks;
+    char *strings;
+    size_t strings_length;
+};
+
+struct ZoneMap {
+    int field_count;
+    int record_count;
+    int block_rows;
+    int block_count;
+    struct ZoneColumn *columns;
+};
+
+static struct ZoneMap *getZoneMap (struct DB *db);
+
+static struct ZoneMap *createZoneMap (struct DB *db, int block_rows);
+
+static struct ZoneMap *loadZoneMap (struct DB *db);
+
+static void saveZoneMap (struct DB *db);
+
+static void getZonesFilename (struct DB *db, char *filename);
+
+static int buildColumn (struct DB *db, struct ZoneMap *zones, int field_index);
+
+static int appendString (struct ZoneColumn *column, size_t *capacity, const char *text);
+
+static int getPredicateField (
+    struct DB *db,
+    struct Node *predicate,
+    int *field_index,
+    enum Function *op,
+    char *constant_text
+);
+
+static int canSkipBlock (
+    struct ZoneColumn *column,
+    int block,
+    enum Function op,
+    struct Value *constant
+);
+
+/**
+ * @brief Work out which blocks of the table can be skipped for these
+ * predicates, building zone maps for the columns they use if it's worth it.
+ *
+ * @param limit_value zone maps are only built for scans which read every row
+ * @param filter OUT must be freed with zoneMap_freeFilter() on success
+ * @return int 0 if filter can be used; -1 if no zone map applies
+ */
+int zoneMap_getFilter (
+    struct DB *db,
+    struct Node *predicates,
+    int predicate_count,
+    int limit_value,
+    struct ZoneFilter *filter
+) {
+    if (predicate_count == 0 || db->offsets == NULL) {
+        return -1;
+    }
+
+    struct ZoneMap *zones = getZoneMap(db);
+
+    if (zones == NULL) {
+        return -1;
+    }
+
+    filter->block_rows = zones->block_rows;
+    filter->block_count = zones->block_count;
+    filter->skip = NULL;
+
+    int built = 0;
+
+    for (int i = 0; i < predicate_count; i++) {
+        int field_index;
+        enum Function op;
+        char constant_text[MAX_VALUE_LENGTH];
+
+        if (!getPredicateField(db, &predicates[i], &field_index, &op, constant_text)) {
+            continue;
+        }
+
+        struct ZoneColumn *column = &zones->columns[field_index];
+
+        if (column->blocks == NULL) {
+            // Building reads the whole column; only worth it for large tables
+            // which are going to be read in full anyway
+            if (
+                limit_value >= 0
+                || db->offsets->file_size < OFFSETS_FILE_LIMIT
+                || buildColumn(db, zones, field_index) != 0
+            ) {
+                continue;
+            }
+
+            built = 1;
+        }
+
+        if (filter->skip == NULL) {
+            filter->skip = calloc(zones->block_count, 1);
+
+            if (filter->skip == NULL) {
+                return -1;
+            }
+        }
+
+        struct Value constant;
+        parseValue(&constant, constant_text);
+
+        for (int block = 0; block < zones->block_count; block++) {
+            if (!filter->skip[block] && canSkipBlock(column, block, op, &constant)) {
+                filter->skip[block] = 1;
+            }
+        }
+    }
+
+    if (built) {
+        saveZoneMap(db);
+    }
+
+    return filter->skip != NULL ? 0 : -1;
+}
+
+void zoneMap_freeFilter (struct ZoneFilter *filter) {
+    free(filter->skip);
+    filter->skip = NULL;
+}
+
+void zoneMap_free (struct ZoneMap *zones) {
+    if (zones == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < zones->field_count; i++) {
+        free(zones->columns[i].blocks);
+        free(zones->columns[i].strings);
+    }
+
+    free(zones->columns);
+    free(zones);
+}
+
+/**
+ * @brief Zone map for the table as it is now, loaded from the sidecar if
+ * there's a valid one
+ *
+ * @return struct ZoneMap* NULL if the table is too small to have one
+ */
+static struct ZoneMap *getZoneMap (struct DB *db) {
+    int record_count = getRecordCount(db);
+
+    if (record_count < ZONE_MAP_BLOCK_ROWS * 2) {
+        return NULL;
+    }
+
+    struct ZoneMap *zones = db->offsets->zones;
+
+    // e.g. rows inserted through this DB
+    if (
+        zones != NULL
+        && (
+            zones->record_count != record_count
+            || zones->field_count != db->field_count
+        )
+    ) {
+        zoneMap_free(zones);
+        zones = NULL;
+    }
+
+    if (zones == NULL) {
+        zones = loadZoneMap(db);
+    }
+
+    if (zones == NULL) {
+        zones = createZoneMap(db, ZONE_MAP_BLOCK_ROWS);
+    }
+
+    db->offsets->zones = zones;
+
+    return zones;
+}
+
+/**
+ * @return struct ZoneMap* with no columns built yet
+ */
+static struct ZoneMap *createZoneMap (struct DB *db, int block_rows) {
+    struct ZoneMap *zones = calloc(1, sizeof(*zones));
+
+    if (zones == NULL) {
+        return NULL;
+    }
+
+    zones->field_count = db->field_count;
+    zones->record_count = getRecordCount(db);
+    zones->block_rows = block_rows;
+    zones->block_count = (zones->record_count + block_rows - 1) / block_rows;
+    zones->columns = calloc(zones->field_count, sizeof(*zones->columns));
+
+    if (zones->columns == NULL) {
+        free(zones);
+        return NULL;
+    }
+
+    return zones;
+}
+
+/**
+ * @brief Read the sidecar if it exists and matches the table
+ */
+static struct ZoneMap *loadZoneMap (struct DB *db) {
+    char filename[FILENAME_MAX];
+
+    getZonesFilename(db, filename);
+
+    FILE *f = fopen(filename, "rb");
+
+    if (f == NULL) {
+        return NULL;
+    }
+
+    struct ZoneHeader header;
+
+    if (
+        fread(&header, sizeof(header), 1, f) != 1
+        || memcmp(header.magic, ZONES_MAGIC, sizeof(header.magic)) != 0
+        || header.version != ZONES_VERSION
+        || header.field_count != db->field_count
+        || header.file_size != db->offsets->file_size
+        || header.file_mtime != db->offsets->file_mtime
+        || header.record_count != getRecordCount(db)
+        || header.block_rows <= 0
+    ) {
+        fclose(f);
+        return NULL;
+    }
+
+    struct ZoneMap *zones = createZoneMap(db, header.block_rows);
+
+    int64_t *column_offsets = malloc(sizeof(*column_offsets) * header.field_count);
+
+    int ok = zones != NULL && column_offsets != NULL
+        && fread(column_offsets, sizeof(*column_offsets), header.field_count, f)
+            == (size_t)header.field_count;
+
+    for (int i = 0; ok && i < zones->field_count; i++) {
+        if (column_offsets[i] == 0) {
+            continue;
+        }
+
+        struct ZoneColumn *column = &zones->columns[i];
+        int64_t strings_length;
+
+        column->blocks = malloc(sizeof(*column->blocks) * zones->block_count);
+
+        ok = column->blocks != NULL
+            && fseek(f, column_offsets[i], SEEK_SET) == 0
+            && fread(column->blocks, sizeof(*column->blocks), zones->block_count, f)
+                == (size_t)zones->block_count
+            && fread(&strings_length, sizeof(strings_length), 1, f) == 1
+            && strings_length > 0
+            && strings_length < 2L * MAX_VALUE_LENGTH * zones->block_count;
+
+        if (ok) {
+            column->strings = malloc(strings_length);
+            column->strings_length = strings_length;
+
+            ok = column->strings != NULL
+                && fread(column->strings, 1, strings_length, f)
+                    == (size_t)strings_length
+                && column->strings[strings_length - 1] == '\0';
+        }
+
+        for (int block = 0; ok && block < zones->block_count; block++) {
+            struct ZoneBlock *b = &column->blocks[block];
+
+            ok = b->min >= 0 && b->min < strings_length
+                && b->max >= 0 && b->max < strings_length;
+        }
+    }
+
+    free(column_offsets);
+    fclose(f);
+
+    if (!ok) {
+        zoneMap_free(zones);
+        return NULL;
+    }
+
+    return zones;
+}
+
+/**
+ * @brief Write every built column to the sidecar, but only if the table is
+ * still the one the zone map was built from. Any failure is silently
+ * ignored; zone maps are purely an optimisation.
+ */
+static void saveZoneMap (struct DB *db) {
+    struct OffsetsFile *offsets = db->offsets;
+    struct ZoneMap *zones = offsets->zones;
+
+    char filename[FILENAME_MAX];
+    char table_filename[FILENAME_MAX];
+    char tmp_filename[FILENAME_MAX + 8];
+
+    getZonesFilename(db, filename);
+
+    size_t len = strlen(offsets->filename) - (sizeof(".offsets") - 1);
+    memcpy(table_filename, offsets->filename, len);
+    table_filename[len] = '\0';
+
+    struct stat st;
+
+    if (
+        stat(table_filename, &st) != 0
+        || st.st_size != offsets->file_size
+        || st.st_mtime != offsets->file_mtime
+    ) {
+        return;
+    }
+
+    sprintf(tmp_filename, "%s.%d", filename, getpid());
+
+    FILE *f = fopen(tmp_filename, "wb");
+
+    if (f == NULL) {
+        return;
+    }
+
+    struct ZoneHeader header = {0};
+    memcpy(header.magic, ZONES_MAGIC, sizeof(header.magic));
+    header.version = ZONES_VERSION;
+    header.field_count = zones->field_count;
+    header.file_size = st.st_size;
+    header.file_mtime = st.st_mtime;
+    header.record_count = zones->record_count;
+    header.block_rows = zones->block_rows;
+
+    int64_t *column_offsets = calloc(zones->field_count, sizeof(*column_offsets));
+
+    int ok = column_offsets != NULL
+        && fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(column_offsets, sizeof(*column_offsets), zones->field_count, f)
+            == (size_t)zones->field_count;
+
+    for (int i = 0; ok && i < zones->field_count; i++) {
+        struct ZoneColumn *column = &zones->columns[i];
+
+        if (column->blocks == NULL) {
+            continue;
+        }
+
+        int64_t strings_length = column->strings_length;
+
+        column_offsets[i] = ftell(f);
+
+        ok = fwrite(column->blocks, sizeof(*column->blocks), zones->block_count, f)
+                == (size_t)zones->block_count
+            && fwrite(&strings_length, sizeof(strings_length), 1, f) == 1
+            && fwrite(column->strings, 1, strings_length, f)
+                == (size_t)strings_length;
+    }
+
+    ok = ok && fseek(f, sizeof(header), SEEK_SET) == 0
+        && fwrite(column_offsets, sizeof(*column_offsets), zones->field_count, f)
+            == (size_t)zones->field_count;
+
+    free(column_offsets);
+
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+
+    // Rename is atomic so concurrent readers see either old or new sidecar
+    if (!ok || rename(tmp_filename, filename) != 0) {
+        remove(tmp_filename);
+    }
+}
+
+/**
+ * @param filename OUT `<table>.zones` (at most FILENAME_MAX)
+ */
+static void getZonesFilename (struct DB *db, char *filename) {
+    size_t len = strlen(db->offsets->filename) - (sizeof(".offsets") - 1);
+
+    memcpy(filename, db->offsets->filename, len);
+    strcpy(filename + len, ".zones");
+}
+
+/**
+ * @brief Find the range of values in each block of a column
+ *
+ * @return int 0 on success; -1 on failure
+ */
+static int buildColumn (struct DB *db, struct ZoneMap *zones, int field_index) {
+    struct ZoneColumn *column = &zones->columns[field_index];
+
+    column->blocks = malloc(sizeof(*column->blocks) * zones->block_count);
+
+    if (column->blocks == NULL) {
+        return -1;
+    }
+
+    column->strings = NULL;
+    column->strings_length = 0;
+    size_t capacity = 0;
+
+    char buffer[MAX_VALUE_LENGTH];
+    char min_text[MAX_VALUE_LENGTH];
+    char max_text[MAX_VALUE_LENGTH];
+
+    for (int block = 0; block < zones->block_count; block++) {
+        int start = block * zones->block_rows;
+        int end = MIN(start + zones->block_rows, zones->record_count);
+
+        enum ValueType type = VALUE_NULL;
+        struct Value min, max;
+
+        min_text[0] = '\0';
+        max_text[0] = '\0';
+
+        for (int rowid = start; rowid < end && type != VALUE_UNKNOWN; rowid++) {
+            const char *text;
+
+            int length = getRecordView(
+                db,
+                rowid,
+                field_index,
+                &text,
+                buffer,
+                MAX_VALUE_LENGTH
+            );
+
+            if (length < 0) {
+                length = 0;
+            }
+
+            if (text != buffer) {
+                memcpy(buffer, text, length);
+            }
+
+            buffer[length] = '\0';
+
+            // Never match a comparison, just like empty values
+            if (strcmp(buffer, "NULL") == 0) {
+                continue;
+            }
+
+            // Parse differently depending on when they're read
+            if (strncmp(buffer, "CURRENT_", 8) == 0) {
+                type = VALUE_UNKNOWN;
+                break;
+            }
+
+            struct Value value;
+            parseValue(&value, buffer);
+
+            if (value.type == VALUE_NULL) {
+                continue;
+            }
+
+            if (type == VALUE_NULL) {
+                type = value.type;
+
+                strcpy(min_text, buffer);
+                strcpy(max_text, buffer);
+                parseValue(&min, min_text);
+                parseValue(&max, max_text);
+
+                continue;
+            }
+
+            if (value.type != type) {
+                type = VALUE_UNKNOWN;
+                break;
+            }
+
+            if (compareValues(OPERATOR_LT, &value, &min)) {
+                strcpy(min_text, buffer);
+                parseValue(&min, min_text);
+            }
+            else if (compareValues(OPERATOR_GT, &value, &max)) {
+                strcpy(max_text, buffer);
+                parseValue(&max, max_text);
+            }
+        }
+
+        if (type == VALUE_UNKNOWN) {
+            min_text[0] = '\0';
+            max_text[0] = '\0';
+        }
+
+        struct ZoneBlock *b = &column->blocks[block];
+
+        b->type = type;
+        b->reserved = 0;
+        b->min = column->strings_length;
+
+        if (appendString(column, &capacity, min_text) != 0) {
+            return -1;
+        }
+
+        b->max = column->strings_length;
+
+        if (appendString(column, &capacity, max_text) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int appendString (struct ZoneColumn *column, size_t *capacity, const char *text) {
+    size_t length = strlen(text) + 1;
+
+    if (column->strings_length + length > *capacity) {
+        size_t new_capacity = MAX(*capacity * 2, column->strings_length + length);
+        char *strings = realloc(column->strings, new_capacity);
+
+        if (strings == NULL) {
+            free(column->blocks);
+            free(column->strings);
+            column->blocks = NULL;
+            column->strings = NULL;
+            return -1;
+        }
+
+        column->strings = strings;
+        *capacity = new_capacity;
+    }
+
+    memcpy(column->strings + column->strings_length, text, length);
+    column->strings_length += length;
+
+    return 0;
+}
+
+/**
+ * @brief Check whether predicate has the form `field op constant` (either
+ * way round) with an operator zone maps can help with
+ *
+ * @param op OUT operator as if the field were on the left
+ * @param constant_text OUT at least MAX_VALUE_LENGTH
+ * @return int 1 if the predicate can use a zone map
+ */
+static int getPredicateField (
+    struct DB *db,
+    struct Node *predicate,
+    int *field_index,
+    enum Function *op,
+    char *constant_text
+) {
+    enum Function function = predicate->function;
+
+    if (
+        (
+            function != OPERATOR_EQ
+            && function != OPERATOR_LT
+            && function != OPERATOR_LE
+            && function != OPERATOR_GT
+            && function != OPERATOR_GE
+        )
+        || predicate->child_count != 2
+    ) {
+        return 0;
+    }
+
+    struct Node *field = NULL;
+    struct Node *constant = NULL;
+
+    for (int i = 0; i < 2; i++) {
+        struct Node *child = &predicate->children[i];
+        struct Node *other = &predicate->children[1 - i];
+
+        if (
+            child->function == FUNC_UNITY
+            && child->field.table_id == 0
+            && child->field.index >= 0
+            && child->field.index < db->field_count
+            && other->function == FUNC_UNITY
+            && other->field.index == FIELD_CONSTANT
+        ) {
+            field = child;
+            constant = other;
+
+            // Turn `k op field` round to `field op k`
+            if (i == 1) {
+                if (function == OPERATOR_LT) function = OPERATOR_GT;
+                else if (function == OPERATOR_LE) function = OPERATOR_GE;
+                else if (function == OPERATOR_GT) function = OPERATOR_LT;
+                else if (function == OPERATOR_GE) function = OPERATOR_LE;
+            }
+
+            break;
+        }
+    }
+
+    if (field == NULL) {
+        return 0;
+    }
+
+    struct Table table;
+    table.db = db;
+
+    // Same evaluation as evaluateOperatorNode() does for each row
+    if (
+        evaluateNode(
+            &table,
+            ROWLIST_ROWID,
+            0,
+            constant,
+            constant_text,
+            MAX_VALUE_LENGTH
+        ) < 0
+    ) {
+        return 0;
+    }
+
+    // NULL is compared specially
+    if (constant_text[0] == '\0' || strcmp(constant_text, "NULL") == 0) {
+        return 0;
+    }
+
+    *field_index = field->field.index;
+    *op = function;
+
+    return 1;
+}
+
+/**
+ * @return int 1 if no row in the block can satisfy `field op constant`
+ */
+static int canSkipBlock (
+    struct ZoneColumn *column,
+    int block,
+    enum Function op,
+    struct Value *constant
+) {
+    struct ZoneBlock *b = &column->blocks[block];
+
+    // Empty values never match
+    if (b->type == VALUE_NULL) {
+        return 1;
+    }
+
+    if (b->type != (int)constant->type) {
+        return 0;
+    }
+
+    struct Value min, max;
+    parseValue(&min, column->strings + b->min);
+    parseValue(&max, column->strings + b->max);
+
+    if (op == OPERATOR_EQ) {
+        return compareValues(OPERATOR_LT, constant, &min)
+            || compareValues(OPERATOR_GT, constant, &max);
+    }
+
+    if (op == OPERATOR_LT || op == OPERATOR_LE) {
+        return !compareValues(op, &min, constant);
+    }
+
+    return !compareValues(op, &max, constant);
+}
@@ -0,0 +1,22 @@
+#include "../structs.h"
+
+struct ZoneMap;
+
+struct ZoneFilter {
+    int block_rows;
+    int block_count;
+    /* Non-zero for each block in which no row can match */
+    unsigned char *skip;
+};
+
+int zoneMap_getFilter (
+    struct DB *db,
+    struct Node *predicates,
+    int predicate_count,
+    int limit_value,
+    struct ZoneFilter *filter
+);
+
+void zoneMap_freeFilter (struct ZoneFilter *filter);
+
+void zoneMap_free (struct ZoneMap *zones);
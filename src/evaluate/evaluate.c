@@ -6,12 +6,31 @@
 #include "evaluate.h"
 #include "function.h"
 #include "predicates.h"
+#include "value.h"
 #include "../query/node.h"
 #include "../query/result.h"
 #include "../db/db.h"
 #include "../functions/date.h"
 #include "../functions/util.h"
 
+/* Enough for most expressions without ever allocating again */
+#define VALUE_BLOCK_SIZE (16 * MAX_VALUE_LENGTH)
+
+/**
+ * Child values are taken from a per-thread stack of blocks rather than the C
+ * stack. Nested expressions recurse through evaluateNode() so MAX_VALUE_LENGTH
+ * locals per child per level added up; now each level only takes what it
+ * uses and the first block is reused for every row.
+ */
+struct ValueBlock {
+    struct ValueBlock *prev;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+static __thread struct ValueBlock *value_blocks = NULL;
+
 static int evaluateField(
     struct Table *tables,
     RowListIndex row_list,
@@ -64,7 +83,7 @@ int evaluateNode(
     {
         // Optimisation where node is its own child
 
-        char value[MAX_VALUE_LENGTH];
+        char *value = evaluatePushBuffers(1);
         evaluateField(
             tables,
             row_list,
@@ -73,9 +92,11 @@ int evaluateNode(
             value,
             MAX_VALUE_LENGTH);
 
-        char *values[] = {value};
+        int result = evaluateFunction(output, node->function, &value, 1);
+
+        evaluatePopBuffers(1);
 
-        return evaluateFunction(output, node->function, (char **)values, 1);
+        return result;
     }
 
     // Function has 0 or more child nodes (parameters)
@@ -87,21 +108,12 @@ int evaluateNode(
         value_count = 1;
     }
 
-    char *values = malloc(value_count * MAX_VALUE_LENGTH);
-    char **values_ptrs = malloc(value_count * sizeof(values));
-    for (int i = 0; i < value_count; i++)
-    {
-        values_ptrs[i] = values + MAX_FIELD_LENGTH * i;
-    }
+    char *values = evaluatePushBuffers(value_count);
+    char *values_ptrs[value_count];
 
-    if (values == NULL)
+    for (int i = 0; i < value_count; i++)
     {
-        fprintf(
-            stderr,
-            __FILE__ ":%d Unable to allocate %d bytes for %d child node values\n", __LINE__,
-            value_count * MAX_VALUE_LENGTH,
-            value_count);
-        exit(-1);
+        values_ptrs[i] = values + MAX_VALUE_LENGTH * i;
     }
 
     for (int i = 0; i < node->child_count; i++)
@@ -130,12 +142,140 @@ int evaluateNode(
         output[0] = '\0';
     }
 
-    free(values);
-    free(values_ptrs);
+    evaluatePopBuffers(value_count);
 
     return result;
 }
 
+/**
+ * @brief Take count MAX_VALUE_LENGTH buffers from this thread's value stack.
+ * Must be given back with evaluatePopBuffers() in reverse order.
+ */
+char *evaluatePushBuffers(int count)
+{
+    size_t size = (size_t)count * MAX_VALUE_LENGTH;
+    struct ValueBlock *block = value_blocks;
+
+    if (block == NULL || block->used + size > block->size)
+    {
+        size_t block_size = size > VALUE_BLOCK_SIZE ? size : VALUE_BLOCK_SIZE;
+
+        block = malloc(sizeof(*block) + block_size);
+
+        if (block == NULL)
+        {
+            fprintf(
+                stderr,
+                "Unable to allocate %zu bytes for %d child node values\n",
+                block_size,
+                count);
+            exit(-1);
+        }
+
+        block->prev = value_blocks;
+        block->used = 0;
+        block->size = block_size;
+
+        value_blocks = block;
+    }
+
+    char *values = block->data + block->used;
+
+    block->used += size;
+
+    return values;
+}
+
+void evaluatePopBuffers(int count)
+{
+    struct ValueBlock *block = value_blocks;
+
+    block->used -= (size_t)count * MAX_VALUE_LENGTH;
+
+    // Only extra blocks are freed; the first stays for the next row
+    if (block->used == 0 && block->prev != NULL)
+    {
+        value_blocks = block->prev;
+        free(block);
+    }
+}
+
+/**
+ * @brief Free this thread's value stack. Threads which evaluate nodes call
+ * this before they exit.
+ */
+void evaluateReleaseBuffers()
+{
+    while (value_blocks != NULL)
+    {
+        struct ValueBlock *prev = value_blocks->prev;
+        free(value_blocks);
+        value_blocks = prev;
+    }
+}
+
+/**
+ * @brief Like evaluateNode() but plain table fields are returned as a view
+ * straight into the table data (where the VFS supports it) instead of being
+ * copied.
+ *
+ * @param value OUT NOT nul terminated unless it points to buffer
+ * @param buffer used for anything which has to be evaluated or copied
+ * @return int length of value; -1 on error
+ */
+int evaluateNodeView(
+    struct Table *tables,
+    RowListIndex row_list,
+    int index,
+    struct Node *node,
+    const char **value,
+    char *buffer,
+    int max_length)
+{
+    struct Field *field = (struct Field *)node;
+
+    if (node->function == FUNC_UNITY && field->table_id >= 0 && field->index >= 0)
+    {
+        int row_id;
+
+        if (row_list == ROWLIST_ROWID)
+        {
+            row_id = index;
+        }
+        else
+        {
+            row_id = getRowID(getRowList(row_list), field->table_id, index);
+        }
+
+        int length = getRecordView(
+            tables[field->table_id].db,
+            row_id,
+            field->index,
+            value,
+            buffer,
+            max_length);
+
+        if (length < 0)
+        {
+            // Missing values are empty, same as evaluateField()
+            *value = buffer;
+            buffer[0] = '\0';
+            return 0;
+        }
+
+        return length;
+    }
+
+    *value = buffer;
+
+    if (evaluateNode(tables, row_list, index, node, buffer, max_length) < 0)
+    {
+        return -1;
+    }
+
+    return strlen(buffer);
+}
+
 // Evaluates functions on nodes with purely constant children
 int evaluateConstantNode(
     struct Node *node,
@@ -154,21 +294,12 @@ int evaluateConstantNode(
         value_count = 1;
     }
 
-    char *values = malloc(value_count * MAX_VALUE_LENGTH);
-    char **values_ptrs = malloc(value_count * sizeof(values));
-    for (int i = 0; i < value_count; i++)
-    {
-        values_ptrs[i] = values + MAX_FIELD_LENGTH * i;
-    }
+    char *values = evaluatePushBuffers(value_count);
+    char *values_ptrs[value_count];
 
-    if (values == NULL)
+    for (int i = 0; i < value_count; i++)
     {
-        fprintf(
-            stderr,
-            __FILE__ ":%d Unable to allocate %d bytes for %d child node values\n", __LINE__,
-            value_count * MAX_VALUE_LENGTH,
-            value_count);
-        exit(-1);
+        values_ptrs[i] = values + MAX_VALUE_LENGTH * i;
     }
 
     if (node->child_count == -1)
@@ -200,8 +331,7 @@ int evaluateConstantNode(
         node->child_count);
     // fprintf(stderr, "[EVALUATE] return value = '%s'\n", output);
 
-    free(values);
-    free(values_ptrs);
+    evaluatePopBuffers(value_count);
 
     return result;
 }
@@ -442,6 +572,9 @@ void evaluateNodeTreePartial(
         node->function = FUNC_UNITY;
         node->field.index = FIELD_CONSTANT;
 
+        // Parsed once here rather than for every row it's compared with
+        parseValue(&node->constant, node->field.text);
+
         return;
     }
 
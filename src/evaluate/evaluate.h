@@ -9,11 +9,27 @@ int evaluateNode (
     int max_length
 );
 
+int evaluateNodeView (
+    struct Table *tables,
+    RowListIndex row_list,
+    int index,
+    struct Node *node,
+    const char **value,
+    char *buffer,
+    int max_length
+);
+
 int evaluateConstantNode (
     struct Node *node,
     char *output
 );
 
+char *evaluatePushBuffers (int count);
+
+void evaluatePopBuffers (int count);
+
+void evaluateReleaseBuffers ();
+
 int evaluateNodeList (
     struct Table *tables,
     RowListIndex row_list,
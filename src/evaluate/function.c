@@ -14,7 +14,9 @@
 #define IS_NOT_NULL(x) (x[0])
 
 /**
- * @brief
+ * @brief Apply a scalar function to already evaluated parameters. Parameters
+ * and result are text: operands are parsed here as each function needs them
+ * rather than as struct Value, which is only used for comparisons.
  *
  * @param output
  * @param function
@@ -3,10 +3,19 @@
 
 #include "./predicates.h"
 #include "./evaluate.h"
+#include "./value.h"
 #include "../structs.h"
 #include "../query/result.h"
-#include "../functions/date.h"
-#include "../functions/util.h"
+#include "../db/db.h"
+
+static void evaluateOperand (
+    struct Table *tables,
+    RowListIndex list_id,
+    int row_index,
+    struct Node *node,
+    char *buffer,
+    struct Value *value
+);
 
 /**
  * Evaluate an OPERATOR node
@@ -38,40 +47,106 @@ int evaluateOperatorNode (struct Table *tables, RowListIndex list_id, int row_in
         return evaluateOperatorNodeListAND(tables, list_id, row_index, node->children, node->child_count);
     }
 
-    char value_left[MAX_VALUE_LENGTH] = {0};
-    char value_right[MAX_VALUE_LENGTH] = {0};
+    // Not zero-initialised: clearing 2 x MAX_VALUE_LENGTH per row is
+    // measurable on large scans.
+    char *value_left = evaluatePushBuffers(2);
+    char *value_right = value_left + MAX_VALUE_LENGTH;
+
+    struct Value typed_left, typed_right;
 
-    int result = evaluateNode(
+    evaluateOperand(
         tables,
         list_id,
         row_index,
         &node->children[0],
         value_left,
-        MAX_VALUE_LENGTH
+        &typed_left
     );
-    if (result < 0) {
-        fprintf(stderr, "Unable to evaluate node\n");
-        exit(-1);
-    }
 
-    result = evaluateNode(
+    evaluateOperand(
         tables,
         list_id,
         row_index,
         &node->children[1],
         value_right,
-        MAX_VALUE_LENGTH
+        &typed_right
     );
-    if (result < 0) {
-        fprintf(stderr, "Unable to evaluate node\n");
-        exit(-1);
+
+    int result = compareValues(node->function, &typed_left, &typed_right);
+
+    evaluatePopBuffers(2);
+
+    return result;
+}
+
+/**
+ * @brief Evaluate one side of a comparison. Constants are only parsed once and
+ * plain fields of tables which can produce typed values (e.g. CALENDAR) skip
+ * formatting and parsing.
+ *
+ * @param buffer MAX_VALUE_LENGTH bytes which value->text will point to unless
+ * node is a constant
+ */
+static void evaluateOperand (
+    struct Table *tables,
+    RowListIndex list_id,
+    int row_index,
+    struct Node *node,
+    char *buffer,
+    struct Value *value
+) {
+    struct Field *field = &node->field;
+
+    if (
+        node->function == FUNC_UNITY
+        && field->index == FIELD_CONSTANT
+        && node->constant.type != VALUE_UNKNOWN
+    ) {
+        *value = node->constant;
+        value->text = field->text;
+        return;
     }
 
-    if (!evaluateExpression(node->function, value_left, value_right)) {
-        return 0;
+    if (
+        node->function == FUNC_UNITY
+        && field->table_id >= 0
+        && field->index >= 0
+    ) {
+        int row_id = list_id == ROWLIST_ROWID
+            ? row_index
+            : getRowID(getRowList(list_id), field->table_id, row_index);
+
+        if (
+            getRecordTyped(
+                tables[field->table_id].db,
+                row_id,
+                field->index,
+                value,
+                buffer,
+                MAX_VALUE_LENGTH
+            ) == 0
+        ) {
+            return;
+        }
     }
 
-    return 1;
+    buffer[0] = '\0';
+
+    if (
+        evaluateNode(
+            tables,
+            list_id,
+            row_index,
+            node,
+            buffer,
+            MAX_VALUE_LENGTH
+        ) < 0
+    ) {
+        fprintf(stderr, "Unable to evaluate node\n");
+        exit(-1);
+    }
+
+    parseValueAs(value, buffer, node->type_hint);
 }
 
 /**
@@ -107,110 +182,67 @@ int evaluateOperatorNodeListOR (struct Table *tables, int row_list, int row_inde
 }
 
 int evaluateExpression (enum Function op, const char *left, const char *right) {
-    // printf("Evaluating %s OP %s\n", left, right);
-
-    if (op == OPERATOR_NEVER) {
-        return 0;
-    }
-
-    if (op == OPERATOR_ALWAYS) {
-        return 1;
-    }
+    struct Value value_left, value_right;
 
-    struct DateTime dt_left, dt_right;
-
-    if (parseDateTime(left, &dt_left) && parseDateTime(right, &dt_right))
-    {
-        // Date comparison
-        int unix_left = datetimeGetUnix(&dt_left);
-        int unix_right = datetimeGetUnix(&dt_right);
-
-        if (op == OPERATOR_EQ)
-            return unix_left == unix_right;
-        if (op == OPERATOR_NE)
-            return unix_left != unix_right;
-        if (op == OPERATOR_LT)
-            return unix_left < unix_right;
-        if (op == OPERATOR_LE)
-            return unix_left <= unix_right;
-        if (op == OPERATOR_GT)
-            return unix_left > unix_right;
-        if (op == OPERATOR_GE)
-            return unix_left >= unix_right;
+    parseValue(&value_left, left);
+    parseValue(&value_right, right);
 
-        return 0;
-    }
-
-    if (parseDate(left, &dt_left) && parseDate(right, &dt_right))
-    {
-        // Date comparison
-        int julian_left = datetimeGetJulian(&dt_left);
-        int julian_right = datetimeGetJulian(&dt_right);
-
-        if (op == OPERATOR_EQ) return julian_left == julian_right;
-        if (op == OPERATOR_NE) return julian_left != julian_right;
-        if (op == OPERATOR_LT) return julian_left < julian_right;
-        if (op == OPERATOR_LE) return julian_left <= julian_right;
-        if (op == OPERATOR_GT) return julian_left > julian_right;
-        if (op == OPERATOR_GE) return julian_left >= julian_right;
+    return compareValues(op, &value_left, &value_right);
+}
 
-        return 0;
+/**
+ * @brief Record the expected type of each operand so evaluateOperatorNode()
+ * can skip parsers which won't match. Constants are typed exactly; table
+ * fields get the type inferred from a sample of their rows.
+ *
+ * @param tables Tables referenced by the predicate's fields
+ * @param predicate
+ * @param max_table_id fields of later tables are left without a hint so
+ * tables the step doesn't read are never opened to sample them
+ */
+void bindPredicateTypes (
+    struct Table *tables,
+    struct Node *predicate,
+    int max_table_id
+) {
+    if ((predicate->function & MASK_FUNC_FAMILY) != FUNC_FAM_OPERATOR) {
+        return;
     }
 
-    if (op == OPERATOR_LIKE) {
-        size_t len = strlen(right);
-        if (right[len-1] == '%') {
-            return strncmp(left, right, len -1) == 0;
+    if (
+        predicate->function == OPERATOR_OR
+        || predicate->function == OPERATOR_AND
+    ) {
+        for (int i = 0; i < predicate->child_count; i++) {
+            bindPredicateTypes(tables, &predicate->children[i], max_table_id);
         }
 
-        return strcmp(left, right) == 0;
-    }
-
-    size_t l_len = strlen(left);
-    size_t r_len = strlen(right);
-
-    if (strcmp(right, "NULL") == 0) {
-
-        if (op == OPERATOR_EQ) return l_len == 0;
-        if (op == OPERATOR_NE) return l_len != 0;
-
-        return 0;
+        return;
     }
 
-    if (strcmp(left, "NULL") == 0) {
-
-        if (op == OPERATOR_EQ) return r_len == 0;
-        if (op == OPERATOR_NE) return r_len != 0;
-
-        return 0;
-    }
+    for (int i = 0; i < predicate->child_count; i++) {
+        struct Node *child = &predicate->children[i];
 
-    // NULL values do not evaluate true with any other operator
-    if (l_len == 0 || r_len == 0) {
-        return 0;
-    }
+        if (child->function != FUNC_UNITY) {
+            continue;
+        }
 
-    if (is_numeric(left)) {
-        long left_num = strtol(left, NULL, 10);
-        long right_num = strtol(right, NULL, 10);
+        if (child->field.index == FIELD_CONSTANT) {
+            parseValue(&child->constant, child->field.text);
 
-        if (op == OPERATOR_EQ) return left_num == right_num;
-        if (op == OPERATOR_NE) return left_num != right_num;
-        if (op == OPERATOR_LT) return left_num < right_num;
-        if (op == OPERATOR_LE) return left_num <= right_num;
-        if (op == OPERATOR_GT) return left_num > right_num;
-        if (op == OPERATOR_GE) return left_num >= right_num;
+            child->type_hint = child->constant.type;
+        }
+        else if (
+            child->field.table_id >= 0
+            && child->field.table_id <= max_table_id
+            && child->field.index >= 0
+        ) {
+            child->type_hint = inferFieldType(
+                tables[child->field.table_id].db,
+                child->field.index
+            );
+        }
     }
-
-    if (op == OPERATOR_EQ) return strcmp(left, right) == 0;
-    if (op == OPERATOR_NE) return strcmp(left, right) != 0;
-    if (op == OPERATOR_LT) return strcmp(left, right) < 0;
-    if (op == OPERATOR_LE) return strcmp(left, right) <= 0;
-    if (op == OPERATOR_GT) return strcmp(left, right) > 0;
-    if (op == OPERATOR_GE) return strcmp(left, right) >= 0;
-
-    fprintf(stderr, "Unrecognised operator: %d\n", op);
-    exit(-1);
 }
 
 /**
@@ -8,6 +8,12 @@ int evaluateOperatorNodeListOR (struct Table *tables, int row_list, int row_inde
 
 int evaluateExpression (enum Function op, const char *left, const char *right);
 
+void bindPredicateTypes (
+    struct Table *tables,
+    struct Node *predicate,
+    int max_table_id
+);
+
 void normalisePredicate (struct Node *p);
 
 int flipPredicate (struct Node *p);
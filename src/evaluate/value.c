@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "./value.h"
+#include "../structs.h"
+#include "../functions/date.h"
+#include "../functions/util.h"
+
+static int compareOrdered (enum Function op, long diff);
+
+/**
+ * @brief Classify text into a typed value. Parsing happens once here so that
+ * comparisons don't need to re-parse dates or numbers.
+ *
+ * @param value OUT
+ * @param text Must outlive value
+ */
+void parseValue (struct Value *value, const char *text) {
+    struct DateTime dt;
+
+    value->text = text;
+
+    if (text[0] == '\0') {
+        value->type = VALUE_NULL;
+        return;
+    }
+
+    if (parseDateTime(text, &dt)) {
+        value->type = VALUE_DATETIME;
+        value->unix_time = datetimeGetUnix(&dt);
+
+        // Date comparisons ignore the time part
+        dt.hour = 0;
+        dt.minute = 0;
+        dt.second = 0;
+        value->julian = datetimeGetJulian(&dt);
+
+        return;
+    }
+
+    if (parseDate(text, &dt)) {
+        value->type = VALUE_DATE;
+        value->julian = datetimeGetJulian(&dt);
+        return;
+    }
+
+    if (is_numeric(text)) {
+        value->type = VALUE_INTEGER;
+        value->integer = strtol(text, NULL, 10);
+        return;
+    }
+
+    value->type = VALUE_STRING;
+}
+
+/**
+ * @brief Like parseValue() but tries the parse suggested by hint first. The
+ * hint is always checked, so a wrong hint only costs a fallback to
+ * parseValue(); the result is identical either way.
+ *
+ * @param value OUT
+ * @param text Must outlive value
+ * @param hint Expected type, usually from bindPredicateTypes()
+ */
+void parseValueAs (struct Value *value, const char *text, enum ValueType hint) {
+    struct DateTime dt;
+
+    value->text = text;
+
+    if (text[0] == '\0') {
+        value->type = VALUE_NULL;
+        return;
+    }
+
+    if (hint == VALUE_INTEGER) {
+        // No date format is purely numeric
+        if (is_numeric(text)) {
+            value->type = VALUE_INTEGER;
+            value->integer = strtol(text, NULL, 10);
+            return;
+        }
+    }
+    else if (hint == VALUE_DATE) {
+        // Too short to be a datetime
+        if (strlen(text) == 10 && parseDate(text, &dt)) {
+            value->type = VALUE_DATE;
+            value->julian = datetimeGetJulian(&dt);
+            return;
+        }
+    }
+    else if (hint == VALUE_STRING) {
+        // Numbers and every date format other than CURRENT_DATE start with a
+        // digit, sign, space or multibyte character
+        if (isalpha(text[0]) && strcmp(text, "CURRENT_DATE") != 0) {
+            value->type = VALUE_STRING;
+            return;
+        }
+    }
+
+    parseValue(value, text);
+}
+
+/**
+ * @brief Compare two typed values with an operator
+ *
+ * @return int 1 if the comparison is true; 0 if false
+ */
+int compareValues (enum Function op, struct Value *left, struct Value *right) {
+    if (op == OPERATOR_NEVER) {
+        return 0;
+    }
+
+    if (op == OPERATOR_ALWAYS) {
+        return 1;
+    }
+
+    if (left->type == VALUE_DATETIME && right->type == VALUE_DATETIME) {
+        if (op == OPERATOR_LIKE) return 0;
+
+        return compareOrdered(op, left->unix_time - right->unix_time);
+    }
+
+    if (
+        (left->type == VALUE_DATE || left->type == VALUE_DATETIME)
+        && (right->type == VALUE_DATE || right->type == VALUE_DATETIME)
+    ) {
+        if (op == OPERATOR_LIKE) return 0;
+
+        return compareOrdered(op, left->julian - right->julian);
+    }
+
+    if (op == OPERATOR_LIKE) {
+        size_t len = strlen(right->text);
+        if (right->text[len-1] == '%') {
+            return strncmp(left->text, right->text, len -1) == 0;
+        }
+
+        return strcmp(left->text, right->text) == 0;
+    }
+
+    if (strcmp(right->text, "NULL") == 0) {
+        if (op == OPERATOR_EQ) return left->type == VALUE_NULL;
+        if (op == OPERATOR_NE) return left->type != VALUE_NULL;
+
+        return 0;
+    }
+
+    if (strcmp(left->text, "NULL") == 0) {
+        if (op == OPERATOR_EQ) return right->type == VALUE_NULL;
+        if (op == OPERATOR_NE) return right->type != VALUE_NULL;
+
+        return 0;
+    }
+
+    // NULL values do not evaluate true with any other operator
+    if (left->type == VALUE_NULL || right->type == VALUE_NULL) {
+        return 0;
+    }
+
+    if (left->type == VALUE_INTEGER) {
+        long right_num = right->type == VALUE_INTEGER
+            ? right->integer
+            : strtol(right->text, NULL, 10);
+
+        if (left->integer == right_num) return compareOrdered(op, 0);
+
+        return compareOrdered(op, left->integer < right_num ? -1 : 1);
+    }
+
+    return compareOrdered(op, strcmp(left->text, right->text));
+}
+
+/**
+ * @brief Apply an ordering operator to the sign of a difference
+ */
+static int compareOrdered (enum Function op, long diff) {
+    if (op == OPERATOR_EQ) return diff == 0;
+    if (op == OPERATOR_NE) return diff != 0;
+    if (op == OPERATOR_LT) return diff < 0;
+    if (op == OPERATOR_LE) return diff <= 0;
+    if (op == OPERATOR_GT) return diff > 0;
+    if (op == OPERATOR_GE) return diff >= 0;
+
+    fprintf(stderr, "Unrecognised operator: %d\n", op);
+    exit(-1);
+}
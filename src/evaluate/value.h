@@ -0,0 +1,7 @@
+#include "../structs.h"
+
+void parseValue (struct Value *value, const char *text);
+
+void parseValueAs (struct Value *value, const char *text, enum ValueType hint);
+
+int compareValues (enum Function op, struct Value *left, struct Value *right);
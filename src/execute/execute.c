@@ -11,6 +11,7 @@
 #include "executeFilter.h"
 #include "executeProcess.h"
 #include "executeSelect.h"
+#include "executeStream.h"
 #include "../query/result.h"
 #include "../db/indices.h"
 #include "../db/db.h"
@@ -29,6 +30,10 @@ int executeQueryPlan (
 
     // results.list_count = 1;
 
+    if (isStreamablePlan(query, plan)) {
+        return executeStreamingPlan(query, plan, output_flags, output);
+    }
+
     FILE *fstats = NULL;
     struct timeval stop, start;
 
@@ -229,6 +234,21 @@ int executeQueryPlan (
                 break;
             }
 
+            case PLAN_HASH_JOIN: {
+                /*************************************************************
+                 * Join type where a hash table is built once on the right
+                 * table's join key and probed by each row on the left.
+                 *************************************************************/
+
+                #ifdef DEBUG
+                debugLog(query, "PLAN_HASH_JOIN");
+                #endif
+
+                result = executeHashJoin(tables, s, result_set);
+
+                break;
+            }
+
             case PLAN_SORT: {
                 #ifdef DEBUG
                 debugLog(query, "PLAN_SORT");
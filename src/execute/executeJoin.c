@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "../structs.h"
 #include "../query/query.h"
@@ -8,10 +9,127 @@
 #include "../evaluate/evaluate.h"
 #include "../db/indices.h"
 #include "../functions/util.h"
+#include "../functions/date.h"
 #include "../debug.h"
 
+#define HASH_JOIN_INITIAL_SIZE 64
+
+/**
+ * Index joins seek to each distinct key when the index has more than this
+ * many rows per key (about the cost of a binary search); otherwise they read
+ * the whole index once
+ */
+#define INDEX_JOIN_SEEK_RATIO 16
+
+/**
+ * @brief Multi-map from join key to rowids of the right hand table. Entries
+ * sharing a slot are chained through `next` in ascending rowid order.
+ */
+struct JoinHashTable {
+    int entry_count;
+    int entry_capacity;
+    int *rowids;
+    int *next;
+    unsigned long *hashes;
+    size_t *key_offsets;
+    /** Each slot holds the first entry index of a chain or -1 for empty */
+    int *slots;
+    size_t slot_count;
+    char *arena;
+    size_t arena_size;
+    size_t arena_capacity;
+};
+
+/**
+ * @brief Rows of the right hand table matched by each row on the left of an
+ * index join
+ */
+struct IndexJoinMatches {
+    /** Offset into rowids of the first match for each row on the left */
+    int *offsets;
+    /** Number of matches for each row on the left */
+    int *counts;
+    int *rowids;
+    int rowid_count;
+    int rowid_capacity;
+};
+
+/**
+ * @brief Key from a row on the left of an index join
+ */
+struct IndexProbe {
+    int row;
+    int is_number;
+    long number;
+    const char *key;
+};
+
 static void replaceTableID (struct Node *node, int table_id);
 
+static int canBatchIndexJoin (struct DB *index_db, struct PlanStep *step);
+
+static void findIndexJoinMatches (
+    struct Table *tables,
+    RowListIndex list_id,
+    struct Node *outer,
+    struct DB *index_db,
+    int rowid_column,
+    struct IndexJoinMatches *matches
+);
+
+static int findIndexRun (
+    struct DB *index_db,
+    struct IndexProbe *probe,
+    int *index_rowid,
+    int seek
+);
+
+static RowListIndex joinIndexMatches (
+    struct Table *table,
+    RowListIndex list_id,
+    struct IndexJoinMatches *matches,
+    int max_matches
+);
+
+static void freeIndexJoinMatches (struct IndexJoinMatches *matches);
+
+static int compareIndexProbes (const void *a, const void *b);
+
+static int compareProbeKeys (struct IndexProbe *a, struct IndexProbe *b);
+
+static int compareIndexKey (
+    const char *key,
+    struct IndexProbe *probe
+);
+
+static int makeJoinKey (const char *value, char *key, size_t max_length);
+
+static unsigned long hashJoinKey (const char *key);
+
+static int matchJoinKeys (const char *a, const char *b);
+
+static size_t storeJoinKey (
+    char **arena,
+    size_t *arena_size,
+    size_t *arena_capacity,
+    const char *key
+);
+
+static void buildJoinHashTable (
+    struct JoinHashTable *hash_table,
+    struct Table *table,
+    struct Node *inner
+);
+
+static void freeJoinHashTable (struct JoinHashTable *hash_table);
+
+static int findJoinHashEntry (
+    struct JoinHashTable *hash_table,
+    const char *key,
+    unsigned long hash,
+    int entry
+);
+
 /**
  * @brief Every row of left table is unconditionally joined to every
  * row of right table.
@@ -318,12 +436,8 @@ int executeUniqueJoin (
 
     struct Table *table = &tables[table_id];
 
-    RowListIndex new_list = createRowList(
-        getRowList(list_id)->join_count + 1,
-        getRowList(list_id)->row_count
-    );
-
-    RowListIndex tmp_list = createRowList(1, 1);
+    // Rows of the inner table are looked up through its index
+    adviseAccess(table->db, ACCESS_RANDOM);
 
     struct Node * p = &step->nodes[0];
 
@@ -364,6 +478,39 @@ int executeUniqueJoin (
 
     int rowid_field = getFieldIndex(&index_db, "rowid");
 
+    if (canBatchIndexJoin(&index_db, step)) {
+        // Every row is needed so look up all the keys in index order
+        struct IndexJoinMatches matches;
+
+        findIndexJoinMatches(
+            tables,
+            list_id,
+            outer,
+            &index_db,
+            rowid_field,
+            &matches
+        );
+
+        RowListIndex new_list = joinIndexMatches(table, list_id, &matches, 1);
+
+        freeIndexJoinMatches(&matches);
+
+        closeDB(&index_db);
+
+        destroyRowList(list_id);
+
+        pushRowList(result_set, new_list);
+
+        return 0;
+    }
+
+    RowListIndex new_list = createRowList(
+        getRowList(list_id)->join_count + 1,
+        getRowList(list_id)->row_count
+    );
+
+    RowListIndex tmp_list = createRowList(1, 1);
+
     for (unsigned int i = 0; i < getRowList(list_id)->row_count; i++) {
         char value[MAX_VALUE_LENGTH];
         int output_status;
@@ -448,12 +595,8 @@ int executeIndexJoin (
 
     struct Table *table = &tables[table_id];
 
-    RowListIndex new_list = createRowList(
-        getRowList(list_id)->join_count + 1,
-        getRowList(list_id)->row_count
-    );
-
-    RowListIndex tmp_list = createRowList(1, getRecordCount(table->db));
+    // Rows of the inner table are looked up through its index
+    adviseAccess(table->db, ACCESS_RANDOM);
 
     struct Node * p = &step->nodes[0];
 
@@ -496,6 +639,44 @@ int executeIndexJoin (
     // table
     int rowid_col = getFieldIndex(&index_db, "rowid");
 
+    if (p->function == OPERATOR_EQ && canBatchIndexJoin(&index_db, step)) {
+        // Every row is needed so look up all the keys in index order
+        struct IndexJoinMatches matches;
+
+        findIndexJoinMatches(
+            tables,
+            list_id,
+            outer,
+            &index_db,
+            rowid_col,
+            &matches
+        );
+
+        RowListIndex new_list = joinIndexMatches(
+            table,
+            list_id,
+            &matches,
+            matches.rowid_count
+        );
+
+        freeIndexJoinMatches(&matches);
+
+        closeDB(&index_db);
+
+        destroyRowList(list_id);
+
+        pushRowList(result_set, new_list);
+
+        return 0;
+    }
+
+    RowListIndex new_list = createRowList(
+        getRowList(list_id)->join_count + 1,
+        getRowList(list_id)->row_count
+    );
+
+    RowListIndex tmp_list = createRowList(1, getRecordCount(table->db));
+
     for (unsigned int i = 0; i < getRowList(list_id)->row_count; i++) {
         char value[MAX_VALUE_LENGTH];
         int done = 0;
@@ -573,6 +754,528 @@ int executeIndexJoin (
     return 0;
 }
 
+/**
+ * @brief Join type for an equality predicate where no index is available.
+ * The right table is read once to build a hash table on its join key, then
+ * each row on the left probes the hash table for matching rows.
+ *
+ * @param query
+ * @param step
+ * @param result_set
+ * @return int 0 on success
+ */
+int executeHashJoin (
+    struct Table *tables,
+    struct PlanStep *step,
+    struct ResultSet *result_set
+) {
+
+    RowListIndex list_id = popRowList(result_set);
+
+    int table_id = getRowList(list_id)->join_count;
+
+    struct Table *table = &tables[table_id];
+
+    struct Node * p = &step->nodes[0];
+
+    if (p->function != OPERATOR_EQ) {
+        fprintf(stderr, "HASH JOIN requires an equality predicate\n");
+        return -1;
+    }
+
+    if (getTableBitMap(&p->children[0]) != (1 << table_id)) {
+        fprintf(stderr, "HASH JOIN table must be on left\n");
+        return -1;
+    }
+
+    struct Node * outer = &p->children[1];
+
+    if (getTableBitMap(outer) & (1 << table_id)) {
+        fprintf(stderr, "Unable to perform HASH JOIN\n");
+        return -1;
+    }
+
+    // Inner node is evaluated against the single right hand table only
+    struct Node inner;
+    copyNodeTree(&inner, &p->children[0]);
+    replaceTableID(&inner, 0);
+
+    struct JoinHashTable hash_table;
+    buildJoinHashTable(&hash_table, table, &inner);
+
+    freeNode(&inner);
+
+    int row_count = getRowList(list_id)->row_count;
+
+    // First pass: probe the hash table with each row on the left and
+    // remember the first matching entry so the output list can be sized
+    // exactly.
+    int *first_entries = malloc(sizeof(*first_entries) * row_count);
+    unsigned long *probe_hashes = malloc(sizeof(*probe_hashes) * row_count);
+
+    // Probe keys are kept because key matching is not transitive: a date
+    // matches datetimes at different times of the day which do not match
+    // each other.
+    size_t *probe_offsets = malloc(sizeof(*probe_offsets) * row_count);
+    size_t probe_arena_size = 0;
+    size_t probe_arena_capacity = HASH_JOIN_INITIAL_SIZE;
+    char *probe_arena = malloc(probe_arena_capacity);
+
+    if (
+        probe_arena == NULL
+        || (row_count > 0 && (
+            first_entries == NULL || probe_hashes == NULL
+            || probe_offsets == NULL
+        ))
+    ) {
+        fprintf(stderr, "Unable to allocate space for hash join probe.\n");
+        exit(-1);
+    }
+
+    long new_length = 0;
+
+    for (int i = 0; i < row_count; i++) {
+        char value[MAX_VALUE_LENGTH];
+        char key[MAX_VALUE_LENGTH];
+
+        first_entries[i] = -1;
+
+        // Fill in value from outer tables
+        evaluateNode(
+            tables,
+            list_id,
+            i,
+            outer,
+            value,
+            MAX_VALUE_LENGTH
+        );
+
+        if (makeJoinKey(value, key, MAX_VALUE_LENGTH)) {
+            unsigned long hash = hashJoinKey(key);
+            int entry = findJoinHashEntry(&hash_table, key, hash, -1);
+
+            first_entries[i] = entry;
+            probe_hashes[i] = hash;
+
+            if (entry != -1) {
+                probe_offsets[i] = storeJoinKey(
+                    &probe_arena,
+                    &probe_arena_size,
+                    &probe_arena_capacity,
+                    key
+                );
+            }
+
+            while (entry != -1) {
+                new_length++;
+                entry = findJoinHashEntry(&hash_table, key, hash, entry);
+            }
+        }
+
+        if (first_entries[i] == -1 && table->join_type == JOIN_LEFT) {
+            new_length++;
+        }
+
+        if (step->limit > -1 && new_length >= step->limit) {
+            new_length = step->limit;
+            row_count = i + 1;
+            break;
+        }
+    }
+
+    RowListIndex new_list = createRowList(
+        getRowList(list_id)->join_count + 1,
+        new_length
+    );
+
+    // Second pass: emit joined rows
+    for (int i = 0; i < row_count; i++) {
+        int done = 0;
+        int entry = first_entries[i];
+
+        if (entry == -1) {
+            if (table->join_type == JOIN_LEFT) {
+                // Add NULL rowid
+                appendJoinedRowID(
+                    getRowList(new_list),
+                    getRowList(list_id),
+                    i,
+                    ROWID_NULL
+                );
+            }
+
+            continue;
+        }
+
+        const char *key = probe_arena + probe_offsets[i];
+
+        while (entry != -1) {
+            appendJoinedRowID(
+                getRowList(new_list),
+                getRowList(list_id),
+                i,
+                hash_table.rowids[entry]
+            );
+
+            if (
+                step->limit > -1
+                && getRowList(new_list)->row_count >= (unsigned)step->limit
+            ) {
+                done = 1;
+                break;
+            }
+
+            entry = findJoinHashEntry(
+                &hash_table,
+                key,
+                probe_hashes[i],
+                entry
+            );
+        }
+
+        if (done) break;
+    }
+
+    free(first_entries);
+    free(probe_hashes);
+    free(probe_offsets);
+    free(probe_arena);
+
+    freeJoinHashTable(&hash_table);
+
+    destroyRowList(list_id);
+
+    pushRowList(result_set, new_list);
+
+    return 0;
+}
+
+/**
+ * @brief Keys can be looked up together when every row is wanted and the
+ * index is a file sorted on its first column. Virtual tables such as CALENDAR
+ * act as their own index with their own ordering.
+ */
+static int canBatchIndexJoin (struct DB *index_db, struct PlanStep *step) {
+    return step->limit < 0
+        && index_db->vfs != VFS_CALENDAR
+        && index_db->vfs != VFS_SEQUENCE;
+}
+
+/**
+ * @brief Look up the key of every row on the left in the index. Keys are
+ * sorted into index order first so the index is read forwards once, either
+ * from start to end or, when there are few keys, seeking to each one.
+ * Duplicate keys are only looked up once.
+ *
+ * @param rowid_column column of the index containing the table rowid
+ * @param matches OUT must be freed with freeIndexJoinMatches()
+ */
+static void findIndexJoinMatches (
+    struct Table *tables,
+    RowListIndex list_id,
+    struct Node *outer,
+    struct DB *index_db,
+    int rowid_column,
+    struct IndexJoinMatches *matches
+) {
+    int row_count = getRowList(list_id)->row_count;
+    int record_count = getRecordCount(index_db);
+
+    struct IndexProbe *probes = malloc(sizeof(*probes) * (row_count + 1));
+    size_t *key_offsets = malloc(sizeof(*key_offsets) * (row_count + 1));
+
+    size_t arena_size = 0;
+    size_t arena_capacity = 16 * (size_t)row_count + 64;
+    char *arena = malloc(arena_capacity);
+
+    matches->offsets = malloc(sizeof(*matches->offsets) * (row_count + 1));
+    matches->counts = malloc(sizeof(*matches->counts) * (row_count + 1));
+    matches->rowid_count = 0;
+    matches->rowid_capacity = HASH_JOIN_INITIAL_SIZE;
+    matches->rowids = malloc(
+        sizeof(*matches->rowids) * matches->rowid_capacity
+    );
+
+    if (
+        probes == NULL || key_offsets == NULL || arena == NULL
+        || matches->offsets == NULL || matches->counts == NULL
+        || matches->rowids == NULL
+    ) {
+        fprintf(stderr, "Unable to allocate space for index join probe.\n");
+        exit(-1);
+    }
+
+    for (int i = 0; i < row_count; i++) {
+        char value[MAX_VALUE_LENGTH];
+
+        // Fill in value from outer tables
+        evaluateNode(
+            tables,
+            list_id,
+            i,
+            outer,
+            value,
+            MAX_VALUE_LENGTH
+        );
+
+        size_t length = strlen(value) + 1;
+
+        if (arena_size + length > arena_capacity) {
+            while (arena_size + length > arena_capacity) {
+                arena_capacity *= 2;
+            }
+
+            arena = realloc(arena, arena_capacity);
+
+            if (arena == NULL) {
+                fprintf(stderr, "Unable to allocate space for join keys.\n");
+                exit(-1);
+            }
+        }
+
+        memcpy(arena + arena_size, value, length);
+        key_offsets[i] = arena_size;
+        arena_size += length;
+
+        probes[i].row = i;
+        probes[i].is_number = is_numeric(value);
+        probes[i].number = probes[i].is_number ? atol(value) : 0;
+    }
+
+    int distinct_count = 0;
+
+    for (int i = 0; i < row_count; i++) {
+        probes[i].key = arena + key_offsets[i];
+    }
+
+    qsort(probes, row_count, sizeof(*probes), compareIndexProbes);
+
+    for (int i = 0; i < row_count; i++) {
+        if (i == 0 || compareProbeKeys(&probes[i], &probes[i - 1]) != 0) {
+            distinct_count++;
+        }
+    }
+
+    int seek = (long)distinct_count * INDEX_JOIN_SEEK_RATIO < record_count;
+
+    int index_rowid = 0;
+
+    for (int i = 0; i < row_count; i++) {
+        struct IndexProbe *probe = &probes[i];
+
+        if (i > 0 && compareProbeKeys(probe, &probes[i - 1]) == 0) {
+            // Same key as the previous row so same matches
+            matches->offsets[probe->row] = matches->offsets[probes[i - 1].row];
+            matches->counts[probe->row] = matches->counts[probes[i - 1].row];
+            continue;
+        }
+
+        matches->offsets[probe->row] = matches->rowid_count;
+
+        if (findIndexRun(index_db, probe, &index_rowid, seek)) {
+            char value[MAX_VALUE_LENGTH];
+
+            while (index_rowid < record_count) {
+                getRecordValue(index_db, index_rowid, 0, value, MAX_VALUE_LENGTH);
+
+                if (compareIndexKey(value, probe) != 0) {
+                    break;
+                }
+
+                getRecordValue(
+                    index_db,
+                    index_rowid,
+                    rowid_column,
+                    value,
+                    MAX_VALUE_LENGTH
+                );
+
+                if (matches->rowid_count == matches->rowid_capacity) {
+                    matches->rowid_capacity *= 2;
+                    matches->rowids = realloc(
+                        matches->rowids,
+                        sizeof(*matches->rowids) * matches->rowid_capacity
+                    );
+
+                    if (matches->rowids == NULL) {
+                        fprintf(stderr, "Unable to allocate space for join.\n");
+                        exit(-1);
+                    }
+                }
+
+                matches->rowids[matches->rowid_count++] = atoi(value);
+
+                index_rowid++;
+            }
+        }
+
+        matches->counts[probe->row] =
+            matches->rowid_count - matches->offsets[probe->row];
+    }
+
+    free(probes);
+    free(key_offsets);
+    free(arena);
+}
+
+/**
+ * @brief Move index_rowid forwards to the first index entry matching probe
+ *
+ * @param index_rowid IN/OUT index entry to search from
+ * @param seek 1 to binary search the index; 0 to read forwards
+ * @return int 1 if an entry matches; 0 otherwise
+ */
+static int findIndexRun (
+    struct DB *index_db,
+    struct IndexProbe *probe,
+    int *index_rowid,
+    int seek
+) {
+    int record_count = getRecordCount(index_db);
+    char value[MAX_VALUE_LENGTH];
+
+    if (seek) {
+        int output_status;
+
+        int rowid = uniqueIndexSearch(index_db, probe->key, &output_status);
+
+        if (output_status != RESULT_FOUND) {
+            return 0;
+        }
+
+        // Search may land anywhere within a run of duplicates
+        while (rowid > 0) {
+            getRecordValue(index_db, rowid - 1, 0, value, MAX_VALUE_LENGTH);
+
+            if (compareIndexKey(value, probe) != 0) {
+                break;
+            }
+
+            rowid--;
+        }
+
+        *index_rowid = rowid;
+    }
+
+    while (*index_rowid < record_count) {
+        getRecordValue(index_db, *index_rowid, 0, value, MAX_VALUE_LENGTH);
+
+        int result = compareIndexKey(value, probe);
+
+        if (result >= 0) {
+            return result == 0;
+        }
+
+        (*index_rowid)++;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Create the joined RowList, keeping rows in their original order
+ *
+ * @param max_matches maximum number of rows to join to each row on the left
+ */
+static RowListIndex joinIndexMatches (
+    struct Table *table,
+    RowListIndex list_id,
+    struct IndexJoinMatches *matches,
+    int max_matches
+) {
+    int row_count = getRowList(list_id)->row_count;
+
+    long new_length = 0;
+
+    for (int i = 0; i < row_count; i++) {
+        int count = MIN(matches->counts[i], max_matches);
+
+        if (count == 0 && table->join_type == JOIN_LEFT) {
+            count = 1;
+        }
+
+        new_length += count;
+    }
+
+    RowListIndex new_list = createRowList(
+        getRowList(list_id)->join_count + 1,
+        new_length
+    );
+
+    for (int i = 0; i < row_count; i++) {
+        int count = MIN(matches->counts[i], max_matches);
+
+        if (count == 0 && table->join_type == JOIN_LEFT) {
+            // Add NULL rowid
+            appendJoinedRowID(
+                getRowList(new_list),
+                getRowList(list_id),
+                i,
+                ROWID_NULL
+            );
+        }
+
+        for (int j = 0; j < count; j++) {
+            appendJoinedRowID(
+                getRowList(new_list),
+                getRowList(list_id),
+                i,
+                matches->rowids[matches->offsets[i] + j]
+            );
+        }
+    }
+
+    return new_list;
+}
+
+static void freeIndexJoinMatches (struct IndexJoinMatches *matches) {
+    free(matches->offsets);
+    free(matches->counts);
+    free(matches->rowids);
+}
+
+/**
+ * @brief qsort comparator putting probes in index order, then row order
+ */
+static int compareIndexProbes (const void *a, const void *b) {
+    struct IndexProbe *probe_a = (struct IndexProbe *)a;
+    struct IndexProbe *probe_b = (struct IndexProbe *)b;
+
+    int result = compareProbeKeys(probe_a, probe_b);
+
+    if (result != 0) {
+        return result;
+    }
+
+    return (probe_a->row > probe_b->row) - (probe_a->row < probe_b->row);
+}
+
+/**
+ * @brief Same ordering as sortQuick() used to build indexes: numerically if
+ * both are numbers, otherwise as strings
+ */
+static int compareProbeKeys (struct IndexProbe *a, struct IndexProbe *b) {
+    if (a->is_number && b->is_number) {
+        return (a->number > b->number) - (a->number < b->number);
+    }
+
+    return strcmp(a->key, b->key);
+}
+
+/**
+ * @return int <0, 0, >0 as index key is below, equal to or above probe
+ */
+static int compareIndexKey (const char *key, struct IndexProbe *probe) {
+    struct IndexProbe key_probe = {
+        .is_number = is_numeric(key),
+        .key = key,
+    };
+
+    key_probe.number = key_probe.is_number ? atol(key) : 0;
+
+    return compareProbeKeys(&key_probe, probe);
+}
+
 static void replaceTableID (struct Node *node, int table_id) {
     for (int i = 0; i < node->child_count; i++) {
         struct Node *child = &node->children[i];
@@ -580,4 +1283,277 @@ static void replaceTableID (struct Node *node, int table_id) {
     }
 
     node->field.table_id = table_id;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Normalise a value so that values which compare equal with
+ * OPERATOR_EQ also produce matching keys. Dates and numbers are written in
+ * canonical form with a prefix to keep the different types apart.
+ *
+ * Datetimes share the julian prefix of plain dates, followed by the unix
+ * time, since a date equals any datetime on that day. See matchJoinKeys().
+ *
+ * @param value
+ * @param key OUT
+ * @param max_length
+ * @return int 0 if the value is NULL and can never match; 1 otherwise
+ */
+static int makeJoinKey (const char *value, char *key, size_t max_length) {
+    struct DateTime dt;
+
+    // NULL values never match with OPERATOR_EQ
+    if (value[0] == '\0') {
+        return 0;
+    }
+
+    if (parseDateTime(value, &dt)) {
+        long unix_time = datetimeGetUnix(&dt);
+
+        // Date comparisons ignore the time part
+        dt.hour = 0;
+        dt.minute = 0;
+        dt.second = 0;
+
+        snprintf(
+            key,
+            max_length,
+            "D%dT%ld",
+            datetimeGetJulian(&dt),
+            unix_time
+        );
+    }
+    else if (parseDate(value, &dt)) {
+        snprintf(key, max_length, "D%d", datetimeGetJulian(&dt));
+    }
+    else if (is_numeric(value)) {
+        snprintf(key, max_length, "N%ld", strtol(value, NULL, 10));
+    }
+    else {
+        snprintf(key, max_length, "S%s", value);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief FNV-1a hash of a NUL terminated join key. The time part of a
+ * datetime key is left out so it hashes the same as a plain date.
+ */
+static unsigned long hashJoinKey (const char *key) {
+    unsigned long hash = 2166136261UL;
+    int is_date = key[0] == 'D';
+
+    while (*key && !(is_date && *key == 'T')) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Compare two join keys. Date keys match on the julian part alone
+ * unless both sides also carry a time, mirroring compareValues().
+ *
+ * @return int 1 if the keys match
+ */
+static int matchJoinKeys (const char *a, const char *b) {
+    if (a[0] != 'D' || b[0] != 'D') {
+        return strcmp(a, b) == 0;
+    }
+
+    while (*a && *a != 'T' && *a == *b) {
+        a++;
+        b++;
+    }
+
+    int a_end = *a == '\0' || *a == 'T';
+    int b_end = *b == '\0' || *b == 'T';
+
+    if (!a_end || !b_end) {
+        return 0;
+    }
+
+    if (*a == '\0' || *b == '\0') {
+        return 1;
+    }
+
+    return strcmp(a, b) == 0;
+}
+
+/**
+ * @brief Copy a NUL terminated key into a growable arena
+ *
+ * @return size_t offset of the key in the arena
+ */
+static size_t storeJoinKey (
+    char **arena,
+    size_t *arena_size,
+    size_t *arena_capacity,
+    const char *key
+) {
+    size_t key_len = strlen(key) + 1;
+
+    if (*arena_size + key_len > *arena_capacity) {
+        while (*arena_size + key_len > *arena_capacity) {
+            *arena_capacity *= 2;
+        }
+
+        *arena = realloc(*arena, *arena_capacity);
+
+        if (*arena == NULL) {
+            fprintf(stderr, "Unable to allocate space for join keys.\n");
+            exit(-1);
+        }
+    }
+
+    size_t offset = *arena_size;
+
+    memcpy(*arena + offset, key, key_len);
+    *arena_size += key_len;
+
+    return offset;
+}
+
+/**
+ * @brief Evaluate `inner` for every row of `table` and insert each key into
+ * the hash table. Rows are inserted in reverse so each chain ends up in
+ * ascending rowid order.
+ */
+static void buildJoinHashTable (
+    struct JoinHashTable *hash_table,
+    struct Table *table,
+    struct Node *inner
+) {
+    int record_count = getRecordCount(table->db);
+
+    hash_table->entry_count = 0;
+    hash_table->entry_capacity = HASH_JOIN_INITIAL_SIZE;
+    while (hash_table->entry_capacity < record_count) {
+        hash_table->entry_capacity *= 2;
+    }
+
+    hash_table->rowids = malloc(
+        sizeof(*hash_table->rowids) * hash_table->entry_capacity
+    );
+    hash_table->next = malloc(
+        sizeof(*hash_table->next) * hash_table->entry_capacity
+    );
+    hash_table->hashes = malloc(
+        sizeof(*hash_table->hashes) * hash_table->entry_capacity
+    );
+    hash_table->key_offsets = malloc(
+        sizeof(*hash_table->key_offsets) * hash_table->entry_capacity
+    );
+
+    hash_table->slot_count = hash_table->entry_capacity * 2;
+    hash_table->slots = malloc(
+        sizeof(*hash_table->slots) * hash_table->slot_count
+    );
+
+    hash_table->arena_size = 0;
+    hash_table->arena_capacity = hash_table->entry_capacity * 16;
+    hash_table->arena = malloc(hash_table->arena_capacity);
+
+    if (
+        hash_table->rowids == NULL || hash_table->next == NULL
+        || hash_table->hashes == NULL || hash_table->key_offsets == NULL
+        || hash_table->slots == NULL || hash_table->arena == NULL
+    ) {
+        fprintf(
+            stderr,
+            "Unable to allocate space for hash join of %d rows.\n",
+            record_count
+        );
+        exit(-1);
+    }
+
+    memset(
+        hash_table->slots,
+        -1,
+        sizeof(*hash_table->slots) * hash_table->slot_count
+    );
+
+    size_t mask = hash_table->slot_count - 1;
+
+    for (int rowid = record_count - 1; rowid >= 0; rowid--) {
+        char value[MAX_VALUE_LENGTH];
+        char key[MAX_VALUE_LENGTH];
+
+        evaluateNode(
+            table,
+            ROWLIST_ROWID,
+            rowid,
+            inner,
+            value,
+            MAX_VALUE_LENGTH
+        );
+
+        if (!makeJoinKey(value, key, MAX_VALUE_LENGTH)) {
+            continue;
+        }
+
+        int entry = hash_table->entry_count++;
+        unsigned long hash = hashJoinKey(key);
+        size_t slot = hash & mask;
+
+        hash_table->key_offsets[entry] = storeJoinKey(
+            &hash_table->arena,
+            &hash_table->arena_size,
+            &hash_table->arena_capacity,
+            key
+        );
+
+        hash_table->rowids[entry] = rowid;
+        hash_table->hashes[entry] = hash;
+
+        // Prepend to chain
+        hash_table->next[entry] = hash_table->slots[slot];
+        hash_table->slots[slot] = entry;
+    }
+}
+
+static void freeJoinHashTable (struct JoinHashTable *hash_table) {
+    free(hash_table->rowids);
+    free(hash_table->next);
+    free(hash_table->hashes);
+    free(hash_table->key_offsets);
+    free(hash_table->slots);
+    free(hash_table->arena);
+}
+
+/**
+ * @brief Find the next entry matching `key`
+ *
+ * @param entry previous matching entry or -1 to start a new search
+ * @return int entry index or -1 if there are no more matches
+ */
+static int findJoinHashEntry (
+    struct JoinHashTable *hash_table,
+    const char *key,
+    unsigned long hash,
+    int entry
+) {
+    if (entry == -1) {
+        entry = hash_table->slots[hash & (hash_table->slot_count - 1)];
+    }
+    else {
+        entry = hash_table->next[entry];
+    }
+
+    while (entry != -1) {
+        if (
+            hash_table->hashes[entry] == hash
+            && matchJoinKeys(
+                hash_table->arena + hash_table->key_offsets[entry],
+                key
+            )
+        ) {
+            return entry;
+        }
+
+        entry = hash_table->next[entry];
+    }
+
+    return -1;
+}
@@ -29,3 +29,10 @@ int executeIndexJoin (
     struct PlanStep *step,
     struct ResultSet *result_set
 );
+
+
+int executeHashJoin (
+    struct Table *tables,
+    struct PlanStep *step,
+    struct ResultSet *result_set
+);
\ No newline at end of file
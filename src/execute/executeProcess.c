@@ -6,6 +6,43 @@
 #include "../sort/sort-quick.h"
 #include "../evaluate/evaluate.h"
 
+#define GROUP_HASH_INITIAL_SIZE 64
+
+struct GroupHashTable {
+    int bucket_count;
+    int bucket_capacity;
+    RowListIndex *buckets;
+    size_t *key_offsets;
+    unsigned long *hashes;
+    /** Each slot holds a bucket index or -1 for empty */
+    int *slots;
+    size_t slot_count;
+    char *arena;
+    size_t arena_size;
+    size_t arena_capacity;
+};
+
+static unsigned long hashGroupKey (const char *key);
+
+static void initGroupHashTable (struct GroupHashTable *table);
+
+static void freeGroupHashTable (struct GroupHashTable *table);
+
+static int findGroupBucket (
+    struct GroupHashTable *table,
+    const char *key,
+    unsigned long hash
+);
+
+static int addGroupBucket (
+    struct GroupHashTable *table,
+    const char *key,
+    unsigned long hash,
+    RowListIndex bucket
+);
+
+static void growGroupHashSlots (struct GroupHashTable *table);
+
 int executeSort (
     struct Table *tables,
     struct PlanStep *step,
@@ -19,7 +56,8 @@ int executeSort (
         tables,
         step->nodes,
         step->node_count,
-        list_id
+        list_id,
+        step->limit
     );
 
     pushRowList(result_set, list_id);
@@ -121,7 +159,9 @@ int executeGroupSorted (
 }
 
 /**
- * @brief Group items by bucket index lookup
+ * @brief Group items by bucket index lookup. Group keys are looked up in an
+ * open-addressing hash table; key text is stored contiguously in an arena.
+ * Buckets are still created in first-seen order.
  *
  * @param query
  * @param step
@@ -144,9 +184,8 @@ int executeGroupBucket (
     // Get RowList
     RowListIndex list_id = popRowList(result_set);
 
-    int bucket_count = 0;
-    char (*bucket_keys)[MAX_VALUE_LENGTH] = NULL;
-    RowListIndex *buckets = NULL;
+    struct GroupHashTable table;
+    initGroupHashTable(&table);
 
     // We cannot have a long kept reference to the RowList because
     // more RowLists get allocated in the loop
@@ -170,66 +209,32 @@ int executeGroupBucket (
             MAX_VALUE_LENGTH
         );
 
-        // Find bucket index;
-        int bucket_index = -1;
-        for (int i = 0; i < bucket_count; i++) {
-            if (strcmp(value, bucket_keys[i]) == 0) {
-                bucket_index = i;
-                break;
-            }
-        }
+        unsigned long hash = hashGroupKey(value);
+
+        // Find bucket index
+        int bucket_index = findGroupBucket(&table, value, hash);
 
         if (bucket_index == -1) {
             // Bucket not found. We need to make a new bucket
+            RowListIndex bucket = createRowList(join_count, row_count - i);
 
-            if (bucket_keys == NULL) {
-                bucket_keys = malloc(sizeof(*bucket_keys));
-                buckets = malloc(sizeof(*buckets));
-            }
-            else {
-                bucket_keys = realloc(
-                    bucket_keys,
-                    sizeof(*bucket_keys) * (bucket_count + 1)
-                );
-                buckets = realloc(
-                    buckets,
-                    sizeof(*buckets) * (bucket_count + 1)
-                );
-
-                if (bucket_keys == NULL || buckets == NULL) {
-                    fprintf(
-                        stderr,
-                        "Unable to allocate space for %d buckets.\n",
-                        bucket_count + 1
-                    );
-                    exit(-1);
-                }
-            }
-
-            strcpy(bucket_keys[bucket_count], value);
-            buckets[bucket_count] = createRowList(join_count, row_count - i);
-
-            getRowList(buckets[bucket_count])->group = 1;
+            getRowList(bucket)->group = 1;
 
-            pushRowList(result_set, buckets[bucket_count]);
+            pushRowList(result_set, bucket);
 
-            bucket_index = bucket_count++;
+            bucket_index = addGroupBucket(&table, value, hash, bucket);
         }
 
         copyResultRow(
-            getRowList(buckets[bucket_index]),
+            getRowList(table.buckets[bucket_index]),
             getRowList(list_id),
             i
         );
     }
 
-    if (buckets != NULL) {
-        free(buckets);
-    }
+    int bucket_count = table.bucket_count;
 
-    if (bucket_keys != NULL) {
-        free(bucket_keys);
-    }
+    freeGroupHashTable(&table);
 
     // Discard any buckets more than the limit
     if (step->limit > -1) {
@@ -243,4 +248,192 @@ int executeGroupBucket (
     destroyRowList(list_id);
 
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief FNV-1a hash of a NUL terminated group key
+ */
+static unsigned long hashGroupKey (const char *key) {
+    unsigned long hash = 2166136261UL;
+
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+static void initGroupHashTable (struct GroupHashTable *table) {
+    table->bucket_count = 0;
+    table->bucket_capacity = GROUP_HASH_INITIAL_SIZE;
+    table->buckets = malloc(sizeof(*table->buckets) * table->bucket_capacity);
+    table->key_offsets = malloc(
+        sizeof(*table->key_offsets) * table->bucket_capacity
+    );
+    table->hashes = malloc(sizeof(*table->hashes) * table->bucket_capacity);
+
+    // Slot count is always a power of two and at least twice bucket_capacity
+    table->slot_count = GROUP_HASH_INITIAL_SIZE * 2;
+    table->slots = malloc(sizeof(*table->slots) * table->slot_count);
+    memset(table->slots, -1, sizeof(*table->slots) * table->slot_count);
+
+    table->arena_size = 0;
+    table->arena_capacity = GROUP_HASH_INITIAL_SIZE * 16;
+    table->arena = malloc(table->arena_capacity);
+
+    if (
+        table->buckets == NULL || table->key_offsets == NULL
+        || table->hashes == NULL || table->slots == NULL
+        || table->arena == NULL
+    ) {
+        fprintf(stderr, "Unable to allocate space for group buckets.\n");
+        exit(-1);
+    }
+}
+
+static void freeGroupHashTable (struct GroupHashTable *table) {
+    free(table->buckets);
+    free(table->key_offsets);
+    free(table->hashes);
+    free(table->slots);
+    free(table->arena);
+}
+
+/**
+ * @brief Find the bucket index for a given key
+ *
+ * @return int bucket index or -1 if key is not in the table
+ */
+static int findGroupBucket (
+    struct GroupHashTable *table,
+    const char *key,
+    unsigned long hash
+) {
+    size_t mask = table->slot_count - 1;
+    size_t slot = hash & mask;
+
+    while (table->slots[slot] != -1) {
+        int bucket_index = table->slots[slot];
+
+        if (
+            table->hashes[bucket_index] == hash
+            && strcmp(table->arena + table->key_offsets[bucket_index], key) == 0
+        ) {
+            return bucket_index;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Add a new bucket for a key known not to be in the table yet. Bucket
+ * arrays, slots and key arena all grow geometrically.
+ *
+ * @return int index of the new bucket
+ */
+static int addGroupBucket (
+    struct GroupHashTable *table,
+    const char *key,
+    unsigned long hash,
+    RowListIndex bucket
+) {
+    size_t key_len = strlen(key) + 1;
+
+    if (table->bucket_count == table->bucket_capacity) {
+        table->bucket_capacity *= 2;
+
+        table->buckets = realloc(
+            table->buckets,
+            sizeof(*table->buckets) * table->bucket_capacity
+        );
+        table->key_offsets = realloc(
+            table->key_offsets,
+            sizeof(*table->key_offsets) * table->bucket_capacity
+        );
+        table->hashes = realloc(
+            table->hashes,
+            sizeof(*table->hashes) * table->bucket_capacity
+        );
+
+        if (
+            table->buckets == NULL || table->key_offsets == NULL
+            || table->hashes == NULL
+        ) {
+            fprintf(
+                stderr,
+                "Unable to allocate space for %d buckets.\n",
+                table->bucket_capacity
+            );
+            exit(-1);
+        }
+
+        growGroupHashSlots(table);
+    }
+
+    if (table->arena_size + key_len > table->arena_capacity) {
+        while (table->arena_size + key_len > table->arena_capacity) {
+            table->arena_capacity *= 2;
+        }
+
+        table->arena = realloc(table->arena, table->arena_capacity);
+
+        if (table->arena == NULL) {
+            fprintf(stderr, "Unable to allocate space for group keys.\n");
+            exit(-1);
+        }
+    }
+
+    int bucket_index = table->bucket_count++;
+
+    memcpy(table->arena + table->arena_size, key, key_len);
+    table->key_offsets[bucket_index] = table->arena_size;
+    table->arena_size += key_len;
+
+    table->hashes[bucket_index] = hash;
+    table->buckets[bucket_index] = bucket;
+
+    size_t mask = table->slot_count - 1;
+    size_t slot = hash & mask;
+
+    while (table->slots[slot] != -1) {
+        slot = (slot + 1) & mask;
+    }
+
+    table->slots[slot] = bucket_index;
+
+    return bucket_index;
+}
+
+/**
+ * @brief Re-size slot array to keep load factor at or below 0.5 and re-insert
+ * existing buckets using their cached hashes.
+ */
+static void growGroupHashSlots (struct GroupHashTable *table) {
+    table->slot_count = table->bucket_capacity * 2;
+
+    free(table->slots);
+    table->slots = malloc(sizeof(*table->slots) * table->slot_count);
+
+    if (table->slots == NULL) {
+        fprintf(stderr, "Unable to allocate space for group hash table.\n");
+        exit(-1);
+    }
+
+    memset(table->slots, -1, sizeof(*table->slots) * table->slot_count);
+
+    size_t mask = table->slot_count - 1;
+
+    for (int i = 0; i < table->bucket_count; i++) {
+        size_t slot = table->hashes[i] & mask;
+
+        while (table->slots[slot] != -1) {
+            slot = (slot + 1) & mask;
+        }
+
+        table->slots[slot] = i;
+    }
+}
@@ -33,6 +33,9 @@ int executeSourcePK (
     struct Table * table = tables;
     struct Node *p = &step->nodes[0];
 
+    // Binary searches the table itself
+    adviseAccess(table->db, ACCESS_RANDOM);
+
     indexPrimarySeek(
         table->db,
         p->function,
@@ -105,6 +108,9 @@ int executeSourceUnique (
     // table
     int rowid_col = getFieldIndex(&index_db, "rowid");
 
+    // Rows will be read in index order
+    adviseAccess(table->db, ACCESS_RANDOM);
+
     // Fill in RowIDs from index
     indexUniqueSeek(
         &index_db,
@@ -158,6 +164,10 @@ int executeSourceIndexSeek (
     // Find which column in the index table contains the rowids of the primary
     // table
     int rowid_col = getFieldIndex(&index_db, "rowid");
+
+    // Rows will be read in index order
+    adviseAccess(table->db, ACCESS_RANDOM);
+
     indexSeek(
         &index_db,
         rowid_col,
@@ -236,6 +246,10 @@ int executeSourceIndexScan (
     // Find which column in the index table contains the rowids of the primary
     // table
     int rowid_col = getFieldIndex(&index_db, "rowid");
+
+    // Rows will be read in index order
+    adviseAccess(table->db, ACCESS_RANDOM);
+
     indexScan(&index_db, rowid_col, getRowList(row_list), step->limit);
 
     closeDB(&index_db);
@@ -295,6 +309,8 @@ int executeSourceTableScan (
     // First table
     struct Table * table = tables;
 
+    adviseAccess(table->db, ACCESS_SEQUENTIAL);
+
     int start_rowid = 0;
     int limit = step->limit;
 
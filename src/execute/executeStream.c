@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/time.h>
+
+#include "../structs.h"
+#include "../query/result.h"
+#include "../query/output.h"
+#include "../db/db.h"
+#include "../evaluate/predicates.h"
+#include "executeStream.h"
+
+/**
+ * Pipelined execution for plans which just read one table, filter it and
+ * print it. Rather than each step materialising a RowList for the whole
+ * table, rows are pulled from the source STREAM_BATCH_ROWS at a time and
+ * each batch is printed before the next one is read.
+ *
+ * Only the first table's rows are ever held in a RowList, so memory use is
+ * constant and output starts as soon as the first batch is available.
+ */
+
+static int isStreamSource (struct Table *table);
+
+/**
+ * @brief Plan must be a full table access or scan of a single table followed
+ * only by limits before PLAN_SELECT. Filtered scans of files are left to
+ * the (possibly parallel) materialising executor; streams are always
+ * streamed.
+ */
+int isStreamablePlan (struct Query *query, struct Plan *plan) {
+    if (query->table_count != 1 || plan->step_count < 2) {
+        return 0;
+    }
+
+    struct Table *table = &query->tables[0];
+
+    if (table->db == NULL) {
+        return 0;
+    }
+
+    // Virtual tables generate their own rows
+    enum VFSType vfs = table->db->vfs;
+
+    if (
+        vfs != VFS_CSV
+        && vfs != VFS_CSV_MEM
+        && vfs != VFS_CSV_MMAP
+        && vfs != VFS_TSV
+        && vfs != VFS_TSV_MEM
+        && vfs != VFS_WSV_MEM
+        && vfs != VFS_CSV_STREAM
+        && vfs != VFS_CSV_CACHE
+    ) {
+        return 0;
+    }
+
+    struct PlanStep *source = &plan->steps[0];
+
+    if (source->type == PLAN_TABLE_SCAN) {
+        // rowid predicates
+        if (source->node_count > 0) {
+            return 0;
+        }
+    }
+    else if (source->type == PLAN_TABLE_ACCESS_FULL) {
+        if (!isStreamSource(table)) {
+            return 0;
+        }
+    }
+    else {
+        return 0;
+    }
+
+    for (int i = 1; i < plan->step_count - 1; i++) {
+        if (
+            plan->steps[i].type != PLAN_SLICE
+            && plan->steps[i].type != PLAN_OFFSET
+        ) {
+            return 0;
+        }
+    }
+
+    return plan->steps[plan->step_count - 1].type == PLAN_SELECT;
+}
+
+int executeStreamingPlan (
+    struct Query *query,
+    struct Plan *plan,
+    enum OutputOption output_flags,
+    FILE * output
+) {
+    FILE *fstats = NULL;
+    struct timeval stop, start;
+
+    if (output_flags & OUTPUT_OPTION_STATS) {
+        fstats = fopen("stats.csv", "a");
+
+        gettimeofday(&start, NULL);
+    }
+
+    struct Table *tables = query->tables;
+    struct DB *db = tables[0].db;
+
+    struct PlanStep *source = &plan->steps[0];
+    struct PlanStep *select = &plan->steps[plan->step_count - 1];
+
+    // Number of matching rows to read (including offset rows) or -1 for all
+    int limit = source->limit;
+    int offset = 0;
+
+    for (int i = 1; i < plan->step_count - 1; i++) {
+        struct PlanStep *s = &plan->steps[i];
+
+        if (s->type == PLAN_OFFSET) {
+            offset = s->limit;
+        }
+        else if (s->limit >= 0 && (limit < 0 || s->limit < limit)) {
+            limit = s->limit;
+        }
+    }
+
+    printPreamble(
+        output,
+        NULL,
+        0,
+        select->nodes,
+        select->node_count,
+        output_flags
+    );
+
+    if (output_flags & OUTPUT_OPTION_HEADERS) {
+        printHeaderLine(
+            output,
+            tables,
+            query->table_count,
+            select->nodes,
+            select->node_count,
+            output_flags
+        );
+    }
+
+    adviseAccess(db, ACCESS_SEQUENTIAL);
+
+    RowListIndex list_id = createRowList(1, STREAM_BATCH_ROWS);
+    struct RowList *row_list = getRowList(list_id);
+
+    int rowid = 0;
+    int match_count = 0;
+    int result_count = 0;
+    int done = limit == 0;
+
+    while (!done) {
+        // Nothing before this batch will be needed again
+        releaseRecords(db, rowid);
+
+        int available = getRecordCountUpTo(db, rowid + STREAM_BATCH_ROWS);
+
+        if (available <= rowid) {
+            break;
+        }
+
+        row_list->row_count = 0;
+
+        for (; rowid < available; rowid++) {
+            if (
+                source->node_count > 0
+                && !evaluateOperatorNodeListAND(
+                    tables,
+                    ROWLIST_ROWID,
+                    rowid,
+                    source->nodes,
+                    source->node_count
+                )
+            ) {
+                continue;
+            }
+
+            match_count++;
+
+            if (match_count > offset) {
+                appendRowID(row_list, rowid);
+            }
+
+            if (limit >= 0 && match_count >= limit) {
+                done = 1;
+                rowid++;
+                break;
+            }
+        }
+
+        for (unsigned int i = 0; i < row_list->row_count; i++) {
+            printResultRow(
+                output,
+                tables,
+                query->table_count,
+                select->nodes,
+                select->node_count,
+                result_count++,
+                list_id,
+                i,
+                output_flags
+            );
+        }
+
+        // Let readers downstream see each batch as soon as it's ready
+        fflush(output);
+    }
+
+    printPostamble(
+        output,
+        NULL,
+        0,
+        select->nodes,
+        select->node_count,
+        result_count,
+        output_flags
+    );
+
+    destroyRowList(list_id);
+
+    destroyRowListPool();
+
+    if (fstats != NULL) {
+        gettimeofday(&stop, NULL);
+
+        fprintf(fstats, "STEP %d,%ld\n", plan->step_count - 1, dt(stop, start));
+
+        fclose(fstats);
+    }
+
+    return 0;
+}
+
+static int isStreamSource (struct Table *table) {
+    return table->db->vfs == VFS_CSV_STREAM
+        || strcmp(table->name, "stdin") == 0
+        || strncmp(table->name, "stdin.", 6) == 0;
+}
@@ -0,0 +1,10 @@
+#include "../structs.h"
+
+int isStreamablePlan (struct Query *query, struct Plan *plan);
+
+int executeStreamingPlan (
+    struct Query *query,
+    struct Plan *plan,
+    enum OutputOption output_flags,
+    FILE * output
+);
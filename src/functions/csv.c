@@ -1,5 +1,7 @@
 #include <stdlib.h>
 
+#include "scan.h"
+
 int is_end_of_line (const char c) {
     return c == '\0' || c == '\n' || c == '\r';
 }
@@ -8,6 +10,36 @@ int is_end_of_field (const char c) {
     return c == ',' || is_end_of_line(c);
 }
 
+/**
+ * @brief Find the end of the field starting at in_ptr without copying it
+ *
+ * @return const char* pointing at the character after the field
+ */
+const char *csv_skip_field (const char *in_ptr) {
+    if (*in_ptr != '"') {
+        return scanFind(in_ptr, ",\n\r");
+    }
+
+    in_ptr++;
+
+    while (1) {
+        in_ptr = scanFind(in_ptr, "\"");
+
+        if (*in_ptr == '\0') {
+            return in_ptr;
+        }
+
+        in_ptr++;
+
+        if (is_end_of_field(*in_ptr)) {
+            return in_ptr;
+        }
+
+        // Escaped quote (or stray character after closing quote)
+        in_ptr++;
+    }
+}
+
 int csv_get_record_from_line (const char *in_ptr, int field_index, char *out_ptr, size_t max_length) {
     int current_field_index = 0;
 
@@ -20,6 +52,20 @@ int csv_get_record_from_line (const char *in_ptr, int field_index, char *out_ptr
     while (!is_end_of_line(*in_ptr)) {
         int quoted_flag = 0;
 
+        // Fast path for fields we're not interested in
+        if (current_field_index < field_index) {
+            in_ptr = csv_skip_field(in_ptr);
+
+            if (*in_ptr != ',') {
+                break;
+            }
+
+            current_field_index++;
+            in_ptr++;
+
+            continue;
+        }
+
         // Start of the field
         // Check if quoted or not
 
@@ -1,3 +1,5 @@
 #include <stdlib.h>
 
+const char *csv_skip_field (const char *in_ptr);
+
 int csv_get_record_from_line (const char *in_ptr, int field_index, char *out_ptr, size_t max_length);
\ No newline at end of file
@@ -74,11 +74,12 @@ int parseDate(const char *input, struct DateTime *output)
 {
     if (strcmp(input, "CURRENT_DATE") == 0) {
         time_t t = time(NULL);
-        struct tm *local = localtime(&t);
+        struct tm local;
+        localtime_r(&t, &local);
 
-        output->year = local->tm_year + 1900;
-        output->month = local->tm_mon + 1;
-        output->day = local->tm_mday;
+        output->year = local.tm_year + 1900;
+        output->month = local.tm_mon + 1;
+        output->day = local.tm_mday;
 
         return 1;
     }
@@ -318,11 +319,12 @@ int parseTime(const char *input, struct DateTime *output)
     if (strcmp(input, "CURRENT_TIME") == 0)
     {
         time_t t = time(NULL);
-        struct tm *local = localtime(&t);
+        struct tm local;
+        localtime_r(&t, &local);
 
-        output->hour = local->tm_hour;
-        output->minute = local->tm_min;
-        output->second = local->tm_sec;
+        output->hour = local.tm_hour;
+        output->minute = local.tm_min;
+        output->second = local.tm_sec;
 
         return 1;
     }
@@ -621,12 +623,13 @@ long datetimeGetUnix(struct DateTime *dt)
 
 void datetimeFromUnix(struct DateTime *dt, time_t time)
 {
-    struct tm *tp = localtime(&time);
-
-    dt->year = tp->tm_year + 1900;
-    dt->month = tp->tm_mon + 1;
-    dt->day = tp->tm_mday;
-    dt->hour = tp->tm_hour;
-    dt->minute = tp->tm_min;
-    dt->second = tp->tm_sec;
+    struct tm tp;
+    localtime_r(&time, &tp);
+
+    dt->year = tp.tm_year + 1900;
+    dt->month = tp.tm_mon + 1;
+    dt->day = tp.tm_mday;
+    dt->hour = tp.tm_hour;
+    dt->minute = tp.tm_min;
+    dt->second = tp.tm_sec;
 }
\ No newline at end of file
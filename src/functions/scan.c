@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Structural character scanner shared by the memory VFSs.
+ *
+ * The SIMD implementations only ever use aligned loads. An aligned load
+ * never crosses a page boundary so it is safe to read past the terminating
+ * NUL (the same technique used by libc strlen). They are excluded from
+ * AddressSanitizer for that reason.
+ */
+
+static const char *scanFindScalar (const char *ptr, const char *set);
+
+static const char *scanFindDispatch (const char *ptr, const char *set);
+
+#ifdef SCAN_X86
+static const char *scanFindSSE2 (const char *ptr, const char *set);
+
+static const char *scanFindAVX2 (const char *ptr, const char *set);
+#endif
+
+static const char *(*scanFindImpl) (const char *, const char *)
+    = &scanFindDispatch;
+
+/**
+ * @brief Find the first byte in a NUL terminated buffer which matches any
+ * character in `set`. NUL always matches.
+ *
+ * @param ptr
+ * @param set up to SCAN_MAX_SET characters
+ * @return const char* pointer to first matching byte (possibly the NUL)
+ */
+const char *scanFind (const char *ptr, const char *set) {
+    return scanFindImpl(ptr, set);
+}
+
+/**
+ * @brief Pick best implementation for this CPU on first use
+ */
+static const char *scanFindDispatch (const char *ptr, const char *set) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        scanFindImpl = &scanFindAVX2;
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        scanFindImpl = &scanFindSSE2;
+    }
+    else {
+        scanFindImpl = &scanFindScalar;
+    }
+#else
+    scanFindImpl = &scanFindScalar;
+#endif
+
+    return scanFindImpl(ptr, set);
+}
+
+static const char *scanFindScalar (const char *ptr, const char *set) {
+    while (*ptr != '\0' && strchr(set, *ptr) == NULL) {
+        ptr++;
+    }
+
+    return ptr;
+}
+
+#ifdef SCAN_X86
+
+__attribute__((target("sse2"), no_sanitize_address))
+static const char *scanFindSSE2 (const char *ptr, const char *set) {
+    __m128i needles[SCAN_MAX_SET];
+    int count = 0;
+
+    while (set[count] != '\0' && count < SCAN_MAX_SET) {
+        needles[count] = _mm_set1_epi8(set[count]);
+        count++;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t misalign = (uintptr_t)ptr & 15;
+    const char *block = ptr - misalign;
+
+    // Ignore matches before ptr in the first block
+    unsigned int ignore = ~0u << misalign;
+
+    while (1) {
+        __m128i data = _mm_load_si128((const __m128i *)block);
+        __m128i match = _mm_cmpeq_epi8(data, zero);
+
+        for (int i = 0; i < count; i++) {
+            match = _mm_or_si128(match, _mm_cmpeq_epi8(data, needles[i]));
+        }
+
+        unsigned int mask = _mm_movemask_epi8(match) & ignore;
+
+        if (mask != 0) {
+            return block + __builtin_ctz(mask);
+        }
+
+        ignore = ~0u;
+        block += 16;
+    }
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static const char *scanFindAVX2 (const char *ptr, const char *set) {
+    __m256i needles[SCAN_MAX_SET];
+    int count = 0;
+
+    while (set[count] != '\0' && count < SCAN_MAX_SET) {
+        needles[count] = _mm256_set1_epi8(set[count]);
+        count++;
+    }
+
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t misalign = (uintptr_t)ptr & 31;
+    const char *block = ptr - misalign;
+
+    // Ignore matches before ptr in the first block
+    unsigned int ignore = ~0u << misalign;
+
+    while (1) {
+        __m256i data = _mm256_load_si256((const __m256i *)block);
+        __m256i match = _mm256_cmpeq_epi8(data, zero);
+
+        for (int i = 0; i < count; i++) {
+            match = _mm256_or_si256(
+                match,
+                _mm256_cmpeq_epi8(data, needles[i])
+            );
+        }
+
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(match) & ignore;
+
+        if (mask != 0) {
+            return block + __builtin_ctz(mask);
+        }
+
+        ignore = ~0u;
+        block += 32;
+    }
+}
+
+#endif
@@ -0,0 +1,3 @@
+#define SCAN_MAX_SET 6
+
+const char *scanFind (const char *ptr, const char *set);
@@ -35,6 +35,41 @@ int is_numeric(const char *string)
     return 1;
 }
 
+/**
+ * @brief Same as is_numeric() but for a string which is not nul terminated
+ */
+int is_numeric_n(const char *string, size_t length)
+{
+    if (length == 0 || *string == '\0')
+        return 0;
+
+    const char *ptr = string;
+    const char *end = string + length;
+
+    // Allow spaces at start
+    while (ptr < end && isspace(*ptr))
+        ptr++;
+
+    // First character can be a negative sign
+    if (ptr < end && *ptr == '-')
+        ptr++;
+
+    int decimal = 0;
+    while (ptr < end && *ptr != '\0')
+    {
+        if (ptr > string && *ptr == '.')
+        {
+            if (decimal)
+                return 0;
+            decimal = 1;
+        }
+        else if (!isdigit(*ptr))
+            return 0;
+        ptr++;
+    }
+    return 1;
+}
+
 void reverse_array(int *array, int size)
 {
     for (int i = 0; i < size / 2; i++)
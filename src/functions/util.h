@@ -1,7 +1,10 @@
 #include <stdint.h>
+#include <stddef.h>
 
 int is_numeric(const char *string);
 
+int is_numeric_n(const char *string, size_t length);
+
 void reverse_array(int *array, int size);
 
 int str_find_index(const char *string, char chr);
@@ -0,0 +1 @@
+const char *gitversion = " 4f69893d4bd8536c840356119641e28ea61e4266 (2026-10-17T09:21:54+00:00)";
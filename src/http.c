@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ctype.h>
+
+#include "http.h"
+#include "structs.h"
+#include "db/db.h"
+#include "db/temp.h"
+
+/*
+ * Request handling shared by the CGI binary and the query server
+ */
+
+/**
+ * @brief Pick an output format from an HTTP Accept header
+ *
+ * @param accept may be NULL
+ * @param format returned if nothing in accept is recognised
+ */
+int http_formatFromAccept (const char *accept, int format)
+{
+    if (accept == NULL)
+    {
+        return format;
+    }
+
+    if (strstr(accept, "text/html") != NULL)
+    {
+        return OUTPUT_FORMAT_HTML;
+    }
+
+    if (strstr(accept, "application/json") != NULL)
+    {
+        return OUTPUT_FORMAT_JSON;
+    }
+
+    if (strstr(accept, "text/csv") != NULL)
+    {
+        return OUTPUT_FORMAT_COMMA;
+    }
+
+    if (strstr(accept, "text/tab-separated-values") != NULL)
+    {
+        return OUTPUT_FORMAT_TAB;
+    }
+
+    if (strstr(accept, "application/sql") != NULL)
+    {
+        return OUTPUT_FORMAT_SQL_INSERT;
+    }
+
+    if (strstr(accept, "application/xml") != NULL)
+    {
+        return OUTPUT_FORMAT_XML;
+    }
+
+    return format;
+}
+
+/**
+ * @brief Read `query` and `format` parameters from a query string.
+ * query_string is modified.
+ *
+ * @param format OUT only written if a format parameter is present
+ * @return char* malloc'd decoded query; NULL if there wasn't one
+ */
+char *http_parseQueryString (char *query_string, int *format)
+{
+    char *query = NULL;
+
+    while (*query_string != '\0')
+    {
+        char *eq = strchr(query_string, '=');
+        if (eq == NULL)
+        {
+            break;
+        }
+        *eq = '\0';
+        char *key = query_string;
+        query_string = eq + 1;
+
+        char *amp = strchr(query_string, '&');
+        char *value = query_string;
+        if (amp != NULL)
+        {
+            *amp = '\0';
+            query_string = amp + 1;
+        }
+        else
+        {
+            query_string += strlen(query_string);
+        }
+
+        if (strcmp(key, "format") == 0)
+        {
+            if (strcmp(value, "txt") == 0)
+            {
+                *format = OUTPUT_FORMAT_TABLE;
+            }
+            else if (strcmp(value, "csv") == 0)
+            {
+                *format = OUTPUT_FORMAT_COMMA;
+            }
+            else if (strcmp(value, "tsv") == 0)
+            {
+                *format = OUTPUT_FORMAT_TAB;
+            }
+            else if (strcmp(value, "html") == 0)
+            {
+                *format = OUTPUT_FORMAT_HTML;
+            }
+            else if (strcmp(value, "json") == 0)
+            {
+                *format = OUTPUT_FORMAT_JSON;
+            }
+            else if (strcmp(value, "json_array") == 0)
+            {
+                *format = OUTPUT_FORMAT_JSON_ARRAY;
+            }
+            else if (strcmp(value, "sql") == 0)
+            {
+                *format = OUTPUT_FORMAT_SQL_INSERT;
+            }
+            else if (strcmp(value, "xml") == 0)
+            {
+                *format = OUTPUT_FORMAT_XML;
+            }
+            else if (strcmp(value, "markdown") == 0)
+            {
+                *format = OUTPUT_FORMAT_TABLE;
+            }
+        }
+        else if (strcmp(key, "query") == 0)
+        {
+            // Decoding never makes the string longer
+            free(query);
+            query = malloc(strlen(value) + 1);
+
+            if (query != NULL)
+            {
+                http_urldecode(query, value);
+            }
+        }
+    }
+
+    if (query != NULL && query[0] == '\0')
+    {
+        free(query);
+        return NULL;
+    }
+
+    return query;
+}
+
+const char *http_contentType (int format)
+{
+    if (format == OUTPUT_FORMAT_COMMA)
+    {
+        return "text/csv; charset=utf-8";
+    }
+
+    if (format == OUTPUT_FORMAT_TAB)
+    {
+        return "text/tab-separated-values; charset=utf-8";
+    }
+
+    if (format == OUTPUT_FORMAT_HTML)
+    {
+        return "text/html; charset=utf-8";
+    }
+
+    if (format == OUTPUT_FORMAT_JSON || format == OUTPUT_FORMAT_JSON_ARRAY)
+    {
+        return "application/json; charset=utf-8";
+    }
+
+    if (format == OUTPUT_FORMAT_SQL_INSERT)
+    {
+        return "application/sql; charset=utf-8";
+    }
+
+    if (format == OUTPUT_FORMAT_XML)
+    {
+        return "application/xml; charset=utf-8";
+    }
+
+    return "text/plain; charset=utf-8";
+}
+
+void http_urldecode (char *dst, const char *src)
+{
+    char a, b;
+    while (*src)
+    {
+        if ((*src == '%') &&
+            ((a = src[1]) && (b = src[2])) &&
+            (isxdigit(a) && isxdigit(b)))
+        {
+            if (a >= 'a')
+                a -= 'a' - 'A';
+            if (a >= 'A')
+                a -= ('A' - 10);
+            else
+                a -= '0';
+            if (b >= 'a')
+                b -= 'a' - 'A';
+            if (b >= 'A')
+                b -= ('A' - 10);
+            else
+                b -= '0';
+            *dst++ = 16 * a + b;
+            src += 3;
+        }
+        else if (*src == '+')
+        {
+            *dst++ = ' ';
+            src++;
+        }
+        else
+        {
+            *dst++ = *src++;
+        }
+    }
+    *dst++ = '\0';
+}
+
+/**
+ * Copies accumulated errors from `error_file` to `output`.
+ */
+void http_printError (int format, FILE *error_file, FILE *output)
+{
+    if (format == OUTPUT_FORMAT_HTML)
+    {
+        fprintf(output, "<p style=\"font-family: sans-serif;color: red\">");
+    }
+    else if (format == OUTPUT_FORMAT_JSON)
+    {
+        fprintf(output, "{\"error\": \"");
+    }
+    else if (format == OUTPUT_FORMAT_XML)
+    {
+        fprintf(output, "<results><error>");
+    }
+
+    fprintf(output, "Error processing query: ");
+
+    fflush(error_file);
+    fseek(error_file, 0, SEEK_SET);
+    char buffer[4096] = {0};
+    int size = fread(buffer, 1, sizeof(buffer), error_file);
+
+    // JSON doesn't allow newlines
+    if (format == OUTPUT_FORMAT_JSON)
+    {
+        for (char *c = buffer; *c; c++)
+        {
+            if (*c == '\n')
+                *c = ' ';
+        }
+    }
+
+    fwrite(buffer, 1, size, output);
+
+    if (format == OUTPUT_FORMAT_HTML)
+    {
+        fprintf(output, "</p>");
+    }
+    else if (format == OUTPUT_FORMAT_JSON)
+    {
+        fprintf(output, "\"}");
+    }
+    else if (format == OUTPUT_FORMAT_XML)
+    {
+        fprintf(output, "</error></results>");
+    }
+}
+
+/**
+ * @brief Get the session identifier from a Cookie header. If there isn't one
+ * a new session is started and a Set-Cookie header is written to output.
+ *
+ * @param cookie may be NULL
+ * @return char* a malloc'd pointer. Caller must free.
+ */
+char *http_getSession (const char *cookie, FILE *output)
+{
+    char *session_id = malloc(32);
+
+    if (cookie != NULL)
+    {
+        const char *start_ptr = strstr(cookie, "CSVDB_SESSION=");
+        if (start_ptr != NULL)
+        {
+            start_ptr += sizeof("CSVDB_SESSION=") - 1;
+
+            // The id ends up in a filename so only accept alphanumerics
+            int len = 0;
+            while (len < 31 && isalnum(start_ptr[len]))
+            {
+                len++;
+            }
+
+            if (len > 0)
+            {
+                strncpy(session_id, start_ptr, len);
+                session_id[len] = '\0';
+
+                return session_id;
+            }
+        }
+    }
+
+    unsigned int r1 = rand();
+    unsigned int r2 = rand();
+
+    sprintf(session_id, "%08x%08x", r1, r2);
+
+    time_t t = time(NULL);
+    t += 7 * 24 * 60 * 60;
+
+    char expires[32];
+    strftime(expires, sizeof(expires), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&t));
+
+    fprintf(
+        output,
+        "Set-Cookie: CSVDB_SESSION=%s; path=/; expires=%s\r\n",
+        session_id,
+        expires);
+
+    return session_id;
+}
+
+/**
+ * @brief Use the session's temp table mapping. The previous session's
+ * mapping is closed so a long running process doesn't accumulate them.
+ */
+void http_setSessionTempDB (const char *session_id)
+{
+    static struct DB *session_mapping = NULL;
+
+    char temp_mapping_filename[MAX_TABLE_LENGTH];
+
+    sprintf(temp_mapping_filename, "/tmp/csvdb.session.%s.temp.csv", session_id);
+
+    struct DB *temp_mapping = temp_openMappingDB(temp_mapping_filename);
+
+    temp_setMappingDB(temp_mapping);
+
+    if (session_mapping != NULL)
+    {
+        closeDB(session_mapping);
+        free(session_mapping);
+    }
+
+    session_mapping = temp_mapping;
+}
@@ -0,0 +1,15 @@
+#include <stdio.h>
+
+int http_formatFromAccept (const char *accept, int format);
+
+char *http_parseQueryString (char *query_string, int *format);
+
+const char *http_contentType (int format);
+
+void http_urldecode (char *dst, const char *src);
+
+void http_printError (int format, FILE *error_file, FILE *output);
+
+char *http_getSession (const char *cookie, FILE *output);
+
+void http_setSessionTempDB (const char *session_id);
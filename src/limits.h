@@ -6,5 +6,18 @@
 #define MAX_FIELD_COUNT 32
 #define MAX_TABLE_COUNT 10
 #define MEMORY_FILE_LIMIT (100 * 1024 * 1024)
+#define OFFSETS_FILE_LIMIT (32 * 1024 * 1024)
+#define FIELD_CACHE_LIMIT (64 * 1024 * 1024)
+#define TABLE_CACHE_LIMIT (256 * 1024 * 1024)
+#define SORT_MEMORY_LIMIT (256 * 1024 * 1024)
+#define PARALLEL_SCAN_MAX_THREADS 32
+#define PARALLEL_SCAN_MIN_ROWS (64 * 1024)
+#define FIELD_TYPE_SAMPLE_ROWS 64
+#define STREAM_BATCH_ROWS 1024
+#define CSV_STREAM_CHUNK_SIZE (64 * 1024)
+#define CACHE_BLOCK_ROWS 4096
+#define ZONE_MAP_BLOCK_ROWS 4096
+#define CALENDAR_BLOCK_ROWS 256
+#define BINARY_INDEX_PAGE_ROWS 64
 #define MAX_ROWLIST_COUNT 512
 #define MAX_TEMP_TABLES 10
\ No newline at end of file
@@ -2,7 +2,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <ctype.h>
 #include <errno.h>
 
 #include <unistd.h>
@@ -10,7 +9,7 @@
 
 #include "structs.h"
 #include "query/query.h"
-#include "db/temp.h"
+#include "http.h"
 
 int debug_verbosity = 0;
 
@@ -26,19 +25,10 @@ int debug_verbosity = 0;
  * POST data: stdin
  */
 
-static void urldecode2(char *dst, const char *src);
-
 static int setDataDir(const char *datadir);
 
-static void printError(int format, FILE *error);
-
-static char *getSession();
-
-void set_session_temp_db(const char *session_id);
-
 int main()
 {
-    char query_buffer[1024];
     int flags = OUTPUT_OPTION_HEADERS | OUTPUT_OPTION_STATS;
     int format = OUTPUT_FORMAT_TABLE;
 
@@ -66,35 +56,7 @@ int main()
         }
     }
 
-    char *accept_env = getenv("HTTP_ACCEPT");
-
-    if (accept_env != NULL)
-    {
-        if (strstr(accept_env, "text/html") != NULL)
-        {
-            format = OUTPUT_FORMAT_HTML;
-        }
-        else if (strstr(accept_env, "application/json") != NULL)
-        {
-            format = OUTPUT_FORMAT_JSON;
-        }
-        else if (strstr(accept_env, "text/csv") != NULL)
-        {
-            format = OUTPUT_FORMAT_COMMA;
-        }
-        else if (strstr(accept_env, "text/tab-separated-values") != NULL)
-        {
-            format = OUTPUT_FORMAT_TAB;
-        }
-        else if (strstr(accept_env, "application/sql") != NULL)
-        {
-            format = OUTPUT_FORMAT_SQL_INSERT;
-        }
-        else if (strstr(accept_env, "application/xml") != NULL)
-        {
-            format = OUTPUT_FORMAT_XML;
-        }
-    }
+    format = http_formatFromAccept(getenv("HTTP_ACCEPT"), format);
 
     // Don't modify char * returned from getenv
     char *query_string = getenv("QUERY_STRING");
@@ -109,74 +71,11 @@ int main()
         return -1;
     }
 
-    while (*query_string != '\0')
-    {
-        char *eq = strchr(query_string, '=');
-        if (eq == NULL)
-        {
-            break;
-        }
-        *eq = '\0';
-        char *key = query_string;
-        query_string = eq + 1;
-
-        char *amp = strchr(query_string, '&');
-        char *value = query_string;
-        if (amp != NULL)
-        {
-            *amp = '\0';
-            query_string = amp + 1;
-        }
-
-        // printf("Query-Value: %s: %s\n", key, value);
-
-        if (strcmp(key, "format") == 0)
-        {
-
-            if (strcmp(value, "txt") == 0)
-            {
-                format = OUTPUT_FORMAT_TABLE;
-            }
-            else if (strcmp(value, "csv") == 0)
-            {
-                format = OUTPUT_FORMAT_COMMA;
-            }
-            else if (strcmp(value, "tsv") == 0)
-            {
-                format = OUTPUT_FORMAT_TAB;
-            }
-            else if (strcmp(value, "html") == 0)
-            {
-                format = OUTPUT_FORMAT_HTML;
-            }
-            else if (strcmp(value, "json") == 0)
-            {
-                format = OUTPUT_FORMAT_JSON;
-            }
-            else if (strcmp(value, "json_array") == 0)
-            {
-                format = OUTPUT_FORMAT_JSON_ARRAY;
-            }
-            else if (strcmp(value, "sql") == 0)
-            {
-                format = OUTPUT_FORMAT_SQL_INSERT;
-            }
-            else if (strcmp(value, "xml") == 0)
-            {
-                format = OUTPUT_FORMAT_XML;
-            }
-            else if (strcmp(value, "markdown") == 0)
-            {
-                format = OUTPUT_FORMAT_TABLE;
-            }
-        }
-        else if (strcmp(key, "query") == 0)
-        {
-            urldecode2(query_buffer, value);
-        }
-    }
+    char *query_copy = strdup(query_string);
+    char *query_buffer = http_parseQueryString(query_copy, &format);
+    free(query_copy);
 
-    if (query_buffer[0] == '\0')
+    if (query_buffer == NULL)
     {
         printf("HTTP/1.1 400 Server Error\n");
         printf("Access-Control-Allow-Origin: *\n");
@@ -187,7 +86,7 @@ int main()
         return -1;
     }
 
-    char *session = getSession();
+    char *session = http_getSession(getenv("HTTP_COOKIE"), stdout);
 
     if (session == NULL)
     {
@@ -195,41 +94,13 @@ int main()
         return -1;
     }
 
-    set_session_temp_db(session);
+    http_setSessionTempDB(session);
 
     flags |= format;
 
     printf("Access-Control-Allow-Origin: *\n");
 
-    if (format == OUTPUT_FORMAT_COMMA)
-    {
-        printf("Content-Type: text/csv; charset=utf-8\n");
-    }
-    else if (format == OUTPUT_FORMAT_TAB)
-    {
-        printf("Content-Type: text/tab-separated-values; charset=utf-8\n");
-    }
-    else if (format == OUTPUT_FORMAT_HTML)
-    {
-        printf("Content-Type: text/html; charset=utf-8\n");
-    }
-    else if (
-        format == OUTPUT_FORMAT_JSON || format == OUTPUT_FORMAT_JSON_ARRAY)
-    {
-        printf("Content-Type: application/json; charset=utf-8\n");
-    }
-    else if (format == OUTPUT_FORMAT_SQL_INSERT)
-    {
-        printf("Content-Type: application/sql; charset=utf-8\n");
-    }
-    else if (format == OUTPUT_FORMAT_XML)
-    {
-        printf("Content-Type: application/xml; charset=utf-8\n");
-    }
-    else
-    {
-        printf("Content-Type: text/plain; charset=utf-8\n");
-    }
+    printf("Content-Type: %s\n", http_contentType(format));
 
     // Get's redirected to /tmp/csvdb_error
     // fprintf(stderr, "query: %s\n", query_buffer);
@@ -238,10 +109,13 @@ int main()
     printf("\n");
 
     int result = runQueries(query_buffer, flags, output);
+    free(query_buffer);
+    free(session);
+
     if (result < 0)
     {
         // Write errors to stdout now
-        printError(format, error_log);
+        http_printError(format, error_log, stdout);
         fclose(error_log);
         return result;
     }
@@ -250,43 +124,6 @@ int main()
     return 0;
 }
 
-static void urldecode2(char *dst, const char *src)
-{
-    char a, b;
-    while (*src)
-    {
-        if ((*src == '%') &&
-            ((a = src[1]) && (b = src[2])) &&
-            (isxdigit(a) && isxdigit(b)))
-        {
-            if (a >= 'a')
-                a -= 'a' - 'A';
-            if (a >= 'A')
-                a -= ('A' - 10);
-            else
-                a -= '0';
-            if (b >= 'a')
-                b -= 'a' - 'A';
-            if (b >= 'A')
-                b -= ('A' - 10);
-            else
-                b -= '0';
-            *dst++ = 16 * a + b;
-            src += 3;
-        }
-        else if (*src == '+')
-        {
-            *dst++ = ' ';
-            src++;
-        }
-        else
-        {
-            *dst++ = *src++;
-        }
-    }
-    *dst++ = '\0';
-}
-
 static int setDataDir(const char *datadir)
 {
     if (datadir != NULL)
@@ -324,120 +161,3 @@ static int setDataDir(const char *datadir)
     }
     return 0;
 }
-
-/**
- * Copies accumulated errors from `error_file` (set to /tmp/csvdb_error) to
- * stdout.
- */
-static void printError(int format, FILE *error_file)
-{
-    if (format == OUTPUT_FORMAT_HTML)
-    {
-        printf("<p style=\"font-family: sans-serif;color: red\">");
-    }
-    else if (format == OUTPUT_FORMAT_JSON)
-    {
-        printf("{\"error\": \"");
-    }
-    else if (format == OUTPUT_FORMAT_XML)
-    {
-        printf("<results><error>");
-    }
-
-    printf("Error processing query: ");
-
-    fseek(error_file, 0, SEEK_SET);
-    char buffer[4096] = {0};
-    int size = fread(buffer, 1, sizeof(buffer), error_file);
-
-    // JSON doesn't allow newlines
-    if (format == OUTPUT_FORMAT_JSON)
-    {
-        for (char *c = buffer; *c; c++)
-        {
-            if (*c == '\n')
-                *c = ' ';
-        }
-    }
-
-    fwrite(buffer, 1, size, stdout);
-
-    if (format == OUTPUT_FORMAT_HTML)
-    {
-        printf("</p>");
-    }
-    else if (format == OUTPUT_FORMAT_JSON)
-    {
-        printf("\"}");
-    }
-    else if (format == OUTPUT_FORMAT_XML)
-    {
-        printf("</error></results>");
-    }
-}
-
-/**
- * @brief Get the session identifier
- *
- * @return char* a malloc'd pointer. Caller must free.
- */
-static char *getSession()
-{
-    char *session_id = malloc(32);
-
-    char *cookie = getenv("HTTP_COOKIE");
-
-    if (cookie != NULL)
-    {
-        char *start_ptr = strstr(cookie, "CSVDB_SESSION=");
-        if (start_ptr != NULL)
-        {
-            start_ptr += sizeof("CSVDB_SESSION=");
-
-            char *end_ptr = strstr(start_ptr, ";");
-
-            if (end_ptr)
-            {
-                int len = end_ptr - start_ptr;
-                strncpy(session_id, start_ptr, len);
-                session_id[len] = '\0';
-            }
-            else
-            {
-                strcpy(session_id, start_ptr);
-            }
-
-            return session_id;
-        }
-    }
-
-    unsigned int r1 = rand();
-    unsigned int r2 = rand();
-
-    sprintf(session_id, "%08x%08x", r1, r2);
-
-    time_t t = time(NULL);
-    t += 7 * 24 * 60 * 60;
-
-    struct tm *expires = localtime(&t);
-
-    fprintf(
-        stdout,
-        // asctime() adds \n at end
-        "Set-Cookie: CSVDB_SESSION=%s; path=/; expires=%s",
-        session_id,
-        asctime(expires));
-
-    return session_id;
-}
-
-void set_session_temp_db(const char *session_id)
-{
-    char temp_mapping_filename[MAX_TABLE_LENGTH];
-
-    sprintf(temp_mapping_filename, "/tmp/csvdb.session.%s.temp.csv", session_id);
-
-    struct DB *temp_mapping = temp_openMappingDB(temp_mapping_filename);
-
-    temp_setMappingDB(temp_mapping);
-}
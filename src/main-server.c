@@ -0,0 +1,637 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "structs.h"
+#include "query/query.h"
+#include "db/table-cache.h"
+#include "http.h"
+
+int debug_verbosity = 0;
+
+/*
+ * Long running HTTP query server.
+ *
+ * GET /?query=<sql>&format=<format>
+ * POST / with the same parameters form encoded, or the raw SQL as the body
+ *
+ * Requests are handled by a fixed pool of worker processes which all accept()
+ * on the same listening socket. Query execution uses process wide state so
+ * each worker handles one request at a time. Workers keep opened tables (and
+ * index files) in the table cache between requests; a worker which dies is
+ * replaced. Workers also exit after a fixed number of requests so anything a
+ * query fails to free can't build up.
+ */
+
+#define SERVER_DEFAULT_PORT         8080
+#define SERVER_DEFAULT_WORKERS      4
+#define SERVER_MAX_WORKERS          64
+#define SERVER_DEFAULT_MAX_REQUESTS 10000
+#define SERVER_MAX_REQUEST_LENGTH   (64 * 1024)
+#define SERVER_READ_TIMEOUT         10
+
+static volatile sig_atomic_t shutting_down = 0;
+
+static pid_t workers[SERVER_MAX_WORKERS];
+
+static int worker_count = SERVER_DEFAULT_WORKERS;
+
+static int max_requests = SERVER_DEFAULT_MAX_REQUESTS;
+
+static FILE *server_log;
+
+static int openListener(const char *socket_path, int port);
+
+static pid_t startWorker(int listener);
+
+static void runWorker(int listener);
+
+static void handleConnection(int fd, FILE *error_log);
+
+static int readRequest(int fd, char *buffer, int max_length, char **body);
+
+static const char *getHeader(const char *headers, const char *name, char *value, int max_length);
+
+static void sendError(FILE *output, const char *status, const char *message);
+
+static void onShutdown(int signal);
+
+static void printUsage(const char *name, FILE *file)
+{
+    fprintf(
+        file,
+        "Usage:\n"
+        "\t%1$s [-p <port>|-s <socket path>] [-w <workers>] [-r <requests>] [-d <data dir>]\n"
+        "\n"
+        "Options:\n"
+        "\t[-p <port>] Listen on 127.0.0.1:<port> (default: %2$d)\n"
+        "\t[-s <socket path>] Listen on a unix socket instead\n"
+        "\t[-w <workers>] Number of worker processes (default: %3$d)\n"
+        "\t[-r <requests>] Restart each worker after this many requests; 0 for never (default: %4$d)\n"
+        "\t[-d <data dir>] Directory containing tables (default: $CSVDB_DATA_DIR)\n",
+        name, SERVER_DEFAULT_PORT, SERVER_DEFAULT_WORKERS, SERVER_DEFAULT_MAX_REQUESTS);
+}
+
+int main(int argc, char *argv[])
+{
+    int port = SERVER_DEFAULT_PORT;
+    const char *socket_path = NULL;
+    const char *data_dir = getenv("CSVDB_DATA_DIR");
+
+    for (int argi = 1; argi < argc; argi++)
+    {
+        const char *arg = argv[argi];
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+        {
+            printUsage(argv[0], stdout);
+            return 0;
+        }
+
+        if (argi + 1 >= argc)
+        {
+            printUsage(argv[0], stderr);
+            return -1;
+        }
+
+        if (strcmp(arg, "-p") == 0)
+        {
+            port = atoi(argv[++argi]);
+        }
+        else if (strcmp(arg, "-s") == 0)
+        {
+            socket_path = argv[++argi];
+        }
+        else if (strcmp(arg, "-w") == 0)
+        {
+            worker_count = atoi(argv[++argi]);
+        }
+        else if (strcmp(arg, "-r") == 0)
+        {
+            max_requests = atoi(argv[++argi]);
+        }
+        else if (strcmp(arg, "-d") == 0)
+        {
+            data_dir = argv[++argi];
+        }
+        else
+        {
+            printUsage(argv[0], stderr);
+            return -1;
+        }
+    }
+
+    if (worker_count < 1 || worker_count > SERVER_MAX_WORKERS)
+    {
+        fprintf(stderr, "Workers must be between 1 and %d\n", SERVER_MAX_WORKERS);
+        return -1;
+    }
+
+    if (max_requests < 0)
+    {
+        fprintf(stderr, "Requests per worker can't be negative\n");
+        return -1;
+    }
+
+    if (data_dir != NULL && chdir(data_dir) != 0)
+    {
+        fprintf(stderr, "Unable to use data dir '%s': %s\n", data_dir, strerror(errno));
+        return -1;
+    }
+
+    // Queries must never wait on our own stdin
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd >= 0)
+    {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+
+    // Workers send query errors to stderr, so keep a handle for our own
+    server_log = fdopen(dup(STDERR_FILENO), "w");
+    setvbuf(server_log, NULL, _IOLBF, 0);
+
+    int listener = openListener(socket_path, port);
+
+    if (listener < 0)
+    {
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sigaction action = {0};
+    action.sa_handler = onShutdown;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[i] = startWorker(listener);
+    }
+
+    if (socket_path != NULL)
+    {
+        fprintf(server_log, "Listening on %s with %d workers\n", socket_path, worker_count);
+    }
+    else
+    {
+        fprintf(server_log, "Listening on 127.0.0.1:%d with %d workers\n", port, worker_count);
+    }
+
+    // Replace any worker which exits until we're asked to stop
+    while (!shutting_down)
+    {
+        int status;
+        pid_t pid = wait(&status);
+
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        for (int i = 0; i < worker_count; i++)
+        {
+            if (workers[i] == pid)
+            {
+                fprintf(server_log, "Worker %d exited (status %d)\n", pid, status);
+
+                if (!shutting_down)
+                {
+                    workers[i] = startWorker(listener);
+                }
+                else
+                {
+                    workers[i] = 0;
+                }
+
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (workers[i] > 0)
+        {
+            kill(workers[i], SIGTERM);
+        }
+    }
+
+    while (wait(NULL) > 0 || errno == EINTR)
+        ;
+
+    close(listener);
+
+    if (socket_path != NULL)
+    {
+        unlink(socket_path);
+    }
+
+    return 0;
+}
+
+static void onShutdown(__attribute__((unused)) int signal)
+{
+    shutting_down = 1;
+}
+
+/**
+ * @return int listening socket; -1 on failure
+ */
+static int openListener(const char *socket_path, int port)
+{
+    int listener;
+
+    if (socket_path != NULL)
+    {
+        struct sockaddr_un address = {0};
+        address.sun_family = AF_UNIX;
+
+        if (strlen(socket_path) >= sizeof(address.sun_path))
+        {
+            fprintf(stderr, "Socket path is too long\n");
+            return -1;
+        }
+
+        strcpy(address.sun_path, socket_path);
+
+        // Remove a socket left behind by a previous run
+        unlink(socket_path);
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            fprintf(stderr, "Unable to bind to %s: %s\n", socket_path, strerror(errno));
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_in address = {0};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            fprintf(stderr, "Unable to bind to port %d: %s\n", port, strerror(errno));
+            return -1;
+        }
+    }
+
+    if (listen(listener, 64) != 0)
+    {
+        fprintf(stderr, "Unable to listen: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return listener;
+}
+
+static pid_t startWorker(int listener)
+{
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        fprintf(server_log, "Unable to start worker: %s\n", strerror(errno));
+        return 0;
+    }
+
+    if (pid == 0)
+    {
+        runWorker(listener);
+        exit(0);
+    }
+
+    return pid;
+}
+
+static void runWorker(int listener)
+{
+    struct sigaction action = {0};
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    srand((unsigned)time(NULL) * getpid());
+
+    tableCache_setEnabled(1);
+
+    // Collect errors from each query so they can be sent to the client
+    FILE *error_log = tmpfile();
+
+    if (error_log == NULL)
+    {
+        fprintf(server_log, "Unable to create error log\n");
+        return;
+    }
+
+    dup2(fileno(error_log), STDERR_FILENO);
+
+    int request_count = 0;
+
+    // The parent starts a fresh worker once this one exits
+    while (max_requests == 0 || request_count < max_requests)
+    {
+        int fd = accept(listener, NULL, NULL);
+
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+
+            fprintf(server_log, "Unable to accept: %s\n", strerror(errno));
+            return;
+        }
+
+        struct timeval timeout = { .tv_sec = SERVER_READ_TIMEOUT };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        fflush(error_log);
+        if (ftruncate(fileno(error_log), 0) != 0)
+        {
+            fprintf(server_log, "Unable to reset error log\n");
+        }
+        fseek(error_log, 0, SEEK_SET);
+
+        handleConnection(fd, error_log);
+
+        request_count++;
+    }
+}
+
+static void handleConnection(int fd, FILE *error_log)
+{
+    char *request = malloc(SERVER_MAX_REQUEST_LENGTH + 1);
+    FILE *output = fdopen(fd, "w");
+
+    if (request == NULL || output == NULL)
+    {
+        free(request);
+        close(fd);
+        return;
+    }
+
+    char *body = NULL;
+
+    if (readRequest(fd, request, SERVER_MAX_REQUEST_LENGTH, &body) < 0)
+    {
+        sendError(output, "400 Bad Request", "Unable to read request\n");
+        fclose(output);
+        free(request);
+        return;
+    }
+
+    char *headers = strstr(request, "\r\n");
+    char *target = strchr(request, ' ');
+
+    if (headers == NULL || target == NULL || target > headers)
+    {
+        sendError(output, "400 Bad Request", "Malformed request\n");
+        fclose(output);
+        free(request);
+        return;
+    }
+
+    *headers = '\0';
+    headers += 2;
+    *target = '\0';
+    target++;
+
+    char *end = strchr(target, ' ');
+    if (end != NULL)
+    {
+        *end = '\0';
+    }
+
+    int format = OUTPUT_FORMAT_TABLE;
+    char header_value[1024];
+
+    format = http_formatFromAccept(
+        getHeader(headers, "Accept", header_value, sizeof(header_value)),
+        format);
+
+    char *query = NULL;
+    char *query_string = strchr(target, '?');
+
+    if (query_string != NULL)
+    {
+        query = http_parseQueryString(query_string + 1, &format);
+    }
+
+    if (strcmp(request, "POST") == 0 && query == NULL && body != NULL)
+    {
+        const char *content_type = getHeader(headers, "Content-Type", header_value, sizeof(header_value));
+
+        // Clients often label raw SQL as a form, so it must have a query field
+        int is_form = content_type != NULL
+            && strstr(content_type, "application/x-www-form-urlencoded") != NULL
+            && (strncmp(body, "query=", 6) == 0 || strstr(body, "&query=") != NULL);
+
+        if (is_form)
+        {
+            query = http_parseQueryString(body, &format);
+        }
+        else if (body[0] != '\0')
+        {
+            query = strdup(body);
+        }
+    }
+    else if (strcmp(request, "GET") != 0 && strcmp(request, "POST") != 0)
+    {
+        sendError(output, "405 Method Not Allowed", "Only GET and POST are supported\n");
+        fclose(output);
+        free(request);
+        return;
+    }
+
+    if (query == NULL)
+    {
+        sendError(output, "400 Bad Request", "No query was provided in the query string\n");
+        fclose(output);
+        free(request);
+        return;
+    }
+
+    fprintf(output, "HTTP/1.0 200 OK\r\n");
+
+    char *session = http_getSession(
+        getHeader(headers, "Cookie", header_value, sizeof(header_value)),
+        output);
+
+    http_setSessionTempDB(session);
+
+    fprintf(output, "Access-Control-Allow-Origin: *\r\n");
+    fprintf(output, "Content-Type: %s\r\n", http_contentType(format));
+    fprintf(output, "Connection: close\r\n");
+    fprintf(output, "\r\n");
+
+    int result = runQueries(query, OUTPUT_OPTION_HEADERS | format, output);
+
+    if (result < 0)
+    {
+        http_printError(format, error_log, output);
+    }
+
+    fclose(output);
+
+    free(session);
+    free(query);
+    free(request);
+}
+
+/**
+ * @brief Read request line, headers and any body (by Content-Length) into
+ * buffer, which is NUL terminated.
+ *
+ * @param body OUT start of body within buffer, or NULL if there isn't one
+ * @return int 0 on success; -1 on failure or if the request is too large
+ */
+static int readRequest(int fd, char *buffer, int max_length, char **body)
+{
+    int length = 0;
+    char *header_end = NULL;
+
+    *body = NULL;
+
+    while (header_end == NULL)
+    {
+        if (length >= max_length)
+        {
+            return -1;
+        }
+
+        ssize_t count = read(fd, buffer + length, max_length - length);
+
+        if (count <= 0)
+        {
+            return -1;
+        }
+
+        length += count;
+        buffer[length] = '\0';
+
+        header_end = strstr(buffer, "\r\n\r\n");
+    }
+
+    char value[32];
+    const char *content_length = getHeader(buffer, "Content-Length", value, sizeof(value));
+
+    if (content_length == NULL)
+    {
+        return 0;
+    }
+
+    int body_start = header_end + 4 - buffer;
+    int body_length = atoi(content_length);
+
+    if (body_length < 0 || body_start + body_length > max_length)
+    {
+        return -1;
+    }
+
+    while (length < body_start + body_length)
+    {
+        ssize_t count = read(fd, buffer + length, body_start + body_length - length);
+
+        if (count <= 0)
+        {
+            return -1;
+        }
+
+        length += count;
+    }
+
+    buffer[body_start + body_length] = '\0';
+
+    // Keep the headers terminated where they end
+    header_end[2] = '\0';
+
+    *body = buffer + body_start;
+
+    return 0;
+}
+
+/**
+ * @brief Case insensitive search for a header
+ *
+ * @param headers "Name: value\r\n" lines
+ * @return const char* value (copied to value) or NULL if not present
+ */
+static const char *getHeader(const char *headers, const char *name, char *value, int max_length)
+{
+    size_t name_length = strlen(name);
+    const char *line = headers;
+
+    while (line != NULL && *line != '\0' && *line != '\r')
+    {
+        if (strncasecmp(line, name, name_length) == 0 && line[name_length] == ':')
+        {
+            const char *start = line + name_length + 1;
+
+            while (*start == ' ')
+            {
+                start++;
+            }
+
+            int length = strcspn(start, "\r\n");
+
+            if (length >= max_length)
+            {
+                length = max_length - 1;
+            }
+
+            memcpy(value, start, length);
+            value[length] = '\0';
+
+            return value;
+        }
+
+        line = strstr(line, "\r\n");
+
+        if (line != NULL)
+        {
+            line += 2;
+        }
+    }
+
+    return NULL;
+}
+
+static void sendError(FILE *output, const char *status, const char *message)
+{
+    fprintf(output, "HTTP/1.0 %s\r\n", status);
+    fprintf(output, "Access-Control-Allow-Origin: *\r\n");
+    fprintf(output, "Content-Type: text/plain\r\n");
+    fprintf(output, "Connection: close\r\n");
+    fprintf(output, "\r\n");
+    fprintf(output, "%s", message);
+}
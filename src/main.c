@@ -34,6 +34,7 @@ void printUsage(const char *name, FILE *file)
         "\t%1$s \"CREATE [UNIQUE] INDEX [<index_file>] ON <file> (<field>)\"\n"
         "\t%1$s \"CREATE TABLE <file> AS <query>\"\n"
         "\t%1$s \"INSERT INTO <file> <query>\"\n"
+        "\t%1$s \"COPY <file> FROM <file>\"\n"
         "\t%1$s \"CREATE VIEW <file> AS <query>\"\n"
         "\t%1$s -h|--help\n"
         "\n"
@@ -44,6 +44,7 @@ void checkPlan (struct Query *query, struct Plan *plan) {
             case PLAN_LOOP_JOIN:
             case PLAN_UNIQUE_JOIN:
             case PLAN_INDEX_JOIN:
+            case PLAN_HASH_JOIN:
                 table_id++;
                 break;
 
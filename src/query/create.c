@@ -1,12 +1,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <dirent.h>
+#include <unistd.h>
 
 #include "../structs.h"
 #include "token.h"
 #include "../db/db.h"
 #include "../db/csv.h"
 #include "../db/temp.h"
+#include "../db/csv-cache.h"
+#include "../db/binary-index.h"
 #include "result.h"
 #include "../sort/sort-quick.h"
 #include "output.h"
@@ -24,10 +28,87 @@ static int create_index(
     const char *table_name,
     const char (*index_field)[MAX_FIELD_LENGTH],
     int field_count,
-    int unique_flag);
+    int unique_flag,
+    int binary_flag);
+
+static struct Node *make_index_columns(
+    struct DB *db,
+    const char (*index_field)[MAX_FIELD_LENGTH],
+    int field_count);
+
+static int write_index(
+    const char *file_name,
+    struct Table *tables,
+    struct Node *columns,
+    int field_count,
+    RowListIndex row_list,
+    int unique_flag,
+    int binary_flag);
+
+/**
+ * @brief An index file being brought up to date after an INSERT or COPY
+ */
+struct IndexUpdate
+{
+    char file_name[FILENAME_MAX];
+    int unique_flag;
+    int binary_flag;
+    /** Number of key columns (not including rowid) */
+    int field_count;
+    struct Node *columns;
+    /** Table rowids in index order, then the row of the existing index each
+     * came from (if merged); -1 until built */
+    RowListIndex row_list;
+    /** The table and the existing index */
+    struct Table tables[2];
+    struct DB index_db;
+    int index_open;
+    /** 0 if the rows break a UNIQUE constraint */
+    int is_valid;
+    /** COPY only: keys of the new rows (and of every row if the index is
+     * being rebuilt), kept under the sort memory limit */
+    struct KeySorter *sorter;
+    /** COPY only: rows to take from the existing index */
+    int merge_count;
+    /** COPY only: binary index built in memory until every index is valid */
+    struct BinaryIndexWriter *writer;
+};
+
+static int update_indexes(const char *table_name, int old_count);
+
+static int find_table_indexes(
+    const char *table_name,
+    struct IndexUpdate **updates);
+
+static RowListIndex merge_index(
+    struct Table *table,
+    struct DB *index_db,
+    struct IndexUpdate *update,
+    int old_count);
+
+static int compare_index_keys(
+    char (*a)[MAX_VALUE_LENGTH],
+    char (*b)[MAX_VALUE_LENGTH],
+    int field_count);
+
+static int compare_index_value(const char *a, const char *b);
+
+static int check_unique(
+    struct Table *table,
+    struct Node *columns,
+    RowListIndex row_list);
+
+static void add_index_key(
+    struct IndexUpdate *update,
+    const char *values,
+    int rowid);
+
+static int write_loaded_index(struct IndexUpdate *update, const char *tmp_name);
 
 static int create_temp_table_query(const char *query, const char **end_ptr);
 
+static int create_cache_query(const char *query, const char **end_ptr);
+
 int create_query(const char *query, const char **end_ptr)
 {
     size_t index = 0;
@@ -75,6 +156,11 @@ int create_query(const char *query, const char **end_ptr)
         return create_index_query(query, end_ptr);
     }
 
+    if (strcmp(keyword, "CACHE") == 0)
+    {
+        return create_cache_query(query, end_ptr);
+    }
+
     fprintf(stderr, "Cannot CREATE '%s'\n", keyword);
     return -1;
 }
@@ -82,6 +168,7 @@ int create_query(const char *query, const char **end_ptr)
 int create_index_query(const char *query, const char **end_ptr)
 {
     int unique_flag = 0;
+    int binary_flag = 0;
     int auto_name = 0;
 
     size_t index = 0;
@@ -173,12 +260,91 @@ int create_index_query(const char *query, const char **end_ptr)
         return -1;
     }
 
+    skipWhitespace(query, &index);
+
+    // Optional USING BINARY to write a binary index (see binary-index.c)
+    if (strncmp(&query[index], "USING ", 6) == 0)
+    {
+        index += 6;
+
+        getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+        if (strcmp(keyword, "BINARY") != 0)
+        {
+            fprintf(stderr, "Expected BINARY got '%s'\n", keyword);
+            return -1;
+        }
+
+        binary_flag = 1;
+
+        skipWhitespace(query, &index);
+    }
+
     if (auto_name)
     {
         sprintf(index_name, "%s__%s", table_name, index_field[0]);
     }
 
-    create_index(index_name, table_name, index_field, field_count, unique_flag);
+    create_index(
+        index_name,
+        table_name,
+        index_field,
+        field_count,
+        unique_flag,
+        binary_flag);
+
+    if (query[index] == ';')
+    {
+        index++;
+    }
+
+    if (end_ptr != NULL)
+    {
+        *end_ptr = &query[index];
+    }
+
+    return 0;
+}
+
+/**
+ * @brief CREATE CACHE ON <table>
+ * Writes a columnar copy of the table alongside it (see csv-cache.c)
+ */
+static int create_cache_query(const char *query, const char **end_ptr)
+{
+    size_t index = 0;
+
+    char keyword[MAX_FIELD_LENGTH] = {0};
+    char table_name[MAX_TABLE_LENGTH] = {0};
+
+    // CREATE
+    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+    // CACHE
+    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+    if (strcmp(keyword, "ON") != 0)
+    {
+        fprintf(stderr, "Expected ON got '%s'\n", keyword);
+        return -1;
+    }
+
+    getQuotedToken(query, &index, table_name, MAX_TABLE_LENGTH);
+
+    if (table_name[0] == '\0')
+    {
+        fprintf(stderr, "Expected table name\n");
+        return -1;
+    }
+
+    if (csvCache_create(table_name) != 0)
+    {
+        return -1;
+    }
+
+    skipWhitespace(query, &index);
 
     if (query[index] == ';')
     {
@@ -198,7 +364,8 @@ static int create_index(
     const char *table_name,
     const char (*index_field)[MAX_FIELD_LENGTH],
     int field_count,
-    int unique_flag)
+    int unique_flag,
+    int binary_flag)
 {
     struct DB db;
     struct Table table = {0};
@@ -217,16 +384,68 @@ static int create_index(
         return -1;
     }
 
+    struct Node *columns = make_index_columns(&db, index_field, field_count);
+
+    if (columns == NULL)
+    {
+        return -1;
+    }
+
+    char file_name[MAX_TABLE_LENGTH + MAX_FIELD_LENGTH + 12];
+    sprintf(
+        file_name,
+        "%s.%s.%s",
+        index_name,
+        unique_flag ? "unique" : "index",
+        binary_flag ? "idx" : "csv");
+
+    int record_count = getRecordCount(&db);
+
+    RowListIndex row_list = createRowList(1, record_count);
+
+    // Fill row list with every sequential rowid
+    fullTableScan(&db, row_list, 0, -1);
+
+    sortQuick(&table, columns, field_count, row_list, -1);
+
+    int result = write_index(
+        file_name,
+        &table,
+        columns,
+        field_count,
+        row_list,
+        unique_flag,
+        binary_flag);
+
+    destroyRowList(row_list);
+
+    free(columns);
+
+    return result;
+}
+
+/**
+ * @brief Columns of an index on the given fields, followed by rowid
+ *
+ * @return struct Node* field_count + 1 columns to be freed by the caller; NULL
+ * if a field doesn't exist
+ */
+static struct Node *make_index_columns(
+    struct DB *db,
+    const char (*index_field)[MAX_FIELD_LENGTH],
+    int field_count)
+{
     struct Node *columns = malloc(sizeof(*columns) * (field_count + 1));
 
     for (int i = 0; i < field_count; i++)
     {
-        int index_field_index = getFieldIndex(&db, index_field[i]);
+        int index_field_index = getFieldIndex(db, index_field[i]);
 
         if (index_field_index < 0)
         {
             fprintf(stderr, "Field does not exist: '%s'\n", index_field[i]);
-            return -1;
+            free(columns);
+            return NULL;
         }
 
         // Defaults to ASC
@@ -246,39 +465,81 @@ static int create_index(
     columns[field_count].child_count = 0;
     columns[field_count].children = NULL;
 
-    char file_name[MAX_TABLE_LENGTH + MAX_FIELD_LENGTH + 12];
-    sprintf(
-        file_name,
-        "%s.%s.csv",
-        index_name,
-        unique_flag ? "unique" : "index");
+    return columns;
+}
 
-    FILE *f = fopen(file_name, "w");
+/**
+ * @brief Write an index file of the rows in row_list, which must already be
+ * in index order. The file is written alongside and then renamed over any
+ * existing index.
+ *
+ * @param tables the table; followed by an existing index if row_list has a
+ * second column giving the row of that index to copy each row from (-1 for
+ * rows to read from the table)
+ * @return int 0 on success; -1 on failure
+ */
+static int write_index(
+    const char *file_name,
+    struct Table *tables,
+    struct Node *columns,
+    int field_count,
+    RowListIndex row_list,
+    int unique_flag,
+    int binary_flag)
+{
+    struct Table *table = &tables[0];
 
-    if (!f)
+    if (binary_flag)
     {
-        fprintf(stderr, "Unable to create file for index: '%s'\n", file_name);
-        return -1;
+        int result = binaryIndex_create(
+            file_name,
+            table,
+            columns,
+            field_count + 1,
+            row_list,
+            unique_flag);
+
+        if (result != 0)
+        {
+            fprintf(stderr, "Unable to create file for index: '%s'\n", file_name);
+        }
+
+        return result;
     }
 
-    int record_count = getRecordCount(&db);
+    char tmp_name[MAX_TABLE_LENGTH + MAX_FIELD_LENGTH + 24];
+    sprintf(tmp_name, "%s.%d", file_name, getpid());
 
-    RowListIndex row_list = createRowList(1, record_count);
+    FILE *f = fopen(tmp_name, "w");
 
-    // Fill row list with every sequential rowid
-    fullTableScan(&db, row_list, 0, -1);
+    if (!f)
+    {
+        fprintf(stderr, "Unable to create file for index: '%s'\n", file_name);
+        return -1;
+    }
 
-    sortQuick(&table, columns, field_count, row_list);
+    int record_count = getRowList(row_list)->row_count;
+    int is_merge = getRowList(row_list)->join_count == 2;
 
     // Output functions assume array of DBs
     printHeaderLine(
         f,
-        &table,
+        table,
         1,
         columns,
         field_count + 1,
         OUTPUT_FORMAT_COMMA);
 
+    // Same columns read from the existing index, where rowid is a field
+    struct Node index_columns[11];
+
+    for (int i = 0; is_merge && i <= field_count; i++)
+    {
+        index_columns[i] = columns[i];
+        index_columns[i].field.table_id = 1;
+        index_columns[i].field.index = i;
+    }
+
     char values[2][MAX_VALUE_LENGTH];
 
     for (int i = 0; i < record_count; i++)
@@ -288,7 +549,7 @@ static int create_index(
         {
             int row_id = getRowID(getRowList(row_list), 0, i);
             getRecordValue(
-                &db,
+                table->db,
                 row_id,
                 columns[0].field.index,
                 values[i % 2],
@@ -301,140 +562,609 @@ static int create_index(
                     "UNIQUE constraint failed. Multiple values for: '%s'\n",
                     values[0]);
                 fclose(f);
-                remove(file_name);
+                remove(tmp_name);
                 exit(-1);
             }
         }
 
+        int is_copy = is_merge && getRowID(getRowList(row_list), 1, i) >= 0;
+
         printResultLine(
             f,
-            &table,
-            1,
-            columns,
+            tables,
+            is_merge ? 2 : 1,
+            is_copy ? index_columns : columns,
             field_count + 1,
             i,
             row_list,
             OUTPUT_FORMAT_COMMA);
     }
 
-    fclose(f);
-
-    destroyRowList(row_list);
+    if (fclose(f) != 0 || rename(tmp_name, file_name) != 0)
+    {
+        fprintf(stderr, "Unable to create file for index: '%s'\n", file_name);
+        remove(tmp_name);
+        return -1;
+    }
 
     return 0;
 }
 
-static int create_table_query(const char *query, const char **end_ptr)
+/**
+ * @brief Bring the automatically named indexes of a table
+ * (`<table>__<field>.(index|unique).(csv|idx)`) up to date after rows have
+ * been appended to it. The new rows are sorted on their own and merged into
+ * each index, which is already sorted, rather than sorting the whole table
+ * again. An index which didn't match the table before the insert is rebuilt
+ * from scratch.
+ *
+ * @param old_count number of rows in the table before the insert
+ * @return int 0 on success; -1 if the new rows break a UNIQUE index, in which
+ * case no index is changed
+ */
+static int update_indexes(const char *table_name, int old_count)
 {
+    struct IndexUpdate *updates = NULL;
+    int update_count = find_table_indexes(table_name, &updates);
 
-    size_t index = 0;
-
-    char keyword[MAX_FIELD_LENGTH] = {0};
-
-    char table_name[MAX_TABLE_LENGTH] = {0};
-
-    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
-
-    if (strcmp(keyword, "CREATE") != 0)
+    if (update_count == 0)
     {
-        fprintf(stderr, "Expected CREATE got '%s'\n", keyword);
-        return -1;
+        return 0;
     }
 
-    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+    struct DB db;
+    struct Table table = {0};
+    table.db = &db;
+    strcpy(table.name, table_name);
 
-    if (strcmp(keyword, "TABLE") != 0)
+    if (openDB(&db, table_name, NULL) != 0)
     {
-        fprintf(stderr, "Expected TABLE got '%s'\n", keyword);
-        return -1;
+        free(updates);
+        return 0;
     }
 
-    skipWhitespace(query, &index);
+    int record_count = getRecordCount(&db);
 
-    getQuotedToken(query, &index, table_name, MAX_TABLE_LENGTH);
+    int result = 0;
 
-    skipWhitespace(query, &index);
+    for (int i = 0; i < update_count && result == 0; i++)
+    {
+        struct IndexUpdate *update = &updates[i];
+        struct DB *index_db = &update->index_db;
 
-    char header_buffer[MAX_VALUE_LENGTH];
+        if (openDB(index_db, update->file_name, NULL) != 0)
+        {
+            continue;
+        }
 
-    if (query[index] == '(')
-    {
-        int length = find_matching_parenthesis(query + index);
-        strncpy(header_buffer, query + index + 1, length - 2);
-        header_buffer[length - 1] = '\0';
-        index += length;
-    }
-    else
-    {
-        header_buffer[0] = '\0';
-    }
+        update->index_open = 1;
+        update->tables[0] = table;
+        update->tables[1].db = index_db;
 
-    const char *sub_query = NULL;
+        // Key columns followed by rowid
+        update->field_count = index_db->field_count - 1;
 
-    if (getToken(query, &index, keyword, MAX_FIELD_LENGTH) > 0)
-    {
-        if (strcmp(keyword, "AS") == 0)
+        char index_field[10][MAX_FIELD_LENGTH];
+
+        if (
+            update->field_count < 1 || update->field_count > 10
+            || strcmp(getFieldName(index_db, update->field_count), "rowid") != 0
+        )
         {
-            skipWhitespace(query, &index);
+            continue;
+        }
 
-            sub_query = query + index;
+        for (int j = 0; j < update->field_count; j++)
+        {
+            strcpy(index_field[j], getFieldName(index_db, j));
+        }
+
+        update->columns = make_index_columns(
+            &db,
+            (const char (*)[MAX_FIELD_LENGTH])index_field,
+            update->field_count);
+
+        if (update->columns == NULL)
+        {
+            continue;
         }
 
+        if (getRecordCount(index_db) == old_count)
+        {
+            update->row_list = merge_index(&table, index_db, update, old_count);
+        }
         else
         {
-            fprintf(stderr, "Unexpected keyword: '%s'\n", keyword);
-            exit(-1);
+            // Index was already out of date so start again
+            update->row_list = createRowList(1, record_count);
+
+            fullTableScan(&db, update->row_list, 0, -1);
+
+            sortQuick(
+                &table,
+                update->columns,
+                update->field_count,
+                update->row_list,
+                -1);
+
+            if (update->unique_flag)
+            {
+                update->is_valid = check_unique(
+                    &table,
+                    update->columns,
+                    update->row_list);
+            }
+        }
+
+        if (!update->is_valid)
+        {
+            result = -1;
         }
     }
 
-    if (sub_query == NULL && header_buffer[0] == '\0')
+    for (int i = 0; i < update_count; i++)
     {
-        fprintf(stderr, "Expected column spec or AS keyword.\n");
-        exit(-1);
-    }
+        struct IndexUpdate *update = &updates[i];
 
-    struct DB db = {0};
+        // UNIQUE has already been checked
+        if (result == 0 && update->row_list >= 0)
+        {
+            write_index(
+                update->file_name,
+                update->tables,
+                update->columns,
+                update->field_count,
+                update->row_list,
+                0,
+                update->binary_flag);
+        }
 
-    int result = csv_fromQuery(
-        &db,
-        table_name,
-        sub_query,
-        end_ptr,
-        header_buffer[0] == '\0' ? NULL : header_buffer);
+        if (update->row_list >= 0)
+        {
+            destroyRowList(update->row_list);
+        }
 
-    closeDB(&db);
+        if (update->index_open)
+        {
+            closeDB(&update->index_db);
+        }
 
-    if (end_ptr != NULL)
-    {
-        *end_ptr = query + index;
+        free(update->columns);
     }
 
+    free(updates);
+
+    closeDB(&db);
+
     return result;
 }
 
-static int create_temp_table_query(const char *query, const char **end_ptr)
+/**
+ * @brief List the automatically named index files of a table
+ *
+ * @param updates OUT one entry per index file, to be freed by the caller
+ * @return int number of index files found
+ */
+static int find_table_indexes(
+    const char *table_name,
+    struct IndexUpdate **updates)
 {
+    const char *suffixes[] = {
+        ".index.csv",
+        ".unique.csv",
+        ".index.idx",
+        ".unique.idx",
+    };
+
+    // Index names are based on the table name without '.csv'
+    char base[MAX_TABLE_LENGTH];
+    strcpy(base, table_name);
+
+    size_t base_len = strlen(base);
+    if (base_len > 4 && strcmp(base + base_len - 4, ".csv") == 0)
+    {
+        base[base_len - 4] = '\0';
+    }
 
-    size_t index = 0;
-
-    char keyword[MAX_FIELD_LENGTH] = {0};
-
-    char table_name[MAX_TABLE_LENGTH] = {0};
+    char dir_name[MAX_TABLE_LENGTH] = ".";
+    char prefix[MAX_TABLE_LENGTH + 2];
 
-    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+    char *slash = strrchr(base, '/');
 
-    if (strcmp(keyword, "CREATE") != 0)
+    if (slash != NULL)
     {
-        fprintf(stderr, "Expected CREATE got '%s'\n", keyword);
-        return -1;
+        *slash = '\0';
+        strcpy(dir_name, base[0] == '\0' ? "/" : base);
+        sprintf(prefix, "%s__", slash + 1);
+    }
+    else
+    {
+        sprintf(prefix, "%s__", base);
     }
 
-    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+    DIR *dir = opendir(dir_name);
 
-    if (strcmp(keyword, "TEMP") != 0)
+    if (dir == NULL)
     {
-        fprintf(stderr, "Expected TEMP got '%s'\n", keyword);
-        return -1;
+        return 0;
+    }
+
+    int count = 0;
+    int capacity = 0;
+    size_t prefix_len = strlen(prefix);
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        const char *name = entry->d_name;
+        size_t name_len = strlen(name);
+
+        if (strncmp(name, prefix, prefix_len) != 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < 4; i++)
+        {
+            size_t suffix_len = strlen(suffixes[i]);
+
+            if (
+                name_len <= prefix_len + suffix_len
+                || strcmp(name + name_len - suffix_len, suffixes[i]) != 0
+            )
+            {
+                continue;
+            }
+
+            if (count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 4;
+                *updates = realloc(*updates, sizeof(**updates) * capacity);
+
+                if (*updates == NULL)
+                {
+                    fprintf(stderr, "Unable to allocate memory for indexes\n");
+                    exit(-1);
+                }
+            }
+
+            struct IndexUpdate *update = &(*updates)[count++];
+
+            memset(update, 0, sizeof(*update));
+
+            snprintf(
+                update->file_name,
+                sizeof(update->file_name),
+                "%s/%s",
+                dir_name,
+                name);
+
+            update->row_list = -1;
+            update->unique_flag = i % 2;
+            update->binary_flag = i >= 2;
+            update->is_valid = 1;
+
+            break;
+        }
+    }
+
+    closedir(dir);
+
+    return count;
+}
+
+/**
+ * @brief Merge the table rows from old_count onwards into an existing index.
+ * Rows with equal keys keep their table order, the same as sortQuick().
+ * Sets update->is_valid to 0 if the index is UNIQUE and a new row repeats a
+ * key.
+ *
+ * @return RowListIndex table rowids in index order, each with the row of the
+ * existing index it came from or -1 for new rows
+ */
+static RowListIndex merge_index(
+    struct Table *table,
+    struct DB *index_db,
+    struct IndexUpdate *update,
+    int old_count)
+{
+    struct DB *db = table->db;
+    int record_count = getRecordCount(db);
+    int field_count = update->field_count;
+    struct Node *columns = update->columns;
+
+    // Only the new rows need sorting
+    RowListIndex new_rows = createRowList(1, record_count - old_count);
+
+    for (int i = old_count; i < record_count; i++)
+    {
+        appendRowID(getRowList(new_rows), i);
+    }
+
+    sortQuick(table, columns, field_count, new_rows, -1);
+
+    RowListIndex merged = createRowList(2, record_count);
+
+    char index_keys[10][MAX_VALUE_LENGTH];
+    char new_keys[10][MAX_VALUE_LENGTH];
+    char last_key[MAX_VALUE_LENGTH] = {0};
+    char value[MAX_VALUE_LENGTH];
+
+    int index_rowid = 0;
+    int new_index = 0;
+    int new_count = getRowList(new_rows)->row_count;
+
+    // Keys are only read again when moving on to the next row
+    int index_loaded = -1;
+    int new_loaded = -1;
+
+    while (index_rowid < old_count || new_index < new_count)
+    {
+        if (index_rowid < old_count && index_loaded != index_rowid)
+        {
+            for (int j = 0; j < field_count; j++)
+            {
+                getRecordValue(
+                    index_db,
+                    index_rowid,
+                    j,
+                    index_keys[j],
+                    MAX_VALUE_LENGTH);
+            }
+
+            index_loaded = index_rowid;
+        }
+
+        if (new_index < new_count && new_loaded != new_index)
+        {
+            int rowid = getRowID(getRowList(new_rows), 0, new_index);
+
+            for (int j = 0; j < field_count; j++)
+            {
+                getRecordValue(
+                    db,
+                    rowid,
+                    columns[j].field.index,
+                    new_keys[j],
+                    MAX_VALUE_LENGTH);
+            }
+
+            new_loaded = new_index;
+        }
+
+        // Existing rows go first when keys are equal since their rowids are
+        // lower
+        int take_new = index_rowid >= old_count
+            || (
+                new_index < new_count
+                && compare_index_keys(new_keys, index_keys, field_count) < 0
+            );
+
+        if (take_new)
+        {
+            if (update->unique_flag && strcmp(new_keys[0], last_key) == 0)
+            {
+                fprintf(
+                    stderr,
+                    "UNIQUE constraint failed. Multiple values for: '%s'\n",
+                    new_keys[0]);
+                update->is_valid = 0;
+                break;
+            }
+
+            strcpy(last_key, new_keys[0]);
+
+            appendRowID2(
+                getRowList(merged),
+                getRowID(getRowList(new_rows), 0, new_index),
+                -1);
+
+            new_index++;
+        }
+        else
+        {
+            strcpy(last_key, index_keys[0]);
+
+            getRecordValue(
+                index_db,
+                index_rowid,
+                field_count,
+                value,
+                MAX_VALUE_LENGTH);
+
+            appendRowID2(getRowList(merged), atoi(value), index_rowid);
+
+            index_rowid++;
+        }
+    }
+
+    destroyRowList(new_rows);
+
+    return merged;
+}
+
+/**
+ * @brief Same ordering as sortQuick(): numerically if both values are
+ * numbers, otherwise as strings
+ */
+static int compare_index_keys(
+    char (*a)[MAX_VALUE_LENGTH],
+    char (*b)[MAX_VALUE_LENGTH],
+    int field_count)
+{
+    for (int i = 0; i < field_count; i++)
+    {
+        int result = compare_index_value(a[i], b[i]);
+
+        if (result != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int compare_index_value(const char *a, const char *b)
+{
+    if (is_numeric(a) && is_numeric(b))
+    {
+        long number_a = atol(a);
+        long number_b = atol(b);
+
+        return (number_a > number_b) - (number_a < number_b);
+    }
+
+    return strcmp(a, b);
+}
+
+/**
+ * @return int 1 if no two rows (which must be sorted) share a key; 0 otherwise
+ */
+static int check_unique(
+    struct Table *table,
+    struct Node *columns,
+    RowListIndex row_list)
+{
+    char values[2][MAX_VALUE_LENGTH];
+
+    int record_count = getRowList(row_list)->row_count;
+
+    for (int i = 0; i < record_count; i++)
+    {
+        int row_id = getRowID(getRowList(row_list), 0, i);
+
+        getRecordValue(
+            table->db,
+            row_id,
+            columns[0].field.index,
+            values[i % 2],
+            MAX_VALUE_LENGTH);
+
+        if (i > 0 && strcmp(values[0], values[1]) == 0)
+        {
+            fprintf(
+                stderr,
+                "UNIQUE constraint failed. Multiple values for: '%s'\n",
+                values[0]);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int create_table_query(const char *query, const char **end_ptr)
+{
+
+    size_t index = 0;
+
+    char keyword[MAX_FIELD_LENGTH] = {0};
+
+    char table_name[MAX_TABLE_LENGTH] = {0};
+
+    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+    if (strcmp(keyword, "CREATE") != 0)
+    {
+        fprintf(stderr, "Expected CREATE got '%s'\n", keyword);
+        return -1;
+    }
+
+    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+    if (strcmp(keyword, "TABLE") != 0)
+    {
+        fprintf(stderr, "Expected TABLE got '%s'\n", keyword);
+        return -1;
+    }
+
+    skipWhitespace(query, &index);
+
+    getQuotedToken(query, &index, table_name, MAX_TABLE_LENGTH);
+
+    skipWhitespace(query, &index);
+
+    char header_buffer[MAX_VALUE_LENGTH];
+
+    if (query[index] == '(')
+    {
+        int length = find_matching_parenthesis(query + index);
+        strncpy(header_buffer, query + index + 1, length - 2);
+        header_buffer[length - 1] = '\0';
+        index += length;
+    }
+    else
+    {
+        header_buffer[0] = '\0';
+    }
+
+    const char *sub_query = NULL;
+
+    if (getToken(query, &index, keyword, MAX_FIELD_LENGTH) > 0)
+    {
+        if (strcmp(keyword, "AS") == 0)
+        {
+            skipWhitespace(query, &index);
+
+            sub_query = query + index;
+        }
+
+        else
+        {
+            fprintf(stderr, "Unexpected keyword: '%s'\n", keyword);
+            exit(-1);
+        }
+    }
+
+    if (sub_query == NULL && header_buffer[0] == '\0')
+    {
+        fprintf(stderr, "Expected column spec or AS keyword.\n");
+        exit(-1);
+    }
+
+    struct DB db = {0};
+
+    int result = csv_fromQuery(
+        &db,
+        table_name,
+        sub_query,
+        end_ptr,
+        header_buffer[0] == '\0' ? NULL : header_buffer);
+
+    closeDB(&db);
+
+    if (end_ptr != NULL)
+    {
+        *end_ptr = query + index;
+    }
+
+    return result;
+}
+
+static int create_temp_table_query(const char *query, const char **end_ptr)
+{
+
+    size_t index = 0;
+
+    char keyword[MAX_FIELD_LENGTH] = {0};
+
+    char table_name[MAX_TABLE_LENGTH] = {0};
+
+    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+    if (strcmp(keyword, "CREATE") != 0)
+    {
+        fprintf(stderr, "Expected CREATE got '%s'\n", keyword);
+        return -1;
+    }
+
+    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+    if (strcmp(keyword, "TEMP") != 0)
+    {
+        fprintf(stderr, "Expected TEMP got '%s'\n", keyword);
+        return -1;
     }
 
     getToken(query, &index, keyword, MAX_FIELD_LENGTH);
@@ -578,16 +1308,557 @@ int insert_query(const char *query, const char **end_ptr)
     // Must force VFS_CSV to make sure changes are persisted
     int result = csv_openDB(&db, table_name, NULL);
 
+    int old_count = 0;
+    long old_size = 0;
+
     if (result == 0)
     {
+        old_count = getRecordCount(&db);
+
+        fseek(db.file, 0, SEEK_END);
+        old_size = ftell(db.file);
+
         result = insertFromQuery(&db, query + index, end_ptr);
     }
 
+    if (result == 0)
+    {
+        fflush(db.file);
+
+        if (update_indexes(table_name, old_count) != 0)
+        {
+            // Take the new rows back out so the table still matches its
+            // indexes
+            if (ftruncate(fileno(db.file), old_size) != 0)
+            {
+                fprintf(stderr, "Unable to undo INSERT INTO '%s'\n", table_name);
+            }
+
+            result = -1;
+        }
+    }
+
     closeDB(&db);
 
     return result;
+}
+
+/**
+ * @brief COPY <table> FROM <source>
+ * Appends every row of source to table, matching columns by name, and
+ * brings the table's automatically named indexes up to date. Source is read
+ * once. As each row is written the keys of every index are gathered, then
+ * sorted and merged into the existing indexes without reading the table
+ * again. If a new row would break a UNIQUE index, the table and its indexes
+ * are left unchanged. Creates the table with the source's columns if it
+ * doesn't exist.
+ *
+ * @return int 0 on success; -1 on failure
+ */
+int copy_query(const char *query, const char **end_ptr)
+{
+    size_t index = 0;
+
+    char keyword[MAX_FIELD_LENGTH] = {0};
+
+    char table_name[MAX_TABLE_LENGTH] = {0};
+    char source_name[MAX_TABLE_LENGTH] = {0};
+
+    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+    if (strcmp(keyword, "COPY") != 0)
+    {
+        fprintf(stderr, "Expected COPY got '%s'\n", keyword);
+        return -1;
+    }
 
-    /**
-     * TODO: Optionally rebuild any indexes found on the table
-     */
+    skipWhitespace(query, &index);
+
+    getQuotedToken(query, &index, table_name, MAX_TABLE_LENGTH);
+
+    getToken(query, &index, keyword, MAX_FIELD_LENGTH);
+
+    if (strcmp(keyword, "FROM") != 0)
+    {
+        fprintf(stderr, "Expected FROM got '%s'\n", keyword);
+        return -1;
+    }
+
+    skipWhitespace(query, &index);
+
+    getQuotedToken(query, &index, source_name, MAX_TABLE_LENGTH);
+
+    skipWhitespace(query, &index);
+
+    if (query[index] == ';')
+    {
+        index++;
+    }
+
+    if (end_ptr != NULL)
+    {
+        *end_ptr = &query[index];
+    }
+
+    struct DB source;
+
+    if (openDB(&source, source_name, NULL) != 0)
+    {
+        fprintf(stderr, "File not found: '%s'\n", source_name);
+        return -1;
+    }
+
+    temp_findTable(table_name, table_name);
+
+    struct DB db = {0};
+
+    // Must force VFS_CSV to make sure changes are persisted
+    if (csv_openDB(&db, table_name, NULL) != 0)
+    {
+        // New table with the same columns as the source
+        char header[MAX_VALUE_LENGTH] = {0};
+
+        for (int i = 0; i < source.field_count; i++)
+        {
+            if (i > 0)
+            {
+                strcat(header, ",");
+            }
+
+            strcat(header, getFieldName(&source, i));
+        }
+
+        strcat(header, "\n");
+
+        if (csv_fromHeaders(&db, table_name, header) != 0)
+        {
+            fprintf(stderr, "Unable to create table '%s'\n", table_name);
+            closeDB(&source);
+            return -1;
+        }
+    }
+
+    int field_count = db.field_count;
+    int *source_fields = malloc(sizeof(*source_fields) * field_count);
+    char *values = malloc(MAX_VALUE_LENGTH * field_count);
+
+    if (source_fields == NULL || values == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for COPY\n");
+        exit(-1);
+    }
+
+    for (int i = 0; i < field_count; i++)
+    {
+        source_fields[i] = getFieldIndex(&source, getFieldName(&db, i));
+
+        if (source_fields[i] < 0)
+        {
+            fprintf(
+                stderr,
+                "Field does not exist in '%s': '%s'\n",
+                source_name,
+                getFieldName(&db, i));
+            free(source_fields);
+            free(values);
+            closeDB(&source);
+            closeDB(&db);
+            return -1;
+        }
+    }
+
+    int old_count = getRecordCount(&db);
+    int source_count = getRecordCount(&source);
+
+    struct IndexUpdate *updates = NULL;
+    int update_count = find_table_indexes(table_name, &updates);
+
+    struct Table table = {0};
+    table.db = &db;
+    strcpy(table.name, table_name);
+
+    for (int i = 0; i < update_count; i++)
+    {
+        struct IndexUpdate *update = &updates[i];
+        struct DB *index_db = &update->index_db;
+
+        if (openDB(index_db, update->file_name, NULL) != 0)
+        {
+            continue;
+        }
+
+        update->index_open = 1;
+        update->field_count = index_db->field_count - 1;
+
+        char index_field[10][MAX_FIELD_LENGTH];
+
+        if (
+            update->field_count < 1 || update->field_count > 10
+            || strcmp(getFieldName(index_db, update->field_count), "rowid") != 0
+        )
+        {
+            continue;
+        }
+
+        for (int j = 0; j < update->field_count; j++)
+        {
+            strcpy(index_field[j], getFieldName(index_db, j));
+        }
+
+        update->columns = make_index_columns(
+            &db,
+            (const char (*)[MAX_FIELD_LENGTH])index_field,
+            update->field_count);
+
+        if (update->columns == NULL)
+        {
+            continue;
+        }
+
+        if (getRecordCount(index_db) == old_count)
+        {
+            update->merge_count = old_count;
+            update->sorter = keySorter_open(update->field_count, source_count);
+            continue;
+        }
+
+        update->sorter =
+            keySorter_open(update->field_count, old_count + source_count);
+
+        // Index was already out of date so start again from the table
+        for (int rowid = 0; rowid < old_count; rowid++)
+        {
+            for (int j = 0; j < update->field_count; j++)
+            {
+                int field_index = update->columns[j].field.index;
+
+                getRecordValue(
+                    &db,
+                    rowid,
+                    field_index,
+                    values + field_index * MAX_VALUE_LENGTH,
+                    MAX_VALUE_LENGTH);
+            }
+
+            add_index_key(update, values, rowid);
+        }
+    }
+
+    fseek(db.file, 0, SEEK_END);
+    long old_size = ftell(db.file);
+
+    // Make sure previous record ended with \n
+    fseek(db.file, -1, SEEK_END);
+
+    if (fgetc(db.file) != '\n')
+    {
+        fseek(db.file, 0, SEEK_END);
+        fputc('\n', db.file);
+    }
+
+    fseek(db.file, 0, SEEK_END);
+
+    for (int i = 0; i < source_count; i++)
+    {
+        for (int j = 0; j < field_count; j++)
+        {
+            char *value = values + j * MAX_VALUE_LENGTH;
+
+            if (getRecordValue(
+                    &source,
+                    i,
+                    source_fields[j],
+                    value,
+                    MAX_VALUE_LENGTH) < 0)
+            {
+                value[0] = '\0';
+            }
+
+            if (j > 0)
+            {
+                fputc(',', db.file);
+            }
+
+            printValue(db.file, OUTPUT_FORMAT_COMMA, value);
+        }
+
+        fputc('\n', db.file);
+
+        for (int j = 0; j < update_count; j++)
+        {
+            if (updates[j].columns != NULL)
+            {
+                add_index_key(&updates[j], values, old_count + i);
+            }
+        }
+    }
+
+    int result = fflush(db.file) == 0 ? 0 : -1;
+
+    // CSV indexes are written alongside and renamed once they're all valid
+    char (*tmp_names)[FILENAME_MAX + 16] =
+        calloc(update_count + 1, sizeof(*tmp_names));
+
+    for (int i = 0; i < update_count && result == 0; i++)
+    {
+        struct IndexUpdate *update = &updates[i];
+
+        if (update->columns == NULL)
+        {
+            continue;
+        }
+
+        if (!update->binary_flag)
+        {
+            sprintf(tmp_names[i], "%s.%d", update->file_name, getpid());
+        }
+
+        if (write_loaded_index(update, tmp_names[i]) != 0)
+        {
+            result = -1;
+        }
+    }
+
+    for (int i = 0; i < update_count; i++)
+    {
+        struct IndexUpdate *update = &updates[i];
+
+        if (update->writer != NULL)
+        {
+            binaryIndex_closeWriter(
+                update->writer,
+                result == 0 ? update->file_name : NULL);
+        }
+        else if (tmp_names[i][0] != '\0')
+        {
+            if (result != 0 || rename(tmp_names[i], update->file_name) != 0)
+            {
+                remove(tmp_names[i]);
+            }
+        }
+
+        if (update->index_open)
+        {
+            closeDB(&update->index_db);
+        }
+
+        free(update->columns);
+        keySorter_close(update->sorter);
+    }
+
+    if (result != 0)
+    {
+        // Take the new rows back out so the table still matches its indexes
+        if (ftruncate(fileno(db.file), old_size) != 0)
+        {
+            fprintf(stderr, "Unable to undo COPY into '%s'\n", table_name);
+        }
+    }
+
+    free(tmp_names);
+    free(updates);
+    free(source_fields);
+    free(values);
+
+    closeDB(&source);
+    closeDB(&db);
+
+    return result;
+}
+
+/**
+ * @brief Gather the key of a row for an index
+ *
+ * @param values every field of the row, MAX_VALUE_LENGTH apart
+ */
+static void add_index_key(
+    struct IndexUpdate *update,
+    const char *values,
+    int rowid)
+{
+    const char *key_values[10];
+
+    for (int i = 0; i < update->field_count; i++)
+    {
+        key_values[i] =
+            values + update->columns[i].field.index * MAX_VALUE_LENGTH;
+    }
+
+    keySorter_add(update->sorter, key_values, rowid);
+}
+
+/**
+ * @brief Write an index of the first merge_count rows of the existing index
+ * merged with the gathered keys, taken in order from update->sorter. A CSV
+ * index is written to tmp_name and a binary index is built in update->writer,
+ * for the caller to put in place.
+ *
+ * @return int 0 on success; -1 if a key repeats in a UNIQUE index or the
+ * index couldn't be written
+ */
+static int write_loaded_index(struct IndexUpdate *update, const char *tmp_name)
+{
+    int field_count = update->field_count;
+
+    FILE *f = NULL;
+    struct BinaryIndexWriter *writer = NULL;
+
+    if (update->binary_flag)
+    {
+        writer = binaryIndex_openWriter(update->columns, field_count + 1);
+        update->writer = writer;
+    }
+    else
+    {
+        f = fopen(tmp_name, "w");
+
+        if (f == NULL)
+        {
+            fprintf(
+                stderr,
+                "Unable to create file for index: '%s'\n",
+                update->file_name);
+            return -1;
+        }
+
+        for (int j = 0; j <= field_count; j++)
+        {
+            if (j > 0)
+            {
+                fputc(',', f);
+            }
+
+            fputs(update->columns[j].alias, f);
+        }
+
+        fputc('\n', f);
+    }
+
+    char index_keys[10][MAX_VALUE_LENGTH];
+    char last_key[MAX_VALUE_LENGTH] = {0};
+    char value[MAX_VALUE_LENGTH];
+
+    const char *index_values[10];
+    const char *new_values[10];
+
+    for (int j = 0; j < field_count; j++)
+    {
+        index_values[j] = index_keys[j];
+    }
+
+    int index_rowid = 0;
+    int new_rowid = 0;
+    int has_new = keySorter_next(update->sorter, new_values, &new_rowid);
+    int is_first = 1;
+    int result = 0;
+
+    // Existing keys are only read again when moving on to the next row
+    int index_loaded = -1;
+
+    while (index_rowid < update->merge_count || has_new)
+    {
+        if (index_rowid < update->merge_count && index_loaded != index_rowid)
+        {
+            for (int j = 0; j < field_count; j++)
+            {
+                getRecordValue(
+                    &update->index_db,
+                    index_rowid,
+                    j,
+                    index_keys[j],
+                    MAX_VALUE_LENGTH);
+            }
+
+            index_loaded = index_rowid;
+        }
+
+        // Existing rows go first when keys are equal since their rowids are
+        // lower
+        int take_new = index_rowid >= update->merge_count;
+
+        if (!take_new && has_new)
+        {
+            int compare = 0;
+
+            for (int j = 0; j < field_count && compare == 0; j++)
+            {
+                compare = compare_index_value(new_values[j], index_values[j]);
+            }
+
+            take_new = compare < 0;
+        }
+
+        const char **row_values;
+        int rowid;
+
+        if (take_new)
+        {
+            row_values = new_values;
+            rowid = new_rowid;
+        }
+        else
+        {
+            getRecordValue(
+                &update->index_db,
+                index_rowid,
+                field_count,
+                value,
+                MAX_VALUE_LENGTH);
+
+            row_values = index_values;
+            rowid = atoi(value);
+            index_rowid++;
+        }
+
+        if (update->unique_flag && !is_first && strcmp(row_values[0], last_key) == 0)
+        {
+            fprintf(
+                stderr,
+                "UNIQUE constraint failed. Multiple values for: '%s'\n",
+                row_values[0]);
+            result = -1;
+            break;
+        }
+
+        strcpy(last_key, row_values[0]);
+        is_first = 0;
+
+        if (writer != NULL)
+        {
+            binaryIndex_addEntry(writer, row_values, rowid);
+        }
+        else
+        {
+            for (int j = 0; j < field_count; j++)
+            {
+                printValue(f, OUTPUT_FORMAT_COMMA, row_values[j]);
+                fputc(',', f);
+            }
+
+            fprintf(f, "%d\n", rowid);
+        }
+
+        // New values stay valid until the next key is taken
+        if (take_new)
+        {
+            has_new = keySorter_next(update->sorter, new_values, &new_rowid);
+        }
+    }
+
+    if (writer != NULL)
+    {
+        return result;
+    }
+
+    if (fclose(f) != 0)
+    {
+        result = -1;
+    }
+
+    if (result != 0)
+    {
+        remove(tmp_name);
+    }
+
+    return result;
 }
@@ -1,4 +1,6 @@
 
 int create_query (const char *query, const char **end_ptr);
 
-int insert_query (const char *query, const char **end_ptr);
\ No newline at end of file
+int insert_query (const char *query, const char **end_ptr);
+
+int copy_query (const char *query, const char **end_ptr);
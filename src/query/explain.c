@@ -322,7 +322,11 @@ int explain_select_query (
         }
         else if (s.type == PLAN_SORT) {
             operation = "SORT";
-            long new_cost = rows * rows;
+            // A limited sort only keeps a heap of `limit` rows but still
+            // compares every row at least once
+            long new_cost = s.limit >= 0 && s.limit < rows
+                ? rows * log_10(s.limit + 1)
+                : rows * rows;
             if (cost < new_cost) {
                 cost = new_cost;
             }
@@ -466,6 +470,21 @@ int explain_select_query (
                 cost = rows;
             }
         }
+        else if (s.type == PLAN_HASH_JOIN) {
+            operation = "HASH JOIN";
+
+            join_count++;
+
+            struct Table *t = &tables[join_count];
+
+            setTableName(table, t);
+
+            int record_count = getRecordCount(t->db);
+
+            if (cost < rows + record_count) {
+                cost = rows + record_count;
+            }
+        }
         else if (s.type == PLAN_DUMMY_ROW) {
             operation = "DUMMY ROW";
             rows = 1;
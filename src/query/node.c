@@ -79,6 +79,10 @@ void copyNodeTree (struct Node *dest, struct Node *src) {
 
     dest->function = src->function;
 
+    dest->type_hint = src->type_hint;
+
+    dest->constant = src->constant;
+
     dest->child_count = src->child_count;
 
     dest->children = NULL;
@@ -108,6 +112,8 @@ void clearNode (struct Node *node) {
     node->function = FUNC_UNITY;
     node->alias[0] = '\0';
     node->filter = NULL;
+    node->type_hint = VALUE_UNKNOWN;
+    node->constant.type = VALUE_UNKNOWN;
 }
 
 void freeNode (struct Node *node) {
@@ -123,6 +129,7 @@ void freeNode (struct Node *node) {
     }
 
     if (node->filter != NULL) {
+        freeNode(node->filter);
         free(node->filter);
         node->filter = NULL;
     }
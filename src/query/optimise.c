@@ -316,6 +316,9 @@ void optimiseFlattenANDPredicates(struct Query *query)
                     &predicate->children[j],
                     sizeof *predicate);
             }
+
+            // Children now belong to the new list
+            free(predicate->children);
         }
         else
         {
@@ -4,6 +4,7 @@
 
 #include "../structs.h"
 #include "result.h"
+#include "output.h"
 #include "../evaluate/evaluate.h"
 #include "../evaluate/function.h"
 #include "../db/db.h"
@@ -40,6 +41,51 @@ static void printColumnValueNumber(
 static void printColumnSeparator(FILE *f, enum OutputOption format);
 
 void printResultLine(
+    FILE *f,
+    struct Table *tables,
+    int table_count,
+    struct Node columns[],
+    int column_count,
+    int result_index,
+    RowListIndex list_id,
+    enum OutputOption flags)
+{
+    printResultRow(
+        f,
+        tables,
+        table_count,
+        columns,
+        column_count,
+        result_index,
+        list_id,
+        result_index,
+        flags);
+}
+
+/**
+ * @brief Print a single value, escaped as it would be in a result line
+ */
+void printValue(FILE *f, enum OutputOption flags, const char *value)
+{
+    enum OutputOption format = flags & OUTPUT_MASK_FORMAT;
+
+    // Most CSV values don't need escaping
+    if (format == OUTPUT_FORMAT_COMMA && strpbrk(value, ",\"\n") == NULL)
+    {
+        fputs(value, f);
+        return;
+    }
+
+    printColumnValue(f, format, NULL, "", value);
+}
+
+/**
+ * @brief Print a result line taken from any row of a RowList
+ *
+ * @param result_index position of this line in the output
+ * @param row_index row of the RowList to print
+ */
+void printResultRow(
     FILE *f,
     struct Table *tables,
     __attribute__((unused)) int table_count,
@@ -47,6 +93,7 @@ void printResultLine(
     int column_count,
     int result_index,
     RowListIndex list_id,
+    int row_index,
     enum OutputOption flags)
 {
     enum OutputOption format = flags & OUTPUT_MASK_FORMAT;
@@ -67,7 +114,7 @@ void printResultLine(
     struct RowList *row_list = getRowList(list_id);
 
     // Arbitrarily choose index 0 for agg rows
-    int rowlist_row_index = row_list->group ? 0 : result_index;
+    int rowlist_row_index = row_list->group ? 0 : row_index;
 
     for (int j = 0; j < column_count; j++)
     {
@@ -105,13 +152,34 @@ void printResultLine(
             else
             {
                 char output[MAX_VALUE_LENGTH];
-                int result = evaluateNode(
-                    tables,
-                    list_id,
-                    rowlist_row_index,
-                    node,
-                    output,
-                    MAX_VALUE_LENGTH);
+                const char *value = output;
+                int result;
+
+                if (
+                    format == OUTPUT_FORMAT_COMMA ||
+                    format == OUTPUT_FORMAT_CSV_EXCEL)
+                {
+                    // Plain CSV fields never need escaping so they can be
+                    // written straight from the table data
+                    result = evaluateNodeView(
+                        tables,
+                        list_id,
+                        rowlist_row_index,
+                        node,
+                        &value,
+                        output,
+                        MAX_VALUE_LENGTH);
+                }
+                else
+                {
+                    result = evaluateNode(
+                        tables,
+                        list_id,
+                        rowlist_row_index,
+                        node,
+                        output,
+                        MAX_VALUE_LENGTH);
+                }
 
                 if (result < 0)
                 {
@@ -122,7 +190,14 @@ void printResultLine(
                     return;
                 }
 
-                printColumnValue(f, format, NULL, node->alias, output);
+                if (value != output)
+                {
+                    fwrite(value, 1, result, f);
+                }
+                else
+                {
+                    printColumnValue(f, format, NULL, node->alias, output);
+                }
             }
         }
         else if ((node->function & MASK_FUNC_FAMILY) == FUNC_FAM_AGG)
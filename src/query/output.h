@@ -20,6 +20,20 @@ void printResultLine (
     enum OutputOption flags
 );
 
+void printResultRow (
+    FILE *f,
+    struct Table *tables,
+    int table_count,
+    struct Node columns[],
+    int column_count,
+    int result_index,
+    RowListIndex row_list,
+    int row_index,
+    enum OutputOption flags
+);
+
+void printValue (FILE *f, enum OutputOption flags, const char *value);
+
 void printPreamble (
     FILE *f,
     struct Table *tables,
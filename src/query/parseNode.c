@@ -939,14 +939,16 @@ int parseComplexNode(
             L   R1  ( L   R2    )
         */
 
-        cloneNodeIntoChild(node);
-
-        node->function = OPERATOR_OR;
-
         skipWhitespace(query, index);
 
+        // A single value is left as a plain comparison. Predicate code
+        // expects operators to have two children.
         if (query[*index] == ',')
         {
+            cloneNodeIntoChild(node);
+
+            node->function = OPERATOR_OR;
+
             (*index)++;
 
             while (query[*index] != '\0' &&
@@ -51,6 +51,10 @@ static void checkCoveringIndex(
 
 static int haveNonUniqueJoins(struct Plan *plan);
 
+static void bindPlanTypes(struct Query *q, struct Plan *plan);
+
+static int haveMatchingKeyTypes(struct Table *tables, struct Node *join);
+
 static void addPredicateSource(struct Plan *plan, struct Query *query);
 
 static enum PlanStepType findIndexSource(struct Query *query);
@@ -243,9 +247,41 @@ int makePlan(struct Query *q, struct Plan *plan)
 
     addStepWithNodes(plan, PLAN_SELECT, q->column_nodes, q->column_count);
 
+    bindPlanTypes(q, plan);
+
     return plan->step_count;
 }
 
+/**
+ * @brief Decide once how predicate operands should be parsed for each row.
+ * Each step only samples the tables it has read: just the first table until
+ * the first join, then one more table for each join.
+ */
+static void bindPlanTypes(struct Query *q, struct Plan *plan)
+{
+    int max_table_id = 0;
+
+    for (int i = 0; i < plan->step_count; i++)
+    {
+        struct PlanStep *step = &plan->steps[i];
+
+        if (step->type >= PLAN_SORT)
+        {
+            break;
+        }
+
+        if (step->type >= PLAN_CROSS_JOIN && step->type <= PLAN_HASH_JOIN)
+        {
+            max_table_id++;
+        }
+
+        for (int j = 0; j < step->node_count; j++)
+        {
+            bindPredicateTypes(q->tables, &step->nodes[j], max_table_id);
+        }
+    }
+}
+
 static void addPredicateSource(struct Plan *plan, struct Query *query)
 {
     int have_order_by = query->order_count > 0;
@@ -910,15 +946,31 @@ static void addJoinStepsIfRequired(struct Plan *plan, struct Query *q)
                 }
                 else
                 {
-                    // No index, just O(NxM) loop both entire tables
-
-                    // Loop step requires this table to be on left
+                    // Loop and hash steps require this table to be on left
                     if ((getTableBitMap(&join->children[0]) & tableBit) == 0)
                     {
                         flipPredicate(join);
                     }
 
-                    addStepWithNode(plan, PLAN_LOOP_JOIN, join);
+                    // Equi-join where each side only references one side of
+                    // the join can be done with a hash table built once over
+                    // this table. Generated tables (CALENDAR, SEQUENCE) are
+                    // better served by their own predicate aware access.
+                    if (
+                        op == OPERATOR_EQ &&
+                        getTableBitMap(&join->children[0]) == tableBit &&
+                        (getTableBitMap(&join->children[1]) & tableBit) == 0 &&
+                        table->db->vfs != VFS_CALENDAR &&
+                        table->db->vfs != VFS_SEQUENCE &&
+                        haveMatchingKeyTypes(q->tables, join))
+                    {
+                        addStepWithNode(plan, PLAN_HASH_JOIN, join);
+                    }
+                    else
+                    {
+                        // No index, just O(NxM) loop both entire tables
+                        addStepWithNode(plan, PLAN_LOOP_JOIN, join);
+                    }
                 }
             }
             else if (tableMap < tableBit)
@@ -1034,7 +1086,8 @@ static void addLimitStepIfRequired(struct Plan *plan, struct Query *query)
                     plan->steps[i].type == PLAN_LOOP_JOIN ||
                     plan->steps[i].type == PLAN_CROSS_JOIN ||
                     plan->steps[i].type == PLAN_INDEX_JOIN ||
-                    plan->steps[i].type == PLAN_UNIQUE_JOIN)
+                    plan->steps[i].type == PLAN_UNIQUE_JOIN ||
+                    plan->steps[i].type == PLAN_HASH_JOIN)
                 {
 
                     if (query->tables[table_id].join_type != JOIN_LEFT)
@@ -1067,20 +1120,13 @@ static void addLimitStepIfRequired(struct Plan *plan, struct Query *query)
             return;
         }
 
-        // PLAN_SORT is incapable of self limiting
-        if (prev->type != PLAN_SORT)
+        // PLAN_SORT keeps only the first `limit` rows using a bounded heap.
+        // If there's no previous limit or the limit was higher than necessary
+        // we'll set our limit.
+        if (prev->limit == -1 || prev->limit > limit)
         {
-            // If there's no previous limit or the limit was higher than
-            // necessary we'll set our limit.
-            if (prev->limit == -1 || prev->limit > limit)
-            {
-                prev->limit = limit;
-            }
-            return;
+            prev->limit = limit;
         }
-
-        // We need to add explicit step
-        addStepWithLimit(plan, PLAN_SLICE, limit);
     }
 }
 
@@ -1121,10 +1167,10 @@ static int optimiseNodes(
     {
         for (int i = 0; i < count; i++)
         {
-            struct Node *left = &predicates[i].children[0];
-
-            // Any predicate on the first table is fine
-            int bit_map = getTableBitMap(left);
+            // Any predicate only on the first table is fine. A field of
+            // the first table compared with another table's field has to
+            // wait for the join.
+            int bit_map = getTableBitMap(&predicates[i]);
 
             if (bit_map == 1)
             {
@@ -1132,10 +1178,6 @@ static int optimiseNodes(
                 chosen_predicate_index = i;
                 break;
             }
-
-            // Only checking left because predicates should have been
-            // normalised, right?
-            /// TODO: check they have actually been normalised
         }
     }
 
@@ -1333,7 +1375,8 @@ static int haveNonUniqueJoins(struct Plan *plan)
     {
         enum PlanStepType type = plan->steps[i].type;
         if (
-            type == PLAN_LOOP_JOIN || type == PLAN_CONSTANT_JOIN || type == PLAN_CROSS_JOIN)
+            type == PLAN_LOOP_JOIN || type == PLAN_CONSTANT_JOIN || type == PLAN_CROSS_JOIN ||
+            type == PLAN_HASH_JOIN)
         {
             non_unique_joins++;
         }
@@ -1513,6 +1556,38 @@ static void checkCoveringIndex(
     free(mapped_cols);
 }
 
+/**
+ * @brief Hash join keys only match values of the same type but compareValues()
+ * will also compare e.g. an integer with a string ('x' = 0). So only hash
+ * join two plain columns whose sampled values all have the same type. Rows
+ * past the sample (see inferFieldType()) are assumed to follow it.
+ */
+static int haveMatchingKeyTypes(struct Table *tables, struct Node *join)
+{
+    struct Node *left = &join->children[0];
+    struct Node *right = &join->children[1];
+
+    if (
+        left->function != FUNC_UNITY || left->field.index < 0 ||
+        right->function != FUNC_UNITY || right->field.index < 0)
+    {
+        return 0;
+    }
+
+    enum ValueType left_type = inferFieldType(
+        tables[left->field.table_id].db,
+        left->field.index);
+
+    if (left_type == VALUE_UNKNOWN)
+    {
+        return 0;
+    }
+
+    return left_type == inferFieldType(
+        tables[right->field.table_id].db,
+        right->field.index);
+}
+
 static const char *getNodeFieldName(struct Node *node)
 {
     if ((node->function & MASK_FUNC_FAMILY) == FUNC_FAM_OPERATOR)
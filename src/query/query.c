@@ -116,6 +116,22 @@ int query(
         return insert_query(query, end_ptr);
     }
 
+    if (strncmp(query, "COPY ", 5) == 0)
+    {
+        if (output_flags & FLAG_READ_ONLY)
+        {
+            fprintf(stderr, "Tried to COPY while in read-only mode\n");
+            return -1;
+        }
+
+        if (output_flags & FLAG_EXPLAIN)
+        {
+            return 0;
+        }
+
+        return copy_query(query, end_ptr);
+    }
+
     if (strncmp(query, "DROP ", 5) == 0)
     {
         if (output_flags & FLAG_READ_ONLY)
@@ -162,6 +162,22 @@ int select_query(
         if (result < 0)
         {
             remove(table.name);
+            free(q);
+            free(q2a);
+            return -1;
+        }
+
+        // Only read once and the name is different every time, so keep it
+        // out of the table cache
+        table.db = calloc(1, sizeof(*table.db));
+
+        if (table.db == NULL || openDBUncached(table.db, table.name, NULL) != 0)
+        {
+            fprintf(stderr, "Unable to use file: '%s'\n", table.name);
+            free(table.db);
+            remove(table.name);
+            free(q);
+            free(q2a);
             return -1;
         }
 
@@ -182,16 +198,20 @@ int select_query(
 
         remove(table.name);
 
+        closeDB(table.db);
+        free(table.db);
+
+        freeNode(&table.join);
+
         q2b->tables = NULL;
 
         destroy_query(q2b);
 
+        // Everything q pointed to now belongs to q2a and was destroyed with it
+        free(q);
         free(q2a);
         free(q2b);
 
-        //      Why aren't we destroying here?
-        // destroy_query(&q);
-
         return result;
     }
 
@@ -296,6 +316,12 @@ int process_query(
     // not. If it was empty then rollback to a tableless query.
     if (auto_stdin && q->tables[0].db->field_count == 0)
     {
+        // Don't let a later query in this process reuse the freed DB
+        if (stdin_db == q->tables[0].db)
+        {
+            stdin_db = NULL;
+        }
+
         closeDB(q->tables[0].db);
         free(q->tables[0].db);
         q->table_count = 0;
@@ -671,6 +697,11 @@ static void destroy_query(struct Query *query)
 {
     if (query->predicate_nodes != NULL)
     {
+        for (int i = 0; i < query->predicate_count; i++)
+        {
+            freeNode(&query->predicate_nodes[i]);
+        }
+
         free(query->predicate_nodes);
         query->predicate_nodes = NULL;
     }
@@ -679,6 +710,8 @@ static void destroy_query(struct Query *query)
     {
         for (int i = 0; i < query->table_count; i++)
         {
+            freeNode(&query->tables[i].join);
+
             if (query->tables[i].db == stdin_db)
             {
                 // Don't close special DB created from stdin
@@ -713,6 +746,12 @@ static void destroy_query(struct Query *query)
         freeNode((struct Node *)&query->column_nodes[i]);
     }
 
+    if (query->column_nodes != NULL)
+    {
+        free(query->column_nodes);
+        query->column_nodes = NULL;
+    }
+
     for (int i = 0; i < query->order_count; i++)
     {
         freeNode(&query->order_nodes[i]);
@@ -1361,6 +1400,9 @@ static void expandFieldStar(struct Query *query)
             // Copy rest of nodes
             memcpy(new_cols + index, query->column_nodes + i + 1, (new_column_count - index) * sizeof *col);
 
+            // Each new column has its own copy of the original's children
+            freeNode(col);
+
             free(query->column_nodes);
 
             query->column_nodes = new_cols;
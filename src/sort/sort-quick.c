@@ -1,114 +1,1426 @@
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "../structs.h"
 #include "../evaluate/evaluate.h"
 #include "../query/result.h"
 #include "../functions/util.h"
 
+/**
+ * Sort keys are evaluated exactly once per row before sorting. Each key keeps
+ * its string (pointing straight into table data where possible, otherwise
+ * copied into an arena) and, for numeric values, the parsed number. Two
+ * numbers compare numerically; anything else compares as strings.
+ *
+ * Rows are then sorted by index with an introsort and the RowList is permuted
+ * once at the end. Ties are broken by original position so the sort is
+ * stable.
+ *
+ * When only the first N rows are wanted a bounded max-heap of N candidates is
+ * kept instead, so memory stays proportional to N and most rows cost a single
+ * comparison against the current worst candidate.
+ *
+ * Keys are kept under SORT_MEMORY_LIMIT bytes (or CSVDB_SORT_MEMORY
+ * megabytes). When a full sort would need more, rows are taken in chunks
+ * which fit; each chunk is sorted and its keys written with their row index
+ * to a temporary file as a run. The runs are then merged with a min-heap,
+ * reading one key set from each run at a time, so memory is bounded by the
+ * budget plus one key set per run. Ties between runs are broken by row index
+ * so the result is identical to sorting in memory.
+ *
+ * A KeySorter does the same for key sets handed to it one at a time rather
+ * than evaluated from a RowList, and gives them back in order one at a time,
+ * so callers such as COPY never need every key in memory at once.
+ */
+
+#define SORT_INSERTION_THRESHOLD    16
+#define SORT_ARENA_BLOCK_SIZE       (64 * 1024)
+#define SORT_MAX_RUNS               256
+
+struct SortKey {
+    long number;
+    const char *string;
+    int length;
+    int is_number;
+};
+
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+/* Owned copy of a computed key string for a top-N slot */
+struct KeyStorage {
+    char *data;
+    int capacity;
+};
+
+/* Fixed part of a key as written to a run file, followed by its string */
+struct RunKey {
+    long number;
+    int length;
+    int is_number;
+};
+
+struct SortRun {
+    FILE *file;
+    int remaining;
+};
+
 struct SortContext {
-    struct Table *tables;
-    struct Node *nodes;
+    struct SortKey *keys;
     int node_count;
-    RowListIndex list_id;
+    /* -1 for DESC, 1 for ASC; one per node */
+    int *directions;
+    /* Original row index of each key set, or NULL if keys are by row index */
+    int *rows;
+};
+
+/* Runs being merged. Each run's current key set lives in its slot of
+ * context.keys so compare() works on run indices. */
+struct RunMerge {
+    struct SortRun *runs;
+    struct SortContext context;
+    struct KeyStorage *storage;
+    int *heap;
+    int heap_size;
+    /* Run returned by the last mergeNext(), -1 before the first */
+    int current;
 };
 
-static void quickSort (struct SortContext *context, int lo, int hi);
-static int partition (struct SortContext *context, int lo, int hi);
-static void swap (struct SortContext *context, int index_a, int index_b);
-static int compare (struct SortContext *context, int index_a, int index_b);
+struct KeySorter {
+    /* Keys held in memory; rows gives the row of each key set */
+    struct SortContext context;
+    int count;
+    int capacity;
+    /* Key sets held before spilling whatever the budget */
+    int min_rows;
+    /* Most key sets held before spilling */
+    int chunk_rows;
+    size_t budget;
+    size_t used;
+    struct ArenaBlock *arena;
+    struct SortRun *runs;
+    int run_count;
+    /* Set once the first key set has been asked for */
+    int is_sorted;
+    /* In memory order when nothing was spilled */
+    int *order;
+    int position;
+    struct RunMerge merge;
+};
+
+static long sort_memory_limit = -1;
+
+static int buildKeys (
+    struct Table *tables,
+    struct Node *nodes,
+    int node_count,
+    RowListIndex list_id,
+    int start,
+    int max_rows,
+    int min_rows,
+    size_t budget,
+    struct SortKey *keys,
+    struct ArenaBlock **arena
+);
+
+static void sortExternal (
+    struct Table *tables,
+    struct Node *nodes,
+    RowListIndex list_id,
+    struct SortContext *context,
+    int chunk_rows,
+    int min_rows,
+    int built,
+    struct ArenaBlock **arena,
+    int *order
+);
+
+static void addRun (
+    struct SortRun **runs,
+    int *run_count,
+    struct SortContext *context,
+    int *order,
+    int count,
+    int start
+);
+
+static void writeRun (
+    FILE *file,
+    struct SortContext *context,
+    int *order,
+    int count,
+    int start
+);
+
+static void mergeOpen (
+    struct RunMerge *merge,
+    struct SortRun *runs,
+    int run_count,
+    struct SortContext *context
+);
+
+static int mergeNext (struct RunMerge *merge);
 
+static void mergeClose (struct RunMerge *merge, int run_count);
+
+static void closeRuns (struct SortRun *runs, int run_count);
+
+static void spillKeys (struct KeySorter *sorter);
+
+static int readRun (
+    struct SortRun *run,
+    int node_count,
+    struct SortKey *keys,
+    struct KeyStorage *storage,
+    int *row
+);
+
+static void mergeSiftDown (
+    struct SortContext *context,
+    int *heap,
+    int root,
+    int count
+);
+
+static size_t getSortMemory ();
+
+static int evaluateKey (
+    struct Table *tables,
+    struct Node *node,
+    RowListIndex list_id,
+    int row_index,
+    struct SortKey *key,
+    char *buffer
+);
+
+static void sortTopN (
+    struct Table *tables,
+    struct Node *nodes,
+    RowListIndex list_id,
+    struct SortContext *context,
+    int limit
+);
+
+static const char *arenaCopy (
+    struct ArenaBlock **arena,
+    const char *string,
+    int length
+);
+
+static void freeArena (struct ArenaBlock *arena);
+
+static void sortRange (struct SortContext *context, int *order, int count);
+
+static void swapOrder (int *order, int a, int b);
+
+static void introSort (
+    struct SortContext *context,
+    int *order,
+    int lo,
+    int hi,
+    int depth
+);
+
+static int partition (struct SortContext *context, int *order, int lo, int hi);
+
+static void insertionSort (
+    struct SortContext *context,
+    int *order,
+    int lo,
+    int hi
+);
+
+static void heapSort (struct SortContext *context, int *order, int count);
+
+static void siftDown (
+    struct SortContext *context,
+    int *order,
+    int root,
+    int count
+);
+
+static void siftUp (struct SortContext *context, int *order, int index);
+
+static int compare (struct SortContext *context, int a, int b);
+
+static void permuteRowList (struct RowList *row_list, int *order, int count);
+
+/**
+ * @brief Stable sort of a RowList by the given nodes
+ *
+ * @param limit if non-negative only the first `limit` rows are kept
+ */
 void sortQuick (
     struct Table *tables,
     struct Node *nodes,
     int node_count,
-    RowListIndex list_id
+    RowListIndex list_id,
+    int limit
 ) {
+    struct RowList *row_list = getRowList(list_id);
+
+    int row_count = row_list->row_count;
+
+    if (limit == 0) {
+        row_list->row_count = 0;
+        return;
+    }
+
+    if (row_count < 2) {
+        return;
+    }
+
+    int *directions = malloc(sizeof(*directions) * node_count);
+
+    if (directions == NULL) {
+        fprintf(stderr, "Unable to allocate sort directions\n");
+        exit(-1);
+    }
+
+    for (int i = 0; i < node_count; i++) {
+        directions[i] = nodes[i].alias[0] == ORDER_DESC ? -1 : 1;
+    }
+
     struct SortContext context = {
-        .tables = tables,
-        .nodes = nodes,
+        .keys = NULL,
         .node_count = node_count,
-        .list_id = list_id,
+        .directions = directions,
+        .rows = NULL,
     };
 
-    struct RowList *row_list = getRowList(list_id);
-    quickSort(&context, 0, row_list->row_count - 1);
+    if (limit > 0 && limit < row_count) {
+        sortTopN(tables, nodes, list_id, &context, limit);
+        free(directions);
+        return;
+    }
+
+    size_t budget = getSortMemory();
+    size_t key_size = sizeof(struct SortKey) * node_count;
+
+    // Rows per run are capped by the budget but runs are never allowed to
+    // outnumber SORT_MAX_RUNS
+    int min_rows = row_count / SORT_MAX_RUNS + 1;
+    int chunk_rows = row_count;
+
+    if ((size_t)row_count * key_size > budget) {
+        chunk_rows = budget / key_size;
+
+        if (chunk_rows < min_rows) {
+            chunk_rows = min_rows;
+        }
+    }
+
+    struct SortKey *keys = malloc(key_size * chunk_rows);
+    int *order = malloc(sizeof(*order) * row_count);
+
+    if (keys == NULL || order == NULL) {
+        fprintf(stderr, "Unable to allocate sort keys for %d rows\n", row_count);
+        exit(-1);
+    }
+
+    struct ArenaBlock *arena = NULL;
+
+    int built = buildKeys(
+        tables,
+        nodes,
+        node_count,
+        list_id,
+        0,
+        chunk_rows,
+        min_rows,
+        budget,
+        keys,
+        &arena
+    );
+
+    context.keys = keys;
+
+    if (built < row_count) {
+        sortExternal(
+            tables,
+            nodes,
+            list_id,
+            &context,
+            chunk_rows,
+            min_rows,
+            built,
+            &arena,
+            order
+        );
+    }
+    else {
+        for (int i = 0; i < row_count; i++) {
+            order[i] = i;
+        }
+
+        sortRange(&context, order, row_count);
+    }
+
+    // Might have moved if anything created a RowList while evaluating
+    permuteRowList(getRowList(list_id), order, row_count);
+
+    freeArena(arena);
+    free(directions);
+    free(order);
+    free(keys);
+}
+
+/**
+ * @brief Start sorting key sets of field_count strings in ascending order,
+ * ties by row. Strings which both look like numbers compare numerically.
+ *
+ * @param row_count expected number of key sets, used to limit the number of
+ * runs
+ */
+struct KeySorter *keySorter_open (int field_count, int row_count) {
+    struct KeySorter *sorter = calloc(1, sizeof(*sorter));
+    int *directions = malloc(sizeof(*directions) * field_count);
+
+    if (sorter == NULL || directions == NULL) {
+        fprintf(stderr, "Unable to allocate sort keys\n");
+        exit(-1);
+    }
+
+    for (int i = 0; i < field_count; i++) {
+        directions[i] = 1;
+    }
+
+    sorter->context.node_count = field_count;
+    sorter->context.directions = directions;
+
+    size_t key_size = sizeof(struct SortKey) * field_count;
+
+    sorter->budget = getSortMemory();
+    sorter->min_rows = row_count / SORT_MAX_RUNS + 1;
+    sorter->chunk_rows = row_count;
+
+    if ((size_t)row_count * key_size > sorter->budget) {
+        sorter->chunk_rows = sorter->budget / key_size;
+    }
+
+    if (sorter->chunk_rows < sorter->min_rows) {
+        sorter->chunk_rows = sorter->min_rows;
+    }
+
+    return sorter;
+}
+
+/**
+ * @brief Add a key set. The strings are copied.
+ */
+void keySorter_add (struct KeySorter *sorter, const char **values, int row) {
+    struct SortContext *context = &sorter->context;
+    int node_count = context->node_count;
+
+    size_t key_size = sizeof(struct SortKey) * node_count;
+
+    if (
+        sorter->count >= sorter->chunk_rows
+        || (
+            sorter->count >= sorter->min_rows
+            && sorter->used + key_size > sorter->budget
+        )
+    ) {
+        spillKeys(sorter);
+    }
+
+    if (sorter->count == sorter->capacity) {
+        int capacity = sorter->capacity ? sorter->capacity * 2 : 1024;
+
+        if (capacity > sorter->chunk_rows) {
+            capacity = sorter->chunk_rows;
+        }
+
+        context->keys = realloc(context->keys, key_size * capacity);
+        context->rows = realloc(
+            context->rows,
+            sizeof(*context->rows) * capacity
+        );
+
+        if (context->keys == NULL || context->rows == NULL) {
+            fprintf(stderr, "Unable to allocate sort keys\n");
+            exit(-1);
+        }
+
+        sorter->capacity = capacity;
+    }
+
+    struct SortKey *keys = &context->keys[sorter->count * node_count];
+
+    for (int i = 0; i < node_count; i++) {
+        int length = strlen(values[i]);
+
+        keys[i].is_number = is_numeric(values[i]);
+        keys[i].number = keys[i].is_number ? atol(values[i]) : 0;
+        // Keep the '\0' so the string can be handed back as it is
+        keys[i].string = arenaCopy(&sorter->arena, values[i], length + 1);
+        keys[i].length = length;
+
+        sorter->used += length + 1;
+    }
+
+    context->rows[sorter->count++] = row;
+    sorter->used += key_size;
+}
+
+/**
+ * @brief Take the next key set in order. No more can be added once this has
+ * been called.
+ *
+ * @param values receives field_count strings, valid until the next call
+ * @return int 0 once every key set has been returned
+ */
+int keySorter_next (struct KeySorter *sorter, const char **values, int *row) {
+    struct SortContext *context = &sorter->context;
+    int node_count = context->node_count;
+
+    if (!sorter->is_sorted) {
+        sorter->is_sorted = 1;
+
+        if (sorter->run_count == 0) {
+            int *order = malloc(sizeof(*order) * (sorter->count + 1));
+
+            if (order == NULL) {
+                fprintf(stderr, "Unable to allocate sort keys\n");
+                exit(-1);
+            }
+
+            for (int i = 0; i < sorter->count; i++) {
+                order[i] = i;
+            }
+
+            sortRange(context, order, sorter->count);
+
+            sorter->order = order;
+        }
+        else {
+            if (sorter->count > 0) {
+                spillKeys(sorter);
+            }
+
+            mergeOpen(&sorter->merge, sorter->runs, sorter->run_count, context);
+        }
+    }
+
+    struct SortKey *keys;
+
+    if (sorter->run_count == 0) {
+        if (sorter->position == sorter->count) {
+            return 0;
+        }
+
+        int index = sorter->order[sorter->position++];
+
+        keys = &context->keys[index * node_count];
+        *row = context->rows[index];
+    }
+    else {
+        int run = mergeNext(&sorter->merge);
+
+        if (run < 0) {
+            return 0;
+        }
+
+        keys = &sorter->merge.context.keys[run * node_count];
+        *row = sorter->merge.context.rows[run];
+    }
+
+    for (int i = 0; i < node_count; i++) {
+        values[i] = keys[i].string;
+    }
+
+    return 1;
+}
+
+void keySorter_close (struct KeySorter *sorter) {
+    if (sorter == NULL) {
+        return;
+    }
+
+    if (sorter->is_sorted && sorter->run_count > 0) {
+        mergeClose(&sorter->merge, sorter->run_count);
+    }
+
+    closeRuns(sorter->runs, sorter->run_count);
+    freeArena(sorter->arena);
+
+    free(sorter->order);
+    free(sorter->context.rows);
+    free(sorter->context.keys);
+    free(sorter->context.directions);
+    free(sorter);
+}
+
+/**
+ * @brief Write the key sets held in memory out as a run and start again
+ */
+static void spillKeys (struct KeySorter *sorter) {
+    int *order = malloc(sizeof(*order) * sorter->count);
+
+    if (order == NULL) {
+        fprintf(stderr, "Unable to allocate sort keys\n");
+        exit(-1);
+    }
+
+    addRun(
+        &sorter->runs,
+        &sorter->run_count,
+        &sorter->context,
+        order,
+        sorter->count,
+        0
+    );
+
+    free(order);
+
+    freeArena(sorter->arena);
+    sorter->arena = NULL;
+    sorter->count = 0;
+    sorter->used = 0;
+}
+
+/**
+ * @brief Evaluate every sort node for rows from start onwards until max_rows
+ * have been done or, once there are at least min_rows, the keys would take
+ * more than budget bytes
+ *
+ * @return int number of rows evaluated
+ */
+static int buildKeys (
+    struct Table *tables,
+    struct Node *nodes,
+    int node_count,
+    RowListIndex list_id,
+    int start,
+    int max_rows,
+    int min_rows,
+    size_t budget,
+    struct SortKey *keys,
+    struct ArenaBlock **arena
+) {
+    char buffer[MAX_VALUE_LENGTH];
+
+    int row_count = getRowList(list_id)->row_count;
+
+    size_t key_size = sizeof(*keys) * node_count;
+    size_t used = 0;
+    int count = 0;
+
+    for (int i = start; i < row_count && count < max_rows; i++) {
+        if (count >= min_rows && used + key_size > budget) {
+            break;
+        }
+
+        struct SortKey *row_keys = &keys[count * node_count];
+
+        for (int j = 0; j < node_count; j++) {
+            struct SortKey *key = &row_keys[j];
+
+            if (evaluateKey(tables, &nodes[j], list_id, i, key, buffer)) {
+                key->string = arenaCopy(arena, key->string, key->length);
+                used += key->length;
+            }
+        }
+
+        used += key_size;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Sort the rows in chunks of at most chunk_rows, spilling each to a
+ * temporary file, then merge the runs into order
+ *
+ * @param built number of rows whose keys are already in context->keys
+ */
+static void sortExternal (
+    struct Table *tables,
+    struct Node *nodes,
+    RowListIndex list_id,
+    struct SortContext *context,
+    int chunk_rows,
+    int min_rows,
+    int built,
+    struct ArenaBlock **arena,
+    int *order
+) {
+    int row_count = getRowList(list_id)->row_count;
+    size_t budget = getSortMemory();
+
+    struct SortRun *runs = NULL;
+    int run_count = 0;
+    int start = 0;
+
+    while (1) {
+        // Start of order is free until the merge so is used for each chunk
+        addRun(&runs, &run_count, context, order, built, start);
+
+        freeArena(*arena);
+        *arena = NULL;
+
+        start += built;
+
+        if (start >= row_count) {
+            break;
+        }
+
+        built = buildKeys(
+            tables,
+            nodes,
+            context->node_count,
+            list_id,
+            start,
+            chunk_rows,
+            min_rows,
+            budget,
+            context->keys,
+            arena
+        );
+    }
+
+    struct RunMerge merge;
+
+    mergeOpen(&merge, runs, run_count, context);
+
+    int count = 0;
+    int run;
+
+    while ((run = mergeNext(&merge)) >= 0) {
+        order[count++] = merge.context.rows[run];
+    }
+
+    mergeClose(&merge, run_count);
+
+    closeRuns(runs, run_count);
+}
+
+/**
+ * @brief Sort the first count key sets of context and spill them to a new
+ * temporary file at the end of runs
+ *
+ * @param order space for at least count indices
+ */
+static void addRun (
+    struct SortRun **runs,
+    int *run_count,
+    struct SortContext *context,
+    int *order,
+    int count,
+    int start
+) {
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+
+    sortRange(context, order, count);
+
+    FILE *file = tmpfile();
+
+    if (file == NULL) {
+        fprintf(stderr, "Unable to create temporary file to sort rows\n");
+        exit(-1);
+    }
+
+    writeRun(file, context, order, count, start);
+
+    rewind(file);
+
+    *runs = realloc(*runs, sizeof(**runs) * (*run_count + 1));
+
+    if (*runs == NULL) {
+        fprintf(stderr, "Unable to allocate sort runs\n");
+        exit(-1);
+    }
+
+    (*runs)[*run_count].file = file;
+    (*runs)[*run_count].remaining = count;
+    (*run_count)++;
+}
+
+/**
+ * @brief Write count key sets in the given order, each preceded by its row
+ * index (from context->rows if set, otherwise start plus its index within the
+ * chunk)
+ */
+static void writeRun (
+    FILE *file,
+    struct SortContext *context,
+    int *order,
+    int count,
+    int start
+) {
+    int node_count = context->node_count;
+
+    for (int i = 0; i < count; i++) {
+        int row = context->rows == NULL
+            ? start + order[i]
+            : context->rows[order[i]];
+
+        fwrite(&row, sizeof(row), 1, file);
+
+        struct SortKey *keys = &context->keys[order[i] * node_count];
+
+        for (int j = 0; j < node_count; j++) {
+            struct RunKey run_key = {
+                .number = keys[j].number,
+                .length = keys[j].length,
+                .is_number = keys[j].is_number,
+            };
+
+            fwrite(&run_key, sizeof(run_key), 1, file);
+            fwrite(keys[j].string, 1, keys[j].length, file);
+        }
+    }
+
+    if (fflush(file) != 0 || ferror(file)) {
+        fprintf(stderr, "Unable to write temporary file to sort rows\n");
+        exit(-1);
+    }
+}
+
+/**
+ * @brief Start a k-way merge of sorted runs using a min-heap of runs
+ */
+static void mergeOpen (
+    struct RunMerge *merge,
+    struct SortRun *runs,
+    int run_count,
+    struct SortContext *context
+) {
+    int node_count = context->node_count;
+
+    struct SortKey *keys = malloc(sizeof(*keys) * run_count * node_count);
+    struct KeyStorage *storage = calloc(
+        (size_t)run_count * node_count,
+        sizeof(*storage)
+    );
+    int *rows = malloc(sizeof(*rows) * run_count);
+    int *heap = malloc(sizeof(*heap) * run_count);
+
+    if (keys == NULL || storage == NULL || rows == NULL || heap == NULL) {
+        fprintf(stderr, "Unable to allocate sort runs\n");
+        exit(-1);
+    }
+
+    merge->runs = runs;
+    merge->context.keys = keys;
+    merge->context.node_count = node_count;
+    merge->context.directions = context->directions;
+    merge->context.rows = rows;
+    merge->storage = storage;
+    merge->heap = heap;
+    merge->heap_size = 0;
+    merge->current = -1;
+
+    for (int i = 0; i < run_count; i++) {
+        int offset = i * node_count;
+
+        if (readRun(
+            &runs[i],
+            node_count,
+            &keys[offset],
+            &storage[offset],
+            &rows[i]
+        )) {
+            heap[merge->heap_size++] = i;
+        }
+    }
+
+    for (int i = merge->heap_size / 2 - 1; i >= 0; i--) {
+        mergeSiftDown(&merge->context, heap, i, merge->heap_size);
+    }
+}
+
+/**
+ * @brief Move on to the smallest remaining key set. It stays valid in the
+ * run's slot of merge->context until the next call.
+ *
+ * @return int the run holding it or -1 once every run is exhausted
+ */
+static int mergeNext (struct RunMerge *merge) {
+    int node_count = merge->context.node_count;
+    int run = merge->current;
+
+    if (run >= 0) {
+        int offset = run * node_count;
+
+        if (!readRun(
+            &merge->runs[run],
+            node_count,
+            &merge->context.keys[offset],
+            &merge->storage[offset],
+            &merge->context.rows[run]
+        )) {
+            merge->heap[0] = merge->heap[--merge->heap_size];
+        }
+
+        mergeSiftDown(&merge->context, merge->heap, 0, merge->heap_size);
+    }
+
+    merge->current = merge->heap_size > 0 ? merge->heap[0] : -1;
+
+    return merge->current;
 }
 
-static void quickSort (struct SortContext *context, int lo, int hi) {
-    if (lo >= 0 && hi >= 0 && lo < hi) {
-        int pivot = partition(context, lo, hi);
-        quickSort(context, lo, pivot);
-        quickSort(context, pivot + 1, hi);
+static void mergeClose (struct RunMerge *merge, int run_count) {
+    for (int i = 0; i < run_count * merge->context.node_count; i++) {
+        free(merge->storage[i].data);
     }
+
+    free(merge->heap);
+    free(merge->context.rows);
+    free(merge->storage);
+    free(merge->context.keys);
 }
 
-static int partition (struct SortContext *context, int lo, int hi) {
-    int pivot = lo;
+static void closeRuns (struct SortRun *runs, int run_count) {
+    for (int i = 0; i < run_count; i++) {
+        fclose(runs[i].file);
+    }
+
+    free(runs);
+}
+
+/**
+ * @brief Read the next key set of a run into keys, copying strings into
+ * storage with a terminating '\0'
+ *
+ * @return int 0 once the run is exhausted
+ */
+static int readRun (
+    struct SortRun *run,
+    int node_count,
+    struct SortKey *keys,
+    struct KeyStorage *storage,
+    int *row
+) {
+    if (run->remaining == 0) {
+        return 0;
+    }
+
+    run->remaining--;
+
+    if (fread(row, sizeof(*row), 1, run->file) != 1) {
+        fprintf(stderr, "Unable to read temporary file to sort rows\n");
+        exit(-1);
+    }
+
+    for (int i = 0; i < node_count; i++) {
+        struct RunKey run_key;
+        struct KeyStorage *store = &storage[i];
+
+        if (fread(&run_key, sizeof(run_key), 1, run->file) != 1) {
+            fprintf(stderr, "Unable to read temporary file to sort rows\n");
+            exit(-1);
+        }
+
+        if (store->capacity < run_key.length + 1) {
+            store->data = realloc(store->data, run_key.length + 1);
+
+            if (store->data == NULL) {
+                fprintf(stderr, "Unable to allocate sort key storage\n");
+                exit(-1);
+            }
+
+            store->capacity = run_key.length + 1;
+        }
+
+        if (
+            run_key.length > 0
+            && fread(store->data, 1, run_key.length, run->file)
+                != (size_t)run_key.length
+        ) {
+            fprintf(stderr, "Unable to read temporary file to sort rows\n");
+            exit(-1);
+        }
 
-    int i = lo - 1;
+        store->data[run_key.length] = '\0';
 
-    int j = hi + 1;
+        keys[i].number = run_key.number;
+        keys[i].string = store->data;
+        keys[i].length = run_key.length;
+        keys[i].is_number = run_key.is_number;
+    }
 
+    return 1;
+}
+
+/**
+ * @brief Same as siftDown() but keeps the smallest key set at the root
+ */
+static void mergeSiftDown (
+    struct SortContext *context,
+    int *heap,
+    int root,
+    int count
+) {
     while (1) {
-        do {
-            i++;
-        } while (compare(context, i, pivot) < 0);
+        int child = root * 2 + 1;
+
+        if (child >= count) {
+            return;
+        }
+
+        if (
+            child + 1 < count
+            && compare(context, heap[child + 1], heap[child]) < 0
+        ) {
+            child++;
+        }
+
+        if (compare(context, heap[root], heap[child]) <= 0) {
+            return;
+        }
+
+        swapOrder(heap, root, child);
+        root = child;
+    }
+}
+
+/**
+ * @brief Memory budget for sort keys in bytes
+ */
+static size_t getSortMemory () {
+    if (sort_memory_limit < 0) {
+        char *env = getenv("CSVDB_SORT_MEMORY");
+
+        if (env != NULL) {
+            sort_memory_limit = atol(env) * 1024 * 1024;
+        }
+
+        if (env == NULL || sort_memory_limit < 0) {
+            sort_memory_limit = SORT_MEMORY_LIMIT;
+        }
+    }
+
+    return sort_memory_limit;
+}
+
+/**
+ * @brief Evaluate a single sort node for one row
+ *
+ * @return int 1 if the key string points into buffer and needs its own copy
+ */
+static int evaluateKey (
+    struct Table *tables,
+    struct Node *node,
+    RowListIndex list_id,
+    int row_index,
+    struct SortKey *key,
+    char *buffer
+) {
+    const char *value;
+
+    int length = evaluateNodeView(
+        tables,
+        list_id,
+        row_index,
+        node,
+        &value,
+        buffer,
+        MAX_VALUE_LENGTH
+    );
+
+    if (length < 0) {
+        value = "";
+        length = 0;
+    }
+
+    key->is_number = is_numeric_n(value, length);
+
+    // Views are followed by a delimiter so atol() stops in time
+    key->number = key->is_number ? atol(value) : 0;
+
+    key->string = value;
+    key->length = length;
+
+    // Views point into table data which outlives the sort, but anything in
+    // buffer needs its own copy
+    return value == buffer;
+}
+
+/**
+ * @brief Keep the best `limit` rows in a bounded max-heap then sort just those.
+ *
+ * Slots 0..limit each hold one candidate's keys; one slot is always spare for
+ * the row being evaluated. Rows are visited in order so a candidate equal to
+ * the current worst has a later position and is rejected, keeping the result
+ * stable.
+ */
+static void sortTopN (
+    struct Table *tables,
+    struct Node *nodes,
+    RowListIndex list_id,
+    struct SortContext *context,
+    int limit
+) {
+    char buffer[MAX_VALUE_LENGTH];
+
+    int node_count = context->node_count;
+    int slot_count = limit + 1;
+    int row_count = getRowList(list_id)->row_count;
+
+    struct SortKey *keys = malloc(sizeof(*keys) * slot_count * node_count);
+    struct KeyStorage *storage = calloc(
+        (size_t)slot_count * node_count,
+        sizeof(*storage)
+    );
+    int *rows = malloc(sizeof(*rows) * slot_count);
+    int *heap = malloc(sizeof(*heap) * limit);
+
+    if (keys == NULL || storage == NULL || rows == NULL || heap == NULL) {
+        fprintf(stderr, "Unable to allocate sort keys for %d rows\n", limit);
+        exit(-1);
+    }
+
+    context->keys = keys;
+    context->rows = rows;
+
+    int heap_size = 0;
+    int spare = 0;
+
+    for (int i = 0; i < row_count; i++) {
+        rows[spare] = i;
+
+        for (int j = 0; j < node_count; j++) {
+            int index = spare * node_count + j;
+            struct SortKey *key = &keys[index];
+
+            if (evaluateKey(tables, &nodes[j], list_id, i, key, buffer)) {
+                struct KeyStorage *store = &storage[index];
+
+                if (store->capacity < key->length) {
+                    store->data = realloc(store->data, key->length);
+
+                    if (store->data == NULL) {
+                        fprintf(stderr, "Unable to allocate sort key storage\n");
+                        exit(-1);
+                    }
+
+                    store->capacity = key->length;
+                }
+
+                memcpy(store->data, key->string, key->length);
+                key->string = store->data;
+            }
+        }
+
+        if (heap_size < limit) {
+            heap[heap_size] = spare;
+            siftUp(context, heap, heap_size);
+            heap_size++;
 
-        do {
+            // Slots are handed out in order until the heap is full
+            spare = heap_size;
+        }
+        else if (compare(context, spare, heap[0]) < 0) {
+            int evicted = heap[0];
+            heap[0] = spare;
+            spare = evicted;
+            siftDown(context, heap, 0, limit);
+        }
+    }
+
+    heapSort(context, heap, limit);
+
+    for (int i = 0; i < limit; i++) {
+        heap[i] = rows[heap[i]];
+    }
+
+    // Might have moved if anything created a RowList while evaluating
+    permuteRowList(getRowList(list_id), heap, limit);
+
+    for (int i = 0; i < slot_count * node_count; i++) {
+        free(storage[i].data);
+    }
+
+    free(heap);
+    free(rows);
+    free(storage);
+    free(keys);
+}
+
+static const char *arenaCopy (
+    struct ArenaBlock **arena,
+    const char *string,
+    int length
+) {
+    struct ArenaBlock *block = *arena;
+
+    if (block == NULL || block->used + length > block->size) {
+        size_t size = SORT_ARENA_BLOCK_SIZE;
+
+        if ((size_t)length > size) {
+            size = length;
+        }
+
+        block = malloc(sizeof(*block) + size);
+
+        if (block == NULL) {
+            fprintf(stderr, "Unable to allocate sort key storage\n");
+            exit(-1);
+        }
+
+        block->next = *arena;
+        block->used = 0;
+        block->size = size;
+
+        *arena = block;
+    }
+
+    char *copy = block->data + block->used;
+
+    memcpy(copy, string, length);
+
+    block->used += length;
+
+    return copy;
+}
+
+static void freeArena (struct ArenaBlock *arena) {
+    while (arena != NULL) {
+        struct ArenaBlock *next = arena->next;
+        free(arena);
+        arena = next;
+    }
+}
+
+/**
+ * @brief Sort order[0..count) with an introsort
+ */
+static void sortRange (struct SortContext *context, int *order, int count) {
+    int depth = 0;
+    for (int n = count; n > 1; n >>= 1) {
+        depth += 2;
+    }
+
+    introSort(context, order, 0, count, depth);
+}
+
+/**
+ * @brief Quicksort which switches to heapsort when recursion gets too deep
+ * and to insertion sort for small ranges.
+ *
+ * @param hi exclusive
+ */
+static void introSort (
+    struct SortContext *context,
+    int *order,
+    int lo,
+    int hi,
+    int depth
+) {
+    while (hi - lo > SORT_INSERTION_THRESHOLD) {
+        if (depth == 0) {
+            heapSort(context, order + lo, hi - lo);
+            return;
+        }
+
+        depth--;
+
+        int pivot = partition(context, order, lo, hi);
+
+        // Recurse into the smaller side to bound stack depth
+        if (pivot - lo < hi - pivot) {
+            introSort(context, order, lo, pivot, depth);
+            lo = pivot + 1;
+        }
+        else {
+            introSort(context, order, pivot + 1, hi, depth);
+            hi = pivot;
+        }
+    }
+
+    insertionSort(context, order, lo, hi);
+}
+
+static void swapOrder (int *order, int a, int b) {
+    int tmp = order[a];
+    order[a] = order[b];
+    order[b] = tmp;
+}
+
+/**
+ * @brief Median-of-three partition. Keys are unique (ties are broken by
+ * position) so a simple Lomuto scheme is fine.
+ *
+ * @return int final index of pivot
+ */
+static int partition (struct SortContext *context, int *order, int lo, int hi) {
+    int mid = lo + (hi - lo) / 2;
+    int last = hi - 1;
+
+    if (compare(context, order[mid], order[lo]) < 0) {
+        swapOrder(order, mid, lo);
+    }
+
+    if (compare(context, order[last], order[lo]) < 0) {
+        swapOrder(order, last, lo);
+    }
+
+    if (compare(context, order[last], order[mid]) < 0) {
+        swapOrder(order, last, mid);
+    }
+
+    // Median is now at mid; move it out of the way
+    swapOrder(order, mid, last);
+
+    int pivot = order[last];
+    int store = lo;
+
+    for (int i = lo; i < last; i++) {
+        if (compare(context, order[i], pivot) < 0) {
+            swapOrder(order, i, store++);
+        }
+    }
+
+    swapOrder(order, store, last);
+
+    return store;
+}
+
+static void insertionSort (
+    struct SortContext *context,
+    int *order,
+    int lo,
+    int hi
+) {
+    for (int i = lo + 1; i < hi; i++) {
+        int value = order[i];
+        int j = i - 1;
+
+        while (j >= lo && compare(context, order[j], value) > 0) {
+            order[j + 1] = order[j];
             j--;
-        } while (compare(context, j, pivot) > 0);
+        }
 
-        if (i >= j) {
-            return j;
+        order[j + 1] = value;
+    }
+}
+
+static void heapSort (struct SortContext *context, int *order, int count) {
+    for (int i = count / 2 - 1; i >= 0; i--) {
+        siftDown(context, order, i, count);
+    }
+
+    for (int end = count - 1; end > 0; end--) {
+        swapOrder(order, 0, end);
+        siftDown(context, order, 0, end);
+    }
+}
+
+static void siftUp (struct SortContext *context, int *order, int index) {
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+
+        if (compare(context, order[parent], order[index]) >= 0) {
+            return;
         }
 
-        swap(context, i, j);
+        swapOrder(order, parent, index);
+        index = parent;
     }
 }
 
-static void swap (struct SortContext *context, int index_a, int index_b) {
-    swapRows(getRowList(context->list_id), index_a, index_b);
+static void siftDown (
+    struct SortContext *context,
+    int *order,
+    int root,
+    int count
+) {
+    while (1) {
+        int child = root * 2 + 1;
+
+        if (child >= count) {
+            return;
+        }
+
+        if (
+            child + 1 < count
+            && compare(context, order[child], order[child + 1]) < 0
+        ) {
+            child++;
+        }
+
+        if (compare(context, order[root], order[child]) >= 0) {
+            return;
+        }
+
+        swapOrder(order, root, child);
+        root = child;
+    }
 }
 
-static int compare (struct SortContext *context, int index_a, int index_b) {
-    char value_a[MAX_VALUE_LENGTH];
-    char value_b[MAX_VALUE_LENGTH];
-    int result;
+/**
+ * @brief Compare two precomputed key sets, falling back to original position
+ */
+static int compare (struct SortContext *context, int a, int b) {
+    struct SortKey *keys_a = &context->keys[a * context->node_count];
+    struct SortKey *keys_b = &context->keys[b * context->node_count];
 
     for (int i = 0; i < context->node_count; i++) {
-        evaluateNode(
-            context->tables,
-            context->list_id,
-            index_a,
-            &context->nodes[i],
-            value_a,
-            MAX_VALUE_LENGTH
-        );
-        evaluateNode(
-            context->tables,
-            context->list_id,
-            index_b,
-            &context->nodes[i],
-            value_b,
-            MAX_VALUE_LENGTH
-        );
+        struct SortKey *a = &keys_a[i];
+        struct SortKey *b = &keys_b[i];
+        int result;
 
-        if (is_numeric(value_a) && is_numeric(value_b)) {
-            result = atol(value_a) - atol(value_b);
+        if (a->is_number && b->is_number) {
+            result = (a->number > b->number) - (a->number < b->number);
         }
         else {
-            result = strcmp(value_a, value_b);
-        }
+            int min_length = a->length < b->length ? a->length : b->length;
 
-        if (result != 0) {
-            if (context->nodes[i].alias[0] == ORDER_DESC) {
-                result *= -1;
+            result = memcmp(a->string, b->string, min_length);
+
+            if (result == 0) {
+                result = (a->length > b->length) - (a->length < b->length);
             }
+        }
 
-            return result;
+        if (result != 0) {
+            return result * context->directions[i];
         }
     }
 
-    return 0;
-}
\ No newline at end of file
+    int row_a = context->rows == NULL ? a : context->rows[a];
+    int row_b = context->rows == NULL ? b : context->rows[b];
+
+    return (row_a > row_b) - (row_a < row_b);
+}
+
+/**
+ * @brief Rearrange rows so that row i becomes old row order[i], keeping only
+ * the first count rows
+ */
+static void permuteRowList (struct RowList *row_list, int *order, int count) {
+    int width = row_list->join_count;
+
+    size_t size = sizeof(*row_list->row_ids) * width * count;
+
+    int *sorted = malloc(size);
+
+    if (sorted == NULL) {
+        fprintf(stderr, "Unable to allocate %zu bytes to sort rows\n", size);
+        exit(-1);
+    }
+
+    for (int i = 0; i < count; i++) {
+        memcpy(
+            sorted + i * width,
+            row_list->row_ids + order[i] * width,
+            sizeof(*sorted) * width
+        );
+    }
+
+    memcpy(row_list->row_ids, sorted, size);
+
+    row_list->row_count = count;
+
+    free(sorted);
+}
@@ -4,5 +4,16 @@ void sortQuick (
     struct Table *tables,
     struct Node *nodes,
     int node_count,
-    RowListIndex list_id
+    RowListIndex list_id,
+    int limit
 );
+
+struct KeySorter;
+
+struct KeySorter *keySorter_open (int field_count, int row_count);
+
+void keySorter_add (struct KeySorter *sorter, const char **values, int row);
+
+int keySorter_next (struct KeySorter *sorter, const char **values, int *row);
+
+void keySorter_close (struct KeySorter *sorter);
@@ -30,6 +30,9 @@ enum VFSType {
     VFS_SAMPLE      = 11,
     VFS_DIR         = 12,
     VFS_TSV         = 13,
+    VFS_CSV_STREAM  = 14,
+    VFS_CSV_CACHE   = 15,
+    VFS_BINARY_INDEX = 16,
 
     VFS_COUNT
 };
@@ -42,6 +45,21 @@ struct DB {
     long *line_indices;
     char * data;
     int _record_count;
+    /* While rows are being appended (see csv.c), the number of records
+     * line_indices still describes; -1 otherwise */
+    int appended_from;
+    /* Persistent line offsets sidecar (see offsets.c); NULL if not in use */
+    struct OffsetsFile *offsets;
+    /* Lazily built field start offsets (see field-cache.c); may be NULL */
+    struct FieldCache *field_cache;
+    /* Incremental reader state for VFS_CSV_STREAM (see csv-stream.c) */
+    struct CsvStream *stream;
+    /* Whole file mapping for VFS_CSV_MMAP (data points into it) and
+     * VFS_CSV_CACHE */
+    void *map;
+    size_t map_size;
+    /* Decoding state for VFS_BINARY_INDEX (see binary-index.c) */
+    struct BinaryIndex *binary_index;
 };
 
 enum Order {
@@ -220,6 +238,27 @@ enum TableType
     TABLE_NONE = -1,
 };
 
+enum ValueType {
+    /* Only used as a type hint: nothing is known about the value */
+    VALUE_UNKNOWN,
+    VALUE_NULL,
+    VALUE_STRING,
+    VALUE_INTEGER,
+    VALUE_DATE,
+    VALUE_DATETIME,
+};
+
+struct Value {
+    enum ValueType type;
+    const char *text;
+    /* VALUE_INTEGER */
+    long integer;
+    /* VALUE_DATE and VALUE_DATETIME (date part only) */
+    int julian;
+    /* VALUE_DATETIME */
+    long unix_time;
+};
+
 struct Field {
     char text[MAX_FIELD_LENGTH];
     enum TableType table_id;
@@ -242,6 +281,14 @@ struct Node {
     struct Node *children;
     /* To filter aggregate functions */
     struct Node *filter;
+    /* Expected type of this node's values, set by bindPredicateTypes() */
+    enum ValueType type_hint;
+    /**
+     * @brief FIELD_CONSTANT nodes parsed once by bindPredicateTypes(). type is
+     * VALUE_UNKNOWN until then. text isn't kept up to date when the node is
+     * copied so always use field.text.
+     */
+    struct Value constant;
 };
 
 enum AliasSearchMode {
@@ -268,6 +315,11 @@ enum IndexSearchType {
     INDEX_PRIMARY =     3,
 };
 
+enum AccessPattern {
+    ACCESS_SEQUENTIAL,
+    ACCESS_RANDOM,
+};
+
 enum IndexScanMode {
     MODE_UNIQUE =        0,
     MODE_LOWER_BOUND =   1,
@@ -298,6 +350,7 @@ enum PlanStepType {
     PLAN_LOOP_JOIN =            0x23,
     PLAN_UNIQUE_JOIN =          0x24,
     PLAN_INDEX_JOIN =           0x25,
+    PLAN_HASH_JOIN =            0x26,
 
     // POP = 1, PUSH = 1
     PLAN_SORT =                 0x30,
@@ -400,6 +453,13 @@ struct Query {
     int limit_value;
 };
 
+/**
+ * @brief Evaluated value tagged with its type. `text` always points at the
+ * original textual form so no copies are made.
+ *
+ * Only comparisons use typed values. Functions still take and return text
+ * (see evaluateFunction()) and output prints that text.
+ */
 typedef int RowListIndex;
 
 #define ROWLIST_ROWID -1
@@ -439,6 +499,7 @@ struct VFS {
     int (* getFieldIndex)(struct DB *db, const char *field);
     char *(* getFieldName)(struct DB *db, int field_index);
     int (* getRecordCount)(struct DB *db);
+    int (* getRecordCountUpTo)(struct DB *db, int max_count);
     int (* getRecordValue)(
         struct DB *db,
         int record_index,
@@ -446,6 +507,20 @@ struct VFS {
         char *value,
         size_t value_max_length
     );
+    int (* getRecordView)(
+        struct DB *db,
+        int record_index,
+        int field_index,
+        const char **value
+    );
+    int (* getRecordTyped)(
+        struct DB *db,
+        int record_index,
+        int field_index,
+        struct Value *value,
+        char *buffer,
+        size_t buffer_length
+    );
     enum IndexSearchType (* findIndex)(
         struct DB *db,
         const char *table_name,
@@ -460,6 +535,8 @@ struct VFS {
         int node_count,
         int limit_value
     );
+    void (* releaseRecords)(struct DB *db, int rowid);
+    void (* adviseAccess)(struct DB *db, enum AccessPattern pattern);
     int (* fullTableScan)(
         struct DB *db,
         int row_list,
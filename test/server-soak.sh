@@ -0,0 +1,93 @@
+#!/usr/bin/env bash
+
+# Sends a mix of queries to a single csvdb-server worker and fails if the
+# worker's resident memory grows by more than an allowance once it has warmed
+# up. Worker restarts are turned off so the same process is measured
+# throughout.
+#
+# Usage: server-soak.sh [<requests>]
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+SCRIPT_DIR=$( cd -- "$( dirname -- "${BASH_SOURCE[0]}" )" &> /dev/null && pwd )
+SERVER="$SCRIPT_DIR/../release/csvdb-server"
+SOCKET=/tmp/csvdb-soak.$$.sock
+
+REQUESTS=${1:-5000}
+WARMUP=500
+# Allowed growth over the whole run
+MAX_GROWTH_KB=512
+
+QUERIES=(
+    "FROM suits"
+    "SELECT 9 * 5"
+    "FROM ranks WHERE value BETWEEN 3 AND 7 ORDER BY name"
+    "FROM suits WHERE name IN ('spades')"
+    "FROM suits WHERE name IN ('spades','hearts')"
+    "FROM suits, ranks ON LENGTH(ranks.name) = LENGTH(suits.name) WHERE value > 10"
+    "FROM ranks GROUP BY LENGTH(name) SELECT LENGTH(name) AS l, COUNT(*) ORDER BY l"
+    "FROM ranks SELECT LEFT(*, 2) AS left_"
+    "FROM SEQUENCE WHERE value < 20 SELECT value, value % 3 AS m ORDER BY m, value DESC"
+    "FROM (VALUES ('a',1),('b',2)) AS v (n, c) WHERE c > 1"
+    "FROM missing_table"
+)
+
+if [ ! -x "$SERVER" ]; then
+    echo "Build the server first (make server)"
+    exit 1
+fi
+
+cd $SCRIPT_DIR
+
+$SERVER -s $SOCKET -w 1 -r 0 2> /dev/null &
+server_pid=$!
+
+trap 'kill $server_pid 2> /dev/null; wait $server_pid 2> /dev/null' EXIT
+
+for i in $(seq 50); do
+    [ -S $SOCKET ] && break
+    sleep 0.1
+done
+
+worker_pid=$(pgrep -P $server_pid | head -n 1)
+
+if [ -z "$worker_pid" ]; then
+    echo "Server did not start"
+    exit 1
+fi
+
+send () {
+    local count=$1
+    for ((i = 0; i < count; i++)); do
+        local sql="${QUERIES[$((i % ${#QUERIES[@]}))]}"
+        curl -s --unix-socket $SOCKET --data-binary "$sql" "http://localhost/?format=csv" > /dev/null
+    done
+}
+
+rss () {
+    awk '/^VmRSS/ { print $2 }' /proc/$worker_pid/status
+}
+
+send $WARMUP
+start_rss=$(rss)
+
+send $REQUESTS
+end_rss=$(rss)
+
+if [ "$(pgrep -P $server_pid | head -n 1)" != "$worker_pid" ]; then
+    printf "${RED}Worker was replaced during the run${NC}\n"
+    exit 1
+fi
+
+growth=$((end_rss - start_rss))
+
+echo "Worker RSS after $WARMUP requests: $start_rss kB; after $((WARMUP + REQUESTS)): $end_rss kB"
+
+if [ $growth -gt $MAX_GROWTH_KB ]; then
+    printf "${RED}Worker grew by $growth kB (allowed $MAX_GROWTH_KB kB)${NC}\n"
+    exit 1
+fi
+
+printf "${GREEN}OK${NC} (grew by $growth kB)\n"
@@ -155,4 +155,65 @@ FROM test ORDER BY birth_date DESC LIMIT 5;
 -- Constants
 SELECT 'CAT', 10, 'CURRENT_DATE', CURRENT_DATE = TODAY(), NULL;
 -- Universal column aliasing
-FROM SEQUENCE AS t(i), SEQUENCE AS s(j)  WHERE t.i < 5 AND s.j < 2;
\ No newline at end of file
+FROM SEQUENCE AS t(i), SEQUENCE AS s(j)  WHERE t.i < 5 AND s.j < 2;
+-- Hash join
+FROM suits LEFT JOIN ranks ON ranks.value = LENGTH(suits.name) * 2;
+-- Typed comparisons
+SELECT '2020-01-01T10:00:00' = '2020-01-01' AS a, '2020-01-02' > '2020-01-01T23:00:00' AS b, 10 > 9 AS c, 'b' > 'a' AS d, NULL = NULL AS e;
+-- Top-N sort with offset
+FROM ranks ORDER BY value DESC OFFSET 2 ROWS FETCH FIRST 3 ROWS ONLY;
+-- Predicates on typed columns
+FROM ranks WHERE name > 'Q' AND value < 13 AND symbol > '5' SELECT name, value, symbol;
+-- Repeated and self-joined tables share one load
+FROM ranks AS r1, ranks AS r2 ON r1.value = r2.value + 12 SELECT r1.name, r2.name; FROM ranks WHERE value > 12 SELECT name;
+-- Streamed table scan with offset and row numbers
+FROM ranks OFFSET 3 ROWS FETCH FIRST 4 ROWS ONLY SELECT ROW_NUMBER(), name, rowid;
+-- Columnar cache
+CREATE CACHE ON ranks; FROM ranks WHERE value > 9 AND name > 'K' SELECT name, value, symbol;
+-- Zone maps on a large table
+FROM test WHERE birth_date < '0010-01-01' AND score >= 90 SELECT COUNT(*), MIN(birth_date), MAX(score);
+-- Binary index
+CREATE INDEX ranks_value ON ranks (value) USING BINARY; FROM ranks WHERE INDEX('ranks_value.index') > 9 SELECT name, value;
+-- Index join with duplicate keys
+FROM test JOIN test AS t2 ON t2.name = test.name WHERE test.name < 'Aaron B' GROUP BY test.name SELECT test.name, COUNT(*) ORDER BY test.name;
+-- INSERT keeps indexes up to date
+CREATE TABLE inserts AS FROM ranks WHERE value < 4; CREATE UNIQUE INDEX ON inserts (value); INSERT INTO inserts VALUES (20,'Twenty','T'),(0,'Zero','Z'); FROM inserts WHERE value < 3 SELECT value, name;
+-- Several TEMP tables and INSERTs in one session
+CREATE TEMP TABLE ta1 AS FROM SEQUENCE LIMIT 3; CREATE TEMP TABLE ta2 AS FROM SEQUENCE LIMIT 2; INSERT INTO ta2 VALUES (7); CREATE TEMP TABLE ta3 AS FROM ta2; INSERT INTO ta3 VALUES (8),(9); FROM ta1, ta3 WHERE ta1.value = 1 SELECT ta3.value;
+-- COPY appends rows and keeps indexes up to date
+CREATE TABLE copies AS FROM ranks WHERE value < 3; CREATE INDEX ON copies (name); COPY copies FROM ranks; FROM copies WHERE name = 'Two' SELECT rowid, value, name;
+-- ORDER BY computed keys keeps ties in table order
+FROM SEQUENCE WHERE value < 12 SELECT value, value % 3 AS m ORDER BY value % 3 DESC, value / 4;
+-- CALENDAR fields across a year and ISO week boundary
+FROM CALENDAR WHERE date BETWEEN '2020-12-26' AND '2021-01-05' AND isWeekend = 0 SELECT date, weekday, week, weekyear, yearday, weekDate, firstOfWeek, lastOfQuarter;
+-- Test hash join matches datetimes against dates on the same day
+FROM (VALUES ('2024-01-01T10:00:00'),('2024-01-01T12:00:00'),('2024-01-02T10:00:00')) AS a (ts) JOIN (VALUES ('2024-01-01'),('2024-01-01T12:00:00')) AS b (d) ON b.d = a.ts;
+-- Test IN with a single value is a plain comparison
+FROM ranks WHERE name IN ('Three') AND value IN (3) SELECT name, value;
+-- Test a WHERE comparing two tables' fields waits for the join
+FROM ranks AS a, ranks AS b WHERE a.value = b.value AND a.value > 10 SELECT COUNT(*);
+-- Cached strings which need quoting are escaped when written back to CSV
+CREATE CACHE ON nl_test; CREATE TABLE nl_copy AS FROM nl_test; FROM nl_copy SELECT id, name, greet;
+-- Join keys of different types compare like the loop join ('3rd' = 3)
+FROM mixed AS m JOIN ranks ON ranks.value = m.key SELECT m.key, ranks.name;
+-- GROUP BY with tens of thousands of distinct keys
+FROM (FROM test GROUP BY name SELECT name, COUNT(*) AS n) SELECT COUNT(*) AS names, SUM(n) AS total, MIN(n), MAX(n);
+-- Line offsets sidecar is written for a large table...
+COPY big FROM test; FROM big SELECT COUNT(*);
+-- ...read back by the next query...
+FROM big WHERE id > 5499150 SELECT id, name;
+-- ...and ignored once the table has changed
+INSERT INTO big VALUES (5499158,'New ROW','2024-01-01',50);
+FROM big WHERE id > 5499150 SELECT id, name;
+-- Quoted newline crossing a 32 byte block, and no newline at the end of the file
+FROM quoted SELECT id, note;
+-- Fields read out of order from rows with a quoted field on a later column
+FROM quoted WHERE name = 'third' SELECT note, name, id;
+-- Sorting on a quoted later column can't use views of the raw field
+FROM quoted ORDER BY note DESC SELECT id, name;
+-- Parallel scan with a LIMIT keeps the first matches in table order
+FROM test WHERE score = 99 AND id % 500 = 7 SELECT id, name FETCH FIRST 10 ROWS ONLY;
+-- Piped stdin with CRLF line endings and a quoted newline
+FROM stdin WHERE id > 1 SELECT name, note, id;
+-- Mapped file of exactly one page with no newline at the end
+FROM page WHERE id > 354 SELECT id, value;
\ No newline at end of file
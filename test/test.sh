@@ -14,6 +14,9 @@ STATFILE="$SCRIPT_DIR/test-cases-stats.csv"
 SNAPSHOT_DIR="$SCRIPT_DIR/__snapshots__"
 ENABLE_SNAPSHOT="1"
 
+# Scan large tables on several threads even on machines with a single CPU
+export CSVDB_THREADS=4
+
 mkdir -p "$SNAPSHOT_DIR"
 
 # Get array of test cases
@@ -22,6 +25,15 @@ readarray -t lines < $TEST_FILE
 # cd so that csvdb is working in the correct dir to find csv files
 cd $SCRIPT_DIR
 
+# Tables, indexes and sidecars written by the test cases. Removed before and
+# after the run so that every run starts from the plain CSV files.
+ARTIFACTS="ranks.csv.cache ranks_value.index.idx inserts.csv
+    inserts__value.unique.csv copies.csv copies__name.index.csv nl_copy.csv
+    nl_test.csv.cache test.csv.offsets test.csv.zones big.csv big.csv.offsets
+    big.csv.zones"
+
+rm -f $ARTIFACTS
+
 stats=""
 if [[ $* == "--stats" ]]; then
     stats="--stats"
@@ -53,6 +65,15 @@ else
     D="date +%s%N"
 fi
 
+# Test cases reading FROM stdin are given stdin.csv as piped input
+runCSVDB () {
+    if [[ "$sql" == *"FROM stdin"* ]]; then
+        cat stdin.csv | $CSVDB "$@"
+    else
+        $CSVDB "$@"
+    fi
+}
+
 for sql in "${lines[@]}"; do
     if [[ "$sql" == --* ]]; then
         continue
@@ -62,12 +83,12 @@ for sql in "${lines[@]}"; do
 
     printf "\n$GREY -- Plan: --\n"
 
-    $CSVDB -E -F table "$sql"
+    runCSVDB -E -F table "$sql"
 
     printf "$NC"
 
     start=`$D`
-    $CSVDB -o $OUTFILE $stats -F table "$sql"
+    runCSVDB -o $OUTFILE $stats -F table "$sql"
     result=$?
     end=`$D`
 
@@ -127,7 +148,7 @@ for sql in "${lines[@]}"; do
 
 done
 
-rm -f $OUTFILE
+rm -f $OUTFILE $ARTIFACTS
 
 printf " All tests ($tests) complete: "
 